@@ -20,7 +20,7 @@
 
 EthernetMIDIConnection ethMIDI;
 
-static int lastEventIndex = -1;
+static MIDIEventCursor midiCursor;
 static unsigned long lastStatusPrint = 0;
 
 // -----------------------------------------------------------------------
@@ -74,11 +74,14 @@ void loop() {
     }
 
     // Print all new MIDI events.
-    const auto& queue = midiHandler.getQueue();
-    for (const auto& ev : queue) {
-        if (ev.index <= lastEventIndex) continue;
-        lastEventIndex = ev.index;
-
+    MIDIEventRecord events[20];
+    uint32_t lost = 0;
+    size_t count = midiHandler.read(midiCursor, events, 20, &lost);
+    if (lost > 0) {
+        Serial.println("[MIDI] queue overrun, lost " + String(lost));
+    }
+    for (size_t i = 0; i < count; i++) {
+        const MIDIEventRecord& ev = events[i];
         char noteBuf[8];
 
         if (ev.statusCode == MIDI_NOTE_ON || ev.statusCode == MIDI_NOTE_OFF) {
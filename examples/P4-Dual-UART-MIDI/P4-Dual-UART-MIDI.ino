@@ -29,10 +29,10 @@
 UARTConnection midiPort1;
 UARTConnection midiPort2;
 
-static int lastEventIndex = -1;
+static MIDIEventCursor midiCursor;
 
 // Prints one MIDI event to the debug serial.
-static void printEvent(const MIDIEventData& ev) {
+static void printEvent(const MIDIEventRecord& ev) {
     char noteBuf[8];
 
     if (ev.statusCode == MIDI_NOTE_ON || ev.statusCode == MIDI_NOTE_OFF) {
@@ -98,11 +98,14 @@ void loop() {
     midiHandler.task();
 
     // Process all new events from both ports.
-    const auto& queue = midiHandler.getQueue();
-    for (const auto& ev : queue) {
-        if (ev.index <= lastEventIndex) continue;
-        lastEventIndex = ev.index;
-        printEvent(ev);
+    MIDIEventRecord events[40];
+    uint32_t lost = 0;
+    size_t count = midiHandler.read(midiCursor, events, 40, &lost);
+    if (lost > 0) {
+        Serial.print("[MIDI] queue overrun, lost "); Serial.println(lost);
+    }
+    for (size_t i = 0; i < count; i++) {
+        printEvent(events[i]);
     }
 
     // Demo: relay NoteOn events received on port 1 out through port 2.
@@ -69,7 +69,7 @@ static bool activeNotes[128] = {};
 static uint8_t lastStatus   = 0;
 static uint8_t lastNote     = 0;
 static uint8_t lastVelocity = 0;
-static int     lastEventIndex = -1;
+static MIDIEventCursor midiCursor;
 
 static void sendCurrentStepOn() {
     const NoteStep& step = ALL_SEQUENCES[currentSeq].steps[currentStep];
@@ -163,10 +163,10 @@ static void playerTick(unsigned long now) {
 // ── Process received notes (bidirectional: USB keyboard / DAW) ───────────────
 
 static void processReceivedNotes() {
-    const auto& queue = midiHandler.getQueue();
-    for (const auto& ev : queue) {
-        if (ev.index <= lastEventIndex) continue;
-        lastEventIndex = ev.index;
+    MIDIEventRecord events[20];
+    size_t count = midiHandler.read(midiCursor, events, 20);
+    for (size_t i = 0; i < count; i++) {
+        const MIDIEventRecord& ev = events[i];
 
         if (ev.noteNumber < 0 || ev.noteNumber > 127) continue;
 
@@ -45,6 +45,15 @@ static void analyzeNotes() {
     }
 }
 
+// ── Synth feed (push subscription) ───────────────────────────────────────────
+// Runs inside midiHandler.task(), in the same call stack as the BLE dispatch,
+// so notes reach the synth without waiting for the next display frame.
+static void onSynthNote(void* ctx, const MIDIEventRecord& ev) {
+    SynthEngine* s = static_cast<SynthEngine*>(ctx);
+    if (ev.statusCode == MIDI_NOTE_ON) s->noteOn(ev.noteNumber, ev.velocity7);
+    else                               s->noteOff(ev.noteNumber);
+}
+
 // ── Setup ─────────────────────────────────────────────────────────────────────
 void setup() {
     Serial.begin(115200);
@@ -64,6 +73,8 @@ void setup() {
     midiHandler.begin(cfg);
 
     synth.begin();
+    midiHandler.subscribe(MIDI_NOTE_ON,  onSynthNote, &synth);
+    midiHandler.subscribe(MIDI_NOTE_OFF, onSynthNote, &synth);
 
     Serial.println("=== BLE MIDI Receiver ===");
     Serial.println("Advertising as 'ESP32 BLE Piano'");
@@ -80,11 +91,6 @@ void loop() {
     midiHandler.fillActiveNotes(activeNotes);
 
     if (memcmp(activeNotes, prevActiveNotes, sizeof(activeNotes)) != 0) {
-        // Feed synth from state diff
-        for (int n = 0; n < 128; n++) {
-            if (activeNotes[n] && !prevActiveNotes[n]) synth.noteOn(n, 100);
-            if (!activeNotes[n] && prevActiveNotes[n]) synth.noteOff(n);
-        }
         memcpy(prevActiveNotes, activeNotes, sizeof(activeNotes));
         analyzeNotes();
 
@@ -13,7 +13,7 @@
 
 OSCConnection oscMIDI;
 
-static int    lastEventIndex = -1;
+static MIDIEventCursor midiCursor;
 static int    inCount        = 0;   // events received from OSC or USB
 static int    outCount       = 0;   // events sent as OSC
 static bool   wifiReady      = false;
@@ -31,8 +31,8 @@ static uint32_t eventColor(uint8_t statusCode) {
     return OSC_COL_WHITE;
 }
 
-// Formats a MIDIEventData into a compact one-line string (max ~27 chars).
-static void formatEvent(const MIDIEventData& ev, char* buf, int bufLen) {
+// Formats a MIDIEventRecord into a compact one-line string (max ~27 chars).
+static void formatEvent(const MIDIEventRecord& ev, char* buf, int bufLen) {
     char noteBuf[8];
     if (ev.statusCode == MIDI_NOTE_ON) {
         MIDIHandler::noteWithOctave(ev.noteNumber, noteBuf, sizeof(noteBuf));
@@ -60,8 +60,8 @@ static void formatEvent(const MIDIEventData& ev, char* buf, int bufLen) {
     }
 }
 
-// Reconstructs raw MIDI bytes from a MIDIEventData and sends them as OSC.
-static bool forwardToOSC(const MIDIEventData& ev) {
+// Reconstructs raw MIDI bytes from a MIDIEventRecord and sends them as OSC.
+static bool forwardToOSC(const MIDIEventRecord& ev) {
     uint8_t data[3];
     int     len = 0;
 
@@ -155,12 +155,12 @@ void loop() {
     }
 
     // Process new MIDI events
-    const auto& queue = midiHandler.getQueue();
+    MIDIEventRecord events[40];
+    size_t count = midiHandler.read(midiCursor, events, 40);
     bool countersChanged = false;
 
-    for (const auto& ev : queue) {
-        if (ev.index <= lastEventIndex) continue;
-        lastEventIndex = ev.index;
+    for (size_t i = 0; i < count; i++) {
+        const MIDIEventRecord& ev = events[i];
         inCount++;
         countersChanged = true;
 
@@ -3,8 +3,9 @@
 
 // Display-facing state derived from midi2flow. Subscribes to the flow's logical
 // stream and maintains exactly what the piano display needs: which notes are
-// held (activeNotes), the current chord named with inversion (via
-// GingoChord::identifyFromMidi), and the last closed note's duration.
+// held (activeNotes), the current chord named with inversion (a lookup in
+// MIDIChordTable, falling back to GingoChord::identifyFromMidi for chords the
+// table does not name), and the last closed note's duration.
 // Source-agnostic: it only sees UMP that some adapter ingested.
 
 #include <cstdint>
@@ -12,6 +13,7 @@
 #include <Gingoduino.h>   // gingo::GingoFlow, gingo::GingoChord, gingo::GingoFlowEvent
                           // (Arduino: lib src/ is on the include path; host tests
                           //  add -I <gingoduino>/src so this also resolves)
+#include <MIDIChordTable.h>  // ESP32_Host_MIDI: constant-time chord lookup
 
 class FlowDisplayState {
 public:
@@ -67,6 +69,13 @@ private:
         for (uint16_t n = 0; n < 128 && c < 16; ++n) if (active_[n]) held[c++] = (uint8_t)n;
         if (c < 2) { chordText_[0] = '\0'; return; }
 
+        // Common chords: one table lookup on the pitch-class set.
+        MIDIChordInfo ci = MIDIChordTable::fromNotes(held, c);
+        if (ci.valid()) {
+            MIDIChordTable::format(ci, chordText_, sizeof chordText_);
+            return;
+        }
+
         static const char* NN[12] = {"C","C#","D","D#","E","F","F#","G","G#","A","A#","B"};
         char nm[24];
         uint8_t bass = 0, inv = 0;
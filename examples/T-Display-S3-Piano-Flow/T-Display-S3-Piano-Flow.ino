@@ -85,6 +85,8 @@ static View g_view = VIEW_PIANO;
 
 // ── UMP callback - MIDI 2.0 device (Alt 1) ────────────────────────────────────
 // One whole UMP packet per call, no CIN, no conversion. Straight into the flow.
+// This slot is the sketch's own: midiHandler.addTransport(&usb) would take the
+// timed UMP batch slot, not this one, so the flow would keep receiving.
 static void onUMP(void* /*ctx*/, const uint32_t* words, uint8_t count) {
     g_flow.ingest(words, count, millis());
 }
@@ -17,8 +17,8 @@
 
 UARTConnection uartMIDI;
 
-// Last processed event index, used to detect new events in the queue.
-static int lastEventIndex = -1;
+// Read position in the event queue; read() returns only events after it.
+static MIDIEventCursor midiCursor;
 
 void setup() {
     Serial.begin(115200);
@@ -40,11 +40,14 @@ void loop() {
     midiHandler.task();
 
     // Process all new events that arrived since last loop iteration.
-    const auto& queue = midiHandler.getQueue();
-    for (const auto& ev : queue) {
-        if (ev.index <= lastEventIndex) continue;
-        lastEventIndex = ev.index;
-
+    MIDIEventRecord events[20];
+    uint32_t lost = 0;
+    size_t count = midiHandler.read(midiCursor, events, 20, &lost);
+    if (lost > 0) {
+        Serial.print("[MIDI] queue overrun, lost "); Serial.println(lost);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const MIDIEventRecord& ev = events[i];
         char noteBuf[8];
 
         if (ev.statusCode == MIDI_NOTE_ON || ev.statusCode == MIDI_NOTE_OFF) {
@@ -83,7 +83,9 @@ static void print_ump(const uint32_t* words, uint8_t wc) {
 }
 
 // UMP callback: ESP32_Host_MIDI delivers one whole UMP packet per call, so
-// there is no need to walk a buffer with a per-message word count.
+// there is no need to walk a buffer with a per-message word count. It has a
+// slot of its own: adding usb to midiHandler (addTransport) later keeps it,
+// and both get every packet.
 static void onUMP(void* /*ctx*/, const uint32_t* words, uint8_t count) {
   print_ump(words, count);
 }
@@ -0,0 +1,190 @@
+// ESP32_Host_MIDI — event path benchmark (native)
+// Compares the v7.0 receive path (MIDIEventData with std::string fields,
+// copied into a std::deque and again into the history buffer) with the
+// current path (compact MIDIEventRecord end to end). Reports events/sec and
+// heap allocations per event.
+//
+// Also measures the chord lookup a chord-naming consumer (GingoAdapter) does
+// after every NoteOn: the string path (getChord(..., {"note"}) + atoi) against
+// the typed getChordNotes() accessor.
+//
+// Last, the worst single addEvent() while a growing history fills up: with
+// chunked storage it must not depend on how much history is already stored.
+//
+// Build:
+//   g++ -std=c++17 -O2 -Iextras/tests/stub -Isrc -Wall -Wextra -Wno-unused-parameter \
+//       -Wno-comment -DESP32_HOST_MIDI_NO_USB_HOST \
+//       -o extras/tests/bench_event_path extras/tests/bench_event_path.cpp src/MIDIHandler.cpp
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "stub/Arduino.h"
+
+unsigned long g_fakeMillis = 0;
+FakeSerial Serial;
+
+#include "../../src/MIDIHandler.h"
+
+// ---------------------------------------------------------------------------
+// Allocation counter
+// ---------------------------------------------------------------------------
+
+static unsigned long g_allocs = 0;
+
+void* operator new(size_t n) {
+    ++g_allocs;
+    void* p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// ---------------------------------------------------------------------------
+// v7.0 path, reproduced verbatim in shape: string-bearing event, deque queue
+// trimmed with pop_front, history ring copy-assigned element by element.
+// ---------------------------------------------------------------------------
+
+struct LegacyEventData {
+    int index; int msgIndex; unsigned long timestamp; unsigned long delay; int chordIndex;
+    MIDIStatus statusCode; uint8_t channel0; uint8_t noteNumber; uint16_t velocity16;
+    uint8_t velocity7; uint32_t pitchBend32; uint16_t pitchBend14;
+    int channel; std::string status; int note; std::string noteName;
+    std::string noteOctave; int velocity; int pitchBend;
+};
+
+struct LegacyPath {
+    std::deque<LegacyEventData> queue;
+    LegacyEventData history[256];
+    int historyHead = 0;
+    int globalIndex = 0;
+
+    static std::string noteName(int note) {
+        static const char* names[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        return names[note % 12];
+    }
+
+    void handle(const uint8_t* m) {
+        LegacyEventData ev;
+        ev.index = ++globalIndex;
+        ev.msgIndex = 0;
+        ev.timestamp = millis();
+        ev.delay = 0;
+        ev.chordIndex = 0;
+        ev.statusCode = (m[2] > 0) ? MIDI_NOTE_ON : MIDI_NOTE_OFF;
+        ev.channel0 = m[0] & 0x0F;
+        ev.noteNumber = m[1];
+        ev.velocity7 = m[2];
+        ev.velocity16 = MIDI2Scaler::scale7to16(m[2]);
+        ev.pitchBend14 = 0;
+        ev.pitchBend32 = 0x80000000;
+        ev.channel = ev.channel0 + 1;
+        ev.status = (m[2] > 0) ? "NoteOn" : "NoteOff";
+        ev.note = m[1];
+        ev.noteName = noteName(m[1]);
+        ev.noteOctave = noteName(m[1]) + std::to_string(m[1] / 12 - 1);
+        ev.velocity = m[2];
+        ev.pitchBend = 0;
+        queue.push_back(ev);
+        while (queue.size() > 20) queue.pop_front();
+        history[historyHead] = ev;
+        historyHead = (historyHead + 1) % 256;
+    }
+};
+
+// ---------------------------------------------------------------------------
+
+static const int N = 500000;
+
+// Single notes: NoteOn/NoteOff pairs walking up and down four octaves.
+static void singleNotes(int i, uint8_t msg[3]) {
+    msg[0] = 0x90;
+    msg[1] = 36 + (i >> 1) % 48;
+    msg[2] = (i & 1) ? 0 : 100;
+}
+
+// Four-note chords: four NoteOns (a seventh chord), then four NoteOffs.
+static void seventhChords(int i, uint8_t msg[3]) {
+    static const uint8_t shape[4] = { 0, 4, 7, 10 };
+    uint8_t root = 48 + (i >> 3) % 12;
+    msg[0] = 0x90;
+    msg[1] = root + shape[i & 3];
+    msg[2] = (i & 4) ? 0 : 100;
+}
+
+template <typename Fn>
+static void run(const char* name, void (*pattern)(int, uint8_t[3]), Fn fn) {
+    unsigned long allocs0 = g_allocs;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; i++) {
+        uint8_t msg[3];
+        pattern(i, msg);
+        g_fakeMillis = i;
+        fn(msg);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double sec = std::chrono::duration<double>(t1 - t0).count();
+    printf("  %-34s %12.0f events/s   %6.3f allocs/event\n",
+           name, N / sec, (double)(g_allocs - allocs0) / N);
+}
+
+int main() {
+    printf("ESP32_Host_MIDI — event path benchmark (%d events)\n", N);
+    printf("====================================================\n");
+
+    static LegacyPath legacy;
+    run("v7.0 path (strings + deque)", singleNotes, [&](const uint8_t* m) { legacy.handle(m); });
+
+    MIDIHandler h;
+    MIDIHandlerConfig cfg;
+    cfg.historyCapacity = 256;
+    h.begin(cfg);
+    run("MIDIEventRecord path", singleNotes, [&](const uint8_t* m) { h.handleMidiMessage(m, 3); });
+
+    printf("\nChord lookup per NoteOn (4-note chords, after the event is handled)\n");
+    MIDIHandler hc;
+    MIDIHandlerConfig ccfg;
+    ccfg.chordTimeWindow = 50;
+    hc.begin(ccfg);
+    unsigned long sink = 0;
+    run("getChord(\"note\") + atoi", seventhChords, [&](const uint8_t* m) {
+        hc.handleMidiMessage(m, 3);
+        if (m[2] == 0) return;
+        std::vector<std::string> strs = hc.getChord(hc.lastChord(hc.getQueue()), hc.getQueue(), {"note"});
+        for (const auto& s : strs) sink += (unsigned long)atoi(s.c_str());
+    });
+    run("getChordNotes()", seventhChords, [&](const uint8_t* m) {
+        hc.handleMidiMessage(m, 3);
+        if (m[2] == 0) return;
+        uint8_t notes[7];
+        uint8_t n = hc.getChordNotes(hc.lastChord(), notes, 7);
+        for (uint8_t i = 0; i < n; i++) sink += notes[i];
+    });
+    if (sink == 1) printf("\n");  // keep the lookups observable
+
+    printf("\nHistory growth (MIDI_HISTORY_GROW, 1024-event blocks)\n");
+    MIDIHandler hh;
+    MIDIHandlerConfig hcfg;
+    hcfg.historyCapacity = 1024;
+    hcfg.historyMode = MIDI_HISTORY_GROW;
+    hh.begin(hcfg);
+    MIDIEventRecord ev = MIDIEventRecord();
+    ev.statusCode = MIDI_CONTROL_CHANGE;
+    long long worstNs = 0;
+    for (int i = 0; i < N; i++) {
+        ev.index = i + 1;
+        auto t0 = std::chrono::steady_clock::now();
+        hh.addEvent(ev);
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        if (ns > worstNs) worstNs = ns;
+    }
+    printf("  %-34s %12lld us worst    %zu stored\n", "addEvent()", worstNs / 1000, (size_t)hh.getHistorySize());
+    return 0;
+}
@@ -0,0 +1,968 @@
+// test_ble_midi.cpp — BLE-MIDI packet decoding and encoding
+//
+// Tests the real decoder from BLEMIDITransportCore.h: message splitting,
+// running status, real-time interleaving, SysEx across packets, and the
+// reconstruction of 13-bit timestamps into local time. Then the encoder:
+// packing queued messages into MTU-sized packets with running-timestamp
+// compression, checked byte for byte and by decoding the result. Last, the
+// scan/connect/subscribe state machine behind BLEClientConnection.
+//
+// Build:
+//   g++ -std=c++11 -Iextras/tests/stub -Isrc -Wall -Wextra -Wno-unused-parameter
+//       -o extras/tests/test_ble_midi extras/tests/test_ble_midi.cpp
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "../../src/BLEMIDITransportCore.h"
+
+using namespace blemidi::core;
+
+// ---------------------------------------------------------------------------
+// Minimal test framework (same as test_native.cpp)
+// ---------------------------------------------------------------------------
+
+static int g_pass = 0, g_fail = 0;
+
+#define TEST(name) do { printf("  %-56s", name); } while(0)
+#define PASS()     do { printf("OK\n"); ++g_pass; } while(0)
+#define ASSERT(e)  do { if (!(e)) { printf("FAIL — " #e " (line %d)\n", __LINE__); ++g_fail; return; } } while(0)
+
+// ---------------------------------------------------------------------------
+// Capturing sink
+// ---------------------------------------------------------------------------
+
+struct Captured {
+    uint8_t  data[3];
+    uint8_t  length;
+    uint64_t t;
+};
+
+struct Capture {
+    Captured msgs[64];
+    int count = 0;
+    uint8_t sysex[8192];
+    size_t sysexLen = 0;
+    int sysexCount = 0;
+    uint64_t sysexT = 0;
+};
+
+static void onMidi(void* ctx, const uint8_t* data, uint8_t length, uint64_t t) {
+    Capture* c = static_cast<Capture*>(ctx);
+    if (c->count >= 64) return;
+    Captured& m = c->msgs[c->count++];
+    memset(m.data, 0, sizeof(m.data));
+    memcpy(m.data, data, length);
+    m.length = length;
+    m.t = t;
+}
+
+static void onSysEx(void* ctx, const uint8_t* data, size_t length, uint64_t t) {
+    Capture* c = static_cast<Capture*>(ctx);
+    memcpy(c->sysex, data, length);
+    c->sysexLen = length;
+    c->sysexCount++;
+    c->sysexT = t;
+}
+
+static Sink sinkFor(Capture& c) {
+    Sink s = { onMidi, onSysEx, &c };
+    return s;
+}
+
+static bool isMsg(const Captured& m, uint8_t a, uint8_t b, uint8_t c, uint8_t len) {
+    return m.length == len && m.data[0] == a && (len < 2 || m.data[1] == b) && (len < 3 || m.data[2] == c);
+}
+
+// Header/timestamp bytes for a 13-bit millisecond time.
+static uint8_t hdr(uint16_t ms) { return (uint8_t)(0x80 | ((ms >> 7) & 0x3F)); }
+static uint8_t ts(uint16_t ms)  { return (uint8_t)(0x80 | (ms & 0x7F)); }
+
+// ---------------------------------------------------------------------------
+// Message splitting
+// ---------------------------------------------------------------------------
+
+void test_single_message() {
+    TEST("single NoteOn");
+    Decoder d; Capture c;
+    const uint8_t p[] = { hdr(100), ts(100), 0x90, 60, 100 };
+    decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+    ASSERT(c.count == 1);
+    ASSERT(isMsg(c.msgs[0], 0x90, 60, 100, 3));
+    ASSERT(d.malformed == 0);
+    PASS();
+}
+
+void test_multiple_messages() {
+    TEST("several timestamped messages in one packet");
+    Decoder d; Capture c;
+    const uint8_t p[] = {
+        hdr(200), ts(200), 0x90, 60, 100,
+                  ts(201), 0xB0, 7, 90,
+                  ts(203), 0xC0, 5,
+                  ts(204), 0xE0, 0, 64,
+    };
+    decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+    ASSERT(c.count == 4);
+    ASSERT(isMsg(c.msgs[0], 0x90, 60, 100, 3));
+    ASSERT(isMsg(c.msgs[1], 0xB0, 7, 90, 3));
+    ASSERT(isMsg(c.msgs[2], 0xC0, 5, 0, 2));
+    ASSERT(isMsg(c.msgs[3], 0xE0, 0, 64, 3));
+    PASS();
+}
+
+void test_running_status() {
+    TEST("running status without timestamps");
+    {
+        Decoder d; Capture c;
+        const uint8_t p[] = { hdr(10), ts(10), 0x90, 60, 100, 64, 100, 67, 100 };
+        decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+        ASSERT(c.count == 3);
+        ASSERT(isMsg(c.msgs[1], 0x90, 64, 100, 3));
+        ASSERT(isMsg(c.msgs[2], 0x90, 67, 100, 3));
+    }
+    PASS();
+
+    TEST("running status with new timestamps");
+    {
+        Decoder d; Capture c;
+        const uint8_t p[] = { hdr(10), ts(10), 0xB0, 1, 10, ts(12), 1, 11, ts(14), 1, 12 };
+        decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+        ASSERT(c.count == 3);
+        ASSERT(isMsg(c.msgs[2], 0xB0, 1, 12, 3));
+        ASSERT(c.msgs[2].t - c.msgs[0].t == 4000);
+    }
+    PASS();
+
+    TEST("running status carries over to the next packet");
+    {
+        Decoder d; Capture c;
+        const uint8_t p1[] = { hdr(10), ts(10), 0xD0, 40 };
+        const uint8_t p2[] = { hdr(20), ts(20), 41 };
+        decodePacket(d, p1, sizeof(p1), 1000000, sinkFor(c));
+        decodePacket(d, p2, sizeof(p2), 1010000, sinkFor(c));
+        ASSERT(c.count == 2);
+        ASSERT(isMsg(c.msgs[1], 0xD0, 41, 0, 2));
+    }
+    PASS();
+
+    TEST("system common clears running status");
+    {
+        Decoder d; Capture c;
+        const uint8_t p[] = { hdr(10), ts(10), 0x90, 60, 100, ts(11), 0xF3, 2, 64, 100 };
+        decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+        ASSERT(c.count == 2);
+        ASSERT(isMsg(c.msgs[1], 0xF3, 2, 0, 2));
+        ASSERT(d.malformed == 2);   // two orphan data bytes
+    }
+    PASS();
+}
+
+void test_realtime() {
+    TEST("real-time message between running-status bytes");
+    Decoder d; Capture c;
+    const uint8_t p[] = { hdr(10), ts(10), 0x90, 60, ts(10), 0xF8, 100 };
+    decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+    ASSERT(c.count == 2);
+    ASSERT(isMsg(c.msgs[0], 0xF8, 0, 0, 1));
+    ASSERT(isMsg(c.msgs[1], 0x90, 60, 100, 3));
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// SysEx
+// ---------------------------------------------------------------------------
+
+void test_sysex() {
+    TEST("SysEx in one packet");
+    {
+        Decoder d; Capture c; uint8_t buf[64];
+        setSysExBuffer(d, buf, sizeof(buf));
+        const uint8_t p[] = { hdr(10), ts(10), 0xF0, 0x7E, 0x7F, 0x06, 0x01, ts(10), 0xF7 };
+        decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+        ASSERT(c.sysexCount == 1);
+        ASSERT(c.sysexLen == 6);
+        ASSERT(c.sysex[0] == 0xF0 && c.sysex[4] == 0x01 && c.sysex[5] == 0xF7);
+    }
+    PASS();
+
+    TEST("SysEx continued across three packets");
+    {
+        Decoder d; Capture c; uint8_t buf[64];
+        setSysExBuffer(d, buf, sizeof(buf));
+        const uint8_t p1[] = { hdr(10), ts(10), 0xF0, 0x43, 0x10 };
+        const uint8_t p2[] = { hdr(11), 0x4C, 0x00, 0x00 };
+        const uint8_t p3[] = { hdr(12), 0x7E, 0x00, ts(12), 0xF7 };
+        decodePacket(d, p1, sizeof(p1), 1000000, sinkFor(c));
+        decodePacket(d, p2, sizeof(p2), 1001000, sinkFor(c));
+        ASSERT(c.sysexCount == 0);
+        decodePacket(d, p3, sizeof(p3), 1002000, sinkFor(c));
+        ASSERT(c.sysexCount == 1);
+        ASSERT(c.sysexLen == 9);
+        const uint8_t expect[] = { 0xF0, 0x43, 0x10, 0x4C, 0x00, 0x00, 0x7E, 0x00, 0xF7 };
+        ASSERT(memcmp(c.sysex, expect, sizeof(expect)) == 0);
+        ASSERT(d.malformed == 0);
+    }
+    PASS();
+
+    TEST("real-time inside SysEx is delivered, SysEx intact");
+    {
+        Decoder d; Capture c; uint8_t buf[64];
+        setSysExBuffer(d, buf, sizeof(buf));
+        const uint8_t p[] = { hdr(10), ts(10), 0xF0, 0x01, ts(11), 0xF8, 0x02, ts(12), 0xF7 };
+        decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+        ASSERT(c.count == 1 && c.msgs[0].data[0] == 0xF8);
+        ASSERT(c.sysexCount == 1 && c.sysexLen == 4);
+        ASSERT(c.sysex[1] == 0x01 && c.sysex[2] == 0x02);
+    }
+    PASS();
+
+    TEST("SysEx larger than the buffer is dropped");
+    {
+        Decoder d; Capture c; uint8_t buf[4];
+        setSysExBuffer(d, buf, sizeof(buf));
+        const uint8_t p[] = { hdr(10), ts(10), 0xF0, 1, 2, 3, 4, 5, ts(10), 0xF7, ts(11), 0x90, 60, 1 };
+        decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+        ASSERT(c.sysexCount == 0);
+        ASSERT(d.sysexDropped == 1);
+        ASSERT(c.count == 1);   // decoding resumes after F7
+    }
+    PASS();
+
+    TEST("status byte inside SysEx aborts it");
+    {
+        Decoder d; Capture c; uint8_t buf[64];
+        setSysExBuffer(d, buf, sizeof(buf));
+        const uint8_t p[] = { hdr(10), ts(10), 0xF0, 1, 2, ts(10), 0x90, 60, 1 };
+        decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+        ASSERT(c.sysexCount == 0);
+        ASSERT(d.sysexDropped == 1);
+        ASSERT(c.count == 1 && isMsg(c.msgs[0], 0x90, 60, 1, 3));
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Malformed input
+// ---------------------------------------------------------------------------
+
+void test_malformed() {
+    TEST("bad header drops the packet");
+    {
+        Decoder d; Capture c;
+        const uint8_t p[] = { 0x40, ts(10), 0x90, 60, 100 };
+        decodePacket(d, p, sizeof(p), 1000000, sinkFor(c));
+        ASSERT(c.count == 0 && d.malformed == 1);
+    }
+    PASS();
+
+    TEST("message cut at the end of a packet is discarded");
+    {
+        Decoder d; Capture c;
+        const uint8_t p1[] = { hdr(10), ts(10), 0x90, 60 };
+        const uint8_t p2[] = { hdr(11), ts(11), 0x80, 60, 0 };
+        decodePacket(d, p1, sizeof(p1), 1000000, sinkFor(c));
+        decodePacket(d, p2, sizeof(p2), 1001000, sinkFor(c));
+        ASSERT(c.count == 1 && isMsg(c.msgs[0], 0x80, 60, 0, 3));
+        ASSERT(d.malformed == 1);
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Timestamp reconstruction
+// ---------------------------------------------------------------------------
+
+void test_timestamps() {
+    TEST("spacing inside a packet follows the sender clock");
+    {
+        Decoder d; Capture c;
+        const uint8_t p[] = { hdr(500), ts(500), 0x90, 60, 100, ts(503), 0x90, 64, 100, ts(507), 0x90, 67, 100 };
+        decodePacket(d, p, sizeof(p), 2000000, sinkFor(c));
+        ASSERT(c.count == 3);
+        ASSERT(c.msgs[2].t == 2000000);            // newest maps to arrival
+        ASSERT(c.msgs[1].t == 2000000 - 4000);
+        ASSERT(c.msgs[0].t == 2000000 - 7000);
+    }
+    PASS();
+
+    TEST("low-byte wrap inside a packet carries into high bits");
+    {
+        Decoder d; Capture c;
+        // 0x7E then 0x01: 126 ms -> 129 ms across a 128 ms boundary
+        const uint8_t p[] = { hdr(126), ts(126), 0xF8, ts(129), 0xF8 };
+        decodePacket(d, p, sizeof(p), 3000000, sinkFor(c));
+        ASSERT(c.count == 2);
+        ASSERT(c.msgs[1].t - c.msgs[0].t == 3000);
+    }
+    PASS();
+
+    TEST("connection-interval jitter is removed");
+    {
+        // Sender plays a note every 10 ms; packets arrive on a 15 ms grid,
+        // each after a different radio delay. Once the shortest delay has
+        // been seen the reconstructed spacing is 10 ms, give or take the
+        // drift allowance (200 ppm of 10 ms = 2 us).
+        Decoder d; Capture c;
+        const uint16_t send[] = { 1000, 1010, 1020, 1030, 1040, 1050 };
+        const uint64_t delayUs[] = { 2000, 9000, 2000, 14000, 5000, 11000 };
+        for (int i = 0; i < 6; i++) {
+            const uint8_t p[] = { hdr(send[i]), ts(send[i]), 0x90, (uint8_t)(60 + i), 100 };
+            decodePacket(d, p, sizeof(p), 5000000 + (uint64_t)(send[i] - 1000) * 1000 + delayUs[i], sinkFor(c));
+        }
+        ASSERT(c.count == 6);
+        for (int i = 2; i < 6; i++) {
+            uint64_t dt = c.msgs[i].t - c.msgs[i - 1].t;
+            ASSERT(dt >= 9998 && dt <= 10002);
+        }
+    }
+    PASS();
+
+    TEST("13-bit wrap across packets is unwrapped");
+    {
+        Decoder d; Capture c;
+        const uint8_t p1[] = { hdr(8190), ts(8190), 0xF8 };
+        const uint8_t p2[] = { hdr(4), ts(4), 0xF8 };       // 6 ms later, wrapped
+        decodePacket(d, p1, sizeof(p1), 7000000, sinkFor(c));
+        decodePacket(d, p2, sizeof(p2), 7006000, sinkFor(c));
+        ASSERT(c.count == 2);
+        ASSERT(c.msgs[1].t - c.msgs[0].t == 6000);
+    }
+    PASS();
+
+    TEST("times never exceed arrival and never go backwards");
+    {
+        Decoder d; Capture c;
+        const uint8_t p1[] = { hdr(100), ts(100), 0xF8 };
+        const uint8_t p2[] = { hdr(90), ts(90), 0xF8 };     // sender stepped back
+        const uint8_t p3[] = { hdr(300), ts(300), 0xF8 };   // arrives "too early"
+        decodePacket(d, p1, sizeof(p1), 8000000, sinkFor(c));
+        decodePacket(d, p2, sizeof(p2), 8001000, sinkFor(c));
+        decodePacket(d, p3, sizeof(p3), 8050000, sinkFor(c));
+        ASSERT(c.count == 3);
+        ASSERT(c.msgs[1].t >= c.msgs[0].t);
+        ASSERT(c.msgs[2].t <= 8050000);
+    }
+    PASS();
+
+    TEST("long silence resynchronises");
+    {
+        Decoder d; Capture c;
+        const uint8_t p1[] = { hdr(100), ts(100), 0xF8 };
+        const uint8_t p2[] = { hdr(50), ts(50), 0xF8 };
+        decodePacket(d, p1, sizeof(p1), 9000000, sinkFor(c));
+        decodePacket(d, p2, sizeof(p2), 19000000, sinkFor(c));   // 10 s later
+        ASSERT(c.count == 2);
+        ASSERT(c.msgs[1].t == 19000000);
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Encoding
+// ---------------------------------------------------------------------------
+
+struct Sent {
+    uint8_t data[64][MAX_PACKET];
+    size_t  len[64];
+    int     count = 0;
+};
+
+static TxQueue<2048> g_txq;
+static Packetizer g_pk;
+static Sent g_sent;
+
+static void resetTx() {
+    g_txq.clear();
+    g_txq.dropped = 0;
+    g_pk.entryLen = 0;
+    g_pk.inSysEx = false;
+    g_pk.packets = g_pk.messages = 0;
+    g_sent.count = 0;
+}
+
+static void queue(const uint8_t* data, size_t len, uint32_t ms) { g_txq.push(data, len, (uint64_t)ms * 1000); }
+
+static void flushTx(size_t maxPacket) {
+    flush(g_pk, maxPacket,
+        [](uint8_t* out, uint64_t& us) -> size_t { return g_txq.pop(out, us); },
+        [](const uint8_t* p, size_t len) {
+            if (g_sent.count >= 64) return;
+            memcpy(g_sent.data[g_sent.count], p, len);
+            g_sent.len[g_sent.count++] = len;
+        });
+}
+
+static bool sentIs(int i, const uint8_t* expect, size_t len) {
+    return g_sent.len[i] == len && memcmp(g_sent.data[i], expect, len) == 0;
+}
+
+// Decodes every sent packet, each arriving 5 ms after its header time.
+static void decodeSent(Decoder& d, Capture& c) {
+    for (int i = 0; i < g_sent.count; i++) {
+        decodePacket(d, g_sent.data[i], g_sent.len[i], 5000 + (uint64_t)i * 1000, sinkFor(c));
+    }
+}
+
+void test_encode_compression() {
+    const uint8_t n1[] = { 0x90, 0x3C, 0x64 };
+    const uint8_t n2[] = { 0x90, 0x40, 0x64 };
+    const uint8_t n3[] = { 0x90, 0x43, 0x64 };
+
+    TEST("chord at one time: one packet, one ts, one status");
+    {
+        resetTx();
+        queue(n1, 3, 10); queue(n2, 3, 10); queue(n3, 3, 10);
+        flushTx(20);
+        const uint8_t expect[] = { hdr(10), ts(10), 0x90, 0x3C, 0x64, 0x40, 0x64, 0x43, 0x64 };
+        ASSERT(g_sent.count == 1);
+        ASSERT(sentIs(0, expect, sizeof(expect)));
+        ASSERT(g_pk.messages == 3);
+    }
+    PASS();
+
+    TEST("new time, same status: timestamp without status");
+    {
+        resetTx();
+        queue(n1, 3, 10); queue(n2, 3, 12);
+        flushTx(20);
+        const uint8_t expect[] = { hdr(10), ts(10), 0x90, 0x3C, 0x64, ts(12), 0x40, 0x64 };
+        ASSERT(g_sent.count == 1);
+        ASSERT(sentIs(0, expect, sizeof(expect)));
+    }
+    PASS();
+
+    TEST("new status at the same time repeats the timestamp");
+    {
+        resetTx();
+        const uint8_t cc[] = { 0xB0, 0x07, 0x40 };
+        queue(n1, 3, 10); queue(cc, 3, 10);
+        flushTx(20);
+        const uint8_t expect[] = { hdr(10), ts(10), 0x90, 0x3C, 0x64, ts(10), 0xB0, 0x07, 0x40 };
+        ASSERT(sentIs(0, expect, sizeof(expect)));
+    }
+    PASS();
+
+    TEST("real-time does not break running status");
+    {
+        resetTx();
+        const uint8_t clk[] = { 0xF8 };
+        queue(n1, 3, 10); queue(clk, 1, 10); queue(n2, 3, 10);
+        flushTx(20);
+        const uint8_t expect[] = { hdr(10), ts(10), 0x90, 0x3C, 0x64, ts(10), 0xF8, 0x40, 0x64 };
+        ASSERT(sentIs(0, expect, sizeof(expect)));
+        Decoder d; Capture c;
+        decodeSent(d, c);
+        ASSERT(c.count == 3);
+        ASSERT(isMsg(c.msgs[2], 0x90, 0x40, 0x64, 3));
+    }
+    PASS();
+
+    TEST("system common clears running status");
+    {
+        resetTx();
+        const uint8_t spp[] = { 0xF2, 0x00, 0x10 };
+        queue(n1, 3, 10); queue(spp, 3, 10); queue(n2, 3, 10);
+        flushTx(20);
+        const uint8_t expect[] = { hdr(10), ts(10), 0x90, 0x3C, 0x64, ts(10), 0xF2, 0x00, 0x10,
+                                   ts(10), 0x90, 0x40, 0x64 };
+        ASSERT(sentIs(0, expect, sizeof(expect)));
+    }
+    PASS();
+}
+
+void test_encode_packets() {
+    TEST("32 notes at MTU 23 fill packets up to 20 bytes");
+    {
+        resetTx();
+        for (int i = 0; i < 32; i++) {
+            uint8_t m[] = { (uint8_t)(0x90 | (i & 1)), (uint8_t)(0x30 + i), 0x64 };
+            queue(m, 3, 10);
+        }
+        flushTx(20);
+        ASSERT(g_sent.count > 1 && g_sent.count < 32);
+        for (int i = 0; i < g_sent.count; i++) ASSERT(g_sent.len[i] <= 20);
+        Decoder d; Capture c;
+        decodeSent(d, c);
+        ASSERT(c.count == 32);
+        for (int i = 0; i < 32; i++) {
+            ASSERT(isMsg(c.msgs[i], (uint8_t)(0x90 | (i & 1)), (uint8_t)(0x30 + i), 0x64, 3));
+        }
+        ASSERT(d.malformed == 0);
+    }
+    PASS();
+
+    TEST("larger MTU needs fewer packets");
+    {
+        resetTx();
+        for (int i = 0; i < 32; i++) {
+            uint8_t m[] = { 0x90, (uint8_t)(0x30 + i), 0x64 };
+            queue(m, 3, 10);
+        }
+        flushTx(182);    // MTU 185
+        ASSERT(g_sent.count == 1);
+        ASSERT(g_sent.len[0] == 2 + 1 + 32 * 2);
+    }
+    PASS();
+
+    TEST("low-byte wrap stays in the packet");
+    {
+        resetTx();
+        const uint8_t n1[] = { 0x90, 0x3C, 0x64 };
+        const uint8_t n2[] = { 0x90, 0x40, 0x64 };
+        queue(n1, 3, 120); queue(n2, 3, 130);
+        flushTx(20);
+        ASSERT(g_sent.count == 1);
+        const uint8_t expect[] = { hdr(120), ts(120), 0x90, 0x3C, 0x64, ts(130), 0x40, 0x64 };
+        ASSERT(sentIs(0, expect, sizeof(expect)));
+    }
+    PASS();
+
+    TEST("time beyond one wrap starts a new packet");
+    {
+        resetTx();
+        const uint8_t n1[] = { 0x90, 0x3C, 0x64 };
+        const uint8_t n2[] = { 0x90, 0x40, 0x64 };
+        queue(n1, 3, 100); queue(n2, 3, 300);
+        flushTx(20);
+        ASSERT(g_sent.count == 2);
+        ASSERT(g_sent.data[1][0] == hdr(300));
+        Decoder d; Capture c;
+        decodePacket(d, g_sent.data[0], g_sent.len[0], 110000, sinkFor(c));
+        decodePacket(d, g_sent.data[1], g_sent.len[1], 310000, sinkFor(c));
+        ASSERT(c.count == 2);
+        ASSERT(c.msgs[1].t - c.msgs[0].t == 200000);
+    }
+    PASS();
+
+    TEST("queue full rejects and counts");
+    {
+        TxQueue<32> q;
+        const uint8_t m[] = { 0x90, 0x3C, 0x64 };
+        int accepted = 0;
+        for (int i = 0; i < 10; i++) accepted += q.push(m, 3, 5000000000ULL) ? 1 : 0;
+        ASSERT(accepted == 2);    // 13 bytes each
+        ASSERT(q.dropped == 8);
+        uint8_t out[TX_ENTRY_MAX]; uint64_t us;
+        ASSERT(q.pop(out, us) == 3);
+        ASSERT(us == 5000000000ULL);
+        ASSERT(q.push(m, 3, 0));  // Space is reused across the wrap
+    }
+    PASS();
+}
+
+void test_encode_sysex() {
+    uint8_t sx[100];
+    sx[0] = 0xF0;
+    for (int i = 1; i < 99; i++) sx[i] = (uint8_t)(i & 0x7F);
+    sx[99] = 0xF7;
+
+    TEST("short SysEx fits one packet");
+    {
+        resetTx();
+        const uint8_t s[] = { 0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7 };
+        queue(s, sizeof(s), 10);
+        flushTx(20);
+        const uint8_t expect[] = { hdr(10), ts(10), 0xF0, 0x7E, 0x7F, 0x06, 0x01, ts(10), 0xF7 };
+        ASSERT(g_sent.count == 1);
+        ASSERT(sentIs(0, expect, sizeof(expect)));
+    }
+    PASS();
+
+    TEST("100-byte SysEx split at MTU 23 reassembles");
+    {
+        resetTx();
+        queue(sx, sizeof(sx), 10);
+        flushTx(20);
+        ASSERT(g_sent.count == 6);
+        for (int i = 0; i < g_sent.count; i++) ASSERT(g_sent.len[i] <= 20);
+        for (int i = 1; i < g_sent.count; i++) ASSERT(!(g_sent.data[i][1] & 0x80) || i == g_sent.count - 1);
+        Decoder d; Capture c; uint8_t buf[256];
+        setSysExBuffer(d, buf, sizeof(buf));
+        decodeSent(d, c);
+        ASSERT(c.sysexCount == 1);
+        ASSERT(c.sysexLen == sizeof(sx));
+        ASSERT(memcmp(c.sysex, sx, sizeof(sx)) == 0);
+    }
+    PASS();
+
+    TEST("messages around SysEx keep their order");
+    {
+        resetTx();
+        const uint8_t n1[] = { 0x90, 0x3C, 0x64 };
+        const uint8_t n2[] = { 0x80, 0x3C, 0x00 };
+        queue(n1, 3, 10); queue(sx, sizeof(sx), 10); queue(n2, 3, 11);
+        flushTx(20);
+        Decoder d; Capture c; uint8_t buf[256];
+        setSysExBuffer(d, buf, sizeof(buf));
+        decodeSent(d, c);
+        ASSERT(c.count == 2);
+        ASSERT(c.sysexCount == 1);
+        ASSERT(isMsg(c.msgs[0], 0x90, 0x3C, 0x64, 3));
+        ASSERT(isMsg(c.msgs[1], 0x80, 0x3C, 0x00, 3));
+        ASSERT(memcmp(c.sysex, sx, sizeof(sx)) == 0);
+        ASSERT(d.malformed == 0);
+    }
+    PASS();
+
+    TEST("SysEx whose F7 spills into the next packet");
+    {
+        // 20-byte packet: hdr ts F0 + 17 data bytes fill it exactly.
+        uint8_t s[19];
+        s[0] = 0xF0;
+        for (int i = 1; i < 18; i++) s[i] = (uint8_t)i;
+        s[18] = 0xF7;
+        resetTx();
+        queue(s, sizeof(s), 10);
+        flushTx(20);
+        ASSERT(g_sent.count == 2);
+        ASSERT(g_sent.len[0] == 20);
+        const uint8_t tail[] = { hdr(10), ts(10), 0xF7 };
+        ASSERT(sentIs(1, tail, sizeof(tail)));
+        Decoder d; Capture c; uint8_t buf[64];
+        setSysExBuffer(d, buf, sizeof(buf));
+        decodeSent(d, c);
+        ASSERT(c.sysexCount == 1 && c.sysexLen == sizeof(s));
+    }
+    PASS();
+
+    static uint8_t big[4000];
+    big[0] = 0xF0;
+    for (size_t i = 1; i < sizeof(big) - 1; i++) big[i] = (uint8_t)((i * 7) & 0x7F);
+    big[sizeof(big) - 1] = 0xF7;
+
+    TEST("4 KB SysEx streams in parts, clock in between");
+    {
+        resetTx();
+        SysExStream st;
+        beginSysEx(st, big, sizeof(big), 10000);
+        int rounds = 0;
+        while (!sysExDone(st) && rounds < 20) {
+            pushSysEx(g_txq, st);
+            if (rounds == 0) {
+                const uint8_t clk[] = { 0xF8 };
+                const uint8_t n1[] = { 0x90, 0x3C, 0x64 };
+                ASSERT(!g_txq.push(n1, 3, 10000));   // Would cut the SysEx
+                ASSERT(g_txq.push(clk, 1, 10000));   // Real-time may interleave
+            }
+            flushTx(182);
+            rounds++;
+        }
+        ASSERT(sysExDone(st));
+        ASSERT(rounds > 1);                          // Did not fit the queue at once
+        ASSERT(!g_txq.sysexOpen);
+        ASSERT(g_pk.messages == 2);
+        for (int i = 0; i < g_sent.count; i++) ASSERT(g_sent.len[i] <= 182);
+        Decoder d; Capture c; static uint8_t buf[8192];
+        setSysExBuffer(d, buf, sizeof(buf));
+        decodeSent(d, c);
+        ASSERT(c.count == 1 && c.msgs[0].data[0] == 0xF8);
+        ASSERT(c.sysexCount == 1);
+        ASSERT(c.sysexLen == sizeof(big));
+        ASSERT(memcmp(c.sysex, big, sizeof(big)) == 0);
+        ASSERT(d.malformed == 0);
+    }
+    PASS();
+
+    TEST("long SysEx whose last part is the F7 alone");
+    {
+        resetTx();
+        uint8_t s[2 * TX_ENTRY_MAX + 1];
+        memcpy(s, big, sizeof(s) - 1);
+        s[sizeof(s) - 1] = 0xF7;
+        SysExStream st;
+        beginSysEx(st, s, sizeof(s), 10000);
+        ASSERT(pushSysEx(g_txq, st) == sizeof(s));
+        flushTx(182);
+        Decoder d; Capture c; static uint8_t buf[2048];
+        setSysExBuffer(d, buf, sizeof(buf));
+        decodeSent(d, c);
+        ASSERT(c.sysexCount == 1 && c.sysexLen == sizeof(s));
+        ASSERT(memcmp(c.sysex, s, sizeof(s)) == 0);
+    }
+    PASS();
+
+    TEST("aborted long SysEx reopens the queue");
+    {
+        TxQueue<1024> q;
+        SysExStream st;
+        beginSysEx(st, big, sizeof(big), 0);
+        ASSERT(pushSysEx(q, st) == TX_ENTRY_MAX);    // The second part does not fit
+        SysExStream other;
+        beginSysEx(other, big, sizeof(big), 0);
+        ASSERT(pushSysEx(q, other) == 0);           // One long SysEx at a time
+        abortSysEx(q, st);
+        const uint8_t n1[] = { 0x90, 0x3C, 0x64 };
+        ASSERT(!q.sysexOpen);
+        ASSERT(q.push(n1, 3, 0));
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Link statistics
+// ---------------------------------------------------------------------------
+
+void test_link_stats() {
+    TEST("rates count the last second only");
+    {
+        RateMeter m;
+        for (int i = 0; i < 100; i++) {
+            countPacket(m, 10000000 + (uint64_t)i * 10000, 20);    // 100 packets over 1 s
+            countMessage(m, 10000000 + (uint64_t)i * 10000, 0);
+        }
+        Rates r = perSecond(m, 10990000);
+        ASSERT(r.packets == 100);
+        ASSERT(r.bytes == 2000);
+        ASSERT(r.messages == 100);
+        r = perSecond(m, 11400000);                                // Buckets from 10.5 s on
+        ASSERT(r.packets == 50);
+        r = perSecond(m, 13000000);
+        ASSERT(r.packets == 0);
+    }
+    PASS();
+
+    TEST("stale buckets are reused, not summed");
+    {
+        RateMeter m;
+        countPacket(m, 1000000, 10);
+        countPacket(m, 2000000, 10);                               // Same bucket index
+        ASSERT(perSecond(m, 2000000).bytes == 10);
+    }
+    PASS();
+
+    TEST("delay average settles and tracks the worst case");
+    {
+        RateMeter m;
+        countMessage(m, 0, 4000);
+        for (int i = 0; i < 100; i++) countMessage(m, 0, 1000);
+        ASSERT(m.delayUs >= 1000 && m.delayUs < 1010);
+        ASSERT(m.maxDelayUs == 4000);
+    }
+    PASS();
+
+    TEST("report: packet size and latency estimate");
+    {
+        RateMeter tx, rx;
+        countMessage(tx, 0, 2000);
+        LinkReport r = makeReport(tx, rx, 0, 185, 7500);
+        ASSERT(r.maxPacket == 182);
+        ASSERT(r.intervalUs == 7500);
+        ASSERT(r.txQueueDelayUs == 2000);
+        ASSERT(r.latencyUs == 2000 + 3750);
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Central state machine
+// ---------------------------------------------------------------------------
+
+static Address addr(uint8_t last) {
+    Address a = { { 0xC0, 0x11, 0x22, 0x33, 0x44, last }, 1 };
+    return a;
+}
+
+// Runs a controller from advertisement to Ready. Returns the link index.
+static int bringUp(Central& c, const Address& a, uint64_t now) {
+    onAdvertisement(c, a, true);
+    Action act = nextAction(c, now);
+    if (act.type == ACTION_STOP_SCAN) { onScanComplete(c); act = nextAction(c, now); }
+    if (act.type != ACTION_CONNECT) return -1;
+    onConnectResult(c, act.link, true, now);
+    Action sub = nextAction(c, now);
+    if (sub.type != ACTION_SUBSCRIBE || sub.link != act.link) return -1;
+    onSubscribeResult(c, act.link, true, now);
+    return act.link;
+}
+
+void test_central() {
+    TEST("start scans once");
+    {
+        Central c;
+        ASSERT(nextAction(c, 0).type == ACTION_NONE);     // Not started
+        centralStart(c, 1);
+        ASSERT(nextAction(c, 0).type == ACTION_START_SCAN);
+        ASSERT(nextAction(c, 0).type == ACTION_NONE);
+    }
+    PASS();
+
+    TEST("only BLE-MIDI advertisers become candidates");
+    {
+        Central c;
+        centralStart(c, 1);
+        nextAction(c, 0);
+        onAdvertisement(c, addr(1), false);
+        ASSERT(nextAction(c, 0).type == ACTION_NONE);
+        onAdvertisement(c, addr(2), true);
+        onAdvertisement(c, addr(2), true);                 // Duplicate
+        ASSERT(c.candidateCount == 1);
+    }
+    PASS();
+
+    TEST("stop scan, connect, subscribe, ready");
+    {
+        Central c;
+        centralStart(c, 1);
+        nextAction(c, 0);
+        onAdvertisement(c, addr(2), true);
+        ASSERT(nextAction(c, 0).type == ACTION_STOP_SCAN);
+        Action a = nextAction(c, 0);
+        ASSERT(a.type == ACTION_CONNECT && a.link == 0);
+        ASSERT(sameAddress(a.addr, addr(2)));
+        ASSERT(nextAction(c, 0).type == ACTION_NONE);      // Waiting for the result
+        onConnectResult(c, 0, true, 100);
+        a = nextAction(c, 100);
+        ASSERT(a.type == ACTION_SUBSCRIBE && a.link == 0);
+        onSubscribeResult(c, 0, true, 200);
+        ASSERT(c.links[0].state == LINK_READY);
+        ASSERT(readyLinks(c) == 1 && c.connects == 1);
+        ASSERT(nextAction(c, 300).type == ACTION_NONE);    // All links busy: no scan
+    }
+    PASS();
+
+    TEST("free links keep the scan going");
+    {
+        Central c;
+        centralStart(c, 2);
+        nextAction(c, 0);
+        ASSERT(bringUp(c, addr(1), 0) == 0);
+        ASSERT(nextAction(c, 0).type == ACTION_START_SCAN);
+        ASSERT(bringUp(c, addr(2), 0) == 1);
+        ASSERT(readyLinks(c) == 2);
+        onAdvertisement(c, addr(1), true);                 // Already linked
+        ASSERT(c.candidateCount == 0);
+    }
+    PASS();
+
+    TEST("failed connect backs off, then retries");
+    {
+        Central c;
+        centralStart(c, 1);
+        c.retryDelayUs = 1000;
+        nextAction(c, 0);
+        onAdvertisement(c, addr(3), true);
+        nextAction(c, 0);                                  // STOP_SCAN
+        Action a = nextAction(c, 0);
+        onConnectResult(c, a.link, false, 10);
+        ASSERT(c.links[0].state == LINK_BACKOFF && c.failures == 1);
+        onAdvertisement(c, addr(3), true);                 // Ignored while backing off
+        ASSERT(c.candidateCount == 0);
+        ASSERT(nextAction(c, 500).type == ACTION_NONE);
+        ASSERT(nextAction(c, 1010).type == ACTION_START_SCAN);
+        ASSERT(c.links[0].state == LINK_IDLE);
+        onAdvertisement(c, addr(3), true);
+        nextAction(c, 1020);
+        ASSERT(nextAction(c, 1020).type == ACTION_CONNECT);
+    }
+    PASS();
+
+    TEST("consecutive failures double the backoff");
+    {
+        Central c;
+        centralStart(c, 1);
+        c.retryDelayUs = 1000;
+        c.links[0].failures = 3;
+        ASSERT(backoffUs(c, c.links[0]) == 4000);
+        c.links[0].failures = 20;
+        ASSERT(backoffUs(c, c.links[0]) == 16000);         // Capped
+    }
+    PASS();
+
+    TEST("unanswered connect times out with a disconnect");
+    {
+        Central c;
+        centralStart(c, 1);
+        c.stepTimeoutUs = 5000;
+        nextAction(c, 0);
+        onAdvertisement(c, addr(4), true);
+        nextAction(c, 0);
+        nextAction(c, 0);                                  // CONNECT at t=0
+        ASSERT(nextAction(c, 4999).type == ACTION_NONE);
+        Action a = nextAction(c, 5000);
+        ASSERT(a.type == ACTION_DISCONNECT && a.link == 0);
+        ASSERT(c.links[0].state == LINK_BACKOFF);
+        onConnectResult(c, 0, true, 5100);                 // Late answer ignored
+        ASSERT(c.links[0].state == LINK_BACKOFF);
+    }
+    PASS();
+
+    TEST("missing characteristic fails the link");
+    {
+        Central c;
+        centralStart(c, 1);
+        nextAction(c, 0);
+        onAdvertisement(c, addr(5), true);
+        nextAction(c, 0);
+        nextAction(c, 0);
+        onConnectResult(c, 0, true, 0);
+        nextAction(c, 0);                                  // SUBSCRIBE
+        onSubscribeResult(c, 0, false, 0);
+        ASSERT(c.links[0].state == LINK_BACKOFF);
+        ASSERT(c.connects == 0 && c.failures == 1);
+    }
+    PASS();
+
+    TEST("drop from ready reconnects after the delay");
+    {
+        Central c;
+        centralStart(c, 1);
+        c.retryDelayUs = 1000;
+        nextAction(c, 0);
+        ASSERT(bringUp(c, addr(6), 0) == 0);
+        onDisconnected(c, 0, 100);
+        ASSERT(c.drops == 1 && c.failures == 0);
+        ASSERT(c.links[0].state == LINK_BACKOFF);
+        ASSERT(nextAction(c, 1100).type == ACTION_START_SCAN);
+        ASSERT(bringUp(c, addr(6), 1200) == 0);
+    }
+    PASS();
+
+    TEST("stop halts scanning and drops candidates");
+    {
+        Central c;
+        centralStart(c, 2);
+        nextAction(c, 0);
+        onAdvertisement(c, addr(7), true);
+        centralStop(c);
+        ASSERT(nextAction(c, 0).type == ACTION_STOP_SCAN);
+        ASSERT(nextAction(c, 0).type == ACTION_NONE);
+        ASSERT(c.candidateCount == 0);
+    }
+    PASS();
+}
+
+int main() {
+    printf("ESP32_Host_MIDI — BLE-MIDI packet tests\n");
+    printf("========================================\n");
+
+    printf("\n[Message splitting]\n");
+    test_single_message();
+    test_multiple_messages();
+    test_running_status();
+    test_realtime();
+
+    printf("\n[SysEx]\n");
+    test_sysex();
+
+    printf("\n[Malformed input]\n");
+    test_malformed();
+
+    printf("\n[Timestamps]\n");
+    test_timestamps();
+
+    printf("\n[Encoding]\n");
+    test_encode_compression();
+    test_encode_packets();
+    test_encode_sysex();
+
+    printf("\n[Link statistics]\n");
+    test_link_stats();
+
+    printf("\n[Central state machine]\n");
+    test_central();
+
+    printf("\n========================================\n");
+    printf("Results: %d passed, %d failed\n", g_pass, g_fail);
+    return (g_fail == 0) ? 0 : 1;
+}
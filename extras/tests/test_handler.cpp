@@ -8,6 +8,8 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdarg>
+#include <initializer_list>
+#include <type_traits>
 #include <vector>
 
 // Stubs
@@ -19,6 +21,13 @@ FakeSerial Serial;
 // Include after stubs
 #include "../../src/MIDIHandler.h"
 
+// MIDIClock source for the whole suite: tests move time with g_fakeMillis,
+// plus g_fakeMicros for sub-millisecond steps.
+static unsigned long g_fakeMicros = 0;
+static uint64_t fakeClockUs() {
+    return static_cast<uint64_t>(g_fakeMillis) * 1000 + g_fakeMicros;
+}
+
 // ---------------------------------------------------------------------------
 // Minimal test framework (same as test_native.cpp)
 // ---------------------------------------------------------------------------
@@ -92,6 +101,7 @@ void test_noteon_fields() {
     ASSERT(ev.pitchBend32 == 0x80000000U);
     PASS();
 
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
     // Deprecated fields
     TEST("deprecated: channel == 1");
     ASSERT_EQ(ev.channel, 1);
@@ -116,6 +126,7 @@ void test_noteon_fields() {
     TEST("deprecated: noteOctave == \"C4\"");
     ASSERT(ev.noteOctave == "C4");
     PASS();
+#endif
 }
 
 // ---------------------------------------------------------------------------
@@ -144,7 +155,9 @@ void test_noteoff_fields() {
     feedMidi(h2, 0x92, 60, 100); // NoteOn ch2
     auto ev2 = feedMidi(h2, 0x82, 60, 0); // NoteOff ch2
     ASSERT_EQ(ev2.channel0, 2);
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
     ASSERT_EQ(ev2.channel, 3); // deprecated: 1-based
+#endif
     PASS();
 }
 
@@ -167,9 +180,11 @@ void test_noteon_vel0_is_noteoff() {
     ASSERT(ev.statusCode == MIDI_NOTE_OFF);
     PASS();
 
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
     TEST("deprecated status == \"NoteOff\"");
     ASSERT(ev.status == "NoteOff");
     PASS();
+#endif
 
     TEST("velocity7 == 0, velocity16 == 0");
     ASSERT_EQ(ev.velocity7, 0);
@@ -209,6 +224,7 @@ void test_cc_fields() {
     ASSERT_EQ(ev.velocity16, 0xFFFF);
     PASS();
 
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
     TEST("deprecated: status == \"ControlChange\"");
     ASSERT(ev.status == "ControlChange");
     PASS();
@@ -216,6 +232,7 @@ void test_cc_fields() {
     TEST("deprecated: channel == 6 (1-based)");
     ASSERT_EQ(ev.channel, 6);
     PASS();
+#endif
 }
 
 // ---------------------------------------------------------------------------
@@ -244,9 +261,11 @@ void test_pc_fields() {
     ASSERT_EQ(ev.velocity16, 0);
     PASS();
 
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
     TEST("deprecated: status == \"ProgramChange\"");
     ASSERT(ev.status == "ProgramChange");
     PASS();
+#endif
 }
 
 // ---------------------------------------------------------------------------
@@ -278,9 +297,11 @@ void test_cp_fields() {
     ASSERT_EQ(ev.velocity16, MIDI2Scaler::scale7to16(80));
     PASS();
 
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
     TEST("deprecated: status == \"ChannelPressure\"");
     ASSERT(ev.status == "ChannelPressure");
     PASS();
+#endif
 }
 
 // ---------------------------------------------------------------------------
@@ -299,7 +320,9 @@ void test_pb_fields() {
     auto ev = feedMidi(h, 0xE0, 0x00, 0x40);
     ASSERT(ev.statusCode == MIDI_PITCH_BEND);
     ASSERT_EQ(ev.pitchBend14, 8192);
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
     ASSERT_EQ(ev.pitchBend, 8192); // deprecated
+#endif
     PASS();
 
     TEST("pitchBend32 scaled from center");
@@ -325,7 +348,9 @@ void test_pb_fields() {
     TEST("channel0 for PitchBend on ch9");
     auto ev4 = feedMidi(h, 0xE9, 0x00, 0x40);
     ASSERT_EQ(ev4.channel0, 9);
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
     ASSERT_EQ(ev4.channel, 10); // deprecated: 1-based
+#endif
     PASS();
 }
 
@@ -422,7 +447,9 @@ void test_all_channels() {
         TEST(name);
         auto ev = feedMidi(h, 0x90 | ch, 60, 100);
         ASSERT_EQ(ev.channel0, ch);
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
         ASSERT_EQ(ev.channel, ch + 1); // deprecated
+#endif
         PASS();
         // Release note
         feedMidi(h, 0x80 | ch, 60, 0);
@@ -483,10 +510,416 @@ void test_queue() {
     ASSERT(h.getQueue().size() <= 5);
     PASS();
 
+    TEST("full ring keeps the newest events, oldest first");
+    {
+        const auto& q = h.getQueue();
+        ASSERT_EQ(q.size(), 5);
+        ASSERT_EQ(q.front().index, 16);
+        ASSERT_EQ(q.back().index, 20);
+        int expect = 16;
+        for (const auto& ev : q) { ASSERT_EQ(ev.index, expect); expect++; }
+        ASSERT_EQ(expect, 21);
+    }
+    PASS();
+
+    TEST("ring storage is not reallocated by pushes");
+    {
+        const MIDIEventRecord* base = &h.getQueue().records().at(0);
+        for (int i = 0; i < 50; i++) feedMidi(h, 0xB0, 7, i);
+        const MIDIEventRecord* lo = base - 4;
+        const MIDIEventRecord* hi = base + 4;
+        for (size_t i = 0; i < h.getQueue().size(); i++) {
+            const MIDIEventRecord* p = &h.getQueue().record(i);
+            ASSERT(p >= lo && p <= hi);
+        }
+        ASSERT_EQ(h.getQueue().records().capacity(), 5);
+    }
+    PASS();
+
+    TEST("setQueueLimit shrinks and keeps the newest events");
+    h.setQueueLimit(3);
+    ASSERT_EQ(h.getQueue().size(), 3);
+    ASSERT_EQ(h.getQueue().back().index, 70);
+    ASSERT_EQ(h.getQueue().front().index, 68);
+    PASS();
+
+    TEST("setQueueLimit grows without losing events");
+    h.setQueueLimit(8);
+    ASSERT_EQ(h.getQueue().size(), 3);
+    feedMidi(h, 0xB0, 7, 1);
+    ASSERT_EQ(h.getQueue().size(), 4);
+    ASSERT_EQ(h.getQueue().front().index, 68);
+    ASSERT_EQ(h.getQueue().back().index, 71);
+    PASS();
+
     TEST("clearQueue empties the queue");
     h.clearQueue();
     ASSERT(h.getQueue().empty());
     PASS();
+
+    TEST("events before begin() use the default queue size");
+    MIDIHandler h2;
+    for (int i = 0; i < 30; i++) feedMidi(h2, 0xB0, 7, i);
+    ASSERT_EQ(h2.getQueue().size(), 20);
+    ASSERT_EQ(h2.getQueue().back().index, 30);
+    PASS();
+
+    TEST("MIDIEventRing counts every push");
+    MIDIEventRing<uint32_t> ring;
+    ASSERT(ring.reserve(4));
+    for (uint32_t i = 1; i <= 6; i++) ring.push(i);
+    ASSERT_EQ(ring.pushed(), 6);
+    ASSERT(ring.full());
+    ASSERT_EQ(ring.front(), 3);
+    ASSERT_EQ(ring.back(), 6);
+    ring.clear();
+    ASSERT(ring.empty());
+    ASSERT_EQ(ring.pushed(), 6);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Test: Cursor reads
+// ---------------------------------------------------------------------------
+
+void test_read_cursor() {
+    printf("\n[Cursor Reads]\n");
+
+    MIDIHandler h;
+    MIDIHandlerConfig cfg;
+    cfg.maxEvents = 8;
+    h.begin(cfg);
+    g_fakeMillis = 8500;
+
+    MIDIEventRecord out[16];
+    MIDIEventCursor a, b;
+    uint32_t lost = 99;
+
+    TEST("read on an empty queue returns nothing");
+    ASSERT_EQ(h.read(a, out, 16, &lost), 0);
+    ASSERT_EQ(lost, 0);
+    PASS();
+
+    TEST("read returns only new events, oldest first");
+    for (int i = 0; i < 3; i++) feedMidi(h, 0xB0, 1, i);
+    ASSERT_EQ(h.read(a, out, 16, &lost), 3);
+    ASSERT_EQ(lost, 0);
+    ASSERT_EQ(out[0].index, 1);
+    ASSERT_EQ(out[2].index, 3);
+    ASSERT_EQ(h.read(a, out, 16, &lost), 0);
+    feedMidi(h, 0xB0, 1, 50);
+    ASSERT_EQ(h.read(a, out, 16), 1);
+    ASSERT_EQ(out[0].index, 4);
+    ASSERT_EQ(out[0].velocity7, 50);
+    PASS();
+
+    TEST("read honours max and resumes where it stopped");
+    for (int i = 0; i < 4; i++) feedMidi(h, 0xB0, 1, i);
+    ASSERT_EQ(h.read(a, out, 3), 3);
+    ASSERT_EQ(out[0].index, 5);
+    ASSERT_EQ(h.read(a, out, 3), 1);
+    ASSERT_EQ(out[0].index, 8);
+    PASS();
+
+    TEST("independent readers keep separate positions");
+    ASSERT_EQ(h.read(b, out, 16, &lost), 8);
+    ASSERT_EQ(lost, 0);
+    ASSERT_EQ(out[0].index, 1);
+    ASSERT_EQ(out[7].index, 8);
+    PASS();
+
+    TEST("overrun reports events lost to wrap-around");
+    for (int i = 0; i < 11; i++) feedMidi(h, 0xB0, 1, i);
+    ASSERT_EQ(h.read(a, out, 16, &lost), 8);
+    ASSERT_EQ(lost, 3);
+    ASSERT_EQ(out[0].index, 12);
+    ASSERT_EQ(out[7].index, 19);
+    ASSERT_EQ(h.read(a, out, 16, &lost), 0);
+    ASSERT_EQ(lost, 0);
+    PASS();
+
+    TEST("partial read after overrun does not lose more events");
+    ASSERT_EQ(h.read(b, out, 2, &lost), 2);
+    ASSERT_EQ(lost, 3);
+    ASSERT_EQ(out[0].index, 12);
+    ASSERT_EQ(h.read(b, out, 16, &lost), 6);
+    ASSERT_EQ(lost, 0);
+    ASSERT_EQ(out[5].index, 19);
+    PASS();
+
+    TEST("clearQueue leaves cursors caught up");
+    h.clearQueue();
+    ASSERT_EQ(h.read(a, out, 16, &lost), 0);
+    ASSERT_EQ(lost, 0);
+    feedMidi(h, 0x90, 60, 100);
+    ASSERT_EQ(h.read(a, out, 16, &lost), 1);
+    ASSERT(out[0].statusCode == MIDI_NOTE_ON);
+    PASS();
+
+    TEST("clearQueue does not count as overrun for a lagging reader");
+    MIDIEventCursor c;
+    ASSERT_EQ(h.read(c, out, 16, &lost), 1);       // Catch up first
+    for (int i = 0; i < 5; i++) feedMidi(h, 0xB0, 1, i);
+    h.clearQueue();
+    feedMidi(h, 0xB0, 2, 7);
+    ASSERT_EQ(h.read(c, out, 16, &lost), 1);
+    ASSERT_EQ(lost, 0);
+    ASSERT_EQ(out[0].noteNumber, 2);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Test: History buffer (overwrite ring and chunked growth)
+// ---------------------------------------------------------------------------
+
+void test_history() {
+    printf("\n[History]\n");
+    g_fakeMillis = 9000;
+
+    TEST("history is empty when disabled");
+    {
+        MIDIHandler h;
+        h.begin();
+        feedMidi(h, 0x90, 60, 100);
+        ASSERT_EQ(h.getHistorySize(), 0);
+        ASSERT(h.getHistoryEvent(0) == nullptr);
+    }
+    PASS();
+
+    TEST("overwrite mode keeps the newest historyCapacity events");
+    {
+        MIDIHandler h;
+        MIDIHandlerConfig cfg;
+        cfg.historyCapacity = 4;
+        cfg.historyMode = MIDI_HISTORY_OVERWRITE;
+        h.begin(cfg);
+        for (int i = 0; i < 10; i++) feedMidi(h, 0xB0, 1, i);
+        ASSERT_EQ(h.getHistorySize(), 4);
+        ASSERT_EQ(h.getHistoryEvent(0)->velocity7, 6);
+        ASSERT_EQ(h.getHistoryEvent(3)->velocity7, 9);
+        ASSERT(h.getHistoryEvent(4) == nullptr);
+    }
+    PASS();
+
+    TEST("grow mode keeps every event, oldest first");
+    {
+        MIDIHandler h;
+        MIDIHandlerConfig cfg;
+        cfg.historyCapacity = 3;
+        cfg.historyMode = MIDI_HISTORY_GROW;
+        h.begin(cfg);
+        for (int i = 0; i < 10; i++) feedMidi(h, 0xB0, 1, i);
+        ASSERT_EQ(h.getHistorySize(), 10);
+        for (int i = 0; i < 10; i++) ASSERT_EQ(h.getHistoryEvent(i)->velocity7, i);
+    }
+    PASS();
+
+    TEST("grow mode never moves stored events");
+    {
+        MIDIHandler h;
+        MIDIHandlerConfig cfg;
+        cfg.historyCapacity = 2;
+        h.begin(cfg);
+        feedMidi(h, 0xB0, 1, 0);
+        const MIDIEventRecord* first = h.getHistoryEvent(0);
+        for (int i = 1; i < 100; i++) feedMidi(h, 0xB0, 1, i);
+        ASSERT(h.getHistoryEvent(0) == first);
+        ASSERT_EQ(first->velocity7, 0);
+    }
+    PASS();
+
+    TEST("grow mode overwrites once historyMaxCapacity is reached");
+    {
+        MIDIHandler h;
+        MIDIHandlerConfig cfg;
+        cfg.historyCapacity = 4;
+        cfg.historyMaxCapacity = 8;
+        h.begin(cfg);
+        for (int i = 0; i < 20; i++) feedMidi(h, 0xB0, 1, i);
+        ASSERT_EQ(h.getHistorySize(), 8);
+        ASSERT_EQ(h.getHistoryEvent(0)->velocity7, 12);
+        ASSERT_EQ(h.getHistoryEvent(7)->velocity7, 19);
+    }
+    PASS();
+
+    TEST("clearQueue keeps the history");
+    {
+        MIDIHandler h;
+        MIDIHandlerConfig cfg;
+        cfg.historyCapacity = 4;
+        h.begin(cfg);
+        feedMidi(h, 0xB0, 1, 1);
+        h.clearQueue();
+        ASSERT_EQ(h.getHistorySize(), 1);
+    }
+    PASS();
+
+    // Growing used to reallocate and copy the whole buffer, so one event in a
+    // long session could stall for as long as it took to copy every event
+    // before it. With chunks no stored event is ever copied again, however
+    // much history is already stored (bench_event_path times the worst push).
+    TEST("grow mode never copies stored events (500k events)");
+    {
+        MIDIHandler h;
+        MIDIHandlerConfig cfg;
+        cfg.historyCapacity = 1024;
+        cfg.historyMode = MIDI_HISTORY_GROW;
+        h.begin(cfg);
+
+        MIDIEventRecord ev = MIDIEventRecord();
+        ev.statusCode = MIDI_CONTROL_CHANGE;
+        std::vector<const MIDIEventRecord*> firstOfBlock;
+        for (int i = 0; i < 500000; i++) {
+            ev.index = i + 1;
+            h.addEvent(ev);
+            if (i % 1024 == 0) firstOfBlock.push_back(h.getHistoryEvent(i));
+        }
+        ASSERT_EQ(h.getHistorySize(), 500000);
+        ASSERT_EQ(h.getHistoryEvent(499999)->index, 500000);
+        for (size_t b = 0; b < firstOfBlock.size(); b++) {
+            if (h.getHistoryEvent((int)b * 1024) != firstOfBlock[b]) FAIL("stored event moved");
+        }
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Test: Push subscriptions
+// ---------------------------------------------------------------------------
+
+struct BusProbe {
+    int calls = 0;
+    MIDIEventRecord last = {};
+    size_t queueSizeAtCall = 0;
+    const MIDIHandler* h = nullptr;
+};
+
+static void onBusEvent(void* ctx, const MIDIEventRecord& ev) {
+    BusProbe* p = static_cast<BusProbe*>(ctx);
+    p->calls++;
+    p->last = ev;
+    if (p->h) p->queueSizeAtCall = p->h->getQueue().size();
+}
+
+// Unsubscribes itself on its first event.
+struct OneShot {
+    MIDIHandler* h = nullptr;
+    int calls = 0;
+};
+
+static void onBusEventOnce(void* ctx, const MIDIEventRecord&) {
+    OneShot* p = static_cast<OneShot*>(ctx);
+    p->calls++;
+    p->h->unsubscribe(MIDI_NOTE_ON, onBusEventOnce, ctx);
+}
+
+void test_event_bus() {
+    printf("\n[Push Subscriptions]\n");
+
+    MIDIHandler h;
+    h.begin();
+    g_fakeMillis = 8800;
+
+    BusProbe notes, cc, ch2;
+    notes.h = &h;
+
+    TEST("subscribe delivers matching status only");
+    ASSERT(h.subscribe(MIDI_NOTE_ON, onBusEvent, &notes));
+    ASSERT(h.subscribe(MIDI_CONTROL_CHANGE, onBusEvent, &cc));
+    feedMidi(h, 0x90, 60, 100);
+    feedMidi(h, 0xB0, 7, 90);
+    feedMidi(h, 0x80, 60, 0);
+    ASSERT_EQ(notes.calls, 1);
+    ASSERT_EQ(notes.last.noteNumber, 60);
+    ASSERT_EQ(notes.last.velocity7, 100);
+    ASSERT_EQ(cc.calls, 1);
+    ASSERT_EQ(cc.last.velocity7, 90);
+    PASS();
+
+    TEST("handler runs after the event is queued");
+    ASSERT_EQ(notes.queueSizeAtCall, 1);
+    ASSERT_EQ(notes.last.index, h.getQueue().record(0).index);
+    PASS();
+
+    TEST("NoteOn with velocity 0 is delivered as NoteOff");
+    BusProbe off;
+    ASSERT(h.subscribe(MIDI_NOTE_OFF, onBusEvent, &off));
+    feedMidi(h, 0x90, 62, 0);
+    ASSERT_EQ(off.calls, 1);
+    ASSERT(off.last.statusCode == MIDI_NOTE_OFF);
+    ASSERT_EQ(notes.calls, 1);
+    PASS();
+
+    TEST("channel filter (1-16) and widening");
+    ASSERT(h.subscribe(MIDI_PITCH_BEND, onBusEvent, &ch2, 2));
+    feedMidi(h, 0xE0, 0, 64);   // ch 1
+    feedMidi(h, 0xE1, 0, 64);   // ch 2
+    feedMidi(h, 0xE2, 0, 64);   // ch 3
+    ASSERT_EQ(ch2.calls, 1);
+    ASSERT_EQ(ch2.last.channel0, 1);
+    ASSERT(h.subscribe(MIDI_PITCH_BEND, onBusEvent, &ch2, 3));
+    feedMidi(h, 0xE2, 0, 64);
+    ASSERT_EQ(ch2.calls, 2);
+    PASS();
+
+    TEST("filtered NoteOn (below threshold) is not delivered");
+    {
+        MIDIHandler ht;
+        MIDIHandlerConfig cfg;
+        cfg.velocityThreshold = 20;
+        ht.begin(cfg);
+        BusProbe p;
+        ht.subscribe(MIDI_NOTE_ON, onBusEvent, &p);
+        feedMidi(ht, 0x90, 60, 10);
+        ASSERT_EQ(p.calls, 0);
+        feedMidi(ht, 0x90, 61, 30);
+        ASSERT_EQ(p.calls, 1);
+    }
+    PASS();
+
+    TEST("table is bounded per status");
+    BusProbe extra[MIDIHandler::MAX_EVENT_HANDLERS];
+    h.unsubscribe(MIDI_CONTROL_CHANGE, onBusEvent, &cc);
+    for (int i = 0; i < MIDIHandler::MAX_EVENT_HANDLERS; i++) {
+        ASSERT(h.subscribe(MIDI_CONTROL_CHANGE, onBusEvent, &extra[i]));
+    }
+    ASSERT(!h.subscribe(MIDI_CONTROL_CHANGE, onBusEvent, &cc));
+    feedMidi(h, 0xB0, 1, 1);
+    for (int i = 0; i < MIDIHandler::MAX_EVENT_HANDLERS; i++) ASSERT_EQ(extra[i].calls, 1);
+    ASSERT_EQ(cc.calls, 1);
+    PASS();
+
+    TEST("unsubscribe and unsubscribeAll stop delivery");
+    h.unsubscribe(MIDI_NOTE_ON, onBusEvent, &notes);
+    feedMidi(h, 0x90, 64, 100);
+    ASSERT_EQ(notes.calls, 1);
+    h.unsubscribeAll();
+    feedMidi(h, 0xB0, 1, 1);
+    ASSERT_EQ(extra[0].calls, 1);
+    PASS();
+
+    TEST("handler unsubscribing itself does not skip the next");
+    {
+        MIDIHandler hs;
+        hs.begin();
+        OneShot once;
+        BusProbe after;
+        once.h = &hs;
+        ASSERT(hs.subscribe(MIDI_NOTE_ON, onBusEventOnce, &once));
+        ASSERT(hs.subscribe(MIDI_NOTE_ON, onBusEvent, &after));
+        feedMidi(hs, 0x90, 60, 100);
+        ASSERT_EQ(once.calls, 1);
+        ASSERT_EQ(after.calls, 1);
+        feedMidi(hs, 0x90, 62, 100);
+        ASSERT_EQ(once.calls, 1);
+        ASSERT_EQ(after.calls, 2);
+    }
+    PASS();
+
+    TEST("invalid arguments are rejected");
+    ASSERT(!h.subscribe(MIDI_NOTE_ON, nullptr, &notes));
+    ASSERT(!h.subscribe(MIDI_NOTE_ON, onBusEvent, &notes, 17));
+    PASS();
 }
 
 // ---------------------------------------------------------------------------
@@ -535,6 +968,64 @@ void test_active_notes() {
     ASSERT(notes[72] == true);
     ASSERT(notes[60] == false);
     PASS();
+
+    TEST("same note on two channels is tracked separately");
+    h.clearActiveNotesNow();
+    feedMidi(h, 0x90, 60, 100);   // ch 1
+    feedMidi(h, 0x91, 60, 100);   // ch 2
+    ASSERT(h.isNoteActive(1, 60));
+    ASSERT(h.isNoteActive(2, 60));
+    ASSERT(!h.isNoteActive(3, 60));
+    ASSERT_EQ(h.getActiveNotesCount(1), 1);
+    ASSERT_EQ(h.getActiveNotesCount(2), 1);
+    ASSERT_EQ(h.getActiveNotesCount(), 1);   // union of pitches
+    PASS();
+
+    TEST("NoteOff on one channel keeps the other held");
+    auto off = feedMidi(h, 0x81, 60, 0);
+    ASSERT(off.msgIndex != 0);
+    ASSERT(!h.isNoteActive(2, 60));
+    ASSERT(h.isNoteActive(1, 60));
+    ASSERT_EQ(h.getActiveNotesCount(), 1);
+    bool held[128];
+    h.fillActiveNotes(held);
+    ASSERT(held[60]);
+    PASS();
+
+    TEST("NoteOff pairs msgIndex per channel");
+    {
+        MIDIHandler hc;
+        hc.begin();
+        auto on1 = feedMidi(hc, 0x90, 64, 100);
+        auto on2 = feedMidi(hc, 0x95, 64, 100);
+        auto off2 = feedMidi(hc, 0x85, 64, 0);
+        auto off1 = feedMidi(hc, 0x80, 64, 0);
+        ASSERT(on1.msgIndex != on2.msgIndex);
+        ASSERT_EQ(off2.msgIndex, on2.msgIndex);
+        ASSERT_EQ(off1.msgIndex, on1.msgIndex);
+        ASSERT_EQ(hc.getActiveNotesCount(), 0);
+    }
+    PASS();
+
+    TEST("all 16 channels x 128 notes can be held");
+    {
+        MIDIHandler hc;
+        hc.begin();
+        for (int ch = 0; ch < 16; ch++)
+            for (int n = 0; n < 128; n++) feedMidi(hc, 0x90 | ch, n, 100);
+        ASSERT_EQ(hc.getActiveNotesCount(), 128);
+        for (int ch = 1; ch <= 16; ch++) ASSERT_EQ(hc.getActiveNotesCount(ch), 128);
+        ASSERT_EQ(hc.getActiveNotesVector().size(), 128);
+        hc.clearActiveNotesNow();
+        ASSERT_EQ(hc.getActiveNotesCount(16), 0);
+    }
+    PASS();
+
+    TEST("channel out of range reports nothing");
+    ASSERT_EQ(h.getActiveNotesCount(0), 0);
+    ASSERT_EQ(h.getActiveNotesCount(17), 0);
+    ASSERT(!h.isNoteActive(0, 60));
+    PASS();
 }
 
 // ---------------------------------------------------------------------------
@@ -569,6 +1060,90 @@ void test_chord_detection() {
     auto ev4 = feedMidi(h, 0x90, 72, 100);
     ASSERT(ev4.chordIndex != ev1.chordIndex);
     PASS();
+
+    TEST("chord index summarises the struck chord");
+    {
+        const MIDIChordRecord* c = h.chord(ev1.chordIndex);
+        ASSERT(c != nullptr);
+        ASSERT_EQ(c->chordIndex, ev1.chordIndex);
+        ASSERT_EQ(c->noteOnCount, 3);
+        ASSERT_EQ(c->lowestNote, 60);
+        ASSERT_EQ(c->highestNote, 67);
+        ASSERT_EQ(c->onset, 10000);
+        ASSERT_EQ(c->lastNoteOn, 10020);
+        ASSERT_EQ(c->velocitySum, 300);
+        ASSERT_EQ(c->velocityMin, 100);
+        ASSERT_EQ(c->channelMask, 1);
+        ASSERT(c->notes[0] == (1ULL << 60));
+        ASSERT(c->notes[1] == ((1ULL << (64 - 64)) | (1ULL << (67 - 64))));
+    }
+    PASS();
+
+    TEST("lastChord() tracks the newest chord in O(1)");
+    ASSERT_EQ(h.lastChord(), ev4.chordIndex);
+    ASSERT_EQ(h.lastChord(), h.lastChord(h.getQueue()));
+    ASSERT(h.lastChordRecord() == h.chord(ev4.chordIndex));
+    ASSERT_EQ(h.lastChordRecord()->noteOnCount, 1);
+    PASS();
+
+    TEST("velocity stats follow each NoteOn");
+    g_fakeMillis = 10210;
+    feedMidi(h, 0x93, 76, 40);
+    ASSERT_EQ(h.lastChordRecord()->noteOnCount, 2);
+    ASSERT_EQ(h.lastChordRecord()->velocityMin, 40);
+    ASSERT_EQ(h.lastChordRecord()->velocityMax, 100);
+    ASSERT_EQ(h.lastChordRecord()->channelMask, (1 | (1 << 3)));
+    PASS();
+
+    TEST("getAnswer uses the chord index");
+    auto ans = h.getAnswer("note");
+    ASSERT_EQ((int)ans.size(), 2);
+    ASSERT(ans[0] == "72" && ans[1] == "76");
+    PASS();
+
+    TEST("getAnswer reads other fields from the chord's events");
+    auto vel = h.getAnswer(std::vector<std::string>{ "note", "velocity" });
+    ASSERT_EQ((int)vel.size(), 2);
+    ASSERT(vel[0] == "72, 100" && vel[1] == "76, 40");
+    ASSERT(h.getAnswer("all") == h.getChord(h.lastChord(), h.getQueue()));
+    PASS();
+
+    TEST("getAnswer note fields need no queued events");
+    {
+        MIDIHandlerConfig small;
+        small.maxEvents = 2;
+        MIDIHandler hs;
+        hs.begin(small);
+        feedMidi(hs, 0x90, 48, 90);
+        feedMidi(hs, 0x90, 52, 90);
+        feedMidi(hs, 0x90, 55, 90);   // Chord's first NoteOn has left the queue
+        auto names = hs.getAnswer("noteOctave");
+        ASSERT_EQ((int)names.size(), 3);
+        ASSERT(names[0] == "C3" && names[2] == "G3");
+    }
+    PASS();
+
+    TEST("old chords age out of the index");
+    feedMidi(h, 0x80, 72, 0);
+    feedMidi(h, 0x83, 76, 0);
+    int first = h.lastChord();
+    for (int i = 0; i < MIDIHandler::CHORD_HISTORY; i++) {
+        g_fakeMillis += 100;
+        feedMidi(h, 0x90, 60, 100);
+        feedMidi(h, 0x80, 60, 0);
+    }
+    ASSERT(h.chord(first) == nullptr);
+    ASSERT(h.chord(h.lastChord()) != nullptr);
+    ASSERT(h.chord(h.lastChord() - (MIDIHandler::CHORD_HISTORY - 1)) != nullptr);
+    ASSERT(h.chord(0) == nullptr);
+    PASS();
+
+    TEST("clearQueue resets the chord index");
+    h.clearQueue();
+    ASSERT_EQ(h.lastChord(), 0);
+    ASSERT(h.lastChordRecord() == nullptr);
+    ASSERT(h.getAnswer().empty());
+    PASS();
 }
 
 // ---------------------------------------------------------------------------
@@ -595,11 +1170,13 @@ void test_velocity_threshold() {
     TEST("note at threshold is accepted");
     auto ev1 = feedMidi(h, 0x90, 60, 20);
     ASSERT_EQ(h.getQueue().size(), before + 1);
+    ASSERT_EQ(ev1.velocity7, 20);
     PASS();
 
     TEST("note above threshold is accepted");
     auto ev2 = feedMidi(h, 0x90, 64, 100);
     ASSERT_EQ(h.getQueue().size(), before + 2);
+    ASSERT_EQ(ev2.noteNumber, 64);
     PASS();
 }
 
@@ -621,7 +1198,7 @@ void test_event_metadata() {
     ASSERT(ev2.index == ev1.index + 1);
     PASS();
 
-    TEST("timestamp reflects millis()");
+    TEST("timestamp reflects the clock");
     ASSERT_EQ(ev1.timestamp, 12000UL);
     ASSERT_EQ(ev2.timestamp, 12050UL);
     PASS();
@@ -714,6 +1291,230 @@ void test_edge_cases() {
     feedMidi(h, 0x80, 60, 0);
 }
 
+// ---------------------------------------------------------------------------
+// Test: Typed chord / active-note accessors
+// ---------------------------------------------------------------------------
+
+void test_chord_accessors() {
+    printf("\n[Typed Chord Accessors]\n");
+
+    MIDIHandlerConfig cfg;
+    cfg.chordTimeWindow = 50;
+    MIDIHandler h;
+    h.begin(cfg);
+    g_fakeMillis = 20000;
+
+    // G7 in second inversion, notes arriving out of order, one doubled.
+    feedMidi(h, 0x90, 77, 90);   // F5
+    feedMidi(h, 0x90, 62, 90);   // D4 (bass)
+    feedMidi(h, 0x90, 67, 90);   // G4
+    feedMidi(h, 0x91, 67, 90);   // G4 on another channel
+    feedMidi(h, 0x90, 71, 90);   // B4
+    int idx = h.lastChord();
+
+    uint8_t notes[8];
+    TEST("getChordNotes returns the chord lowest first");
+    ASSERT_EQ(h.getChordNotes(idx, notes, 8), 4);
+    ASSERT_EQ(notes[0], 62);
+    ASSERT_EQ(notes[1], 67);
+    ASSERT_EQ(notes[2], 71);
+    ASSERT_EQ(notes[3], 77);
+    PASS();
+
+    TEST("getChordNotes honours maxNotes");
+    ASSERT_EQ(h.getChordNotes(idx, notes, 2), 2);
+    ASSERT_EQ(notes[1], 67);
+    PASS();
+
+    TEST("getChordPitchClasses builds a 12-bit mask");
+    // G=7, B=11, D=2, F=5
+    ASSERT_EQ(h.getChordPitchClasses(idx), (1 << 7) | (1 << 11) | (1 << 2) | (1 << 5));
+    PASS();
+
+    TEST("unknown chord index yields nothing");
+    ASSERT_EQ(h.getChordNotes(idx + 1, notes, 8), 0);
+    ASSERT_EQ(h.getChordPitchClasses(0), 0);
+    PASS();
+
+    TEST("getActiveNoteNumbers / getActivePitchClasses");
+    feedMidi(h, 0x80, 77, 0);
+    ASSERT_EQ(h.getActiveNoteNumbers(notes, 8), 3);
+    ASSERT_EQ(notes[0], 62);
+    ASSERT_EQ(notes[2], 71);
+    ASSERT_EQ(h.getActivePitchClasses(), (1 << 7) | (1 << 11) | (1 << 2));
+    PASS();
+
+    TEST("noteSetToArray covers both 64-bit words");
+    uint64_t set[2] = { 1ULL | (1ULL << 63), (1ULL << 0) | (1ULL << 63) };
+    ASSERT_EQ(MIDIHandler::noteSetToArray(set, notes, 8), 4);
+    ASSERT_EQ(notes[0], 0);
+    ASSERT_EQ(notes[1], 63);
+    ASSERT_EQ(notes[2], 64);
+    ASSERT_EQ(notes[3], 127);
+    ASSERT_EQ(MIDIHandler::noteSetToPitchClasses(set), (1 << 0) | (1 << 3) | (1 << 4) | (1 << 7));
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Test: Pitch-class chord table
+// ---------------------------------------------------------------------------
+
+static const char* chordName(std::initializer_list<uint8_t> notes, char* buf) {
+    uint8_t n[8];
+    uint8_t c = 0;
+    for (uint8_t x : notes) n[c++] = x;
+    return MIDIChordTable::format(MIDIChordTable::fromNotes(n, c), buf, 16);
+}
+
+void test_chord_table() {
+    printf("\n[Chord Table]\n");
+    char buf[16];
+
+    TEST("major triad in all 12 keys, root position");
+    {
+        static const char* roots[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        for (uint8_t r = 0; r < 12; r++) {
+            uint16_t mask = (1 << r) | (1 << ((r + 4) % 12)) | (1 << ((r + 7) % 12));
+            MIDIChordInfo ci = MIDIChordTable::lookup(mask, r);
+            ASSERT(ci.quality == CHORD_MAJOR);
+            ASSERT_EQ(ci.root, r);
+            ASSERT_EQ(ci.inversion, 0);
+            char expect[8];
+            snprintf(expect, sizeof(expect), "%sM", roots[r]);
+            ASSERT(strcmp(MIDIChordTable::format(ci, buf, 16), expect) == 0);
+        }
+    }
+    PASS();
+
+    TEST("inversions name the bass");
+    ASSERT(strcmp(chordName({64, 67, 72}, buf), "CM/E") == 0);
+    ASSERT(strcmp(chordName({67, 72, 76}, buf), "CM/G") == 0);
+    ASSERT(strcmp(chordName({62, 67, 71, 77}, buf), "G7/D") == 0);
+    ASSERT(strcmp(chordName({65, 67, 71, 74}, buf), "G7/F") == 0);
+    const uint8_t g7third[4] = { 65, 67, 71, 74 };
+    ASSERT_EQ(MIDIChordTable::fromNotes(g7third, 4).inversion, 3);
+    PASS();
+
+    TEST("qualities");
+    ASSERT(strcmp(chordName({57, 60, 64}, buf), "Am") == 0);
+    ASSERT(strcmp(chordName({59, 62, 65}, buf), "Bdim") == 0);
+    ASSERT(strcmp(chordName({60, 64, 67, 71}, buf), "C7M") == 0);
+    ASSERT(strcmp(chordName({59, 62, 65, 69}, buf), "Bm7(b5)") == 0);
+    ASSERT(strcmp(chordName({60, 67}, buf), "C5") == 0);
+    ASSERT(strcmp(chordName({60, 64, 67, 70, 74}, buf), "C9") == 0);
+    ASSERT(strcmp(chordName({62, 65, 69, 72, 76}, buf), "Dm9") == 0);
+    PASS();
+
+    TEST("doubled notes collapse into the set");
+    ASSERT(strcmp(chordName({48, 60, 64, 67, 72, 76}, buf), "CM") == 0);
+    PASS();
+
+    TEST("ambiguous sets prefer the chord rooted on the bass");
+    ASSERT(strcmp(chordName({60, 64, 67, 69}, buf), "C6") == 0);
+    ASSERT(strcmp(chordName({57, 60, 64, 67}, buf), "Am7") == 0);
+    ASSERT(strcmp(chordName({60, 62, 67}, buf), "Csus2") == 0);
+    ASSERT(strcmp(chordName({55, 60, 62}, buf), "Gsus4") == 0);
+    ASSERT(strcmp(chordName({64, 68, 72}, buf), "Eaug") == 0);
+    ASSERT(strcmp(chordName({63, 66, 69, 72}, buf), "D#dim7") == 0);
+    PASS();
+
+    TEST("bass outside the set is reported as such");
+    {
+        MIDIChordInfo ci = MIDIChordTable::lookup((1 << 0) | (1 << 4) | (1 << 7), 2);
+        ASSERT(ci.quality == CHORD_MAJOR);
+        ASSERT_EQ(ci.root, 0);
+        ASSERT_EQ(ci.inversion, CHORD_BASS_NOT_IN_CHORD);
+    }
+    PASS();
+
+    TEST("unknown sets and single notes are not named");
+    const uint8_t cluster[3] = { 60, 61, 62 };
+    ASSERT(!MIDIChordTable::fromNotes(cluster, 1).valid());
+    ASSERT(!MIDIChordTable::fromNotes(cluster, 3).valid());
+    ASSERT(!MIDIChordTable::lookup(0, 0).valid());
+    ASSERT(strcmp(chordName({60, 61}, buf), "") == 0);
+    PASS();
+
+    TEST("MIDIHandler chord info from the chord index and held notes");
+    {
+        MIDIHandlerConfig cfg;
+        cfg.chordTimeWindow = 50;
+        MIDIHandler h;
+        h.begin(cfg);
+        g_fakeMillis = 30000;
+        feedMidi(h, 0x90, 64, 100);
+        feedMidi(h, 0x90, 60, 100);
+        feedMidi(h, 0x90, 55, 100);
+        MIDIChordInfo ci = h.getChordInfo(h.lastChord());
+        ASSERT(ci.quality == CHORD_MAJOR);
+        ASSERT_EQ(ci.root, 0);
+        ASSERT_EQ(ci.bass, 7);
+        ASSERT_EQ(ci.inversion, 2);
+        feedMidi(h, 0x80, 55, 0);
+        ASSERT(h.getActiveChordInfo().quality == CHORD_NONE);   // C + E only
+        ASSERT(!h.getChordInfo(0).valid());
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Test: Compact event record — storage layout and expansion on read
+// ---------------------------------------------------------------------------
+
+void test_compact_record() {
+    printf("\n[Compact Event Record]\n");
+
+    TEST("MIDIEventRecord is 32 bytes and trivially copyable");
+    ASSERT_EQ(sizeof(MIDIEventRecord), 32);
+    ASSERT(std::is_trivially_copyable<MIDIEventRecord>::value);
+    PASS();
+
+    MIDIHandler h;
+    h.begin();
+    g_fakeMillis = 15000;
+    feedMidi(h, 0x93, 64, 90);
+    feedMidi(h, 0x93, 60, 80);
+
+    TEST("record() exposes the stored event without expansion");
+    const MIDIEventRecord& r = h.getQueue().record(1);
+    ASSERT(r.statusCode == MIDI_NOTE_ON);
+    ASSERT_EQ(r.channel0, 3);
+    ASSERT_EQ(r.noteNumber, 60);
+    ASSERT_EQ(r.velocity7, 80);
+    PASS();
+
+    TEST("iteration yields MIDIEventData in arrival order");
+    int n = 0;
+    uint8_t notes[2] = {};
+    for (const auto& ev : h.getQueue()) notes[n++] = ev.noteNumber;
+    ASSERT_EQ(n, 2);
+    ASSERT_EQ(notes[0], 64);
+    ASSERT_EQ(notes[1], 60);
+    PASS();
+
+    TEST("getChord(\"note\") sorts chord notes by pitch");
+    auto chord = h.getChord(h.lastChord(h.getQueue()), h.getQueue(), {"note"});
+    ASSERT_EQ((int)chord.size(), 2);
+    ASSERT(chord[0] == "60");
+    ASSERT(chord[1] == "64");
+    PASS();
+
+    TEST("getChord(\"noteOctave\") formats from the record");
+    auto oct = h.getChord(h.lastChord(h.getQueue()), h.getQueue(), {"noteOctave"});
+    ASSERT(oct[0] == "C4");
+    ASSERT(oct[1] == "E4");
+    PASS();
+
+    TEST("history (memcpy of records) leaves queue intact");
+    MIDIHandlerConfig cfg;
+    cfg.historyCapacity = 4;
+    MIDIHandler hh;
+    hh.begin(cfg);
+    for (int i = 0; i < 10; i++) feedMidi(hh, 0xB0, 1, i);
+    ASSERT_EQ((int)hh.getQueue().size(), 10);
+    PASS();
+}
+
 // ---------------------------------------------------------------------------
 // v6 regression tests: handler optional, transports explicit
 // ---------------------------------------------------------------------------
@@ -748,6 +1549,17 @@ public:
     void inject(const uint8_t* data, size_t len) {
         dispatchMidiData(data, len);
     }
+    // As inject(), with the time the transport received the bytes.
+    void injectAt(const uint8_t* data, size_t len, uint64_t timestampUs) {
+        dispatchMidiData(data, len, timestampUs);
+    }
+    // Delivers UMP words the way a MIDI 2.0 transport does.
+    void injectUMP(const uint32_t* words, size_t count) {
+        dispatchUMPBatch(words, count);
+    }
+    void injectUMPAt(const uint32_t* words, size_t count, uint64_t timestampUs) {
+        dispatchUMPBatch(words, count, timestampUs);
+    }
 };
 
 void test_v6_handler_no_transports() {
@@ -818,6 +1630,274 @@ void test_v6_multi_transport_fan_out() {
     ASSERT_EQ(t2.sentCount, 0);  // not called, t1 already accepted
     ASSERT_EQ(t3.sentCount, 0);
     PASS();
+
+    TEST("addTransport takes up to MAX_TRANSPORTS");
+    {
+        MIDIHandler hm;
+        MockMidiTransport many[MIDIHandler::MAX_TRANSPORTS + 1];
+        for (int i = 0; i < MIDIHandler::MAX_TRANSPORTS; i++) {
+            if (!hm.addTransport(&many[i])) FAIL("transport refused below the cap");
+        }
+        ASSERT(!hm.addTransport(&many[MIDIHandler::MAX_TRANSPORTS]));
+        ASSERT(MIDIHandler::MAX_TRANSPORTS >= 16);
+        hm.task();
+        ASSERT_EQ(many[MIDIHandler::MAX_TRANSPORTS - 1].taskCount, 1);
+        ASSERT_EQ(many[MIDIHandler::MAX_TRANSPORTS].taskCount, 0);
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Test: Arrival timestamps carried from the transport
+// ---------------------------------------------------------------------------
+
+void test_arrival_time() {
+    printf("\n[Arrival Timestamps]\n");
+
+    TEST("timestampUs keeps sub-millisecond resolution");
+    {
+        MIDIHandler h;
+        h.begin();
+        g_fakeMillis = 60000;
+        g_fakeMicros = 250;
+        MIDIEventData ev = feedMidi(h, 0x90, 60, 100);
+        g_fakeMicros = 0;
+        ASSERT_EQ(ev.timestampUs, 60000250UL);
+        ASSERT_EQ(ev.timestamp, 60000UL);
+    }
+    PASS();
+
+    TEST("transport timestamp is used instead of the dispatch time");
+    {
+        MIDIHandler h;
+        MockMidiTransport t;
+        h.addTransport(&t);
+        h.begin();
+        g_fakeMillis = 61000;  // task() runs late...
+        uint8_t noteon[3] = { 0x90, 60, 100 };
+        t.injectAt(noteon, 3, 60900123ULL);  // ...the bytes arrived 100 ms earlier
+        ASSERT_EQ(h.getQueue().back().timestamp, 60900UL);
+        ASSERT_EQ(h.getQueue().back().timestampUs, 60900123UL);
+    }
+    PASS();
+
+    TEST("delay is measured between arrival times");
+    {
+        MIDIHandler h;
+        MockMidiTransport t;
+        h.addTransport(&t);
+        h.begin();
+        g_fakeMillis = 62000;
+        uint8_t cc1[3] = { 0xB0, 1, 10 };
+        uint8_t cc2[3] = { 0xB0, 1, 20 };
+        t.injectAt(cc1, 3, 61000000ULL);
+        t.injectAt(cc2, 3, 61012000ULL);
+        ASSERT_EQ(h.getQueue().back().delay, 12UL);
+    }
+    PASS();
+
+    TEST("chordTimeWindow uses arrival time, not processing time");
+    {
+        MIDIHandler h;
+        MockMidiTransport t;
+        h.addTransport(&t);
+        MIDIHandlerConfig cfg;
+        cfg.chordTimeWindow = 50;
+        h.begin(cfg);
+        uint8_t c4[3] = { 0x90, 60, 100 };
+        uint8_t e4[3] = { 0x90, 64, 100 };
+        uint8_t g4[3] = { 0x90, 67, 100 };
+
+        // Arrived 10 ms apart but drained 300 ms later, in one task(): one chord.
+        g_fakeMillis = 63300;
+        t.injectAt(c4, 3, 63000000ULL);
+        t.injectAt(e4, 3, 63010000ULL);
+        ASSERT_EQ(h.getQueue().record(0).chordIndex, h.getQueue().record(1).chordIndex);
+
+        // Arrived 200 ms apart but drained back to back: a new chord.
+        t.injectAt(g4, 3, 63210000ULL);
+        ASSERT(h.getQueue().record(2).chordIndex != h.getQueue().record(1).chordIndex);
+    }
+    PASS();
+
+    TEST("stamps out of order: delay 0, same chord");
+    {
+        MIDIHandler h;
+        MIDIHandlerConfig cfg;
+        cfg.chordTimeWindow = 50;
+        h.begin(cfg);
+        uint8_t on1[3] = { 0x90, 60, 100 };
+        uint8_t on2[3] = { 0x90, 64, 100 };
+        uint8_t on3[3] = { 0x90, 67, 100 };
+        h.handleMidiMessage(on1, 3, 200000);   // Second transport drained first...
+        h.handleMidiMessage(on2, 3, 190000);   // ...then the earlier arrival
+        ASSERT_EQ(h.getQueue().record(1).delay, 0UL);
+        ASSERT_EQ(h.getQueue().record(0).chordIndex, h.getQueue().record(1).chordIndex);
+        h.handleMidiMessage(on3, 3, 230000);   // Measured from the latest stamp
+        ASSERT_EQ(h.getQueue().record(2).delay, 30UL);
+        ASSERT_EQ(h.getQueue().record(2).chordIndex, h.getQueue().record(0).chordIndex);
+    }
+    PASS();
+
+    TEST("a transport with only a plain callback still works");
+    {
+        MockMidiTransport t;
+        int calls = 0;
+        t.setMidiCallback([](void* ctx, const uint8_t*, size_t) { ++*static_cast<int*>(ctx); }, &calls);
+        uint8_t noteon[3] = { 0x90, 60, 100 };
+        t.injectAt(noteon, 3, 1);
+        t.inject(noteon, 3);
+        ASSERT_EQ(calls, 2);
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Test: UMP received natively (MIDI 2.0 resolution, group)
+// ---------------------------------------------------------------------------
+
+void test_ump_path() {
+    printf("\n[UMP Path]\n");
+
+    MIDIHandler h;
+    h.begin();
+    g_fakeMillis = 70000;
+
+    TEST("MIDI 2.0 NoteOn keeps 16-bit velocity and group");
+    UMPWord64 on = UMPBuilder::noteOn(5, 2, 60, 0x1234);
+    uint32_t pkt[2] = { on.word0, on.word1 };
+    h.handleUMP(pkt, 2);
+    const MIDIEventRecord* ev = &h.getQueue().records().back();
+    ASSERT(ev->statusCode == MIDI_NOTE_ON);
+    ASSERT_EQ(ev->velocity16, 0x1234);
+    ASSERT_EQ(ev->velocity7, MIDI2Scaler::scale16to7(0x1234));
+    ASSERT_EQ(ev->group, 5);
+    ASSERT_EQ(ev->channel0, 2);
+    ASSERT_EQ(ev->noteNumber, 60);
+    ASSERT(h.isNoteActive(3, 60));
+    PASS();
+
+    TEST("MIDI 2.0 NoteOff pairs with its NoteOn");
+    uint16_t onMsg = ev->msgIndex;
+    UMPWord64 off = UMPBuilder::noteOff(5, 2, 60, 0x8000);
+    pkt[0] = off.word0; pkt[1] = off.word1;
+    h.handleUMP(pkt, 2);
+    ev = &h.getQueue().records().back();
+    ASSERT(ev->statusCode == MIDI_NOTE_OFF);
+    ASSERT_EQ(ev->msgIndex, onMsg);
+    ASSERT_EQ(ev->velocity16, 0x8000);
+    ASSERT(!h.isNoteActive(3, 60));
+    PASS();
+
+    TEST("NoteOn with velocity 0 stays a NoteOn (velocity7 = 1)");
+    UMPWord64 soft = UMPBuilder::noteOn(0, 0, 64, 0);
+    pkt[0] = soft.word0; pkt[1] = soft.word1;
+    h.handleUMP(pkt, 2);
+    ev = &h.getQueue().records().back();
+    ASSERT(ev->statusCode == MIDI_NOTE_ON);
+    ASSERT_EQ(ev->velocity16, 0);
+    ASSERT_EQ(ev->velocity7, 1);
+    PASS();
+
+    TEST("CC keeps the 32-bit value");
+    UMPWord64 cc = UMPBuilder::controlChange(1, 0, 74, 0x89ABCDEFu);
+    pkt[0] = cc.word0; pkt[1] = cc.word1;
+    h.handleUMP(pkt, 2);
+    ev = &h.getQueue().records().back();
+    ASSERT(ev->statusCode == MIDI_CONTROL_CHANGE);
+    ASSERT_EQ(ev->noteNumber, 74);
+    ASSERT(ev->value32 == 0x89ABCDEFu);
+    ASSERT_EQ(ev->velocity16, 0x89AB);
+    ASSERT_EQ(ev->velocity7, MIDI2Scaler::scale32to7(0x89ABCDEFu));
+    PASS();
+
+    TEST("Pitch bend keeps the 32-bit value");
+    UMPWord64 pb = UMPBuilder::pitchBend(0, 4, 0x80012345u);
+    pkt[0] = pb.word0; pkt[1] = pb.word1;
+    h.handleUMP(pkt, 2);
+    ev = &h.getQueue().records().back();
+    ASSERT(ev->statusCode == MIDI_PITCH_BEND);
+    ASSERT(ev->pitchBend32 == 0x80012345u);
+    ASSERT_EQ(ev->pitchBend14, MIDI2Scaler::scale32to14(0x80012345u));
+    PASS();
+
+    TEST("MIDI 1.0 in UMP is parsed like bytes, with its group");
+    const uint8_t volume[3] = { 0xB3, 7, 100 };
+    uint32_t m1 = UMPBuilder::fromMIDI1(7, volume, 3).raw;
+    h.handleUMP(&m1, 1);
+    ev = &h.getQueue().records().back();
+    ASSERT(ev->statusCode == MIDI_CONTROL_CHANGE);
+    ASSERT_EQ(ev->group, 7);
+    ASSERT_EQ(ev->channel0, 3);
+    ASSERT_EQ(ev->velocity7, 100);
+    ASSERT(ev->value32 == MIDI2Scaler::scale7to32(100));
+    PASS();
+
+    TEST("Other message types and partial packets are skipped");
+    size_t before = h.getQueue().size();
+    uint32_t mixed[3] = { 0x10F80000u, cc.word0, cc.word1 };   // Clock, then CC
+    h.handleUMP(mixed, 3);
+    ASSERT_EQ((int)h.getQueue().size(), (int)before + 1);
+    h.handleUMP(mixed + 1, 1);                                 // Half a CC
+    ASSERT_EQ((int)h.getQueue().size(), (int)before + 1);
+    PASS();
+
+    TEST("MIDI 1.0 bytes record group 0");
+    auto bytes = feedMidi(h, 0x91, 62, 90);
+    ASSERT_EQ(bytes.group, 0);
+    PASS();
+
+    TEST("addTransport() takes UMP from the transport");
+    {
+        MIDIHandler th;
+        MockMidiTransport t;
+        th.addTransport(&t);
+        th.begin();
+        UMPWord64 n = UMPBuilder::noteOn(3, 9, 36, 0xFFFF);
+        uint32_t batch[4] = { n.word0, n.word1, cc.word0, cc.word1 };
+        t.injectUMP(batch, 4);
+        ASSERT_EQ((int)th.getQueue().size(), 2);
+        ASSERT_EQ(th.getQueue().record(0).velocity16, 0xFFFF);
+        ASSERT_EQ(th.getQueue().record(0).group, 3);
+        ASSERT(th.getQueue().record(1).value32 == 0x89ABCDEFu);
+    }
+    PASS();
+
+    TEST("UMP from a transport keeps its arrival time");
+    {
+        MIDIHandler th;
+        MockMidiTransport t;
+        th.addTransport(&t);
+        th.begin();
+        g_fakeMillis = 71000;                  // task() runs late...
+        UMPWord64 n = UMPBuilder::noteOn(0, 0, 48, 0x8000);
+        uint32_t batch[2] = { n.word0, n.word1 };
+        t.injectUMPAt(batch, 2, 70900123ULL);  // ...the span arrived 100 ms earlier
+        ASSERT_EQ(th.getQueue().back().timestamp, 70900UL);
+        ASSERT_EQ(th.getQueue().back().timestampUs, 70900123UL);
+    }
+    PASS();
+
+    TEST("sketch UMP callbacks and the handler both receive");
+    {
+        struct Sketch {
+            static void onUMP(void* ctx, const uint32_t*, uint8_t) { (*(int*)ctx)++; }
+            static void onBatch(void* ctx, const uint32_t*, size_t) { (*(int*)ctx) += 10; }
+        };
+        int seen = 0;
+        MIDIHandler th;
+        MockMidiTransport t;
+        t.setUMPCallback(Sketch::onUMP, &seen);          // Before addTransport...
+        th.addTransport(&t);
+        t.setUMPBatchCallback(Sketch::onBatch, &seen);   // ...and after
+        th.begin();
+        UMPWord64 n = UMPBuilder::noteOn(0, 0, 50, 0x8000);
+        uint32_t batch[4] = { n.word0, n.word1, cc.word0, cc.word1 };
+        t.injectUMP(batch, 4);
+        ASSERT_EQ(seen, 12);                             // 2 packets + 1 span
+        ASSERT_EQ((int)th.getQueue().size(), 2);
+    }
+    PASS();
 }
 
 void test_v6_blename_not_auto_consumed() {
@@ -855,6 +1935,8 @@ int main() {
     printf("ESP32_Host_MIDI — MIDIHandler test suite (v5.2)\n");
     printf("================================================\n");
 
+    MIDIClock::setSource(fakeClockUs);
+
     test_noteon_fields();
     test_noteoff_fields();
     test_noteon_vel0_is_noteoff();
@@ -866,14 +1948,22 @@ int main() {
     test_all_channels();
     test_velocity_scaling();
     test_queue();
+    test_read_cursor();
+    test_history();
+    test_event_bus();
     test_active_notes();
     test_chord_detection();
+    test_chord_accessors();
+    test_chord_table();
     test_velocity_threshold();
     test_event_metadata();
     test_raw_midi_format();
     test_edge_cases();
+    test_compact_record();
     test_v6_handler_no_transports();
     test_v6_multi_transport_fan_out();
+    test_arrival_time();
+    test_ump_path();
     test_v6_blename_not_auto_consumed();
 
     printf("\n================================================\n");
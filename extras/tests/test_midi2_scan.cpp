@@ -408,6 +408,91 @@ void test_ump_dispatch() {
     PASS();
 }
 
+void test_ump_batch_dispatch() {
+    printf("\n[UMP batch dispatch]\n");
+
+    struct TestTransport : public MIDITransport {
+        void task() override {}
+        bool isConnected() const override { return true; }
+        void fireBatch(const uint32_t* w, size_t c) { dispatchUMPBatch(w, c); }
+        void fireBatchAt(const uint32_t* w, size_t c, uint64_t ts) { dispatchUMPBatch(w, c, ts); }
+        void fireUMP(const uint32_t* w, uint8_t c) { dispatchUMPData(w, c); }
+    };
+
+    static int calls = 0;
+    static size_t words = 0;
+    static uint8_t sizes[8];
+    static uint64_t stamp = 0;
+
+    struct CB {
+        static void onBatch(void*, const uint32_t*, size_t count) { calls++; words += count; }
+        static void onUMP(void*, const uint32_t*, uint8_t count) {
+            if (calls < 8) sizes[calls] = count;
+            calls++;
+        }
+        // ctx counts the calls of each slot separately.
+        static void onUMPCtx(void* ctx, const uint32_t*, uint8_t) { (*(int*)ctx)++; }
+        static void onBatchCtx(void* ctx, const uint32_t*, size_t) { (*(int*)ctx)++; }
+        static void onTimed(void* ctx, const uint32_t*, size_t, uint64_t ts) {
+            (*(int*)ctx)++;
+            stamp = ts;
+        }
+    };
+
+    // MT 0x4 (2w), MT 0x2 (1w), MT 0xF (4w), MT 0x4 (2w)
+    const uint32_t span[9] = { 0x40903C00, 0xFFFF0000, 0x20903C64,
+                               0xF0010000, 0, 0, 0, 0x40803C00, 0 };
+
+    TEST("batch callback: one call for the whole span");
+    TestTransport t;
+    t.setUMPBatchCallback(CB::onBatch, nullptr);
+    calls = 0; words = 0;
+    t.fireBatch(span, 9);
+    ASSERT(calls == 1 && words == 9);
+    PASS();
+
+    TEST("single packet reaches a batch callback too");
+    calls = 0; words = 0;
+    t.fireUMP(span, 2);
+    ASSERT(calls == 1 && words == 2);
+    PASS();
+
+    TEST("per-packet callback: batch split at packet bounds");
+    TestTransport t2;
+    t2.setUMPCallback(CB::onUMP, nullptr);
+    calls = 0;
+    t2.fireBatch(span, 9);
+    ASSERT(calls == 4);
+    ASSERT(sizes[0] == 2 && sizes[1] == 1 && sizes[2] == 4 && sizes[3] == 2);
+    PASS();
+
+    TEST("trailing partial packet is not delivered");
+    calls = 0;
+    t2.fireBatch(span, 8);
+    ASSERT(calls == 3);
+    PASS();
+
+    TEST("per-packet, batch and timed slots all fire");
+    TestTransport t3;
+    int perPacket = 0, batch = 0, timed = 0;
+    t3.setTimedUMPBatchCallback(CB::onTimed, &timed);
+    t3.setUMPCallback(CB::onUMPCtx, &perPacket);
+    t3.setUMPBatchCallback(CB::onBatchCtx, &batch);
+    t3.fireBatchAt(span, 3, 123456);
+    ASSERT(perPacket == 2 && batch == 1 && timed == 1);
+    ASSERT(stamp == 123456);
+    t3.fireUMP(span, 2);
+    ASSERT(perPacket == 3 && batch == 2 && timed == 2);
+    PASS();
+
+    TEST("clearing one UMP slot leaves the others set");
+    t3.setUMPCallback(nullptr, nullptr);
+    perPacket = batch = timed = 0;
+    t3.fireBatchAt(span, 3, 0);
+    ASSERT(perPacket == 0 && batch == 1 && timed == 1);
+    PASS();
+}
+
 // ---------------------------------------------------------------------------
 // Tests — UMP Stream Message building
 // ---------------------------------------------------------------------------
@@ -1083,6 +1168,370 @@ void test_ump_carryover() {
     PASS();
 }
 
+void test_ump_split_in_place() {
+    printf("\n[UMP split in place]\n");
+    using usbmidi::core::UMPCarry;
+    using usbmidi::core::UMPSplit;
+    using usbmidi::core::umpSplit;
+
+    UMPCarry carry = {};
+    UMPSplit split;
+
+    uint32_t a[4] = { 0x20903C64, 0x40903C00, 0xFFFF0000, 0x40803C00 };
+    umpSplit(a, 4, carry, split);
+    TEST("whole packets stay in the transfer buffer");
+    ASSERT(split.joinedWords == 0);
+    ASSERT(split.body == a);
+    ASSERT(split.bodyWords == 3);
+    ASSERT(carry.count == 1 && carry.words[0] == 0x40803C00);
+    PASS();
+
+    uint32_t b[3] = { 0x00000000, 0x20803C00, 0x20903C40 };
+    umpSplit(b, 3, carry, split);
+    TEST("straddling packet joined, rest in place after it");
+    ASSERT(split.joinedWords == 2);
+    ASSERT(split.joined[0] == 0x40803C00 && split.joined[1] == 0x00000000);
+    ASSERT(split.body == b + 1);
+    ASSERT(split.bodyWords == 2);
+    ASSERT(carry.count == 0);
+    PASS();
+
+    // A 4-word stream message arriving one word per transfer
+    UMPCarry c2 = {};
+    uint32_t w0 = 0xF0010000, w1 = 0x11111111, w2 = 0x22222222, w3 = 0x33333333;
+    umpSplit(&w0, 1, c2, split);
+    umpSplit(&w1, 1, c2, split);
+    TEST("packet spread over several short transfers");
+    ASSERT(split.joinedWords == 0 && split.bodyWords == 0);
+    ASSERT(c2.count == 2);
+    umpSplit(&w2, 1, c2, split);
+    umpSplit(&w3, 1, c2, split);
+    ASSERT(split.joinedWords == 4);
+    ASSERT(split.joined[0] == w0 && split.joined[3] == w3);
+    ASSERT(c2.count == 0);
+    PASS();
+
+    TEST("same packets as umpReassemble on a 128-word transfer");
+    UMPCarry c3 = {}, c4 = {};
+    uint32_t big[128], out[usbmidi::core::UMP_OUT_WORDS];
+    for (int i = 0; i < 128; ++i) big[i] = (i % 3 == 0) ? 0x40903C00 : 0x20903C00 + i;
+    uint16_t n = usbmidi::core::umpReassemble(big, 128, c3, out, usbmidi::core::UMP_OUT_WORDS);
+    umpSplit(big, 128, c4, split);
+    ASSERT(split.bodyWords == n);
+    ASSERT(memcmp(split.body, out, n * 4) == 0);
+    ASSERT(c3.count == c4.count);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Tests — IN pipeline sizing and transfer statistics
+// ---------------------------------------------------------------------------
+
+void test_in_pipeline() {
+    printf("\n[IN pipeline — transfer size + statistics]\n");
+    using usbmidi::core::inTransferBytes;
+    using usbmidi::core::TransferMeter;
+    using usbmidi::core::countTransfer;
+
+    TEST("transfer is one max packet: FS 64, HS 512");
+    ASSERT(inTransferBytes(64) == 64);
+    ASSERT(inTransferBytes(512) == 512);
+    ASSERT(inTransferBytes(1024) == usbmidi::core::IN_TRANSFER_MAX);
+    ASSERT(inTransferBytes(0) == 64);
+    PASS();
+
+    TEST("HS transfer fits the UMP reassembly buffer");
+    ASSERT(usbmidi::core::IN_TRANSFER_MAX / 4 <= usbmidi::core::UMP_MAX_TRANSFER_WORDS);
+    PASS();
+
+    // 1000 transfers of 16 bytes over one second, 50 us each to handle.
+    TransferMeter m;
+    uint64_t t = 5000000;
+    for (int i = 0; i < 1000; ++i, t += 1000) countTransfer(m, t, t + 50, 16, true);
+    countTransfer(m, t, t + 50, 16, false);      // Opens the next window
+    TEST("rates cover the last full one-second window");
+    ASSERT(m.transfersPerSec == 1000);
+    ASSERT(m.bytesPerSec == 16000);
+    ASSERT(m.busyPermille == 50);                // 50 ms busy per second = 5.0 %
+    PASS();
+
+    TEST("totals and errors accumulate across windows");
+    ASSERT(m.transfers == 1001);
+    ASSERT(m.errors == 1);
+    ASSERT(m.windowTransfers == 1);
+    PASS();
+
+    TEST("idle gap: next window reports the real rate");
+    t += 3000000;                                 // 3 s of silence
+    countTransfer(m, t, t + 10, 16, true);
+    ASSERT(m.transfersPerSec == 0);               // 2 transfers over 3+ s
+    ASSERT(m.busyPermille == 0);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Tests — virtual cables (embedded jacks per endpoint)
+// ---------------------------------------------------------------------------
+
+// 4x4 interface, MIDI 1.0 only: 4 embedded jacks on each endpoint.
+static const uint8_t DESC_4X4[] = {
+    0x09, 0x02, 0x41, 0x00, 0x02, 0x01, 0x00, 0x80, 0x32,
+    0x09, 0x04, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00,
+    0x09, 0x04, 0x01, 0x00, 0x02, 0x01, 0x03, 0x00, 0x00,
+    0x07, 0x24, 0x01, 0x00, 0x01, 0x25, 0x00,
+    0x09, 0x05, 0x02, 0x02, 0x40, 0x00, 0x00, 0x00, 0x00,
+    0x08, 0x25, 0x01, 0x04, 0x01, 0x02, 0x03, 0x04,   // OUT: jacks 1-4
+    0x09, 0x05, 0x82, 0x02, 0x40, 0x00, 0x00, 0x00, 0x00,
+    0x08, 0x25, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08,   // IN: jacks 5-8
+};
+
+void test_virtual_cables() {
+    printf("\n[Virtual cables — embedded jacks]\n");
+
+    TEST("4x4 interface: 4 IN and 4 OUT cables");
+    AltCandidate best = {};
+    ASSERT(findBestAlt(DESC_4X4, sizeof(DESC_4X4), best));
+    ASSERT(best.inCables == 4);
+    ASSERT(best.outCables == 4);
+    PASS();
+
+    TEST("single-port device: 1 cable each way");
+    AltCandidate one = {};
+    ASSERT(findBestAlt(DESC_MIDI1_ONLY, sizeof(DESC_MIDI1_ONLY), one));
+    ASSERT(one.inCables == 1);
+    ASSERT(one.outCables == 1);
+    PASS();
+
+    TEST("MIDI 2.0 CS endpoint (subtype 0x02) is not a cable count");
+    AltCandidate two = {};
+    ASSERT(findBestAlt(DESC_BOHEMIAN_SENDER, sizeof(DESC_BOHEMIAN_SENDER), two));
+    ASSERT(two.isMIDI2);
+    ASSERT(two.inCables == 0 && two.outCables == 0);
+    PASS();
+
+    TEST("no CS endpoint descriptor: 0 (not declared)");
+    AltCandidate none = {};
+    ASSERT(findBestAlt(DESC_MAXPKT_ZERO, sizeof(DESC_MAXPKT_ZERO), none));
+    ASSERT(none.inCables == 0);
+    PASS();
+
+    TEST("cable count clamps at 16");
+    const uint8_t big[] = { 0x05, 0x25, 0x01, 0x20, 0x01 };
+    ASSERT(usbmidi::core::msEndpointCables(big, sizeof(big)) == 16);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Tests — device slots (several devices behind a hub)
+// ---------------------------------------------------------------------------
+
+void test_device_slots() {
+    printf("\n[Device slots — hub]\n");
+    using usbmidi::core::DeviceSlot;
+    using usbmidi::core::chooseDeviceSlot;
+
+    TEST("filtered slot wins over an earlier unfiltered one");
+    DeviceSlot s[3] = {
+        { true, false, 0,      0      },
+        { true, false, 0x0582, 0      },
+        { true, false, 0x09E8, 0x0029 },
+    };
+    ASSERT(chooseDeviceSlot(s, 3, 0x0582, 0x0157) == 1);
+    ASSERT(chooseDeviceSlot(s, 3, 0x09E8, 0x0029) == 2);
+    PASS();
+
+    TEST("no filter match: first free unfiltered slot");
+    ASSERT(chooseDeviceSlot(s, 3, 0x09E8, 0x0030) == 0);
+    ASSERT(chooseDeviceSlot(s, 3, 0x1234, 0x0001) == 0);
+    PASS();
+
+    TEST("busy and unregistered slots are skipped");
+    DeviceSlot t[3] = {
+        { false, false, 0,      0 },
+        { true,  true,  0,      0 },
+        { true,  false, 0,      0 },
+    };
+    ASSERT(chooseDeviceSlot(t, 3, 0x1234, 0x0001) == 2);
+    PASS();
+
+    TEST("matching filter slot busy: falls back to unfiltered");
+    DeviceSlot u[2] = {
+        { true, true,  0x0582, 0 },
+        { true, false, 0,      0 },
+    };
+    ASSERT(chooseDeviceSlot(u, 2, 0x0582, 0x0157) == 1);
+    PASS();
+
+    TEST("all slots taken or filtered out: -1");
+    DeviceSlot v[2] = {
+        { true, true,  0,      0 },
+        { true, false, 0x0582, 0 },
+    };
+    ASSERT(chooseDeviceSlot(v, 2, 0x1234, 0x0001) == -1);
+    ASSERT(chooseDeviceSlot(v, 0, 0x0582, 0x0001) == -1);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Tests — device profile cache (fast re-claim on replug)
+// ---------------------------------------------------------------------------
+
+static usbmidi::core::DeviceProfile makeProfile(uint16_t vid, uint16_t pid, uint16_t bcd, uint32_t hash) {
+    usbmidi::core::DeviceProfile p = {};
+    p.vid = vid; p.pid = pid; p.bcdDevice = bcd; p.configHash = hash;
+    return p;
+}
+
+static uint32_t fbInfoWord0(uint8_t index, uint8_t dir) {
+    return ((uint32_t)0x0F << 28) | ((uint32_t)0x011 << 16) | (1 << 15) | ((uint32_t)index << 8) | dir;
+}
+
+void test_profile_cache() {
+    printf("\n[Descriptor cache — replug]\n");
+    using namespace usbmidi::core;
+
+    TEST("descriptorHash changes with any byte of the config");
+    uint8_t cfg[sizeof(DESC_4X4)];
+    memcpy(cfg, DESC_4X4, sizeof(cfg));
+    uint32_t h = descriptorHash(cfg, sizeof(cfg));
+    cfg[sizeof(cfg) - 1] ^= 0x01;
+    ASSERT(descriptorHash(cfg, sizeof(cfg)) != h);
+    ASSERT(descriptorHash(DESC_4X4, sizeof(DESC_4X4)) == h);
+    PASS();
+
+    TEST("hit returns the stored alt; bcdDevice is part of the key");
+    ProfileCache<2> c = {};
+    DeviceProfile p = makeProfile(0x0582, 0x0157, 0x0100, h);
+    ASSERT(findBestAlt(DESC_4X4, sizeof(DESC_4X4), p.alt));
+    storeProfile(c, p);
+    DeviceProfile* hit = lookupProfile(c, 0x0582, 0x0157, 0x0100, h);
+    ASSERT(hit && hit->alt.epInAddress == p.alt.epInAddress && hit->alt.inCables == 4);
+    ASSERT(lookupProfile(c, 0x0582, 0x0157, 0x0101, h) == nullptr);
+    PASS();
+
+    TEST("changed configuration descriptor: miss");
+    ASSERT(lookupProfile(c, 0x0582, 0x0157, 0x0100, h ^ 1) == nullptr);
+    PASS();
+
+    TEST("store replaces same key, evicts least recently used");
+    storeProfile(c, makeProfile(0x09E8, 0x0029, 0x0001, 7));
+    DeviceProfile again = makeProfile(0x0582, 0x0157, 0x0100, h);
+    again.discovered = true;
+    storeProfile(c, again);                                  // Same key: in place
+    ASSERT(lookupProfile(c, 0x09E8, 0x0029, 0x0001, 7) != nullptr);
+    storeProfile(c, makeProfile(0x1234, 0x0001, 0x0001, 9)); // Evicts the Roland
+    ASSERT(lookupProfile(c, 0x0582, 0x0157, 0x0100, h) == nullptr);
+    ASSERT(lookupProfile(c, 0x09E8, 0x0029, 0x0001, 7) != nullptr);
+    ASSERT(lookupProfile(c, 0x1234, 0x0001, 0x0001, 9) != nullptr);
+    PASS();
+
+    TEST("forgetProfile drops the entry (claim failed)");
+    forgetProfile(c, 0x1234, 0x0001, 0x0001);
+    ASSERT(lookupProfile(c, 0x1234, 0x0001, 0x0001, 9) == nullptr);
+    PASS();
+
+    TEST("FB Info updates by block index, no duplicates");
+    FunctionBlockInfo fbs[MAX_FUNCTION_BLOCKS] = {};
+    uint8_t n = 0;
+    uint32_t w[4] = { fbInfoWord0(0, 2), 0x00010000, 0, 0 };
+    ASSERT(upsertFunctionBlock(fbs, n, MAX_FUNCTION_BLOCKS, parseFunctionBlockInfo(w)));
+    w[0] = fbInfoWord0(1, 2);
+    ASSERT(upsertFunctionBlock(fbs, n, MAX_FUNCTION_BLOCKS, parseFunctionBlockInfo(w)));
+    w[0] = fbInfoWord0(0, 1); w[1] = 0x02040000;              // Re-announce of block 0
+    ASSERT(upsertFunctionBlock(fbs, n, MAX_FUNCTION_BLOCKS, parseFunctionBlockInfo(w)));
+    ASSERT(n == 2);
+    ASSERT(fbs[0].direction == 1 && fbs[0].firstGroup == 2 && fbs[0].groupLength == 4);
+    PASS();
+
+    TEST("prune drops blocks the endpoint no longer declares");
+    pruneFunctionBlocks(fbs, n, 1);
+    ASSERT(n == 1 && fbs[0].index == 0);
+    PASS();
+
+    TEST("FB table full: new index rejected, known index updated");
+    n = 0;
+    for (uint8_t i = 0; i < MAX_FUNCTION_BLOCKS; i++) {
+        w[0] = fbInfoWord0(i, 2);
+        upsertFunctionBlock(fbs, n, MAX_FUNCTION_BLOCKS, parseFunctionBlockInfo(w));
+    }
+    w[0] = fbInfoWord0(MAX_FUNCTION_BLOCKS, 2);
+    ASSERT(!upsertFunctionBlock(fbs, n, MAX_FUNCTION_BLOCKS, parseFunctionBlockInfo(w)));
+    w[0] = fbInfoWord0(3, 0);
+    ASSERT(upsertFunctionBlock(fbs, n, MAX_FUNCTION_BLOCKS, parseFunctionBlockInfo(w)));
+    ASSERT(n == MAX_FUNCTION_BLOCKS && fbs[3].direction == 0);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Tests — UMP group routing (Function Block / GTB views)
+// ---------------------------------------------------------------------------
+
+void test_group_routing() {
+    printf("\n[UMP group routing]\n");
+    using namespace usbmidi::core;
+
+    FunctionBlockInfo fb[2] = {};
+    fb[0].index = 0; fb[0].firstGroup = 0; fb[0].groupLength = 1;
+    fb[1].index = 1; fb[1].firstGroup = 1; fb[1].groupLength = 2;
+    GTBlock gtb[3] = {};
+    gtb[2].firstGroup = 5; gtb[2].numGroups = 1;
+
+    TEST("block groups from FB Info, GTB as fallback");
+    uint8_t first = 0, n = 0;
+    ASSERT(blockGroups(fb, 2, gtb, 3, 1, first, n) && first == 1 && n == 2);
+    ASSERT(blockGroups(fb, 2, gtb, 3, 2, first, n) && first == 5 && n == 1);
+    ASSERT(!blockGroups(fb, 2, gtb, 3, 3, first, n));
+    ASSERT(!blockGroups(fb, 0, gtb, 0, 0, first, n));
+    PASS();
+
+    TEST("views own their groups, rest follow the main mask");
+    uint8_t f[3] = { 0, 1, 0 }, c[3] = { 1, 2, 0 };
+    GroupRoutes r;
+    buildGroupRoutes(r, f, c, 3, 0x0010);          // Main wants group 4 only
+    ASSERT(r.target[0] == 0 && r.target[1] == 1 && r.target[2] == 1);
+    ASSERT(r.target[4] == UMP_ROUTE_MAIN);
+    ASSERT(r.target[3] == UMP_ROUTE_DROP && r.target[15] == UMP_ROUTE_DROP);
+    PASS();
+
+    TEST("overlapping blocks: the lower view keeps the group");
+    uint8_t f2[2] = { 0, 1 }, c2[2] = { 2, 2 };
+    GroupRoutes r2;
+    buildGroupRoutes(r2, f2, c2, 2, 0xFFFF);
+    ASSERT(r2.target[1] == 0 && r2.target[2] == 1 && r2.target[3] == UMP_ROUTE_MAIN);
+    PASS();
+
+    TEST("span split into runs per target, unsubscribed dropped");
+    const uint32_t span[] = {
+        0x40903C00, 0xFFFF0000,     // Group 0 -> view 0
+        0x20903C40,                 // Group 0 -> view 0
+        0x21903C40,                 // Group 1 -> view 1
+        0x23903C40,                 // Group 3 -> dropped
+        0x00000000,                 // Utility (no group) -> main
+        0x24903C40,                 // Group 4 -> main
+    };
+    uint8_t targets[8]; size_t sizes[8]; int runs = 0;
+    size_t dropped = routeUMP(r, span, sizeof(span) / 4, [&](uint8_t t, const uint32_t*, size_t k) {
+        if (runs < 8) { targets[runs] = t; sizes[runs] = k; }
+        runs++;
+    });
+    ASSERT(dropped == 1);
+    ASSERT(runs == 3);
+    ASSERT(targets[0] == 0 && sizes[0] == 3);
+    ASSERT(targets[1] == 1 && sizes[1] == 1);
+    ASSERT(targets[2] == UMP_ROUTE_MAIN && sizes[2] == 2);
+    PASS();
+
+    TEST("MIDI 1.0 short message as one-word UMP on a group");
+    uint32_t w = 0;
+    const uint8_t noteOn[3] = { 0x91, 60, 100 };
+    ASSERT(buildMIDI1UMP(noteOn, 3, 2, w) && w == 0x22913C64);
+    const uint8_t clock[1] = { 0xF8 };
+    ASSERT(buildMIDI1UMP(clock, 1, 0, w) && w == 0x10F80000);
+    const uint8_t sysex[3] = { 0xF0, 0x7E, 0xF7 };
+    ASSERT(!buildMIDI1UMP(sysex, 3, 0, w));
+    PASS();
+}
+
 // ---------------------------------------------------------------------------
 // Tests — internal stream-message filter
 // ---------------------------------------------------------------------------
@@ -1124,40 +1573,42 @@ void test_send_ump_edges() {
     printf("\n[sendUMPMessage — edge cases]\n");
 
     // We can't test the actual USB submission, but we can test the
-    // parameter validation logic that mirrors the real code.
+    // parameter validation logic that mirrors the real code (the queue
+    // itself is the real pushUMP()).
 
+    static usbmidi::core::UMPQueue<64> q;
     auto validateSend = [](const uint32_t* words, uint8_t count,
-                           bool isReady, bool hasOut, uint16_t maxPkt) -> bool {
+                           bool isReady, bool hasOut) -> bool {
         if (!isReady || !hasOut || count == 0) return false;
-        size_t byteLen = (size_t)count * 4;
-        if (byteLen > maxPkt) return false;
-        return true;
+        return usbmidi::core::pushUMP(q, words, count);
     };
 
-    uint32_t msg[4] = { 0x40903C00, 0xFFFF0000, 0, 0 };
+    uint32_t msg[4] = { 0x40903C00, 0xFFFF0000, 0x40903E00, 0xFFFF0000 };
 
     TEST("count=0 → reject");
-    ASSERT(!validateSend(msg, 0, true, true, 64));
+    ASSERT(!validateSend(msg, 0, true, true));
     PASS();
 
     TEST("not ready → reject");
-    ASSERT(!validateSend(msg, 2, false, true, 64));
+    ASSERT(!validateSend(msg, 2, false, true));
     PASS();
 
     TEST("no OUT transfer → reject");
-    ASSERT(!validateSend(msg, 2, true, false, 64));
+    ASSERT(!validateSend(msg, 2, true, false));
     PASS();
 
-    TEST("payload exceeds maxPacket → reject");
-    ASSERT(!validateSend(msg, 4, true, true, 8));  // 16 bytes > 8
+    TEST("packet cut short → reject, nothing queued");
+    ASSERT(!validateSend(msg, 3, true, true));
+    ASSERT(q.count == 0);
     PASS();
 
-    TEST("exact maxPacket fit → accept");
-    ASSERT(validateSend(msg, 4, true, true, 16));  // 16 bytes == 16
+    TEST("several packets in one call → accept");
+    ASSERT(validateSend(msg, 4, true, true));
+    ASSERT(q.count == 4 && q.queued == 2);
     PASS();
 
     TEST("normal send → accept");
-    ASSERT(validateSend(msg, 2, true, true, 64));  // 8 bytes < 64
+    ASSERT(validateSend(msg, 2, true, true));
     PASS();
 }
 
@@ -1634,6 +2085,7 @@ int main() {
     test_interval();
     test_corrupt_descriptor();
     test_ump_dispatch();
+    test_ump_batch_dispatch();
     test_stream_message_build();
     test_parse_endpoint_info();
     test_parse_stream_config();
@@ -1651,6 +2103,12 @@ int main() {
     test_ump_demux_incomplete();
     test_ump_demux_all_mts();
     test_ump_carryover();
+    test_ump_split_in_place();
+    test_in_pipeline();
+    test_virtual_cables();
+    test_device_slots();
+    test_profile_cache();
+    test_group_routing();
     test_internal_stream_filter();
     test_send_ump_edges();
     test_device_gone_reset();
@@ -46,6 +46,9 @@ struct MockTransport : public MIDITransport {
 
 static bool s_cbFired = false;
 static void testCb(void*, const uint8_t*, size_t) { s_cbFired = true; }
+static uint64_t s_lastTimestampUs = 0;
+static void timedCb(void*, const uint8_t*, size_t, uint64_t us) { s_lastTimestampUs = us; }
+static uint64_t fixedClockUs() { return 42000; }
 
 void test_transport() {
     printf("\n[MIDITransport]\n");
@@ -74,6 +77,33 @@ void test_transport() {
     tt.fireDispatch(midi, 3);
     ASSERT(s_cbFired);
     PASS();
+
+    TEST("timed callback gets the transport's timestamp");
+    struct TimedTransport : public MockTransport {
+        void fireAt(const uint8_t* d, size_t l, uint64_t us) { dispatchMidiData(d, l, us); }
+        void fire(const uint8_t* d, size_t l) { dispatchMidiData(d, l); }
+    } timed;
+    timed.setTimedMidiCallback(timedCb, nullptr);
+    timed.fireAt(midi, 3, 123456789ULL);
+    ASSERT(s_lastTimestampUs == 123456789ULL);
+    PASS();
+
+    TEST("untimed dispatch is stamped with MIDIClock");
+    MIDIClock::setSource(fixedClockUs);
+    timed.fire(midi, 3);
+    ASSERT(s_lastTimestampUs == 42000ULL);
+    ASSERT(MIDIClock::nowMs() == 42);
+    MIDIClock::setSource(nullptr);
+    ASSERT(MIDIClock::nowUs() != 42000ULL);
+    PASS();
+
+    TEST("setMidiCallback replaces the timed callback");
+    s_cbFired = false;
+    s_lastTimestampUs = 0;
+    timed.setMidiCallback(testCb, nullptr);
+    timed.fireAt(midi, 3, 7);
+    ASSERT(s_cbFired && s_lastTimestampUs == 0);
+    PASS();
 }
 
 // ---------------------------------------------------------------------------
@@ -109,6 +139,16 @@ void test_config() {
     cfg.chordTimeWindow = 60;
     ASSERT(cfg.maxEvents == 50 && cfg.chordTimeWindow == 60);
     PASS();
+
+    // MIDIEventHistory.h picks PSRAM from these; it includes only this header.
+    TEST("feature macros come with MIDIHandlerConfig.h");
+#if !defined(ESP32_HOST_MIDI_HAS_PSRAM) || !defined(ESP32_HOST_MIDI_HAS_USB) || \
+    !defined(ESP32_HOST_MIDI_HAS_BLE) || !defined(ESP32_HOST_MIDI_HAS_ETH_MAC)
+    FAIL("feature macro missing");
+#else
+    ASSERT(ESP32_HOST_MIDI_HAS_PSRAM == 0);     // No CONFIG_SPIRAM on the host
+    PASS();
+#endif
 }
 
 // ---------------------------------------------------------------------------
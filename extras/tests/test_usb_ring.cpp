@@ -0,0 +1,428 @@
+// ESP32_Host_MIDI — USB receive ring unit tests
+// Tests the lock-free SPSC EventRing from USBMIDITransportCore.h: packing,
+// in-place batch dequeue, wraparound, overflow accounting, device tags, and a two-thread
+// stress run (producer = USB task, consumer = task()).
+//
+// Build:
+//   g++ -std=c++11 -pthread -Wall -Wextra -Wno-unused-parameter -o extras/tests/test_usb_ring extras/tests/test_usb_ring.cpp
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include "../../src/USBMIDITransportCore.h"
+
+using usbmidi::core::EventRing;
+using usbmidi::core::UMPRing;
+
+// ---------------------------------------------------------------------------
+// Minimal test framework (same as test_native.cpp)
+// ---------------------------------------------------------------------------
+
+static int g_pass = 0;
+static int g_fail = 0;
+
+#define TEST(name) \
+    do { printf("  %-56s", name); } while(0)
+
+#define PASS() \
+    do { printf("OK\n"); ++g_pass; } while(0)
+
+#define FAIL(msg) \
+    do { printf("FAIL  %s\n", msg); ++g_fail; return; } while(0)
+
+#define ASSERT_EQ(a, b) \
+    do { if ((a) != (b)) { \
+        printf("FAIL  expected %lu, got %lu (line %d)\n", (unsigned long)(b), (unsigned long)(a), __LINE__); \
+        ++g_fail; return; } } while(0)
+
+// ---------------------------------------------------------------------------
+// Packing
+// ---------------------------------------------------------------------------
+
+void test_pack_roundtrip() {
+    TEST("packEvent / unpackEvent round-trip, byte 0 low");
+    const uint8_t in[4] = { 0x19, 0x91, 0x3C, 0x64 };
+    uint32_t ev = usbmidi::core::packEvent(in);
+    ASSERT_EQ(ev, 0x643C9119u);
+    uint8_t out[4];
+    usbmidi::core::unpackEvent(ev, out);
+    if (memcmp(in, out, 4) != 0) FAIL("bytes differ");
+    PASS();
+}
+
+void test_expand_stamp() {
+    TEST("expandStamp rebuilds 64-bit time across 2^32 wrap");
+    uint64_t now = 0x100000010ull;                 // Just past a 32-bit wrap
+    ASSERT_EQ(usbmidi::core::expandStamp(0xFFFFFFF0u, now), 0xFFFFFFF0ull);
+    ASSERT_EQ(usbmidi::core::expandStamp(0x00000008u, now), 0x100000008ull);
+    ASSERT_EQ(usbmidi::core::expandStamp((uint32_t)now, now), now);
+    PASS();
+
+    TEST("expandStamp: stamp newer than now counts as now");
+    ASSERT_EQ(usbmidi::core::expandStamp(1005, 1000), 1000ull);
+    ASSERT_EQ(usbmidi::core::expandStamp(0x00000004u, 0xFFFFFFFEull), 0xFFFFFFFEull);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Single-threaded behaviour
+// ---------------------------------------------------------------------------
+
+void test_push_packets_skips_padding() {
+    TEST("pushPackets queues events, skips zero padding");
+    EventRing<16> ring;
+    const uint8_t transfer[16] = {
+        0x09, 0x90, 0x3C, 0x64,
+        0x00, 0x00, 0x00, 0x00,       // Padding
+        0x08, 0x80, 0x3C, 0x00,
+        0x00, 0x00, 0x00, 0x00,
+    };
+    ASSERT_EQ(ring.pushPackets(transfer, sizeof(transfer), 1234), 2u);
+    ASSERT_EQ(ring.size(), 2u);
+    const uint32_t* ev;
+    const uint32_t* st;
+    ASSERT_EQ(ring.peek(ev, st), 2u);
+    ASSERT_EQ(ev[0], usbmidi::core::packEvent(transfer));
+    ASSERT_EQ(ev[1], usbmidi::core::packEvent(transfer + 8));
+    ASSERT_EQ(st[1], 1234u);
+    PASS();
+}
+
+void test_peek_is_in_place() {
+    TEST("peek points into the ring, release frees slots");
+    EventRing<8> ring;
+    for (uint32_t i = 1; i <= 5; i++) ring.push(i, i * 10);
+    const uint32_t* ev;
+    const uint32_t* st;
+    size_t n = ring.peek(ev, st);
+    ASSERT_EQ(n, 5u);
+    const uint32_t* again;
+    ring.peek(again, st);
+    if (again != ev) FAIL("peek copied");
+    ring.release(3);
+    ASSERT_EQ(ring.size(), 2u);
+    ASSERT_EQ(ring.peek(ev, st), 2u);
+    ASSERT_EQ(ev[0], 4u);
+    ASSERT_EQ(st[0], 40u);
+    PASS();
+}
+
+void test_wrap_splits_span() {
+    TEST("wrapped ring drains in two contiguous spans");
+    EventRing<8> ring;
+    for (uint32_t i = 0; i < 6; i++) ring.push(i, 0);
+    ring.release(6);                               // Head and tail at slot 6
+    for (uint32_t i = 100; i < 105; i++) ring.push(i, 0);
+    const uint32_t* ev;
+    const uint32_t* st;
+    ASSERT_EQ(ring.peek(ev, st), 2u);              // Slots 6, 7
+    ASSERT_EQ(ev[1], 101u);
+    ring.release(2);
+    ASSERT_EQ(ring.peek(ev, st), 3u);              // Slots 0..2
+    ASSERT_EQ(ev[0], 102u);
+    PASS();
+}
+
+void test_drain_calls_per_span() {
+    TEST("drain hands every event over, in order");
+    EventRing<8> ring;
+    for (uint32_t i = 0; i < 5; i++) ring.push(i, 0);
+    ring.release(5);
+    for (uint32_t i = 0; i < 7; i++) ring.push(i, 0);
+    uint32_t expect = 0;
+    int calls = 0;
+    bool ordered = true;
+    size_t total = ring.drain([&](const uint32_t* ev, const uint32_t*, size_t n) {
+        calls++;
+        for (size_t i = 0; i < n; i++) if (ev[i] != expect++) ordered = false;
+    });
+    ASSERT_EQ(total, 7u);
+    ASSERT_EQ(calls, 2);
+    if (!ordered) FAIL("out of order");
+    ASSERT_EQ(ring.size(), 0u);
+    PASS();
+}
+
+void test_full_counts_dropped() {
+    TEST("full ring rejects and counts dropped events");
+    EventRing<4> ring;
+    for (uint32_t i = 0; i < 4; i++) {
+        if (!ring.push(i, 0)) FAIL("push rejected before full");
+    }
+    if (ring.push(9, 0)) FAIL("push accepted when full");
+    const uint8_t transfer[12] = { 0x09, 0x90, 1, 1, 0x09, 0x90, 2, 2, 0x09, 0x90, 3, 3 };
+    ASSERT_EQ(ring.pushPackets(transfer, sizeof(transfer), 0), 0u);
+    ASSERT_EQ(ring.dropped(), 4u);
+    ring.release(2);
+    ASSERT_EQ(ring.pushPackets(transfer, sizeof(transfer), 0), 2u);
+    ASSERT_EQ(ring.dropped(), 5u);
+    ASSERT_EQ(ring.size(), 4u);
+    PASS();
+}
+
+void test_drain_tagged() {
+    TEST("drainTagged keeps each event's device tag");
+    EventRing<8> ring;
+    for (uint32_t i = 0; i < 6; i++) ring.push(i, 0);
+    ring.release(6);
+    const uint8_t transfer[8] = { 0x09, 0x90, 1, 1, 0x08, 0x80, 1, 0 };
+    ring.pushPackets(transfer, sizeof(transfer), 0, 2);   // Slots 6, 7
+    ring.push(0x19, 0, 3);                                // Wraps to slot 0
+    ASSERT_EQ(ring.tagAt(0), 2u);
+    ASSERT_EQ(ring.tagAt(2), 3u);
+    uint8_t seen[3] = {};
+    size_t k = 0;
+    ring.drainTagged([&](const uint32_t*, const uint32_t*, const uint8_t* tags, size_t n) {
+        for (size_t i = 0; i < n && k < 3; i++) seen[k++] = tags[i];
+    });
+    ASSERT_EQ(k, 3u);
+    ASSERT_EQ(seen[0], 2u);
+    ASSERT_EQ(seen[1], 2u);
+    ASSERT_EQ(seen[2], 3u);
+    PASS();
+}
+
+void test_footprint() {
+    TEST("256-event ring: 9 bytes per event (with device tag)");
+    if (sizeof(EventRing<256>) > 256 * 9 + 16) FAIL("ring larger than 9 bytes per event");
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// UMP ring (MIDI 2.0): whole packets in, spans of whole packets out
+// ---------------------------------------------------------------------------
+
+void test_ump_spans_in_place() {
+    TEST("UMP drain: one span of whole packets, in place");
+    UMPRing<16> ring;
+    const uint32_t in[7] = { 0x40903C00, 0xFFFF0000, 0x20903C64, 0xF0010000, 1, 2, 3 };
+    ASSERT_EQ(ring.pushPackets(in, 7, 0), 7u);
+    int calls = 0;
+    size_t got = 0;
+    bool same = true;
+    ring.drain([&](const uint32_t* w, size_t n, uint32_t) {
+        calls++;
+        for (size_t i = 0; i < n; i++) if (w[i] != in[got + i]) same = false;
+        got += n;
+    });
+    ASSERT_EQ(calls, 1);
+    ASSERT_EQ(got, 7u);
+    if (!same) FAIL("words differ");
+    PASS();
+}
+
+void test_ump_wrapped_packet() {
+    TEST("UMP packet across the ring end is copied whole");
+    UMPRing<8> ring;
+    const uint32_t pad[6] = { 0x20000001, 0x20000002, 0x20000003, 0x20000004, 0x20000005, 0x20000006 };
+    ring.pushPackets(pad, 6, 0);
+    ring.drain([](const uint32_t*, size_t, uint32_t) {});
+    const uint32_t in[5] = { 0x40903C00, 0xFFFF0000, 0x40803C00, 0x12340000, 0x20903C64 };
+    ASSERT_EQ(ring.pushPackets(in, 5, 0), 5u); // Slots 6, 7 | 0, 1, 2
+    size_t sizes[4] = {};
+    uint32_t first[4] = {};
+    int calls = 0;
+    ring.drain([&](const uint32_t* w, size_t n, uint32_t) {
+        if (calls < 4) { sizes[calls] = n; first[calls] = w[0]; }
+        calls++;
+    });
+    ASSERT_EQ(calls, 2);
+    ASSERT_EQ(sizes[0], 2u);                   // Slots 6-7 hold one whole packet
+    ASSERT_EQ(sizes[1], 3u);
+    ASSERT_EQ(first[1], 0x40803C00u);
+
+    // Now a 2-word packet that starts in the last slot.
+    ring.pushPackets(pad, 4, 0);               // Slots 3..6
+    ring.drain([](const uint32_t*, size_t, uint32_t) {});
+    ASSERT_EQ(ring.pushPackets(in + 2, 3, 77), 3u); // Slots 7 | 0, 1
+    calls = 0;
+    uint32_t joined[2] = {};
+    uint32_t joinedStamp = 0;
+    ring.drain([&](const uint32_t* w, size_t n, uint32_t stampUs) {
+        if (calls == 0 && n == 2) { joined[0] = w[0]; joined[1] = w[1]; joinedStamp = stampUs; }
+        calls++;
+    });
+    ASSERT_EQ(calls, 2);
+    ASSERT_EQ(joined[0], 0x40803C00u);
+    ASSERT_EQ(joined[1], 0x12340000u);
+    ASSERT_EQ(joinedStamp, 77u);
+    PASS();
+}
+
+void test_ump_spans_split_by_stamp() {
+    TEST("UMP drain: one span per arrival stamp");
+    UMPRing<16> ring;
+    const uint32_t a[3] = { 0x40903C00, 0xFFFF0000, 0x20903C64 };
+    const uint32_t b[2] = { 0x20803C00, 0x20B00740 };
+    ring.pushPackets(a, 3, 1000);
+    ring.pushPackets(b, 2, 1500);
+    ring.pushPackets(a + 2, 1, 1500);
+    size_t sizes[4] = {};
+    uint32_t stamps[4] = {};
+    int calls = 0;
+    ring.drain([&](const uint32_t*, size_t n, uint32_t stampUs) {
+        if (calls < 4) { sizes[calls] = n; stamps[calls] = stampUs; }
+        calls++;
+    });
+    ASSERT_EQ(calls, 2);                       // Runs with equal stamps merge
+    ASSERT_EQ(sizes[0], 3u);
+    ASSERT_EQ(stamps[0], 1000u);
+    ASSERT_EQ(sizes[1], 3u);
+    ASSERT_EQ(stamps[1], 1500u);
+    PASS();
+}
+
+void test_ump_full_drops_packets() {
+    TEST("full UMP ring keeps whole packets, counts the rest");
+    UMPRing<4> ring;
+    const uint32_t in[5] = { 0x20903C64, 0x40903C00, 0xFFFF0000, 0x40803C00, 0 };
+    ASSERT_EQ(ring.pushPackets(in, 5, 0), 3u); // 1w + 2w; next 2w does not fit
+    ASSERT_EQ(ring.dropped(), 1u);
+    ASSERT_EQ(ring.size(), 3u);
+    PASS();
+}
+
+void test_ump_stress_two_threads() {
+    TEST("stress: 1M UMP packets across two threads, in order");
+    static UMPRing<64> ring;
+    const uint32_t TOTAL = 1000000;
+
+    // Packet k: 1, 2 or 4 words (MT 0x2, 0x4, 0x5), k in the low 24 bits of word 0.
+    std::thread producer([&]() {
+        uint32_t k = 0;
+        uint32_t transfer[16];
+        while (k < TOTAL) {
+            uint32_t first = k;                // Stamp: first packet of the transfer
+            size_t n = 0;
+            while (k < TOTAL) {
+                static const uint32_t MT[3] = { 0x2, 0x4, 0x5 };
+                static const size_t WORDS[3] = { 1, 2, 4 };
+                size_t t = k % 3;
+                if (n + WORDS[t] > 16) break;
+                transfer[n] = (MT[t] << 28) | (k & 0xFFFFFF);
+                for (size_t j = 1; j < WORDS[t]; j++) transfer[n + j] = k;
+                n += WORDS[t];
+                k++;
+            }
+            size_t done = 0;
+            while (done < n) {
+                size_t q = ring.pushPackets(transfer + done, n - done, first);
+                if (q == 0) std::this_thread::yield();
+                done += q;
+            }
+        }
+    });
+
+    uint32_t expect = 0;
+    bool ordered = true;
+    while (expect < TOTAL) {
+        size_t n = ring.drain([&](const uint32_t* w, size_t count, uint32_t stampUs) {
+            if (stampUs > expect) ordered = false;
+            size_t i = 0;
+            while (i < count) {
+                size_t pw = usbmidi::core::umpWordCount(w[i] >> 28);
+                if ((w[i] & 0xFFFFFF) != (expect & 0xFFFFFF)) ordered = false;
+                if (pw > 1 && w[i + pw - 1] != expect) ordered = false;
+                expect++;
+                i += pw;
+            }
+        });
+        if (n == 0) std::this_thread::yield();
+    }
+    producer.join();
+
+    if (!ordered) FAIL("packet lost, torn or reordered");
+    ASSERT_EQ(ring.size(), 0u);
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Two-thread stress: producer pushes a numbered sequence in transfer-sized
+// batches, consumer checks every event arrives once and in order.
+// ---------------------------------------------------------------------------
+
+void test_stress_two_threads() {
+    TEST("stress: 2M events across two threads, in order");
+    static EventRing<64> ring;
+    const uint32_t TOTAL = 2000000;
+
+    std::thread producer([&]() {
+        uint32_t next = 1;
+        uint8_t transfer[64];
+        while (next <= TOTAL) {
+            // Up to 16 events per "transfer", as a full-speed endpoint delivers.
+            size_t n = 1 + (next % 16);
+            size_t bytes = 0;
+            for (size_t i = 0; i < n && next + i <= TOTAL; i++, bytes += 4) {
+                uint32_t v = (next + (uint32_t)i) | 0x01;   // Byte 0 never zero
+                transfer[bytes + 0] = (uint8_t)v;
+                transfer[bytes + 1] = (uint8_t)(v >> 8);
+                transfer[bytes + 2] = (uint8_t)(v >> 16);
+                transfer[bytes + 3] = (uint8_t)(v >> 24);
+            }
+            // Retry only the events that did not fit, like a resubmit would.
+            size_t done = 0;
+            while (done < bytes) {
+                size_t room = ring.capacity() - ring.size();
+                size_t chunk = (bytes - done) / 4;
+                if (chunk > room) chunk = room;
+                if (chunk == 0) { std::this_thread::yield(); continue; }
+                done += 4 * ring.pushPackets(transfer + done, chunk * 4, next);
+            }
+            next += (uint32_t)(bytes / 4);
+        }
+    });
+
+    uint32_t expect = 1;
+    uint32_t received = 0;
+    bool ordered = true;
+    while (received < TOTAL) {
+        size_t n = ring.drain([&](const uint32_t* ev, const uint32_t*, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                if (ev[i] != (expect | 0x01)) ordered = false;
+                expect++;
+            }
+        });
+        received += (uint32_t)n;
+        if (n == 0) std::this_thread::yield();
+    }
+    producer.join();
+
+    if (!ordered) FAIL("event lost, duplicated or reordered");
+    ASSERT_EQ(received, TOTAL);
+    ASSERT_EQ(ring.dropped(), 0u);
+    ASSERT_EQ(ring.size(), 0u);
+    PASS();
+}
+
+int main() {
+    printf("USB receive ring — test suite\n");
+    printf("=============================\n");
+
+    printf("\n[Packing]\n");
+    test_pack_roundtrip();
+    test_expand_stamp();
+
+    printf("\n[Single thread]\n");
+    test_push_packets_skips_padding();
+    test_peek_is_in_place();
+    test_wrap_splits_span();
+    test_drain_calls_per_span();
+    test_full_counts_dropped();
+    test_drain_tagged();
+    test_footprint();
+
+    printf("\n[UMP ring]\n");
+    test_ump_spans_in_place();
+    test_ump_wrapped_packet();
+    test_ump_spans_split_by_stamp();
+    test_ump_full_drops_packets();
+
+    printf("\n[Two threads]\n");
+    test_stress_two_threads();
+    test_ump_stress_two_threads();
+
+    printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
+    return g_fail ? 1 : 0;
+}
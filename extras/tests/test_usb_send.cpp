@@ -1,5 +1,7 @@
 // ESP32_Host_MIDI — USB MIDI Send unit tests
-// Tests CIN calculation and packet formatting for all MIDI message types.
+// Tests CIN calculation and packet formatting for all MIDI message types,
+// the outbound event queue that batches packets into OUT transfers, and the
+// outbound UMP queue used on MIDI 2.0 devices.
 // USB-MIDI 1.0 spec Table 4-1.
 //
 // Build:
@@ -8,6 +10,7 @@
 #include <cstdio>
 #include <cstdint>
 #include <cstring>
+#include "../../src/USBMIDITransportCore.h"
 
 // ---------------------------------------------------------------------------
 // Minimal test framework (same as test_native.cpp)
@@ -31,43 +34,16 @@ static int g_fail = 0;
         ++g_fail; return; } } while(0)
 
 // ---------------------------------------------------------------------------
-// Extract _midiStatusToCIN from USBConnection.cpp (copy for testability)
+// Packet building lives in the transport core (USBMIDITransportCore.h)
 // ---------------------------------------------------------------------------
 
 static uint8_t _midiStatusToCIN(uint8_t status) {
-    if (status >= 0x80 && status <= 0xEF) {
-        return status >> 4;
-    }
-    switch (status) {
-        case 0xF0: return 0x04; // SysEx Start
-        case 0xF1: return 0x02; // MTC Quarter Frame (2 bytes)
-        case 0xF2: return 0x03; // Song Position Pointer (3 bytes)
-        case 0xF3: return 0x02; // Song Select (2 bytes)
-        case 0xF6: return 0x05; // Tune Request (1 byte)
-        case 0xF7: return 0x05; // SysEx End (single-byte)
-        case 0xF8: return 0x0F; // Timing Clock
-        case 0xFA: return 0x0F; // Start
-        case 0xFB: return 0x0F; // Continue
-        case 0xFC: return 0x0F; // Stop
-        case 0xFE: return 0x0F; // Active Sensing
-        case 0xFF: return 0x0F; // System Reset
-        default:   return 0;    // Undefined
-    }
+    return usbmidi::core::statusToCIN(status);
 }
 
-// Builds a 4-byte USB-MIDI packet (same logic as USBConnection::sendMidiMessage)
+// Builds a 4-byte USB-MIDI packet on cable 0 (as USBConnection::sendMidiMessage)
 static bool buildPacket(const uint8_t* data, size_t length, uint8_t* packet) {
-    if (length == 0) return false;
-    uint8_t cin = _midiStatusToCIN(data[0]);
-    if (cin == 0) return false;
-    packet[0] = cin;  // cable 0 | CIN
-    packet[1] = 0;
-    packet[2] = 0;
-    packet[3] = 0;
-    for (size_t i = 0; i < length && i < 3; i++) {
-        packet[i + 1] = data[i];
-    }
-    return true;
+    return usbmidi::core::buildEventPacket(data, length, 0, packet);
 }
 
 // ---------------------------------------------------------------------------
@@ -444,6 +420,435 @@ void test_packet_all_channels_note_on() {
 // Main
 // ---------------------------------------------------------------------------
 
+// ---------------------------------------------------------------------------
+// Virtual cables
+// ---------------------------------------------------------------------------
+
+void test_packet_cable_number() {
+    TEST("Cable 3 NoteOn -> header 0x39");
+    uint8_t msg[3] = { 0x90, 0x3C, 0x64 };
+    uint8_t pkt[4];
+    if (!usbmidi::core::buildEventPacket(msg, 3, 3, pkt)) FAIL("rejected");
+    ASSERT_EQ(pkt[0], 0x39);
+    ASSERT_EQ(pkt[1], 0x90);
+    PASS();
+}
+
+void test_packet_cable_15() {
+    TEST("Cable 15 Timing Clock -> header 0xFF");
+    uint8_t msg[1] = { 0xF8 };
+    uint8_t pkt[4];
+    if (!usbmidi::core::buildEventPacket(msg, 1, 15, pkt)) FAIL("rejected");
+    ASSERT_EQ(pkt[0], 0xFF);
+    PASS();
+}
+
+void test_event_cable_roundtrip() {
+    TEST("eventCable reads the cable back from the header");
+    for (uint8_t cable = 0; cable < 16; cable++) {
+        uint8_t msg[2] = { 0xC5, 0x10 };
+        uint8_t pkt[4];
+        usbmidi::core::buildEventPacket(msg, 2, cable, pkt);
+        ASSERT_EQ(usbmidi::core::eventCable(pkt[0]), cable);
+        ASSERT_EQ(pkt[0] & 0x0F, 0x0C);
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Outbound event queue
+// ---------------------------------------------------------------------------
+
+static void makeNoteOn(uint8_t note, uint8_t out[4]) {
+    uint8_t msg[3] = { 0x90, note, 100 };
+    usbmidi::core::buildEventPacket(msg, 3, 0, out);
+}
+
+void test_queue_packs_16_per_64_bytes() {
+    TEST("Queue: 40 events fill 64-byte transfers 16/16/8");
+    usbmidi::core::EventQueue<64> q;
+    for (uint8_t n = 0; n < 40; n++) {
+        uint8_t ev[1][4];
+        makeNoteOn(n, ev[0]);
+        if (!usbmidi::core::pushEvents(q, ev, 1)) FAIL("push rejected");
+    }
+    uint8_t buf[64];
+    ASSERT_EQ(usbmidi::core::fillTransfer(q, buf, 64), 64u);
+    ASSERT_EQ(buf[2], 0);        // First event's note
+    ASSERT_EQ(buf[60 + 2], 15);  // Sixteenth
+    ASSERT_EQ(usbmidi::core::fillTransfer(q, buf, 64), 64u);
+    ASSERT_EQ(buf[2], 16);
+    ASSERT_EQ(usbmidi::core::fillTransfer(q, buf, 64), 32u);
+    ASSERT_EQ(buf[28 + 2], 39);
+    ASSERT_EQ(usbmidi::core::fillTransfer(q, buf, 64), 0u);
+    ASSERT_EQ(q.queued, 40u);
+    PASS();
+}
+
+void test_queue_respects_max_packet() {
+    TEST("Queue: fill limited to maxBytes / 4 events");
+    usbmidi::core::EventQueue<16> q;
+    uint8_t ev[5][4];
+    for (uint8_t n = 0; n < 5; n++) makeNoteOn(n, ev[n]);
+    usbmidi::core::pushEvents(q, ev, 5);
+    uint8_t buf[64];
+    ASSERT_EQ(usbmidi::core::fillTransfer(q, buf, 10), 8u);   // Whole events only
+    ASSERT_EQ(q.count, 3u);
+    PASS();
+}
+
+void test_queue_all_or_nothing() {
+    TEST("Queue: push is all-or-nothing, counts dropped");
+    usbmidi::core::EventQueue<8> q;
+    uint8_t ev[6][4];
+    for (uint8_t n = 0; n < 6; n++) makeNoteOn(n, ev[n]);
+    if (!usbmidi::core::pushEvents(q, ev, 6)) FAIL("first push rejected");
+    if (usbmidi::core::pushEvents(q, ev, 3)) FAIL("overflowing push accepted");
+    ASSERT_EQ(q.count, 6u);
+    ASSERT_EQ(q.dropped, 3u);
+    if (!usbmidi::core::pushEvents(q, ev, 2)) FAIL("fitting push rejected");
+    ASSERT_EQ(q.count, 8u);
+    ASSERT_EQ(q.queued, 8u);
+    PASS();
+}
+
+void test_queue_wraparound() {
+    TEST("Queue: order kept across ring wraparound");
+    usbmidi::core::EventQueue<8> q;
+    uint8_t buf[64];
+    uint8_t next = 0, expect = 0;
+    for (int round = 0; round < 10; round++) {
+        uint8_t ev[5][4];
+        for (int i = 0; i < 5; i++) makeNoteOn(next++, ev[i]);
+        if (!usbmidi::core::pushEvents(q, ev, 5)) FAIL("push rejected");
+        size_t bytes = usbmidi::core::fillTransfer(q, buf, sizeof(buf));
+        ASSERT_EQ(bytes, 20u);
+        for (size_t i = 0; i < bytes / 4; i++) {
+            if (buf[i * 4] != 0x09 || buf[i * 4 + 2] != expect++) FAIL("event out of order");
+        }
+    }
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// SysEx segmentation (CIN 0x4 / 0x5 / 0x6 / 0x7)
+// ---------------------------------------------------------------------------
+
+// Segments a whole SysEx into out[]; returns the event count.
+static size_t segment(const uint8_t* data, size_t length, uint8_t cable, uint8_t (*out)[4], size_t max) {
+    usbmidi::core::SysExSegmenter seg;
+    usbmidi::core::beginSysEx(seg, data, length, cable);
+    size_t n = 0;
+    while (n < max && usbmidi::core::nextSysExEvent(seg, out[n])) n++;
+    return n;
+}
+
+void test_sysex_two_bytes() {
+    TEST("SysEx F0 F7 -> one CIN 0x6 event");
+    const uint8_t msg[] = { 0xF0, 0xF7 };
+    uint8_t ev[4][4];
+    ASSERT_EQ(segment(msg, sizeof(msg), 0, ev, 4), 1u);
+    ASSERT_EQ(ev[0][0], 0x06); ASSERT_EQ(ev[0][1], 0xF0);
+    ASSERT_EQ(ev[0][2], 0xF7); ASSERT_EQ(ev[0][3], 0x00);
+    PASS();
+}
+
+void test_sysex_three_bytes() {
+    TEST("SysEx F0 7E F7 -> one CIN 0x7 event");
+    const uint8_t msg[] = { 0xF0, 0x7E, 0xF7 };
+    uint8_t ev[4][4];
+    ASSERT_EQ(segment(msg, sizeof(msg), 0, ev, 4), 1u);
+    ASSERT_EQ(ev[0][0], 0x07); ASSERT_EQ(ev[0][3], 0xF7);
+    PASS();
+}
+
+void test_sysex_ends_with_one_byte() {
+    TEST("SysEx 4 bytes -> CIN 0x4 + CIN 0x5");
+    const uint8_t msg[] = { 0xF0, 0x01, 0x02, 0xF7 };
+    uint8_t ev[4][4];
+    ASSERT_EQ(segment(msg, sizeof(msg), 0, ev, 4), 2u);
+    ASSERT_EQ(ev[0][0], 0x04); ASSERT_EQ(ev[0][1], 0xF0); ASSERT_EQ(ev[0][3], 0x02);
+    ASSERT_EQ(ev[1][0], 0x05); ASSERT_EQ(ev[1][1], 0xF7);
+    ASSERT_EQ(ev[1][2], 0x00); ASSERT_EQ(ev[1][3], 0x00);
+    PASS();
+}
+
+void test_sysex_ends_with_two_bytes() {
+    TEST("SysEx 5 bytes -> CIN 0x4 + CIN 0x6");
+    const uint8_t msg[] = { 0xF0, 0x01, 0x02, 0x03, 0xF7 };
+    uint8_t ev[4][4];
+    ASSERT_EQ(segment(msg, sizeof(msg), 0, ev, 4), 2u);
+    ASSERT_EQ(ev[1][0], 0x06); ASSERT_EQ(ev[1][1], 0x03);
+    ASSERT_EQ(ev[1][2], 0xF7); ASSERT_EQ(ev[1][3], 0x00);
+    PASS();
+}
+
+void test_sysex_ends_with_three_bytes() {
+    TEST("SysEx 6 bytes -> CIN 0x4 + CIN 0x7");
+    const uint8_t msg[] = { 0xF0, 0x01, 0x02, 0x03, 0x04, 0xF7 };
+    uint8_t ev[4][4];
+    ASSERT_EQ(segment(msg, sizeof(msg), 0, ev, 4), 2u);
+    ASSERT_EQ(ev[1][0], 0x07); ASSERT_EQ(ev[1][1], 0x03);
+    ASSERT_EQ(ev[1][2], 0x04); ASSERT_EQ(ev[1][3], 0xF7);
+    PASS();
+}
+
+void test_sysex_long_roundtrip() {
+    TEST("SysEx 512 bytes: 171 events, bytes round-trip");
+    uint8_t msg[512];
+    msg[0] = 0xF0;
+    for (size_t i = 1; i < 511; i++) msg[i] = (uint8_t)(i & 0x7F);
+    msg[511] = 0xF7;
+    static uint8_t ev[200][4];
+    size_t n = segment(msg, sizeof(msg), 0, ev, 200);
+    ASSERT_EQ(n, usbmidi::core::sysExEventCount(sizeof(msg)));
+    ASSERT_EQ(n, 171u);
+    uint8_t back[520];
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t cin = ev[i][0] & 0x0F;
+        size_t count = (cin == 0x4) ? 3 : (size_t)(cin - 0x4);
+        if (cin == 0x4 && i == n - 1) FAIL("last event not an end CIN");
+        if (cin != 0x4 && i != n - 1) FAIL("end CIN before the last event");
+        for (size_t k = 0; k < count; k++) back[len++] = ev[i][1 + k];
+    }
+    ASSERT_EQ(len, sizeof(msg));
+    if (memcmp(back, msg, sizeof(msg)) != 0) FAIL("payload mismatch");
+    PASS();
+}
+
+void test_sysex_cable_number() {
+    TEST("SysEx events carry the cable number");
+    const uint8_t msg[] = { 0xF0, 0x01, 0x02, 0x03, 0xF7 };
+    uint8_t ev[4][4];
+    segment(msg, sizeof(msg), 3, ev, 4);
+    ASSERT_EQ(ev[0][0], 0x34);
+    ASSERT_EQ(ev[1][0], 0x36);
+    PASS();
+}
+
+void test_sysex_rejects_malformed() {
+    TEST("isCompleteSysEx rejects malformed messages");
+    const uint8_t noEnd[]    = { 0xF0, 0x01, 0x02 };
+    const uint8_t noStart[]  = { 0x01, 0x02, 0xF7 };
+    const uint8_t inner[]    = { 0xF0, 0x01, 0x90, 0xF7 };
+    const uint8_t ok[]       = { 0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7 };
+    if (usbmidi::core::isCompleteSysEx(noEnd, sizeof(noEnd))) FAIL("missing F7 accepted");
+    if (usbmidi::core::isCompleteSysEx(noStart, sizeof(noStart))) FAIL("missing F0 accepted");
+    if (usbmidi::core::isCompleteSysEx(inner, sizeof(inner))) FAIL("inner status accepted");
+    if (usbmidi::core::isCompleteSysEx(ok, 1)) FAIL("lone F0 accepted");
+    if (!usbmidi::core::isCompleteSysEx(ok, sizeof(ok))) FAIL("identity request rejected");
+    PASS();
+}
+
+void test_sysex_batches_into_transfer() {
+    TEST("SysEx 48 bytes fills one 64-byte transfer");
+    uint8_t msg[48];
+    msg[0] = 0xF0;
+    for (size_t i = 1; i < 47; i++) msg[i] = 0x10;
+    msg[47] = 0xF7;
+    usbmidi::core::EventQueue<64> q;
+    usbmidi::core::SysExSegmenter seg;
+    usbmidi::core::beginSysEx(seg, msg, sizeof(msg), 0);
+    ASSERT_EQ(usbmidi::core::pushSysEx(q, seg), 16u);
+    if (!usbmidi::core::sysExDone(seg)) FAIL("segmenter not done");
+    uint8_t buf[64];
+    ASSERT_EQ(usbmidi::core::fillTransfer(q, buf, 64), 64u);
+    ASSERT_EQ(buf[0], 0x04);
+    ASSERT_EQ(buf[60], 0x07);
+    ASSERT_EQ(buf[63], 0xF7);
+    PASS();
+}
+
+void test_sysex_streams_through_small_queue() {
+    TEST("SysEx larger than the queue streams in pieces");
+    uint8_t msg[100];
+    msg[0] = 0xF0;
+    for (size_t i = 1; i < 99; i++) msg[i] = (uint8_t)i;
+    msg[99] = 0xF7;
+    usbmidi::core::EventQueue<8> q;
+    usbmidi::core::SysExSegmenter seg;
+    usbmidi::core::beginSysEx(seg, msg, sizeof(msg), 0);
+    uint8_t back[120];
+    size_t len = 0;
+    int rounds = 0;
+    while (!usbmidi::core::sysExDone(seg) || q.count > 0) {
+        usbmidi::core::pushSysEx(q, seg);
+        if (q.count > 8) FAIL("queue overfilled");
+        uint8_t buf[16];                      // A 16-byte endpoint: 4 events
+        size_t bytes = usbmidi::core::fillTransfer(q, buf, sizeof(buf));
+        for (size_t i = 0; i < bytes; i += 4) {
+            uint8_t cin = buf[i] & 0x0F;
+            size_t count = (cin == 0x4) ? 3 : (size_t)(cin - 0x4);
+            for (size_t k = 0; k < count; k++) back[len++] = buf[i + 1 + k];
+        }
+        if (++rounds > 100) FAIL("no progress");
+    }
+    ASSERT_EQ(len, sizeof(msg));
+    if (memcmp(back, msg, sizeof(msg)) != 0) FAIL("payload mismatch");
+    ASSERT_EQ(q.queued, 34u);
+    PASS();
+}
+
+void test_sysex_waits_to_go_whole() {
+    TEST("SysEx that fits the queue is queued whole or not at all");
+    const uint8_t msg[] = { 0xF0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xF7 };   // 4 events
+    usbmidi::core::EventQueue<8> q;
+    const uint8_t note[3] = { 0x90, 60, 1 };
+    uint8_t ev[5][4] = {};
+    for (int i = 0; i < 5; i++) usbmidi::core::buildEventPacket(note, 3, 0, ev[i]);
+    usbmidi::core::pushEvents(q, ev, 5);
+    usbmidi::core::SysExSegmenter seg;
+    usbmidi::core::beginSysEx(seg, msg, sizeof(msg), 0);
+    ASSERT_EQ(usbmidi::core::pushSysEx(q, seg), 0u);
+    ASSERT_EQ(q.count, 5u);
+    uint8_t buf[8];
+    usbmidi::core::fillTransfer(q, buf, sizeof(buf));   // Two events leave
+    ASSERT_EQ(usbmidi::core::pushSysEx(q, seg), 4u);
+    if (!usbmidi::core::sysExDone(seg)) FAIL("segmenter not done");
+    ASSERT_EQ(q.sysexBusy, 0);
+    PASS();
+}
+
+void test_sysex_stream_holds_cable() {
+    TEST("streaming SysEx keeps other messages off its cable");
+    uint8_t msg[100];
+    msg[0] = 0xF0;
+    for (size_t i = 1; i < 99; i++) msg[i] = (uint8_t)i;
+    msg[99] = 0xF7;
+    usbmidi::core::EventQueue<8> q;
+    usbmidi::core::SysExSegmenter seg;
+    usbmidi::core::beginSysEx(seg, msg, sizeof(msg), 2);
+    ASSERT_EQ(usbmidi::core::pushSysEx(q, seg), 8u);
+    ASSERT_EQ(q.sysexBusy, 1u << 2);
+
+    uint8_t buf[32];
+    usbmidi::core::fillTransfer(q, buf, sizeof(buf));
+    const uint8_t note[3] = { 0x90, 60, 100 };
+    const uint8_t clock[1] = { 0xF8 };
+    uint8_t ev[1][4];
+    usbmidi::core::buildEventPacket(note, 3, 2, ev[0]);
+    if (usbmidi::core::pushEvents(q, ev, 1)) FAIL("note queued inside the SysEx");
+    usbmidi::core::buildEventPacket(note, 3, 3, ev[0]);
+    if (!usbmidi::core::pushEvents(q, ev, 1)) FAIL("other cable refused");
+    usbmidi::core::buildEventPacket(clock, 1, 2, ev[0]);
+    if (!usbmidi::core::pushEvents(q, ev, 1)) FAIL("real-time refused");
+
+    const uint8_t other[] = { 0xF0, 0x01, 0xF7 };
+    usbmidi::core::SysExSegmenter seg2;
+    usbmidi::core::beginSysEx(seg2, other, sizeof(other), 2);
+    ASSERT_EQ(usbmidi::core::pushSysEx(q, seg2), 0u);      // Waits its turn
+
+    int rounds = 0;
+    while (!usbmidi::core::sysExDone(seg)) {
+        usbmidi::core::fillTransfer(q, buf, sizeof(buf));
+        usbmidi::core::pushSysEx(q, seg);
+        if (++rounds > 100) FAIL("no progress");
+    }
+    ASSERT_EQ(q.sysexBusy, 0);
+    usbmidi::core::buildEventPacket(note, 3, 2, ev[0]);
+    usbmidi::core::fillTransfer(q, buf, sizeof(buf));
+    if (!usbmidi::core::pushEvents(q, ev, 1)) FAIL("cable not released");
+    PASS();
+}
+
+void test_sysex_abort_releases_cable() {
+    TEST("abandoned SysEx releases its cable");
+    uint8_t msg[100];
+    msg[0] = 0xF0;
+    for (size_t i = 1; i < 99; i++) msg[i] = 0x11;
+    msg[99] = 0xF7;
+    usbmidi::core::EventQueue<8> q;
+    usbmidi::core::SysExSegmenter seg;
+    usbmidi::core::beginSysEx(seg, msg, sizeof(msg), 5);
+    usbmidi::core::pushSysEx(q, seg);
+    ASSERT_EQ(q.sysexBusy, 1u << 5);
+    usbmidi::core::abortSysEx(q, seg);
+    ASSERT_EQ(q.sysexBusy, 0);
+    if (seg.streaming) FAIL("segmenter still streaming");
+    PASS();
+}
+
+// ---------------------------------------------------------------------------
+// Outbound UMP queue (MIDI 2.0)
+// ---------------------------------------------------------------------------
+
+static uint32_t ump4NoteOn(uint8_t group, uint8_t note) {
+    return 0x40000000u | ((uint32_t)group << 24) | 0x00900000u | ((uint32_t)note << 8);
+}
+
+void test_ump_queue_packs_whole_packets() {
+    TEST("UMP: 2-word Note Ons pack 8 per 64-byte transfer");
+    usbmidi::core::UMPQueue<64> q;
+    for (uint8_t n = 0; n < 10; n++) {
+        uint32_t msg[2] = { ump4NoteOn(0, n), 0xFFFF0000 };
+        if (!usbmidi::core::pushUMP(q, msg, 2)) FAIL("push rejected");
+    }
+    uint8_t buf[64];
+    uint16_t packets = 0;
+    ASSERT_EQ(usbmidi::core::fillUMPTransfer(q, buf, 64, packets), 64u);
+    ASSERT_EQ(packets, 8);
+    ASSERT_EQ(buf[1], 0);                    // Note of the first packet (word 0, byte 1)
+    ASSERT_EQ(buf[56 + 1], 7);
+    ASSERT_EQ(buf[3], 0x40);                 // MT / group byte, little-endian on the wire
+    ASSERT_EQ(usbmidi::core::fillUMPTransfer(q, buf, 64, packets), 16u);
+    ASSERT_EQ(packets, 2);
+    PASS();
+}
+
+void test_ump_queue_keeps_packet_bounds() {
+    TEST("UMP: a packet that does not fit waits for the next");
+    usbmidi::core::UMPQueue<64> q;
+    uint32_t one[1] = { 0x20903C64 };                         // MT 0x2, 1 word
+    uint32_t four[4] = { 0xF0010000, 1, 2, 3 };               // MT 0xF, 4 words
+    usbmidi::core::pushUMP(q, one, 1);
+    usbmidi::core::pushUMP(q, four, 4);
+    uint8_t buf[16];
+    uint16_t packets = 0;
+    ASSERT_EQ(usbmidi::core::fillUMPTransfer(q, buf, 16, packets), 4u);
+    ASSERT_EQ(packets, 1);
+    ASSERT_EQ(usbmidi::core::fillUMPTransfer(q, buf, 16, packets), 16u);
+    ASSERT_EQ(buf[12], 3);
+    ASSERT_EQ(q.count, 0u);
+    PASS();
+}
+
+void test_ump_queue_group_backpressure() {
+    TEST("UMP: one group is capped at half the queue");
+    usbmidi::core::UMPQueue<16> q;
+    uint32_t msg[2] = { ump4NoteOn(3, 60), 0xFFFF0000 };
+    for (int i = 0; i < 4; i++) {
+        if (!usbmidi::core::pushUMP(q, msg, 2)) FAIL("push rejected early");
+    }
+    ASSERT_EQ(usbmidi::core::umpSendRoom(q, 3), 0u);
+    if (usbmidi::core::pushUMP(q, msg, 2)) FAIL("group 3 over its share");
+    ASSERT_EQ(q.groupRefused[3], 1u);
+    ASSERT_EQ(usbmidi::core::umpSendRoom(q, 5), 8u);
+    uint32_t other[2] = { ump4NoteOn(5, 60), 0xFFFF0000 };
+    if (!usbmidi::core::pushUMP(q, other, 2)) FAIL("other group refused");
+    uint8_t buf[16];
+    uint16_t packets = 0;
+    usbmidi::core::fillUMPTransfer(q, buf, 16, packets);       // Two group 3 packets leave
+    ASSERT_EQ(usbmidi::core::umpSendRoom(q, 3), 4u);
+    PASS();
+}
+
+void test_ump_queue_all_or_nothing() {
+    TEST("UMP: a message that does not fit is refused whole");
+    usbmidi::core::UMPQueue<8> q;
+    uint32_t chord[6] = { ump4NoteOn(0, 60), 0xFFFF0000, ump4NoteOn(1, 64), 0xFFFF0000,
+                          ump4NoteOn(1, 67), 0xFFFF0000 };
+    ASSERT_EQ(usbmidi::core::pushUMP(q, chord, 6), true);
+    if (usbmidi::core::pushUMP(q, chord, 6)) FAIL("accepted past capacity");
+    ASSERT_EQ(q.count, 6u);
+    ASSERT_EQ(q.dropped, 3u);
+    ASSERT_EQ(q.groupRefused[1], 2u);
+    usbmidi::core::clearUMP(q);
+    ASSERT_EQ(q.dropped, 6u);
+    ASSERT_EQ(usbmidi::core::umpSendRoom(q, 1), 4u);
+    PASS();
+}
+
 int main() {
     printf("=== USB MIDI Send Tests ===\n\n");
 
@@ -503,6 +908,38 @@ int main() {
     test_packet_rejects_zero_length();
     test_packet_all_channels_note_on();
 
+    printf("\n[Virtual cables]\n");
+    test_packet_cable_number();
+    test_packet_cable_15();
+    test_event_cable_roundtrip();
+
+    printf("\n[Outbound queue]\n");
+    test_queue_packs_16_per_64_bytes();
+    test_queue_respects_max_packet();
+    test_queue_all_or_nothing();
+    test_queue_wraparound();
+
+    printf("\n[SysEx segmentation]\n");
+    test_sysex_two_bytes();
+    test_sysex_three_bytes();
+    test_sysex_ends_with_one_byte();
+    test_sysex_ends_with_two_bytes();
+    test_sysex_ends_with_three_bytes();
+    test_sysex_long_roundtrip();
+    test_sysex_cable_number();
+    test_sysex_rejects_malformed();
+    test_sysex_batches_into_transfer();
+    test_sysex_streams_through_small_queue();
+    test_sysex_waits_to_go_whole();
+    test_sysex_stream_holds_cable();
+    test_sysex_abort_releases_cable();
+
+    printf("\n[Outbound UMP queue]\n");
+    test_ump_queue_packs_whole_packets();
+    test_ump_queue_keeps_packet_bounds();
+    test_ump_queue_group_backpressure();
+    test_ump_queue_all_or_nothing();
+
     printf("\n=== Results: %d passed, %d failed ===\n", g_pass, g_fail);
     return g_fail ? 1 : 0;
 }
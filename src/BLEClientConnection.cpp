@@ -0,0 +1,228 @@
+#include "BLEClientConnection.h"
+
+using namespace blemidi;
+
+// Seconds per scan run. The state machine restarts the scan while link slots
+// are free; each run starts with an empty result list.
+static const uint32_t SCAN_SECONDS = 5;
+
+BLEClientConnection* BLEClientConnection::scanOwner = nullptr;
+
+BLEClientConnection::BLEClientConnection()
+    : centralMux(portMUX_INITIALIZER_UNLOCKED),
+      preferredMtu(185),
+      lastConnectedCount(0),
+      centralTaskHandle(nullptr)
+{
+    for (int i = 0; i < core::MAX_LINKS; i++) {
+        core::setSysExBuffer(controllers[i].decoder, controllers[i].sysexRx, sizeof(controllers[i].sysexRx));
+    }
+}
+
+BLEClientConnection::~BLEClientConnection() {
+    if (centralTaskHandle) {
+        vTaskDelete(centralTaskHandle);
+        centralTaskHandle = nullptr;
+    }
+    if (scanOwner == this) scanOwner = nullptr;
+    for (int i = 0; i < core::MAX_LINKS; i++) {
+        delete controllers[i].callbacks;
+        controllers[i].callbacks = nullptr;
+    }
+}
+
+void BLEClientConnection::begin(const std::string& deviceName, int maxControllers, uint16_t mtu) {
+    if (centralTaskHandle) return;  // already initialized
+
+    preferredMtu = mtu;
+
+    // BLEDevice::init is a no-op when BLEConnection already initialized it.
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+    BLEDevice::init(String(deviceName.c_str()));
+#else
+    BLEDevice::init(deviceName);
+#endif
+
+    // Advertisements: queue controllers that offer the BLE-MIDI service.
+    class ScanCallback : public BLEAdvertisedDeviceCallbacks {
+    public:
+        BLEClientConnection* con;
+        ScanCallback(BLEClientConnection* c) : con(c) {}
+        void onResult(BLEAdvertisedDevice device) override {
+            con->onAdvertised(device);
+        }
+    };
+    static ScanCallback* scanCallback = nullptr;
+    delete scanCallback;
+    scanCallback = new ScanCallback(this);
+
+    BLEScan* scan = BLEDevice::getScan();
+    scan->setAdvertisedDeviceCallbacks(scanCallback);
+    scan->setActiveScan(true);     // Names and UUIDs often sit in the scan response
+    scan->setInterval(100);
+    scan->setWindow(99);
+    scanOwner = this;
+
+    portENTER_CRITICAL(&centralMux);
+    core::centralStart(central, maxControllers);
+    portEXIT_CRITICAL(&centralMux);
+
+    // Creates a dedicated task on core 0 for scanning and connecting.
+    xTaskCreatePinnedToCore(_centralTask, "ble_central", 4096, this, 3, &centralTaskHandle, 0);
+}
+
+void BLEClientConnection::task() {
+    rxQueue.drain(
+        [this](const uint8_t* data, size_t len, uint64_t timestampUs) {
+            dispatchMidiData(data, len, timestampUs);
+        },
+        [this](const uint8_t* data, size_t len) {
+            dispatchSysExData(data, len);
+        });
+
+    // Connection callbacks from the loop task: first controller up, last one gone.
+    int count = connectedCount();
+    if (count > 0 && lastConnectedCount == 0) dispatchConnected();
+    else if (count == 0 && lastConnectedCount > 0) dispatchDisconnected();
+    lastConnectedCount = count;
+}
+
+int BLEClientConnection::connectedCount() const {
+    portENTER_CRITICAL(&centralMux);
+    int n = core::readyLinks(central);
+    portEXIT_CRITICAL(&centralMux);
+    return n;
+}
+
+// ---------- Events (BLE stack task) ----------
+
+void BLEClientConnection::onAdvertised(BLEAdvertisedDevice& device) {
+    core::Address addr;
+    memcpy(addr.bytes, *device.getAddress().getNative(), sizeof(addr.bytes));
+    addr.type = (uint8_t)device.getAddressType();
+    bool midi = device.haveServiceUUID() &&
+                device.isAdvertisingService(BLEUUID(BLE_MIDI_SERVICE_UUID));
+
+    portENTER_CRITICAL(&centralMux);
+    core::onAdvertisement(central, addr, midi);
+    portEXIT_CRITICAL(&centralMux);
+    if (midi) wake();
+}
+
+void BLEClientConnection::_onScanComplete(BLEScanResults) {
+    BLEClientConnection* self = scanOwner;
+    if (!self) return;
+    portENTER_CRITICAL(&self->centralMux);
+    core::onScanComplete(self->central);
+    portEXIT_CRITICAL(&self->centralMux);
+    self->wake();
+}
+
+void BLEClientConnection::onLinkDropped(int link) {
+    portENTER_CRITICAL(&centralMux);
+    core::onDisconnected(central, link, MIDIClock::nowUs());
+    portEXIT_CRITICAL(&centralMux);
+    wake();
+}
+
+void BLEClientConnection::wake() {
+    if (centralTaskHandle) xTaskNotifyGive(centralTaskHandle);
+}
+
+// ---------- Central Task ----------
+
+void BLEClientConnection::_centralTask(void* arg) {
+    BLEClientConnection* self = static_cast<BLEClientConnection*>(arg);
+    for (;;) {
+        portENTER_CRITICAL(&self->centralMux);
+        core::Action action = core::nextAction(self->central, MIDIClock::nowUs());
+        portEXIT_CRITICAL(&self->centralMux);
+
+        if (action.type == core::ACTION_NONE) {
+            // Sleep until an event arrives; wake anyway for timeouts and backoff.
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(250));
+            continue;
+        }
+        self->runAction(action);
+    }
+}
+
+void BLEClientConnection::runAction(const core::Action& action) {
+    switch (action.type) {
+        case core::ACTION_START_SCAN: {
+            BLEScan* scan = BLEDevice::getScan();
+            scan->clearResults();
+            scan->start(SCAN_SECONDS, _onScanComplete, false);
+            break;
+        }
+        case core::ACTION_STOP_SCAN:
+            BLEDevice::getScan()->stop();
+            break;
+        case core::ACTION_CONNECT: {
+            bool ok = connectLink(action.link, action.addr);
+            portENTER_CRITICAL(&centralMux);
+            core::onConnectResult(central, action.link, ok, MIDIClock::nowUs());
+            portEXIT_CRITICAL(&centralMux);
+            break;
+        }
+        case core::ACTION_SUBSCRIBE: {
+            bool ok = subscribeLink(action.link);
+            if (!ok) controllers[action.link].client->disconnect();
+            portENTER_CRITICAL(&centralMux);
+            core::onSubscribeResult(central, action.link, ok, MIDIClock::nowUs());
+            portEXIT_CRITICAL(&centralMux);
+            break;
+        }
+        case core::ACTION_DISCONNECT:
+            if (controllers[action.link].client) controllers[action.link].client->disconnect();
+            break;
+        default:
+            break;
+    }
+}
+
+bool BLEClientConnection::connectLink(int link, const core::Address& addr) {
+    Controller& ctl = controllers[link];
+    if (!ctl.client) {
+        class ClientCallback : public BLEClientCallbacks {
+        public:
+            BLEClientConnection* con;
+            int link;
+            ClientCallback(BLEClientConnection* c, int l) : con(c), link(l) {}
+            void onConnect(BLEClient*) override {}
+            void onDisconnect(BLEClient*) override { con->onLinkDropped(link); }
+        };
+        ctl.callbacks = new ClientCallback(this, link);
+        ctl.client = BLEDevice::createClient();
+        ctl.client->setClientCallbacks(ctl.callbacks);
+    }
+
+    uint8_t bda[6];
+    memcpy(bda, addr.bytes, sizeof(bda));
+    if (!ctl.client->connect(BLEAddress(bda), (esp_ble_addr_type_t)addr.type)) return false;
+    if (preferredMtu > 23) ctl.client->setMTU(preferredMtu);
+    return true;
+}
+
+bool BLEClientConnection::subscribeLink(int link) {
+    Controller& ctl = controllers[link];
+    BLERemoteService* service = ctl.client->getService(BLEUUID(BLE_MIDI_SERVICE_UUID));
+    if (!service) return false;
+    BLERemoteCharacteristic* characteristic =
+        service->getCharacteristic(BLEUUID(BLE_MIDI_CHARACTERISTIC_UUID));
+    if (!characteristic || !characteristic->canNotify()) return false;
+
+    // Fresh decoder per connection: timestamps restart, no half-built SysEx.
+    ctl.decoder = core::Decoder();
+    core::setSysExBuffer(ctl.decoder, ctl.sysexRx, sizeof(ctl.sysexRx));
+
+    // The BLE-MIDI spec has the central read the characteristic once after
+    // connecting; some controllers only start sending after that read.
+    if (characteristic->canRead()) characteristic->readValue();
+
+    characteristic->registerForNotify(
+        [this, link](BLERemoteCharacteristic*, uint8_t* data, size_t length, bool) {
+            rxQueue.decode(controllers[link].decoder, data, length);
+        });
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef BLE_CLIENT_CONNECTION_H
+#define BLE_CLIENT_CONNECTION_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEClient.h>
+#include <BLEScan.h>
+#include <freertos/portmacro.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "MIDITransport.h"
+#include "BLEMIDITransportCore.h"
+#include "BLEMIDIReceiveQueue.h"
+#include "BLEConnection.h"   // Service / characteristic UUIDs
+
+// BLE-MIDI central: scans for controllers advertising the BLE-MIDI service,
+// connects to them and subscribes to their notifications, so a wireless
+// keyboard talks to the ESP32 directly instead of through a phone or computer.
+//
+//   BLEClientConnection bleKeys;
+//   bleKeys.begin("ESP32 MIDI Central", /*maxControllers=*/2);
+//   midiHandler.addTransport(&bleKeys);
+//
+// Controllers that drop are reconnected when they advertise again. Packets
+// go through the same decoder and receive queue as BLEConnection. Receive
+// only: sendMidiMessage() is not supported.
+//
+// BLEConnection (peripheral) and BLEClientConnection can run side by side;
+// both share the one BLEDevice, so pass the same name to each begin().
+
+class BLEClientConnection : public MIDITransport {
+public:
+    BLEClientConnection();
+    virtual ~BLEClientConnection();
+
+    // Initializes BLE (if BLEConnection has not) and starts the central task,
+    // which scans and connects in the background. maxControllers: 1-4.
+    // preferredMtu is requested from each controller after connecting.
+    void begin(const std::string& deviceName = "ESP32 MIDI Central",
+               int maxControllers = 1, uint16_t preferredMtu = 185);
+
+    // Drains the ring buffer and dispatches MIDI data via MIDITransport callbacks. Call from loop().
+    void task() override;
+
+    // True while at least one controller is subscribed.
+    bool isConnected() const override { return connectedCount() > 0; }
+
+    // Controllers currently subscribed.
+    int connectedCount() const;
+
+    // Received traffic (see "Link statistics" in BLEMIDITransportCore.h).
+    blemidi::core::RateMeter getReceiveStats() { return rxQueue.stats(); }
+
+protected:
+    // Scan / connect / subscribe policy (host-tested in test_ble_midi.cpp).
+    // Fed from the BLE stack task and the central task, under centralMux.
+    blemidi::core::Central central;
+    mutable portMUX_TYPE centralMux;
+
+    // One per link slot of the state machine.
+    struct Controller {
+        BLEClient* client = nullptr;
+        BLEClientCallbacks* callbacks = nullptr;
+        blemidi::core::Decoder decoder;
+        uint8_t sysexRx[BLEMIDIReceiveQueue::SYSEX_MAX];   // Decoder assembly buffer
+    };
+    Controller controllers[blemidi::core::MAX_LINKS];
+
+    BLEMIDIReceiveQueue rxQueue;
+    uint16_t preferredMtu;
+    int lastConnectedCount;           // For connect / disconnect callbacks in task()
+
+    // Dedicated FreeRTOS task that runs the state machine: BLE connect and
+    // service discovery block, so they stay out of loop() and the BLE task.
+    TaskHandle_t centralTaskHandle;
+    static void _centralTask(void* arg);
+    void runAction(const blemidi::core::Action& action);
+    bool connectLink(int link, const blemidi::core::Address& addr);
+    bool subscribeLink(int link);
+    void wake();
+
+    static BLEClientConnection* scanOwner;   // Scan callbacks carry no context pointer
+    static void _onScanComplete(BLEScanResults results);
+    void onAdvertised(BLEAdvertisedDevice& device);
+    void onLinkDropped(int link);
+};
+
+#endif // BLE_CLIENT_CONNECTION_H
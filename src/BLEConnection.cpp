@@ -21,9 +21,10 @@ BLEConnection::BLEConnection()
     : pServer(nullptr), pCharacteristic(nullptr),
       pBleCallback(nullptr), pServerCallback(nullptr),
       sendMutex(nullptr),
-      queueHead(0), queueTail(0),
-      queueMux(portMUX_INITIALIZER_UNLOCKED)
+      linkMtu(23), linkIntervalUs(0),
+      txMux(portMUX_INITIALIZER_UNLOCKED)
 {
+    blemidi::core::setSysExBuffer(rxDecoder, sysexRx, sizeof(sysexRx));
 }
 
 BLEConnection::~BLEConnection() {
@@ -37,9 +38,17 @@ BLEConnection::~BLEConnection() {
     pServerCallback = nullptr;
 }
 
+BLEConnection* BLEConnection::gapOwner = nullptr;
+
 void BLEConnection::begin(const std::string& deviceName) {
+    begin(deviceName, BLEMIDILinkConfig());
+}
+
+void BLEConnection::begin(const std::string& deviceName, const BLEMIDILinkConfig& link) {
     if (pServer) return;  // already initialized
 
+    linkConfig = link;
+
     sendMutex = xSemaphoreCreateMutex();
 
     // BLEDevice::init signature differs by stack:
@@ -50,6 +59,12 @@ void BLEConnection::begin(const std::string& deviceName) {
 #else
     BLEDevice::init(deviceName);
 #endif
+    // Offered when the central starts the MTU exchange (the peripheral
+    // cannot start it). Connection-interval updates arrive as GAP events.
+    if (linkConfig.preferredMtu > 23) BLEDevice::setMTU(linkConfig.preferredMtu);
+    gapOwner = this;
+    BLEDevice::setCustomGapHandler(onGapEvent);
+
     pServer = BLEDevice::createServer();
 
     // Server callbacks: handle connect/disconnect and restart advertising automatically.
@@ -57,15 +72,28 @@ void BLEConnection::begin(const std::string& deviceName) {
     public:
         BLEConnection* bleCon;
         ServerCallback(BLEConnection* con) : bleCon(con) {}
-        void onConnect(BLEServer*) override {
+        void onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) override {
+            bleCon->onLinkUp(server, param);
             bleCon->dispatchConnected();
         }
+        void onMtuChanged(BLEServer*, esp_ble_gatts_cb_param_t* param) override {
+            bleCon->linkMtu = param->mtu.mtu;
+        }
         void onDisconnect(BLEServer*) override {
+            bleCon->linkMtu = 23;
+            bleCon->linkIntervalUs = 0;
             // Flush pending data from the disconnected central.
-            portENTER_CRITICAL(&bleCon->queueMux);
-            bleCon->queueHead = 0;
-            bleCon->queueTail = 0;
-            portEXIT_CRITICAL(&bleCon->queueMux);
+            bleCon->rxQueue.clear();
+
+            // Fresh decoder for the next central (same task as onWrite):
+            // no running status, half-built SysEx or timestamp sync carried over.
+            bleCon->rxDecoder = blemidi::core::Decoder();
+            blemidi::core::setSysExBuffer(bleCon->rxDecoder, bleCon->sysexRx, sizeof(bleCon->sysexRx));
+
+            // Output queued for it is stale for the next one.
+            portENTER_CRITICAL(&bleCon->txMux);
+            bleCon->txQueue.clear();
+            portEXIT_CRITICAL(&bleCon->txMux);
 
             bleCon->dispatchDisconnected();
             // Restart advertising so a new central can connect.
@@ -93,9 +121,9 @@ void BLEConnection::begin(const std::string& deviceName) {
     // previous ESP_ARDUINO_VERSION_MAJOR gate was incorrect.
     pCharacteristic->addDescriptor(new BLE2902());
 
-    // Receive callback: strips the 2-byte BLE MIDI header and enqueues raw MIDI bytes.
-    // BLE MIDI packet format: [header][timestamp][midi_bytes...]
-    // Processing is deferred to task() — same pattern as USBConnection.
+    // Receive callback: decodes the BLE MIDI packet into individual messages
+    // (see BLEMIDITransportCore.h) and enqueues each with its reconstructed time.
+    // Dispatch is deferred to task() — same pattern as USBConnection.
     class BLECallback : public BLECharacteristicCallbacks {
     public:
         BLEConnection* bleCon;
@@ -110,14 +138,8 @@ void BLEConnection::begin(const std::string& deviceName) {
 #else
             std::string rxValue = characteristic->getValue();
 #endif
-            size_t len = rxValue.length();
-            // Minimum valid BLE MIDI packet: header + timestamp + 1 MIDI byte = 3 bytes
-            if (len >= 3) {
-                const uint8_t* data = reinterpret_cast<const uint8_t*>(rxValue.c_str());
-                // Skip header (byte 0) and timestamp (byte 1); enqueue raw MIDI bytes.
-                // Processing happens in task() on the main loop — thread-safe.
-                bleCon->enqueueMidiMessage(data + 2, len - 2);
-            }
+            bleCon->rxQueue.decode(bleCon->rxDecoder,
+                                   reinterpret_cast<const uint8_t*>(rxValue.c_str()), rxValue.length());
         }
     };
     delete pBleCallback;
@@ -143,7 +165,14 @@ void BLEConnection::begin(const std::string& deviceName) {
 
 void BLEConnection::task() {
     // Drain the ring buffer and dispatch via MIDITransport callbacks.
-    processQueue();
+    rxQueue.drain(
+        [this](const uint8_t* data, size_t len, uint64_t timestampUs) {
+            dispatchMidiData(data, len, timestampUs);
+        },
+        [this](const uint8_t* data, size_t len) {
+            dispatchSysExData(data, len);
+        });
+    flush();
 }
 
 bool BLEConnection::isConnected() const {
@@ -152,74 +181,121 @@ bool BLEConnection::isConnected() const {
     return false;
 }
 
-// ---------- Ring Buffer ----------
-// Same pattern as USBConnection. Spinlock protects cross-task access:
-// enqueue() runs in the BLE stack task; dequeue() runs in the main loop.
-
-bool BLEConnection::enqueueMidiMessage(const uint8_t* data, size_t length) {
-    portENTER_CRITICAL(&queueMux);
-    int next = (queueHead + 1) % QUEUE_SIZE;
-    if (next == queueTail) {
-        // Queue full — discard to avoid blocking the BLE task.
-        portEXIT_CRITICAL(&queueMux);
-        return false;
+// ---------- Link Parameters ----------
+
+void BLEConnection::onLinkUp(BLEServer* server, esp_ble_gatts_cb_param_t* param) {
+    linkMtu = 23;
+    linkIntervalUs = (uint32_t)param->connect.conn_params.interval * 1250;
+
+    // Statistics describe one connection.
+    portENTER_CRITICAL(&txMux);
+    txMeter = blemidi::core::RateMeter();
+    portEXIT_CRITICAL(&txMux);
+    rxQueue.resetStats();
+
+    // Ask for the preferred interval (1.25 ms units, timeout in 10 ms units).
+    // The central answers with an update event, or keeps its own choice.
+    if (linkConfig.minIntervalUs > 0 && linkConfig.maxIntervalUs >= linkConfig.minIntervalUs) {
+        server->updateConnParams(param->connect.remote_bda,
+                                 (uint16_t)(linkConfig.minIntervalUs / 1250),
+                                 (uint16_t)(linkConfig.maxIntervalUs / 1250),
+                                 linkConfig.peripheralLatency,
+                                 (uint16_t)(linkConfig.supervisionTimeoutMs / 10));
     }
-    size_t copyLen = (length > sizeof(bleQueue[0].data)) ? sizeof(bleQueue[0].data) : length;
-    memcpy(bleQueue[queueHead].data, data, copyLen);
-    bleQueue[queueHead].length = copyLen;
-    queueHead = next;
-    portEXIT_CRITICAL(&queueMux);
-    return true;
 }
 
-bool BLEConnection::dequeueMidiMessage(RawBleMessage& msg) {
-    portENTER_CRITICAL(&queueMux);
-    if (queueTail == queueHead) {
-        portEXIT_CRITICAL(&queueMux);
-        return false;
-    }
-    msg = bleQueue[queueTail];
-    queueTail = (queueTail + 1) % QUEUE_SIZE;
-    portEXIT_CRITICAL(&queueMux);
-    return true;
+void BLEConnection::onGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    if (event != ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT || !gapOwner) return;
+    if (param->update_conn_params.status != ESP_BT_STATUS_SUCCESS) return;
+    gapOwner->linkIntervalUs = (uint32_t)param->update_conn_params.conn_int * 1250;
 }
 
-void BLEConnection::processQueue() {
-    RawBleMessage msg;
-    while (dequeueMidiMessage(msg)) {
-        dispatchMidiData(msg.data, msg.length);
-    }
+BLEConnection::LinkReport BLEConnection::getLinkReport() {
+    portENTER_CRITICAL(&txMux);
+    blemidi::core::RateMeter tx = txMeter;
+    portEXIT_CRITICAL(&txMux);
+    blemidi::core::RateMeter rx = rxQueue.stats();
+    return blemidi::core::makeReport(tx, rx, MIDIClock::nowUs(), linkMtu, linkIntervalUs);
 }
 
 // ---------- BLE MIDI Output ----------
+// sendMidiMessage() only queues, so callers never wait on the BLE stack.
+// flush() turns the queue into notifications: a chord sent in one loop()
+// iteration leaves as one packet instead of one per note.
 
 bool BLEConnection::sendMidiMessage(const uint8_t* data, size_t length) {
-    if (!pCharacteristic || !sendMutex || length == 0) return false;
-
-    // Build BLE MIDI 1.0 packet before acquiring the mutex.
-    //   Byte 0: Header    = 0x80 | ((timestamp_ms >> 7) & 0x3F)
-    //   Byte 1: Timestamp = 0x80 | (timestamp_ms & 0x7F)
-    //   Byte 2+: MIDI bytes (status + data bytes)
-    uint32_t ts = (uint32_t)millis();
-    uint8_t header    = 0x80 | ((ts >> 7) & 0x3F);
-    uint8_t timestamp = 0x80 | (ts & 0x7F);
-
-    size_t midiLen = (length > 18) ? 18 : length;  // safe limit for default BLE MTU
-    uint8_t packet[20];
-    packet[0] = header;
-    packet[1] = timestamp;
-    memcpy(packet + 2, data, midiLen);
-
-    // Check connection inside the mutex to minimize TOCTOU race window.
-    if (xSemaphoreTake(sendMutex, pdMS_TO_TICKS(100)) != pdTRUE) return false;
-
-    bool sent = false;
-    if (isConnected()) {
-        pCharacteristic->setValue(packet, 2 + midiLen);
-        pCharacteristic->notify();
-        sent = true;
+    if (!pCharacteristic || length == 0 || !isConnected()) return false;
+    if (data[0] == 0xF0 && (length < 2 || data[length - 1] != 0xF7)) return false;
+    if (data[0] != 0xF0 && length > 3) return false;
+
+    uint64_t now = MIDIClock::nowUs();
+    if (length > blemidi::core::TX_ENTRY_MAX) return streamSysEx(data, length);
+    portENTER_CRITICAL(&txMux);
+    bool queued = txQueue.push(data, length, now);
+    portEXIT_CRITICAL(&txMux);
+    return queued;
+}
+
+// Feeds a SysEx longer than one queue entry (patch dump, firmware) in parts,
+// flushing as it goes; other messages wait until the last part is queued,
+// so nothing but real-time lands inside it on the wire.
+bool BLEConnection::streamSysEx(const uint8_t* data, size_t length) {
+    blemidi::core::SysExStream s;
+    blemidi::core::beginSysEx(s, data, length, MIDIClock::nowUs());
+    unsigned long lastProgress = millis();
+    for (;;) {
+        portENTER_CRITICAL(&txMux);
+        size_t pushed = blemidi::core::pushSysEx(txQueue, s);
+        portEXIT_CRITICAL(&txMux);
+
+        if (pushed > 0) lastProgress = millis();
+        if (blemidi::core::sysExDone(s)) return true;
+        if (!isConnected() || millis() - lastProgress > SYSEX_STALL_MS) {
+            portENTER_CRITICAL(&txMux);
+            blemidi::core::abortSysEx(txQueue, s);
+            txQueue.dropped++;
+            portEXIT_CRITICAL(&txMux);
+            return false;
+        }
+        flush();
+        vTaskDelay(1);
+    }
+}
+
+void BLEConnection::flush() {
+    if (!pCharacteristic || !sendMutex) return;
+    if (xSemaphoreTake(sendMutex, 0) != pdTRUE) return;   // Another flush is running
+
+    auto pop = [this](uint8_t* out, uint64_t& timeUs) -> size_t {
+        uint64_t now = MIDIClock::nowUs();
+        portENTER_CRITICAL(&txMux);
+        size_t len = txQueue.pop(out, timeUs);
+        if (len > 0) blemidi::core::countMessage(txMeter, now, now - timeUs);
+        portEXIT_CRITICAL(&txMux);
+        return len;
+    };
+
+    if (!isConnected()) {
+        // Discard instead of sending into the void; a SysEx cut mid-way
+        // must not resume on the next connection.
+        portENTER_CRITICAL(&txMux);
+        txQueue.clear();
+        portEXIT_CRITICAL(&txMux);
+        txPacketizer.entryLen = 0;
+        txPacketizer.inSysEx = false;
+        xSemaphoreGive(sendMutex);
+        return;
     }
 
+    // ATT payload is the negotiated MTU minus 3 (20 bytes until the exchange).
+    blemidi::core::flush(txPacketizer, linkMtu - 3, pop,
+        [this](const uint8_t* packet, size_t len) {
+            pCharacteristic->setValue(const_cast<uint8_t*>(packet), len);
+            pCharacteristic->notify();
+            portENTER_CRITICAL(&txMux);
+            blemidi::core::countPacket(txMeter, MIDIClock::nowUs(), len);
+            portEXIT_CRITICAL(&txMux);
+        });
+
     xSemaphoreGive(sendMutex);
-    return sent;
 }
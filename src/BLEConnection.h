@@ -4,18 +4,37 @@
 #include <Arduino.h>
 #include <BLEDevice.h>
 #include <BLEServer.h>
+#include <esp_gap_ble_api.h>
 #include <freertos/portmacro.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
 #include "MIDITransport.h"
+#include "BLEMIDITransportCore.h"
+#include "BLEMIDIReceiveQueue.h"
 
 // Standard BLE MIDI Service UUIDs (Apple/MIDI Association specification)
 #define BLE_MIDI_SERVICE_UUID        "03B80E5A-EDE8-4B33-A751-6CE34EC4C700"
 #define BLE_MIDI_CHARACTERISTIC_UUID "7772E5DB-3868-4112-A1A9-F2669D106BF3"
 
-// Structure to store a raw BLE MIDI packet (after BLE MIDI header is stripped).
-struct RawBleMessage {
-    uint8_t data[20];  // Up to 18 MIDI bytes (BLE MIDI safe MTU minus 2-byte header)
-    size_t length;
+// Link parameters requested from the central after it connects. The central
+// has the final say; getMtu() / getConnectionIntervalUs() report what it chose.
+//
+//   BLEMIDILinkConfig link;
+//   link.minIntervalUs = link.maxIntervalUs = 7500;   // Tightest the spec allows
+//   ble.begin("Stage Keys", link);
+struct BLEMIDILinkConfig {
+    // ATT MTU offered in the exchange. Each notification carries up to MTU - 3
+    // bytes; 185 matches what iOS and macOS accept. 23 = no exchange.
+    uint16_t preferredMtu = 185;
+
+    // Connection interval range (1.25 ms steps, 7.5 ms minimum). Shorter
+    // intervals lower latency at the cost of power. 0 = leave it to the central.
+    uint32_t minIntervalUs = 7500;
+    uint32_t maxIntervalUs = 15000;
+
+    // Connection events the peripheral may skip, and the link-loss timeout.
+    uint16_t peripheralLatency = 0;
+    uint16_t supervisionTimeoutMs = 2000;
 };
 
 class BLEConnection : public MIDITransport {
@@ -25,18 +44,39 @@ public:
 
     // Initializes the BLE MIDI server and starts advertising.
     void begin(const std::string& deviceName = "ESP32 MIDI BLE");
+    void begin(const std::string& deviceName, const BLEMIDILinkConfig& link);
 
-    // Drains the ring buffer and dispatches MIDI data via MIDITransport callbacks. Call from loop().
+    // Drains the ring buffer and dispatches MIDI data via MIDITransport callbacks,
+    // then flushes queued output. Call from loop().
     void task() override;
 
     // Returns whether a BLE central is currently connected.
     bool isConnected() const override;
 
-    // Sends a MIDI message via BLE NOTIFY.
-    // data: raw MIDI bytes (status + data, no BLE header, no CIN byte).
-    // Returns true if connected and notification was sent.
+    // Queues a MIDI message for the next flush(). Never blocks, except for a
+    // SysEx longer than 512 bytes: that one is queued in parts as flush()
+    // sends the earlier ones, and the call returns once the last part is in.
+    // data: one complete message (status + data, or F0 ... F7), no BLE header.
+    // Returns false if not connected, the message is malformed, or the queue
+    // is full (a long SysEx: the link dropped or made no progress for
+    // SYSEX_STALL_MS).
     bool sendMidiMessage(const uint8_t* data, size_t length) override;
 
+    // Packs everything queued into as few notifications as the negotiated MTU
+    // allows (see BLEMIDITransportCore.h). Called by task(); call it directly
+    // to send sooner, e.g. right after a burst of sendMidiMessage() calls.
+    void flush();
+
+    // Effective link parameters of the current connection.
+    uint16_t getMtu() const { return linkMtu; }                      // 23 until negotiated
+    uint32_t getConnectionIntervalUs() const { return linkIntervalUs; }   // 0 when idle
+
+    // Rolling one-second throughput in both directions, average queue and
+    // receive delays, and an outbound latency estimate. See the "Link
+    // statistics" section of BLEMIDITransportCore.h for what is measured.
+    typedef blemidi::core::LinkReport LinkReport;
+    LinkReport getLinkReport();
+
 protected:
     BLEServer* pServer;
     BLECharacteristic* pCharacteristic;
@@ -44,17 +84,31 @@ protected:
     BLEServerCallbacks* pServerCallback;        // Managed to prevent memory leak
     SemaphoreHandle_t sendMutex;
 
-    // Ring buffer for incoming BLE MIDI packets.
-    // Protected by spinlock — same pattern as USBConnection.
-    static const int QUEUE_SIZE = 64;
-    RawBleMessage bleQueue[QUEUE_SIZE];
-    volatile int queueHead;
-    volatile int queueTail;
-    portMUX_TYPE queueMux;
-
-    bool enqueueMidiMessage(const uint8_t* data, size_t length);
-    bool dequeueMidiMessage(RawBleMessage& msg);
-    void processQueue();
+    BLEMIDILinkConfig linkConfig;
+    volatile uint16_t linkMtu;
+    volatile uint32_t linkIntervalUs;
+    static BLEConnection* gapOwner;   // GAP events carry no context pointer
+    static void onGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+
+    // Incoming messages: decoded in the BLE stack task, dispatched by task().
+    blemidi::core::Decoder rxDecoder;
+    uint8_t sysexRx[BLEMIDIReceiveQueue::SYSEX_MAX];   // Decoder assembly buffer
+    BLEMIDIReceiveQueue rxQueue;
+
+    // Outgoing messages: sendMidiMessage() pushes under txMux from any task,
+    // flush() drains. The packetizer is touched only by flush(), which
+    // sendMutex keeps to one caller at a time.
+    static const size_t TX_QUEUE_BYTES = 1024;
+    blemidi::core::TxQueue<TX_QUEUE_BYTES> txQueue;
+    blemidi::core::Packetizer txPacketizer;
+    portMUX_TYPE txMux;
+    static const unsigned long SYSEX_STALL_MS = 500;
+    bool streamSysEx(const uint8_t* data, size_t length);
+
+    // Outbound link statistics, under txMux (inbound ones live in rxQueue).
+    blemidi::core::RateMeter txMeter;
+
+    void onLinkUp(BLEServer* server, esp_ble_gatts_cb_param_t* param);
 };
 
 #endif // BLE_CONNECTION_H
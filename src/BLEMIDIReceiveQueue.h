@@ -0,0 +1,184 @@
+#ifndef BLE_MIDI_RECEIVE_QUEUE_H
+#define BLE_MIDI_RECEIVE_QUEUE_H
+
+#include <Arduino.h>
+#include <freertos/portmacro.h>
+#include "MIDIClock.h"
+#include "BLEMIDITransportCore.h"
+
+// One MIDI message decoded from a BLE MIDI packet (header and timestamps stripped).
+struct RawBleMessage {
+    uint8_t data[3];   // Status + up to 2 data bytes (SysEx goes through the SysEx slots)
+    size_t length;
+    uint64_t timestampUs;   // Reconstructed send time on the local clock
+};
+
+// Receive side shared by BLEConnection (peripheral) and BLEClientConnection
+// (central). decode() runs in the BLE stack task: it decodes a packet with
+// the sender's own Decoder (see BLEMIDITransportCore.h) and queues every
+// message; drain() runs in task() and hands them to the transport. Same
+// spinlock ring pattern as USBConnection.
+class BLEMIDIReceiveQueue {
+public:
+    BLEMIDIReceiveQueue()
+        : queueHead(0), queueTail(0),
+          queueMux(portMUX_INITIALIZER_UNLOCKED),
+          sysexHead(0), sysexTail(0),
+          arrivalUs(0) {}
+
+    // ---------- BLE stack task ----------
+
+    void decode(blemidi::core::Decoder& decoder, const uint8_t* data, size_t length) {
+        arrivalUs = MIDIClock::nowUs();
+        portENTER_CRITICAL(&queueMux);
+        blemidi::core::countPacket(meter, arrivalUs, length);
+        portEXIT_CRITICAL(&queueMux);
+
+        blemidi::core::Sink sink = { _onDecodedMidi, _onDecodedSysEx, this };
+        blemidi::core::decodePacket(decoder, data, length, arrivalUs, sink);
+    }
+
+    bool pushMidi(const uint8_t* data, size_t length, uint64_t timestampUs) {
+        portENTER_CRITICAL(&queueMux);
+        int next = (queueHead + 1) % QUEUE_SIZE;
+        if (next == queueTail) {
+            // Queue full — discard to avoid blocking the BLE task.
+            portEXIT_CRITICAL(&queueMux);
+            return false;
+        }
+        size_t copyLen = (length > sizeof(queue[0].data)) ? sizeof(queue[0].data) : length;
+        memcpy(queue[queueHead].data, data, copyLen);
+        queue[queueHead].length = copyLen;
+        queue[queueHead].timestampUs = timestampUs;
+        queueHead = next;
+        portEXIT_CRITICAL(&queueMux);
+        return true;
+    }
+
+    // Single producer (BLE task), single consumer (task()): the slot is written
+    // before sysexHead moves past it and read before sysexTail does.
+    bool pushSysEx(const uint8_t* data, size_t length) {
+        if (length > SYSEX_MAX) return false;
+        portENTER_CRITICAL(&queueMux);
+        int head = sysexHead;
+        int next = (head + 1) % SYSEX_SLOTS;
+        bool full = (next == sysexTail);
+        portEXIT_CRITICAL(&queueMux);
+        if (full) return false;
+
+        memcpy(sysexSlots[head].data, data, length);
+        sysexSlots[head].length = length;
+
+        portENTER_CRITICAL(&queueMux);
+        sysexHead = next;
+        portEXIT_CRITICAL(&queueMux);
+        return true;
+    }
+
+    // ---------- task() ----------
+
+    // Calls midi(data, length, timestampUs) for each queued message, then
+    // sysex(data, length) for each completed SysEx, straight from its slot.
+    template <typename MidiFn, typename SysExFn>
+    void drain(MidiFn midi, SysExFn sysex) {
+        RawBleMessage msg;
+        while (pop(msg)) {
+            midi(msg.data, msg.length, msg.timestampUs);
+        }
+
+        for (;;) {
+            portENTER_CRITICAL(&queueMux);
+            int tail = sysexTail;
+            bool empty = (tail == sysexHead);
+            portEXIT_CRITICAL(&queueMux);
+            if (empty) break;
+
+            sysex(sysexSlots[tail].data, sysexSlots[tail].length);
+
+            portENTER_CRITICAL(&queueMux);
+            sysexTail = (tail + 1) % SYSEX_SLOTS;
+            portEXIT_CRITICAL(&queueMux);
+        }
+    }
+
+    // Drops pending short messages (e.g. from a central that disconnected).
+    void clear() {
+        portENTER_CRITICAL(&queueMux);
+        queueHead = 0;
+        queueTail = 0;
+        portEXIT_CRITICAL(&queueMux);
+    }
+
+    // Receive statistics (see "Link statistics" in BLEMIDITransportCore.h).
+    blemidi::core::RateMeter stats() {
+        portENTER_CRITICAL(&queueMux);
+        blemidi::core::RateMeter m = meter;
+        portEXIT_CRITICAL(&queueMux);
+        return m;
+    }
+
+    void resetStats() {
+        portENTER_CRITICAL(&queueMux);
+        meter = blemidi::core::RateMeter();
+        portEXIT_CRITICAL(&queueMux);
+    }
+
+    static const size_t SYSEX_MAX = 512;
+
+private:
+    // One entry per message. A single BLE packet can carry many (dense
+    // controllers pack 5-10 per connection interval).
+    static const int QUEUE_SIZE = 128;
+    RawBleMessage queue[QUEUE_SIZE];
+    volatile int queueHead;
+    volatile int queueTail;
+    portMUX_TYPE queueMux;
+
+    // Completed SysEx messages waiting for task(). The BLE task fills the slot
+    // at sysexHead and publishes it; task() dispatches straight from the slot
+    // at sysexTail and only then releases it, so no copy is made under the lock.
+    static const int SYSEX_SLOTS = 3;    // One slot stays empty: 2 messages in flight
+    struct SysExSlot {
+        uint8_t data[SYSEX_MAX];
+        size_t length;
+    };
+    SysExSlot sysexSlots[SYSEX_SLOTS];
+    volatile int sysexHead;
+    volatile int sysexTail;
+
+    // Statistics, under queueMux.
+    blemidi::core::RateMeter meter;
+    uint64_t arrivalUs;               // Arrival of the packet being decoded
+
+    bool pop(RawBleMessage& msg) {
+        portENTER_CRITICAL(&queueMux);
+        if (queueTail == queueHead) {
+            portEXIT_CRITICAL(&queueMux);
+            return false;
+        }
+        msg = queue[queueTail];
+        queueTail = (queueTail + 1) % QUEUE_SIZE;
+        portEXIT_CRITICAL(&queueMux);
+        return true;
+    }
+
+    void countMessage(uint64_t timestampUs) {
+        portENTER_CRITICAL(&queueMux);
+        blemidi::core::countMessage(meter, arrivalUs, arrivalUs - timestampUs);
+        portEXIT_CRITICAL(&queueMux);
+    }
+
+    static void _onDecodedMidi(void* ctx, const uint8_t* data, uint8_t length, uint64_t timestampUs) {
+        BLEMIDIReceiveQueue* self = static_cast<BLEMIDIReceiveQueue*>(ctx);
+        self->countMessage(timestampUs);
+        self->pushMidi(data, length, timestampUs);
+    }
+
+    static void _onDecodedSysEx(void* ctx, const uint8_t* data, size_t length, uint64_t timestampUs) {
+        BLEMIDIReceiveQueue* self = static_cast<BLEMIDIReceiveQueue*>(ctx);
+        self->countMessage(timestampUs);
+        self->pushSysEx(data, length);
+    }
+};
+
+#endif // BLE_MIDI_RECEIVE_QUEUE_H
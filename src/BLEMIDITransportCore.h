@@ -0,0 +1,902 @@
+#ifndef BLE_MIDI_TRANSPORT_CORE_H
+#define BLE_MIDI_TRANSPORT_CORE_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Pure BLE-MIDI 1.0 packet logic. No Arduino, no BLE stack.
+// Consumed by BLEConnection AND the native tests, so tests validate the real
+// code (not copies) — same arrangement as USBMIDITransportCore.h.
+namespace blemidi { namespace core {
+
+// ── Packet format ───────────────────────────────────────────────────────────
+//
+//   [header] ([timestamp] [status] [data...] | [data...] | [timestamp] [data...])*
+//
+//   header     10hh hhhh   bits 12..7 of the 13-bit millisecond timestamp
+//   timestamp  1lll llll   bits 6..0; when it is lower than the previous one
+//                          in the same packet, the high bits have wrapped
+//
+// Every message starts with a timestamp byte, except running-status messages,
+// which may repeat data bytes with or without a new timestamp. A byte with bit
+// 7 set is therefore a timestamp unless it directly follows one, in which case
+// it is a status byte. SysEx may span packets: a continuation packet carries
+// data bytes straight after the header, and the closing F7 has its own
+// timestamp. Real-time messages (F8..FF) may appear anywhere, including inside
+// SysEx and between the bytes of a running-status message.
+
+// ── Timestamp reconstruction ────────────────────────────────────────────────
+//
+// The 13-bit timestamp is the sender's clock modulo 8192 ms. It is unwrapped
+// into a continuous count and mapped onto the local clock with an offset equal
+// to the smallest (arrival - sender time) seen so far: the packet that waited
+// least in the radio defines the offset, so the connection interval no longer
+// shows up as jitter. The offset follows a slower sender clock by creeping up
+// no faster than MAX_DRIFT_PPM, and is reset after a silence long enough for
+// the 13-bit value to be ambiguous. Reconstructed times never exceed the
+// packet's arrival time and never go backwards.
+
+static const uint16_t TIMESTAMP_MASK = 0x1FFF;
+static const uint64_t RESYNC_GAP_US  = 4000000;   // Half the 8.192 s wrap
+static const uint32_t MAX_DRIFT_PPM  = 200;       // Two crystals at +/-100 ppm
+
+// Length of a message from its status byte (0 = variable: SysEx).
+inline uint8_t messageLength(uint8_t status) {
+    if (status < 0xF0) {
+        uint8_t hi = status & 0xF0;
+        return (hi == 0xC0 || hi == 0xD0) ? 2 : 3;
+    }
+    switch (status) {
+        case 0xF0: return 0;
+        case 0xF1: case 0xF3: return 2;
+        case 0xF2: return 3;
+        default:   return 1;   // F6, F7, real-time, undefined
+    }
+}
+
+// Called once per decoded message with its reconstructed arrival time.
+struct Sink {
+    void (*midi)(void* ctx, const uint8_t* data, uint8_t length, uint64_t timestampUs);
+    void (*sysex)(void* ctx, const uint8_t* data, size_t length, uint64_t timestampUs);
+    void* ctx;
+};
+
+struct Decoder {
+    // Message assembly
+    uint8_t runningStatus = 0;
+    uint8_t msg[3] = { 0, 0, 0 };
+    uint8_t msgLen = 0;
+    uint8_t msgExpected = 0;
+
+    // SysEx assembly into a caller-provided buffer (F0 ... F7 inclusive).
+    // Without a buffer SysEx is skipped.
+    uint8_t* sysexBuf = nullptr;
+    size_t   sysexCap = 0;
+    size_t   sysexLen = 0;
+    bool     inSysEx = false;
+    bool     sysexOverflow = false;
+
+    // Timestamp reconstruction
+    bool     synced = false;
+    uint16_t lastTs13 = 0;
+    uint64_t lastRemoteMs = 0;    // Unwrapped sender time
+    int64_t  offsetUs = 0;        // Local time = sender time + offset
+    uint64_t lastArrivalUs = 0;
+    uint64_t lastOutUs = 0;
+
+    // Counters
+    uint32_t packets = 0;
+    uint32_t messages = 0;
+    uint32_t malformed = 0;       // Bad header, orphan data, truncated messages
+    uint32_t sysexDropped = 0;    // Overflowed or interrupted SysEx
+};
+
+inline void setSysExBuffer(Decoder& d, uint8_t* buf, size_t cap) {
+    d.sysexBuf = buf; d.sysexCap = cap; d.sysexLen = 0; d.inSysEx = false;
+}
+
+// Unwraps a 13-bit timestamp against the previous one. A step of more than
+// half the range is taken as a small step backwards and holds the time.
+inline uint64_t unwrapTimestamp(uint16_t ts13, uint16_t& lastTs13, uint64_t& lastRemoteMs) {
+    uint16_t delta = (uint16_t)((ts13 - lastTs13) & TIMESTAMP_MASK);
+    if (delta < 0x1000) {
+        lastRemoteMs += delta;
+        lastTs13 = ts13;
+    }
+    return lastRemoteMs;
+}
+
+// Walks the timestamp bytes of a packet. Calls fn(ts13) for each one, with the
+// high bits carried over low-byte wraps, and returns how many there were.
+template <typename Fn>
+inline uint16_t forEachTimestamp(const uint8_t* p, size_t len, Fn fn) {
+    uint8_t hi = p[0] & 0x3F;
+    int prevLo = -1;
+    bool afterTs = false;
+    uint16_t n = 0;
+    for (size_t i = 1; i < len; i++) {
+        uint8_t b = p[i];
+        if ((b & 0x80) && !afterTs) {
+            uint8_t lo = b & 0x7F;
+            if (prevLo >= 0 && lo < prevLo) hi = (uint8_t)((hi + 1) & 0x3F);
+            prevLo = lo;
+            fn((uint16_t)((hi << 7) | lo));
+            afterTs = true;
+            n++;
+        } else {
+            afterTs = false;
+        }
+    }
+    return n;
+}
+
+namespace detail {
+    inline uint64_t toLocal(Decoder& d, uint64_t remoteMs, uint64_t arrivalUs) {
+        int64_t t = (int64_t)(remoteMs * 1000) + d.offsetUs;
+        uint64_t out = (t < 0) ? 0 : (uint64_t)t;
+        if (out > arrivalUs) out = arrivalUs;
+        if (out < d.lastOutUs) out = d.lastOutUs;
+        d.lastOutUs = out;
+        return out;
+    }
+
+    inline void emit(Decoder& d, const Sink& sink, const uint8_t* data, uint8_t len, uint64_t t) {
+        d.messages++;
+        if (sink.midi) sink.midi(sink.ctx, data, len, t);
+    }
+
+    inline void abortSysEx(Decoder& d) {
+        if (d.inSysEx) d.sysexDropped++;
+        d.inSysEx = false;
+        d.sysexLen = 0;
+    }
+}
+
+// Decodes one BLE-MIDI packet (the characteristic value, header included)
+// received at arrivalUs. Emits every complete message through the sink.
+inline void decodePacket(Decoder& d, const uint8_t* p, size_t len, uint64_t arrivalUs, const Sink& sink) {
+    if (len < 2 || (p[0] & 0xC0) != 0x80) { d.malformed++; return; }
+    d.packets++;
+
+    if (d.synced && arrivalUs - d.lastArrivalUs > RESYNC_GAP_US) d.synced = false;
+    d.lastArrivalUs = arrivalUs;
+
+    // Pass 1: the packet's newest sender time sets (or tightens) the offset.
+    {
+        bool have = d.synced;
+        uint16_t ts = d.lastTs13, firstTs = 0;
+        uint64_t remote = d.lastRemoteMs;
+        uint16_t n = forEachTimestamp(p, len, [&](uint16_t ts13) {
+            if (!have) { ts = firstTs = ts13; remote = 0; have = true; }
+            unwrapTimestamp(ts13, ts, remote);
+        });
+        if (n > 0) {
+            int64_t cand = (int64_t)arrivalUs - (int64_t)(remote * 1000);
+            if (!d.synced) {
+                // Restart unwrapping at this packet's first timestamp.
+                d.lastTs13 = firstTs;
+                d.lastRemoteMs = 0;
+                d.offsetUs = cand;
+                d.synced = true;
+            } else if (cand < d.offsetUs) {
+                d.offsetUs = cand;
+            } else {
+                // Drift: creep towards the candidate at most MAX_DRIFT_PPM of
+                // the sender time elapsed since the previous packet.
+                int64_t creep = (int64_t)((remote - d.lastRemoteMs) * 1000 * MAX_DRIFT_PPM / 1000000);
+                int64_t gap = cand - d.offsetUs;
+                d.offsetUs += (gap < creep) ? gap : creep;
+            }
+        }
+    }
+
+    // Pass 2: split messages.
+    uint8_t hi = p[0] & 0x3F;
+    int prevLo = -1;
+    bool afterTs = false;
+    uint64_t now = d.lastOutUs;
+    bool haveTs = false;
+
+    for (size_t i = 1; i < len; i++) {
+        uint8_t b = p[i];
+
+        if ((b & 0x80) && !afterTs) {
+            // Timestamp byte
+            uint8_t lo = b & 0x7F;
+            if (prevLo >= 0 && lo < prevLo) hi = (uint8_t)((hi + 1) & 0x3F);
+            prevLo = lo;
+            uint64_t remote = unwrapTimestamp((uint16_t)((hi << 7) | lo), d.lastTs13, d.lastRemoteMs);
+            now = detail::toLocal(d, remote, arrivalUs);
+            haveTs = true;
+            afterTs = true;
+            continue;
+        }
+        afterTs = false;
+        if (!haveTs) now = arrivalUs;   // SysEx continuation before any timestamp
+
+        if (b & 0x80) {
+            // Status byte
+            if (b >= 0xF8) {                       // Real-time: interleaves anything
+                detail::emit(d, sink, &b, 1, now);
+                continue;
+            }
+            if (b == 0xF7) {
+                if (d.inSysEx) {
+                    if (d.sysexOverflow) {
+                        d.sysexDropped++;
+                    } else if (d.sysexBuf && d.sysexLen < d.sysexCap) {
+                        d.sysexBuf[d.sysexLen++] = 0xF7;
+                        d.messages++;
+                        if (sink.sysex) sink.sysex(sink.ctx, d.sysexBuf, d.sysexLen, now);
+                    } else if (d.sysexBuf) {
+                        d.sysexDropped++;
+                    }
+                    d.inSysEx = false;
+                    d.sysexLen = 0;
+                } else {
+                    d.malformed++;
+                }
+                continue;
+            }
+            detail::abortSysEx(d);
+            if (d.msgLen > 0) { d.malformed++; d.msgLen = 0; }
+
+            if (b == 0xF0) {
+                d.runningStatus = 0;
+                d.inSysEx = true;
+                d.sysexOverflow = false;
+                d.sysexLen = 0;
+                if (d.sysexBuf && d.sysexCap > 0) d.sysexBuf[d.sysexLen++] = 0xF0;
+                continue;
+            }
+            // System common clears running status; channel messages set it.
+            d.runningStatus = (b < 0xF0) ? b : 0;
+            d.msg[0] = b;
+            d.msgLen = 1;
+            d.msgExpected = messageLength(b);
+            if (d.msgExpected == 1) {
+                detail::emit(d, sink, d.msg, 1, now);
+                d.msgLen = 0;
+            }
+            continue;
+        }
+
+        // Data byte
+        if (d.inSysEx) {
+            if (d.sysexBuf && d.sysexLen < d.sysexCap) d.sysexBuf[d.sysexLen++] = b;
+            else d.sysexOverflow = true;
+            continue;
+        }
+        if (d.msgLen == 0) {
+            if (!d.runningStatus) { d.malformed++; continue; }
+            d.msg[0] = d.runningStatus;
+            d.msgLen = 1;
+            d.msgExpected = messageLength(d.runningStatus);
+        }
+        d.msg[d.msgLen++] = b;
+        if (d.msgLen >= d.msgExpected) {
+            detail::emit(d, sink, d.msg, d.msgLen, now);
+            d.msgLen = 0;
+        }
+    }
+
+    // Only SysEx may continue in the next packet.
+    if (d.msgLen > 0) { d.malformed++; d.msgLen = 0; }
+}
+
+// ── Packet encoding ─────────────────────────────────────────────────────────
+//
+// The reverse of decodePacket: outgoing messages are packed into as few
+// packets as the link allows. Within a packet a message repeats the previous
+// timestamp only when it changes, and drops its status byte when it matches
+// the running status:
+//
+//   90 3C 64  90 40 64  90 43 64   (same ms)  ->  [hdr] [ts] 90 3C 64 40 64 43 64
+//
+// Every packet starts afresh with a timestamp and a status byte. The header
+// carries the high bits of the first message's time; a later message joins
+// the packet only if its timestamp can still be expressed against it (same
+// high bits, or one low-byte wrap). SysEx longer than the packet continues in
+// the next ones as bare data bytes after the header; the closing F7 gets its
+// own timestamp.
+
+static const size_t MIN_PACKET = 5;      // Header + timestamp + 3-byte message
+static const size_t MAX_PACKET = 512;    // ATT value limit (MTU 515)
+
+struct Encoder {
+    uint8_t* buf = nullptr;
+    size_t   cap = 0;
+    size_t   len = 0;
+    uint8_t  runningStatus = 0;
+    uint32_t lastMs = 0;          // Time of the last timestamp byte written
+};
+
+// Starts a packet in buf whose header carries the high bits of ms.
+inline void beginPacket(Encoder& e, uint8_t* buf, size_t cap, uint32_t ms) {
+    e.buf = buf;
+    e.cap = cap;
+    e.buf[0] = (uint8_t)(0x80 | ((ms >> 7) & 0x3F));
+    e.len = 1;
+    e.runningStatus = 0;
+    e.lastMs = ms;
+}
+
+namespace detail {
+    // Times never go backwards inside a packet.
+    inline uint32_t clampMs(const Encoder& e, uint32_t ms) {
+        return ((int32_t)(ms - e.lastMs) < 0) ? e.lastMs : ms;
+    }
+
+    // Whether the decoder will rebuild ms from a timestamp byte in this packet.
+    inline bool timestampFits(const Encoder& e, uint32_t ms) {
+        uint32_t hiStep = (ms >> 7) - (e.lastMs >> 7);
+        if (hiStep == 0) return true;
+        return hiStep == 1 && (ms & 0x7F) < (e.lastMs & 0x7F);
+    }
+
+    inline void putTimestamp(Encoder& e, uint32_t ms) {
+        e.buf[e.len++] = (uint8_t)(0x80 | (ms & 0x7F));
+        e.lastMs = ms;
+    }
+}
+
+// Appends a complete non-SysEx message (status first). Returns false, leaving
+// the packet untouched, when it does not fit.
+inline bool appendMessage(Encoder& e, const uint8_t* data, size_t len, uint32_t ms) {
+    ms = detail::clampMs(e, ms);
+    uint8_t status = data[0];
+    bool sameTs = e.len > 1 && ms == e.lastMs;
+    bool running = status < 0xF0 && status == e.runningStatus;
+
+    size_t need = running ? len - 1 : len;
+    if (!(running && sameTs)) need++;
+    if (e.cap - e.len < need) return false;
+    if (!(running && sameTs) && !detail::timestampFits(e, ms)) return false;
+
+    if (!(running && sameTs)) detail::putTimestamp(e, ms);
+    for (size_t i = running ? 1 : 0; i < len; i++) e.buf[e.len++] = data[i];
+
+    // Real-time leaves running status alone; system common clears it.
+    if (status < 0xF0) e.runningStatus = status;
+    else if (status < 0xF8) e.runningStatus = 0;
+    return true;
+}
+
+// Appends as much of a SysEx message (F0 ... F7 inclusive) as fits, starting
+// at offset (0 = not started yet). Returns the new offset; the message is
+// complete when it equals len. Call again on a fresh packet to continue.
+// data may also be one part of a longer SysEx (see pushSysEx()): without a
+// leading F0 it continues the one in progress, without a trailing F7 the
+// next part continues it.
+inline size_t appendSysEx(Encoder& e, const uint8_t* data, size_t len, size_t offset, uint32_t ms) {
+    ms = detail::clampMs(e, ms);
+    bool closes = data[len - 1] == 0xF7;
+    size_t last = closes ? len - 1 : len;        // Index of the closing F7, if any
+    if (offset == 0 && data[0] == 0xF0) {
+        if (e.cap - e.len < 2 || !detail::timestampFits(e, ms)) return 0;
+        detail::putTimestamp(e, ms);
+        e.buf[e.len++] = 0xF0;
+        e.runningStatus = 0;
+        offset = 1;
+    }
+    while (offset < last && e.len < e.cap) e.buf[e.len++] = data[offset++];
+    if (!closes) return offset;
+    if (offset == last && e.cap - e.len >= 2 && detail::timestampFits(e, ms)) {
+        detail::putTimestamp(e, ms);
+        e.buf[e.len++] = 0xF7;
+        offset = len;
+    }
+    return offset;
+}
+
+// ── Outbound queue ──────────────────────────────────────────────────────────
+//
+// Byte FIFO of whole messages, each stored as [length:2][time:8][bytes], the
+// time being MIDIClock::nowUs() at send. Not thread-safe on its own:
+// BLEConnection wraps push and pop in its spinlock.
+//
+// A SysEx longer than TX_ENTRY_MAX goes in as consecutive parts through
+// pushSysEx(), as the queue drains. While one is open, push() refuses
+// everything but real-time, which may interleave with SysEx on the wire.
+
+static const size_t TX_ENTRY_MAX = 512;   // Largest entry (one message or SysEx part)
+
+template <size_t N>
+struct TxQueue {
+    uint8_t  buf[N];
+    size_t   head = 0;
+    size_t   tail = 0;
+    size_t   used = 0;
+    uint32_t dropped = 0;         // Rejected by push() for lack of space
+    bool     sysexOpen = false;   // A long SysEx is part-way in (pushSysEx)
+
+    static const size_t ENTRY_HEADER = 10;
+
+    void put(uint8_t b) { buf[head] = b; head = (head + 1) % N; }
+    uint8_t get() { uint8_t b = buf[tail]; tail = (tail + 1) % N; return b; }
+
+    bool push(const uint8_t* data, size_t len, uint64_t timeUs) {
+        if (len == 0 || len > TX_ENTRY_MAX || (sysexOpen && data[0] < 0xF8) ||
+            !pushEntry(data, len, timeUs)) {
+            dropped++;
+            return false;
+        }
+        return true;
+    }
+
+    bool pushEntry(const uint8_t* data, size_t len, uint64_t timeUs) {
+        if (N - used < len + ENTRY_HEADER) return false;
+        put((uint8_t)len); put((uint8_t)(len >> 8));
+        for (int i = 0; i < 8; i++) put((uint8_t)(timeUs >> (8 * i)));
+        for (size_t i = 0; i < len; i++) put(data[i]);
+        used += len + ENTRY_HEADER;
+        return true;
+    }
+
+    // Copies the oldest message into out (at least TX_ENTRY_MAX bytes).
+    // Returns its length, or 0 when empty.
+    size_t pop(uint8_t* out, uint64_t& timeUs) {
+        if (used == 0) return 0;
+        size_t len = get();
+        len |= (size_t)get() << 8;
+        timeUs = 0;
+        for (int i = 0; i < 8; i++) timeUs |= (uint64_t)get() << (8 * i);
+        for (size_t i = 0; i < len; i++) out[i] = get();
+        used -= len + ENTRY_HEADER;
+        return len;
+    }
+
+    void clear() { head = tail = used = 0; sysexOpen = false; }
+};
+
+// A SysEx of any length being fed into a TxQueue in parts.
+struct SysExStream {
+    const uint8_t* data = nullptr;
+    size_t   length = 0;
+    size_t   offset = 0;          // Next byte to queue
+    uint64_t timeUs = 0;
+};
+
+inline void beginSysEx(SysExStream& s, const uint8_t* data, size_t length, uint64_t timeUs) {
+    s.data = data;
+    s.length = length;
+    s.offset = 0;
+    s.timeUs = timeUs;
+}
+
+inline bool sysExDone(const SysExStream& s) { return s.offset == s.length; }
+
+// Queues the next parts of s, each at most TX_ENTRY_MAX bytes, while they
+// fit. Returns the bytes queued: 0 when the queue is full, or while another
+// long SysEx is open. The queue stays closed to other messages until the
+// last part is in.
+template <size_t N>
+inline size_t pushSysEx(TxQueue<N>& q, SysExStream& s) {
+    if (s.offset == 0 && q.sysexOpen) return 0;
+    size_t queued = 0;
+    while (s.offset < s.length) {
+        size_t n = s.length - s.offset;
+        if (n > TX_ENTRY_MAX) n = TX_ENTRY_MAX;
+        if (!q.pushEntry(s.data + s.offset, n, s.timeUs)) break;
+        s.offset += n;
+        queued += n;
+        q.sysexOpen = s.offset < s.length;
+    }
+    return queued;
+}
+
+// Gives up on s part-way: reopens the queue. The receiver sees the SysEx
+// end at the next status byte.
+template <size_t N>
+inline void abortSysEx(TxQueue<N>& q, const SysExStream& s) {
+    if (s.offset > 0 && s.offset < s.length) q.sysexOpen = false;
+}
+
+// ── Flush ───────────────────────────────────────────────────────────────────
+//
+// Drains the queue into packets of at most maxPacket bytes (the ATT MTU minus
+// 3). pop(out, timeUs) returns the next message's length (0 = empty);
+// send(p, len) transmits one packet. A SysEx cut at the end of a packet resumes in the next.
+
+struct Packetizer {
+    uint8_t  entry[TX_ENTRY_MAX];  // Message being packed
+    size_t   entryLen = 0;
+    uint64_t entryUs = 0;
+    size_t   offset = 0;           // SysEx progress
+    bool     inSysEx = false;      // Between the parts of a long SysEx
+    uint8_t  packet[MAX_PACKET];
+    Encoder  enc;
+
+    // Counters
+    uint32_t packets = 0;
+    uint32_t messages = 0;
+};
+
+template <typename Pop, typename Send>
+inline void flush(Packetizer& p, size_t maxPacket, Pop pop, Send send) {
+    if (maxPacket > MAX_PACKET) maxPacket = MAX_PACKET;
+    if (maxPacket < MIN_PACKET) maxPacket = MIN_PACKET;
+    p.enc.len = 0;
+
+    for (;;) {
+        if (p.entryLen == 0) {
+            p.entryLen = pop(p.entry, p.entryUs);
+            p.offset = 0;
+            if (p.entryLen == 0) break;
+        }
+        uint32_t ms = (uint32_t)(p.entryUs / 1000);
+        if (p.enc.len == 0) beginPacket(p.enc, p.packet, maxPacket, ms);
+        bool fresh = p.enc.len == 1;
+
+        // A part without F0 continues a long SysEx; one that finds none
+        // open (it was aborted, or the link dropped) is stale.
+        bool part = p.entry[0] < 0x80 || (p.entry[0] == 0xF7 && p.entryLen == 1);
+        if (part && !p.inSysEx) { p.entryLen = 0; continue; }
+
+        bool done, progressed;
+        bool sysex = part || p.entry[0] == 0xF0;
+        if (sysex) {
+            size_t before = p.offset;
+            p.offset = appendSysEx(p.enc, p.entry, p.entryLen, p.offset, ms);
+            done = p.offset == p.entryLen;
+            progressed = p.offset != before;
+        } else {
+            done = progressed = appendMessage(p.enc, p.entry, p.entryLen, ms);
+        }
+        if (done) {
+            bool open = sysex && p.entry[p.entryLen - 1] != 0xF7;
+            if (sysex || p.entry[0] < 0xF8) p.inSysEx = open;   // Real-time leaves it open
+            if (!open) p.messages++;
+            p.entryLen = 0;
+            continue;
+        }
+
+        // Packet full (or the timestamp needs a new header): send it.
+        if (fresh && !progressed) { p.entryLen = 0; continue; }   // Can never fit
+        if (p.enc.len > 1) { send(p.packet, p.enc.len); p.packets++; }
+        p.enc.len = 0;
+    }
+    if (p.enc.len > 1) { send(p.packet, p.enc.len); p.packets++; }
+    p.enc.len = 0;
+}
+
+// ── Link statistics ─────────────────────────────────────────────────────────
+//
+// Rolling one-second counters for one direction of the link, kept in eight
+// 125 ms buckets so the rate follows changes without jumping once a second,
+// plus a moving average of how long messages waited:
+//
+//   TX  sendMidiMessage() -> notify() call: time spent in the outbound queue
+//   RX  arrival - reconstructed send time: the wait beyond the fastest packet
+//       seen, i.e. mostly the phase within the connection interval
+//
+// Neither includes the radio itself, which the two clocks cannot measure.
+
+struct RateMeter {
+    static const int      BUCKETS = 8;
+    static const uint64_t BUCKET_US = 125000;
+
+    uint64_t startUs[BUCKETS] = {};
+    uint32_t messages[BUCKETS] = {};
+    uint32_t packets[BUCKETS] = {};
+    uint32_t bytes[BUCKETS] = {};
+    uint32_t delayUs = 0;         // Moving average, 1/8 weight per sample
+    uint32_t maxDelayUs = 0;      // Worst since the meter was reset
+    bool     haveDelay = false;
+};
+
+struct Rates {
+    uint32_t messages;
+    uint32_t packets;
+    uint32_t bytes;
+};
+
+namespace detail {
+    inline int bucketFor(RateMeter& m, uint64_t nowUs) {
+        uint64_t slot = nowUs / RateMeter::BUCKET_US;
+        int i = (int)(slot % RateMeter::BUCKETS);
+        uint64_t start = slot * RateMeter::BUCKET_US;
+        if (m.startUs[i] != start) {
+            m.startUs[i] = start;
+            m.messages[i] = m.packets[i] = m.bytes[i] = 0;
+        }
+        return i;
+    }
+}
+
+inline void countPacket(RateMeter& m, uint64_t nowUs, size_t bytes) {
+    int i = detail::bucketFor(m, nowUs);
+    m.packets[i]++;
+    m.bytes[i] += (uint32_t)bytes;
+}
+
+inline void countMessage(RateMeter& m, uint64_t nowUs, uint64_t delayUs) {
+    int i = detail::bucketFor(m, nowUs);
+    m.messages[i]++;
+    uint32_t d = (delayUs > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)delayUs;
+    if (!m.haveDelay) { m.delayUs = d; m.haveDelay = true; }
+    else m.delayUs = (uint32_t)((int64_t)m.delayUs + ((int64_t)d - (int64_t)m.delayUs) / 8);
+    if (d > m.maxDelayUs) m.maxDelayUs = d;
+}
+
+// Totals over the second before nowUs.
+inline Rates perSecond(const RateMeter& m, uint64_t nowUs) {
+    Rates r = { 0, 0, 0 };
+    uint64_t window = RateMeter::BUCKETS * RateMeter::BUCKET_US;
+    for (int i = 0; i < RateMeter::BUCKETS; i++) {
+        if (m.startUs[i] > nowUs || nowUs - m.startUs[i] >= window) continue;
+        r.messages += m.messages[i];
+        r.packets += m.packets[i];
+        r.bytes += m.bytes[i];
+    }
+    return r;
+}
+
+// Snapshot returned by BLEConnection::getLinkReport().
+struct LinkReport {
+    uint16_t mtu;               // Effective ATT MTU (23 until negotiated)
+    uint16_t maxPacket;         // BLE-MIDI packet size in use: mtu - 3
+    uint32_t intervalUs;        // Effective connection interval (0 = not connected)
+    Rates    tx;                // Per second, last second
+    Rates    rx;
+    uint32_t txQueueDelayUs;    // Average wait in the outbound queue
+    uint32_t txMaxQueueDelayUs;
+    uint32_t rxDelayUs;         // Average inbound wait (see above)
+    uint32_t latencyUs;         // Outbound estimate: queue wait + half an interval
+};
+
+inline LinkReport makeReport(const RateMeter& tx, const RateMeter& rx, uint64_t nowUs,
+                             uint16_t mtu, uint32_t intervalUs) {
+    LinkReport r;
+    r.mtu = mtu;
+    r.maxPacket = (uint16_t)(mtu > 3 ? mtu - 3 : 0);
+    r.intervalUs = intervalUs;
+    r.tx = perSecond(tx, nowUs);
+    r.rx = perSecond(rx, nowUs);
+    r.txQueueDelayUs = tx.delayUs;
+    r.txMaxQueueDelayUs = tx.maxDelayUs;
+    r.rxDelayUs = rx.delayUs;
+    r.latencyUs = tx.delayUs + intervalUs / 2;
+    return r;
+}
+
+// ── Central (client) state machine ──────────────────────────────────────────
+//
+// Drives BLEClientConnection: scan for the BLE-MIDI service, connect to each
+// controller found, subscribe to its MIDI characteristic, and retry after a
+// failure or a drop. The machine makes no BLE calls. The driver feeds it
+// events (advertisements, results, disconnects) and asks nextAction() what
+// to do next, which keeps the policy testable on the host:
+//
+//   Idle --CONNECT--> Connecting --ok--> Connected --SUBSCRIBE--> Subscribing
+//                          |                                          |
+//                          +-- fail / timeout --> Backoff <-- fail ---+
+//                                                   |          Ready <-ok
+//                      (retryDelayUs, then Idle) <--+    drop --^
+//
+// Scanning stops while a connection is being set up (Bluedroid cannot do
+// both reliably) and while every link is busy.
+
+static const int MAX_LINKS = 4;
+static const int MAX_CANDIDATES = 8;
+
+struct Address {
+    uint8_t bytes[6];
+    uint8_t type;                 // Public / random, as reported by the scan
+};
+
+inline bool sameAddress(const Address& a, const Address& b) {
+    for (int i = 0; i < 6; i++) if (a.bytes[i] != b.bytes[i]) return false;
+    return true;
+}
+
+enum LinkState : uint8_t {
+    LINK_IDLE = 0,
+    LINK_CONNECTING,              // CONNECT issued
+    LINK_CONNECTED,               // Waiting for SUBSCRIBE to be issued
+    LINK_SUBSCRIBING,             // SUBSCRIBE issued
+    LINK_READY,                   // Notifications flowing
+    LINK_BACKOFF                  // Failed or dropped; slot reserved until retry
+};
+
+enum ActionType : uint8_t {
+    ACTION_NONE = 0,
+    ACTION_START_SCAN,
+    ACTION_STOP_SCAN,
+    ACTION_CONNECT,               // link, addr
+    ACTION_SUBSCRIBE,             // link
+    ACTION_DISCONNECT             // link
+};
+
+struct Action {
+    ActionType type;
+    int        link;
+    Address    addr;
+};
+
+struct Link {
+    LinkState state = LINK_IDLE;
+    Address   addr = {};
+    uint64_t  sinceUs = 0;        // Entry into the current state
+    uint8_t   failures = 0;       // Consecutive; reset once Ready
+};
+
+struct Central {
+    Link     links[MAX_LINKS];
+    int      maxLinks = 1;
+    bool     running = false;
+    bool     scanning = false;
+
+    // Controllers seen advertising the service, oldest first.
+    Address  candidates[MAX_CANDIDATES];
+    int      candidateCount = 0;
+
+    uint64_t stepTimeoutUs = 10000000;   // Connect or subscribe taking longer fails
+    uint64_t retryDelayUs  = 2000000;    // Backoff, doubled per consecutive failure
+    uint8_t  maxBackoffShift = 4;        // Up to 16 x retryDelayUs
+
+    // Counters
+    uint32_t connects = 0;
+    uint32_t failures = 0;
+    uint32_t drops = 0;
+};
+
+namespace detail {
+    inline int findLink(const Central& c, const Address& a) {
+        for (int i = 0; i < c.maxLinks; i++) {
+            if (c.links[i].state != LINK_IDLE && sameAddress(c.links[i].addr, a)) return i;
+        }
+        return -1;
+    }
+
+    inline int freeLink(const Central& c) {
+        for (int i = 0; i < c.maxLinks; i++) if (c.links[i].state == LINK_IDLE) return i;
+        return -1;
+    }
+
+    inline bool settingUp(const Central& c) {
+        for (int i = 0; i < c.maxLinks; i++) {
+            LinkState s = c.links[i].state;
+            if (s == LINK_CONNECTING || s == LINK_CONNECTED || s == LINK_SUBSCRIBING) return true;
+        }
+        return false;
+    }
+
+    inline void enter(Link& l, LinkState s, uint64_t nowUs) { l.state = s; l.sinceUs = nowUs; }
+
+    inline void fail(Central& c, Link& l, uint64_t nowUs) {
+        c.failures++;
+        if (l.failures < 255) l.failures++;
+        enter(l, LINK_BACKOFF, nowUs);
+    }
+
+    inline Action act(ActionType t, int link = -1) {
+        Action a;
+        a.type = t;
+        a.link = link;
+        a.addr = Address();
+        return a;
+    }
+}
+
+inline void centralStart(Central& c, int maxLinks) {
+    c.maxLinks = (maxLinks < 1) ? 1 : (maxLinks > MAX_LINKS ? MAX_LINKS : maxLinks);
+    c.running = true;
+}
+
+// Stops scanning and connecting. Links stay up; the driver tears them down.
+inline void centralStop(Central& c) {
+    c.running = false;
+    c.candidateCount = 0;
+}
+
+// An advertisement was seen. Only controllers offering the BLE-MIDI service,
+// not already linked (or backing off), and not already queued are kept.
+inline void onAdvertisement(Central& c, const Address& a, bool hasMidiService) {
+    if (!c.running || !hasMidiService) return;
+    if (detail::findLink(c, a) >= 0) return;
+    for (int i = 0; i < c.candidateCount; i++) if (sameAddress(c.candidates[i], a)) return;
+    if (c.candidateCount >= MAX_CANDIDATES) return;
+    c.candidates[c.candidateCount++] = a;
+}
+
+// The scan ran its course (or was stopped).
+inline void onScanComplete(Central& c) { c.scanning = false; }
+
+inline void onConnectResult(Central& c, int link, bool ok, uint64_t nowUs) {
+    Link& l = c.links[link];
+    if (l.state != LINK_CONNECTING) return;
+    if (ok) detail::enter(l, LINK_CONNECTED, nowUs);
+    else detail::fail(c, l, nowUs);
+}
+
+// Service and characteristic found, notifications enabled.
+inline void onSubscribeResult(Central& c, int link, bool ok, uint64_t nowUs) {
+    Link& l = c.links[link];
+    if (l.state != LINK_SUBSCRIBING) return;
+    if (ok) {
+        detail::enter(l, LINK_READY, nowUs);
+        l.failures = 0;
+        c.connects++;
+    } else {
+        detail::fail(c, l, nowUs);
+    }
+}
+
+inline void onDisconnected(Central& c, int link, uint64_t nowUs) {
+    Link& l = c.links[link];
+    if (l.state == LINK_IDLE || l.state == LINK_BACKOFF) return;
+    if (l.state == LINK_READY) { c.drops++; detail::enter(l, LINK_BACKOFF, nowUs); }
+    else detail::fail(c, l, nowUs);
+}
+
+inline uint64_t backoffUs(const Central& c, const Link& l) {
+    uint8_t shift = (l.failures > 0) ? (uint8_t)(l.failures - 1) : 0;
+    if (shift > c.maxBackoffShift) shift = c.maxBackoffShift;
+    return c.retryDelayUs << shift;
+}
+
+// The next thing the driver should do. Call until it returns ACTION_NONE,
+// reporting each result back before asking again.
+inline Action nextAction(Central& c, uint64_t nowUs) {
+    // Steps that never answered fail; expired backoffs free their slot.
+    for (int i = 0; i < c.maxLinks; i++) {
+        Link& l = c.links[i];
+        bool pending = l.state == LINK_CONNECTING || l.state == LINK_SUBSCRIBING;
+        if (pending && nowUs - l.sinceUs >= c.stepTimeoutUs) {
+            detail::fail(c, l, nowUs);
+            return detail::act(ACTION_DISCONNECT, i);
+        }
+        if (l.state == LINK_BACKOFF && nowUs - l.sinceUs >= backoffUs(c, l)) {
+            detail::enter(l, LINK_IDLE, nowUs);
+        }
+    }
+
+    for (int i = 0; i < c.maxLinks; i++) {
+        if (c.links[i].state == LINK_CONNECTED) {
+            detail::enter(c.links[i], LINK_SUBSCRIBING, nowUs);
+            return detail::act(ACTION_SUBSCRIBE, i);
+        }
+    }
+
+    int slot = detail::freeLink(c);
+    if (c.running && slot >= 0 && c.candidateCount > 0 && !detail::settingUp(c)) {
+        if (c.scanning) {
+            c.scanning = false;
+            return detail::act(ACTION_STOP_SCAN);
+        }
+        Address a = c.candidates[0];
+        for (int i = 1; i < c.candidateCount; i++) c.candidates[i - 1] = c.candidates[i];
+        c.candidateCount--;
+
+        Link& l = c.links[slot];
+        // A controller coming back keeps its failure count; a new one starts clean.
+        if (!sameAddress(l.addr, a)) l.failures = 0;
+        l.addr = a;
+        detail::enter(l, LINK_CONNECTING, nowUs);
+        Action act = detail::act(ACTION_CONNECT, slot);
+        act.addr = a;
+        return act;
+    }
+
+    bool wantScan = c.running && slot >= 0 && c.candidateCount == 0 && !detail::settingUp(c);
+    if (wantScan && !c.scanning) {
+        c.scanning = true;
+        return detail::act(ACTION_START_SCAN);
+    }
+    if (!wantScan && c.scanning && (slot < 0 || !c.running)) {
+        c.scanning = false;
+        return detail::act(ACTION_STOP_SCAN);
+    }
+    return detail::act(ACTION_NONE);
+}
+
+inline int readyLinks(const Central& c) {
+    int n = 0;
+    for (int i = 0; i < c.maxLinks; i++) if (c.links[i].state == LINK_READY) n++;
+    return n;
+}
+
+}} // namespace blemidi::core
+
+#endif // BLE_MIDI_TRANSPORT_CORE_H
@@ -57,7 +57,10 @@
 //
 //   #include <USBConnection.h>          // USB Host MIDI 1.0
 //   #include <USBMIDI2Connection.h>     // USB Host MIDI 2.0
+//   #include <USBMIDICable.h>           // One port of a multi-port USB interface
+//   #include <USBMIDI2Block.h>          // One Function Block of a USB MIDI 2.0 device
 //   #include <BLEConnection.h>
+//   #include <BLEClientConnection.h>    // BLE central (connects to controllers)
 //   #include <UARTConnection.h>
 //   #include <ESPNowConnection.h>
 //   #include <RTPMIDIConnection.h>
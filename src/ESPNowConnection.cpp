@@ -75,7 +75,7 @@ void ESPNowConnection::_onReceive(const esp_now_recv_info_t* info, const uint8_t
 void ESPNowConnection::_onReceive(const uint8_t* mac, const uint8_t* data, int len) {
 #endif
     if (!_instance || len < 2 || len > 3) return;
-    _instance->enqueueMidiMessage(data, len);
+    _instance->enqueueMidiMessage(data, len, MIDIClock::nowUs());
 }
 
 #if ESP_ARDUINO_VERSION >= ESP_ARDUINO_VERSION_VAL(3, 3, 0)
@@ -126,7 +126,7 @@ void ESPNowConnection::getLocalMAC(uint8_t mac[6]) const {
 // Spinlock protects cross-task access: enqueue runs in the WiFi task,
 // dequeue runs in the main loop.
 
-bool ESPNowConnection::enqueueMidiMessage(const uint8_t* data, size_t length) {
+bool ESPNowConnection::enqueueMidiMessage(const uint8_t* data, size_t length, uint64_t timestampUs) {
     portENTER_CRITICAL(&queueMux);
     int next = (queueHead + 1) % QUEUE_SIZE;
     if (next == queueTail) {
@@ -137,6 +137,7 @@ bool ESPNowConnection::enqueueMidiMessage(const uint8_t* data, size_t length) {
                    ? sizeof(espNowQueue[0].data) : length;
     memcpy(espNowQueue[queueHead].data, data, copyLen);
     espNowQueue[queueHead].length = copyLen;
+    espNowQueue[queueHead].timestampUs = timestampUs;
     queueHead = next;
     portEXIT_CRITICAL(&queueMux);
     return true;
@@ -157,6 +158,6 @@ bool ESPNowConnection::dequeueMidiMessage(RawEspNowMessage& msg) {
 void ESPNowConnection::processQueue() {
     RawEspNowMessage msg;
     while (dequeueMidiMessage(msg)) {
-        dispatchMidiData(msg.data, msg.length);
+        dispatchMidiData(msg.data, msg.length, msg.timestampUs);
     }
 }
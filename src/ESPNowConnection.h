@@ -13,6 +13,7 @@
 struct RawEspNowMessage {
     uint8_t data[4];   // Up to 3 MIDI bytes (status + data1 + data2)
     size_t length;
+    uint64_t timestampUs;   // MIDIClock::nowUs() when the packet was received
 };
 
 class ESPNowConnection : public MIDITransport {
@@ -57,7 +58,7 @@ private:
     volatile int queueTail;
     portMUX_TYPE queueMux;
 
-    bool enqueueMidiMessage(const uint8_t* data, size_t length);
+    bool enqueueMidiMessage(const uint8_t* data, size_t length, uint64_t timestampUs);
     bool dequeueMidiMessage(RawEspNowMessage& msg);
     void processQueue();
 
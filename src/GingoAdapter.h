@@ -57,44 +57,25 @@ inline uint8_t activeNotesToGingo(const MIDIHandler& handler,
                                   gingoduino::GingoNote* output) {
     if (!output) return 0;
 
-    std::vector<std::string> noteNames = handler.getActiveNotesVector();
-    uint8_t count = 0;
-    for (const auto& name : noteNames) {
-        if (count >= MAX_CHORD_NOTES) break;
-        output[count++] = gingoduino::GingoNote(name.c_str());
-    }
-    return count;
+    uint8_t midiNotes[MAX_CHORD_NOTES];
+    uint8_t count = handler.getActiveNoteNumbers(midiNotes, MAX_CHORD_NOTES);
+    return midiToGingoNotes(midiNotes, count, output);
 }
 
 // =========================================================================
 // Chord Identification
 // =========================================================================
 
-// Identifies the chord from the last chord in the MIDIHandler queue.
+// Identifies a chord from a specific chordIndex in the MIDIHandler chord index.
 // Writes the chord name (e.g., "CM", "Am7", "Gdim") into the output buffer.
 // Returns true if a chord was identified, false otherwise.
-inline bool identifyLastChord(const MIDIHandler& handler,
-                              char* output, uint8_t maxLen) {
+inline bool identifyChord(const MIDIHandler& handler, int chordIndex,
+                          char* output, uint8_t maxLen) {
     if (!output || maxLen < 2) return false;
 
-    const auto& queue = handler.getQueue();
-    if (queue.empty()) return false;
-
-    int chordIdx = handler.lastChord(queue);
-    if (chordIdx <= 0) return false;
-
-    std::vector<std::string> noteStrs = handler.getChord(
-        chordIdx, queue, {"note"}
-    );
-
-    if (noteStrs.empty()) return false;
-
     uint8_t midiNotes[MAX_CHORD_NOTES];
-    uint8_t count = 0;
-    for (const auto& s : noteStrs) {
-        if (count >= MAX_CHORD_NOTES) break;
-        midiNotes[count++] = (uint8_t)atoi(s.c_str());
-    }
+    uint8_t count = handler.getChordNotes(chordIndex, midiNotes, MAX_CHORD_NOTES);
+    if (count == 0) return false;
 
     gingoduino::GingoNote notes[MAX_CHORD_NOTES];
     uint8_t n = midiToGingoNotes(midiNotes, count, notes);
@@ -102,32 +83,11 @@ inline bool identifyLastChord(const MIDIHandler& handler,
     return gingoduino::GingoChord::identify(notes, n, output, maxLen);
 }
 
-// Identifies a chord from a specific chordIndex in the queue.
+// Identifies the most recent chord played.
 // Returns true if a chord was identified, false otherwise.
-inline bool identifyChord(const MIDIHandler& handler, int chordIndex,
-                          char* output, uint8_t maxLen) {
-    if (!output || maxLen < 2) return false;
-
-    const auto& queue = handler.getQueue();
-    if (queue.empty()) return false;
-
-    std::vector<std::string> noteStrs = handler.getChord(
-        chordIndex, queue, {"note"}
-    );
-
-    if (noteStrs.empty()) return false;
-
-    uint8_t midiNotes[MAX_CHORD_NOTES];
-    uint8_t count = 0;
-    for (const auto& s : noteStrs) {
-        if (count >= MAX_CHORD_NOTES) break;
-        midiNotes[count++] = (uint8_t)atoi(s.c_str());
-    }
-
-    gingoduino::GingoNote notes[MAX_CHORD_NOTES];
-    uint8_t n = midiToGingoNotes(midiNotes, count, notes);
-
-    return gingoduino::GingoChord::identify(notes, n, output, maxLen);
+inline bool identifyLastChord(const MIDIHandler& handler,
+                              char* output, uint8_t maxLen) {
+    return identifyChord(handler, handler.lastChord(), output, maxLen);
 }
 
 // =========================================================================
@@ -166,8 +126,8 @@ inline uint8_t deduceFieldFromQueue(const MIDIHandler& handler,
     int seenChords[MAX_CHORD_HISTORY];
     uint8_t seenCount = 0;
 
-    for (const auto& event : queue) {
-        if (event.chordIndex <= 0 || event.status != "NoteOn") continue;
+    for (const MIDIEventRecord& event : queue.records()) {
+        if (event.chordIndex <= 0 || event.statusCode != MIDI_NOTE_ON) continue;
 
         // Check if we already processed this chordIndex
         bool seen = false;
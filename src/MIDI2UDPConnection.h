@@ -28,16 +28,17 @@
 //   Control Change value :  7-bit  (128 steps)   → 32-bit (4 294 967 296 steps)
 //   Pitch Bend           : 14-bit  (16 384 steps) → 32-bit (4 294 967 296 steps)
 //
-// The library automatically scales values in both directions so all existing
-// callbacks and queue entries remain compatible with MIDI 1.0 code.
-// High-resolution MIDI 2.0 values are accessible via lastResult().
+// Registered with midiHandler, received packets go to the handler as UMP and
+// the queue keeps the full resolution (velocity16, value32, pitchBend32,
+// group) next to the scaled-down MIDI 1.0 fields. Without a UMP consumer the
+// transport scales down and dispatches MIDI 1.0 bytes.
 //
 // Signal path (send):
 //   MIDI 1.0 bytes → scale up → UMP Type 4 (64-bit) → UDP → peer ESP32
 //
 // Signal path (receive):
-//   UDP → validate magic → UMPParser::parseMIDI2() → scale down → dispatchMidiData()
-//   Raw 32-bit values accessible via lastResult() immediately after task().
+//   UDP → validate magic → dispatchUMPData()       (UMP consumer, e.g. midiHandler)
+//                        → scale down → dispatchMidiData()  (MIDI 1.0 callback only)
 //
 // Prerequisites:
 //   1. #include "MIDI2Support.h"  must appear BEFORE this file.
@@ -64,10 +65,9 @@
 //       for (const auto& ev : q) {
 //           if (ev.index <= lastIndex) continue;
 //           lastIndex = ev.index;
-//           // Standard MIDI 1.0 values in ev.velocity, ev.note, etc.
-//           // MIDI 2.0 high-res values via:
-//           const UMPResult& r = midi2udp.lastResult();
-//           if (r.valid && r.isMIDI2) { /* r.value = 32-bit */ }
+//           // MIDI 1.0 values in ev.velocity7, ev.noteNumber, etc.
+//           // MIDI 2.0 values in ev.velocity16, ev.value32 (CC),
+//           // ev.pitchBend32 and ev.group.
 //       }
 //   }
 
@@ -147,21 +147,16 @@ public:
                       ((uint32_t)buf[10] <<  8) |  (uint32_t)buf[11];
 
         uint8_t mt = (w0 >> 28) & 0x0F;
+        const uint32_t words[2] = { w0, w1 };
 
         if (mt == UMP_MT_MIDI2_VOICE) {
             // Type 4 — MIDI 2.0 Channel Voice (64-bit)
-            UMPWord64 pkt(w0, w1);
-            _lastResult = UMPParser::parseMIDI2(pkt);
-            if (_lastResult.valid && _lastResult.midi1Len > 0) {
-                dispatchMidiData(_lastResult.midi1, _lastResult.midi1Len);
-            }
+            _lastResult = UMPParser::parseMIDI2(UMPWord64(w0, w1));
+            _dispatch(words, 2);
         } else if (mt == UMP_MT_MIDI1_VOICE) {
             // Type 2 — MIDI 1.0 in UMP (32-bit, w1 unused)
-            UMPWord32 pkt(w0);
-            _lastResult = UMPParser::parseMIDI1(pkt);
-            if (_lastResult.valid && _lastResult.midi1Len > 0) {
-                dispatchMidiData(_lastResult.midi1, _lastResult.midi1Len);
-            }
+            _lastResult = UMPParser::parseMIDI1(UMPWord32(w0));
+            _dispatch(words, 1);
         }
         // Other UMP message types are silently ignored.
     }
@@ -236,6 +231,8 @@ public:
     }
 
     // lastResult() — the UMPResult from the most recently received packet.
+    // Kept for compatibility: with midiHandler the queued events already
+    // carry these values, so there is no need to read this after task().
     // Access the 32-bit MIDI 2.0 value via result.value.
     // For NoteOn/Off: 32-bit value holds velocity in the upper 16 bits
     //   → uint16_t vel16 = (uint16_t)(result.value >> 16)
@@ -260,6 +257,15 @@ private:
     int       _targetPort;
     UMPResult _lastResult;
 
+    // The packet as UMP to a UMP consumer, else scaled down to MIDI 1.0.
+    void _dispatch(const uint32_t* words, uint8_t count) {
+        if (hasUMPConsumer()) {
+            dispatchUMPData(words, count);
+        } else if (_lastResult.valid && _lastResult.midi1Len > 0) {
+            dispatchMidiData(_lastResult.midi1, _lastResult.midi1Len);
+        }
+    }
+
     bool _sendUMP(uint32_t w0, uint32_t w1) {
         uint8_t buf[12];
 
@@ -0,0 +1,190 @@
+#ifndef MIDI_CHORD_TABLE_H
+#define MIDI_CHORD_TABLE_H
+
+// MIDIChordTable — constant-time chord recognition from a pitch-class set.
+//
+// A 12-bit pitch-class mask (bit n = pitch class n, C = bit 0) has only 4096
+// values, so the chord for every set is computed once, at compile time, into
+// a 4096-entry table (8 KB of flash). The table is keyed by the set rotated so
+// the bass sits on bit 0; each entry holds the root (relative to the bass),
+// the quality and the inversion. lookup() is one rotation and one load.
+//
+// Only exact matches are named: the set must equal one quality's intervals
+// (doubled notes collapse into the set). When a set has several readings
+// (C6 = Am7/C, Csus2 = Gsus4/C, augmented and dim7 are symmetric) the chord
+// rooted on the bass wins; otherwise the first quality in the list below.
+//
+// Pure C++14, no Arduino dependency: used by MIDIHandler and the native tests.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+enum MIDIChordQuality : uint8_t {
+    CHORD_NONE = 0,
+    CHORD_MAJOR,           // M       1 3 5
+    CHORD_MINOR,           // m       1 b3 5
+    CHORD_DIMINISHED,      // dim     1 b3 b5
+    CHORD_AUGMENTED,       // aug     1 3 #5
+    CHORD_SUS2,            // sus2    1 2 5
+    CHORD_SUS4,            // sus4    1 4 5
+    CHORD_POWER,           // 5       1 5
+    CHORD_DOMINANT7,       // 7       1 3 5 b7
+    CHORD_MAJOR7,          // 7M      1 3 5 7
+    CHORD_MINOR7,          // m7      1 b3 5 b7
+    CHORD_HALF_DIMINISHED, // m7(b5)  1 b3 b5 b7
+    CHORD_DIMINISHED7,     // dim7    1 b3 b5 bb7
+    CHORD_MINOR_MAJOR7,    // m7M     1 b3 5 7
+    CHORD_AUGMENTED7,      // 7(#5)   1 3 #5 b7
+    CHORD_SIXTH,           // 6       1 3 5 6
+    CHORD_MINOR6,          // m6      1 b3 5 6
+    CHORD_DOMINANT7_SUS4,  // 7sus4   1 4 5 b7
+    CHORD_ADD9,            // add9    1 3 5 9
+    CHORD_DOMINANT9,       // 9       1 3 5 b7 9
+    CHORD_MAJOR9,          // 7M(9)   1 3 5 7 9
+    CHORD_MINOR9,          // m9      1 b3 5 b7 9
+    CHORD_QUALITY_COUNT
+};
+
+// Result of a lookup. inversion is the position of the bass in the chord's
+// stacking order: 0 = root position, 1 = third, 2 = fifth, 3 = seventh (or
+// added tone), 4 = ninth; CHORD_BASS_NOT_IN_CHORD when the bass is not a
+// chord tone (slash chord).
+struct MIDIChordInfo {
+    uint8_t root;                 // Pitch class 0-11
+    MIDIChordQuality quality;     // CHORD_NONE if the set is not a known chord
+    uint8_t inversion;
+    uint8_t bass;                 // Pitch class 0-11
+    bool valid() const { return quality != CHORD_NONE; }
+};
+
+static const uint8_t CHORD_BASS_NOT_IN_CHORD = 0x0F;
+
+class MIDIChordTable {
+public:
+    // pcMask: 12-bit pitch-class set. bassPc: pitch class of the lowest note.
+    static MIDIChordInfo lookup(uint16_t pcMask, uint8_t bassPc) {
+        bassPc %= 12;
+        uint16_t e = table().entries[rotateDown(pcMask & 0x0FFF, bassPc)];
+        MIDIChordInfo info;
+        info.root = static_cast<uint8_t>((bassPc + (e & 0x0F)) % 12);
+        info.quality = static_cast<MIDIChordQuality>((e >> 4) & 0x1F);
+        info.inversion = static_cast<uint8_t>((e >> 9) & 0x0F);
+        info.bass = bassPc;
+        return info;
+    }
+
+    // Lowest note is the bass; order of `notes` does not matter.
+    static MIDIChordInfo fromNotes(const uint8_t* notes, uint8_t count) {
+        uint16_t mask = 0;
+        uint8_t bass = 127;
+        for (uint8_t i = 0; i < count; i++) {
+            mask |= static_cast<uint16_t>(1u << (notes[i] % 12));
+            if (notes[i] < bass) bass = notes[i];
+        }
+        return lookup(mask, bass % 12);
+    }
+
+    static const char* suffix(MIDIChordQuality q) {
+        static const char* const names[CHORD_QUALITY_COUNT] = {
+            "", "M", "m", "dim", "aug", "sus2", "sus4", "5",
+            "7", "7M", "m7", "m7(b5)", "dim7", "m7M", "7(#5)",
+            "6", "m6", "7sus4", "add9", "9", "7M(9)", "m9"
+        };
+        return (q < CHORD_QUALITY_COUNT) ? names[q] : "";
+    }
+
+    // Writes e.g. "CM", "Am7", "G7/D" (bass appended unless root position).
+    // Writes an empty string for CHORD_NONE.
+    static const char* format(const MIDIChordInfo& info, char* buf, size_t bufLen) {
+        static const char* const pc[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        if (!buf || bufLen == 0) return buf;
+        if (!info.valid()) { buf[0] = '\0'; return buf; }
+        if (info.inversion == 0) {
+            snprintf(buf, bufLen, "%s%s", pc[info.root], suffix(info.quality));
+        } else {
+            snprintf(buf, bufLen, "%s%s/%s", pc[info.root], suffix(info.quality), pc[info.bass]);
+        }
+        return buf;
+    }
+
+private:
+    struct QualityDef {
+        uint16_t intervals;   // Pitch-class set with the root on bit 0
+        uint8_t tones[5];     // Intervals in stacking order (root, 3rd, 5th, 7th, 9th)
+        uint8_t toneCount;
+    };
+
+    static constexpr uint16_t rotateDown(uint16_t mask, uint8_t n) {
+        return static_cast<uint16_t>(((mask >> n) | (mask << (12 - n))) & 0x0FFF);
+    }
+
+    static constexpr uint16_t rotateUp(uint16_t mask, uint8_t n) {
+        return static_cast<uint16_t>(((mask << n) | (mask >> (12 - n))) & 0x0FFF);
+    }
+
+    static constexpr uint16_t pack(int rootOffset, int quality, int inversion) {
+        return static_cast<uint16_t>(rootOffset | (quality << 4) | (inversion << 9));
+    }
+
+    // Entries pack the root offset (bits 0-3), quality (4-8) and inversion
+    // (9-12) for a set whose bass is on bit 0; if bit 0 is clear the bass is
+    // not in the set. Built by writing every (quality, root offset) pair to
+    // its key, 21 x 12 stores, rather than testing each of the 4096 sets.
+    struct Table {
+        uint16_t entries[4096];
+        constexpr Table() : entries() {
+            // Indexed by MIDIChordQuality; order sets the preference between readings.
+            const QualityDef defs[CHORD_QUALITY_COUNT] = {
+                { 0x000, { 0, 0, 0, 0, 0 },   0 },  // CHORD_NONE
+                { 0x091, { 0, 4, 7, 0, 0 },   3 },  // M
+                { 0x089, { 0, 3, 7, 0, 0 },   3 },  // m
+                { 0x049, { 0, 3, 6, 0, 0 },   3 },  // dim
+                { 0x111, { 0, 4, 8, 0, 0 },   3 },  // aug
+                { 0x085, { 0, 2, 7, 0, 0 },   3 },  // sus2
+                { 0x0A1, { 0, 5, 7, 0, 0 },   3 },  // sus4
+                { 0x081, { 0, 7, 0, 0, 0 },   2 },  // 5
+                { 0x491, { 0, 4, 7, 10, 0 },  4 },  // 7
+                { 0x891, { 0, 4, 7, 11, 0 },  4 },  // 7M
+                { 0x489, { 0, 3, 7, 10, 0 },  4 },  // m7
+                { 0x449, { 0, 3, 6, 10, 0 },  4 },  // m7(b5)
+                { 0x249, { 0, 3, 6, 9, 0 },   4 },  // dim7
+                { 0x889, { 0, 3, 7, 11, 0 },  4 },  // m7M
+                { 0x511, { 0, 4, 8, 10, 0 },  4 },  // 7(#5)
+                { 0x291, { 0, 4, 7, 9, 0 },   4 },  // 6
+                { 0x289, { 0, 3, 7, 9, 0 },   4 },  // m6
+                { 0x4A1, { 0, 5, 7, 10, 0 },  4 },  // 7sus4
+                { 0x095, { 0, 4, 7, 2, 0 },   4 },  // add9
+                { 0x495, { 0, 4, 7, 10, 2 },  5 },  // 9
+                { 0x895, { 0, 4, 7, 11, 2 },  5 },  // 7M(9)
+                { 0x48D, { 0, 3, 7, 10, 2 },  5 },  // m9
+            };
+
+            for (int q = 1; q < CHORD_QUALITY_COUNT; q++) {
+                for (int r = 0; r < 12; r++) {
+                    // Root r semitones above the bass.
+                    uint16_t key = rotateUp(defs[q].intervals, static_cast<uint8_t>(r));
+
+                    // First quality wins, except that a reading rooted on the
+                    // bass beats any earlier one.
+                    uint16_t cur = entries[key];
+                    if (cur != 0 && !(r == 0 && (cur & 0x0F) != 0)) continue;
+
+                    int inversion = CHORD_BASS_NOT_IN_CHORD;
+                    int bassInterval = (12 - r) % 12;
+                    for (int t = 0; t < defs[q].toneCount; t++) {
+                        if (defs[q].tones[t] == bassInterval) { inversion = t; break; }
+                    }
+                    entries[key] = pack(r, q, inversion);
+                }
+            }
+        }
+    };
+
+    static const Table& table() {
+        static constexpr Table t{};
+        return t;
+    }
+};
+
+#endif // MIDI_CHORD_TABLE_H
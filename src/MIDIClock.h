@@ -0,0 +1,55 @@
+#ifndef MIDI_CLOCK_H
+#define MIDI_CLOCK_H
+
+#include <cstdint>
+
+// Monotonic 64-bit microsecond clock used to timestamp incoming MIDI.
+//
+// On ESP32 it reads esp_timer_get_time(), which is safe to call from the USB,
+// BLE and WiFi tasks where transports enqueue received packets; elsewhere it
+// falls back to std::chrono::steady_clock. Native tests can install their own
+// source to drive time by hand:
+//
+//   static uint64_t fakeUs = 0;
+//   MIDIClock::setSource([]() -> uint64_t { return fakeUs; });
+//   ...
+//   MIDIClock::setSource(nullptr);   // back to the platform clock
+
+#if defined(ESP_PLATFORM)
+  #include "esp_timer.h"
+#else
+  #include <chrono>
+#endif
+
+class MIDIClock {
+public:
+    typedef uint64_t (*Source)();
+
+    // Microseconds since boot (or since an arbitrary epoch on the host).
+    static uint64_t nowUs() {
+        Source s = source();
+        return s ? s() : platformNowUs();
+    }
+
+    static uint32_t nowMs() { return static_cast<uint32_t>(nowUs() / 1000); }
+
+    // nullptr restores the platform clock.
+    static void setSource(Source s) { source() = s; }
+
+private:
+    static Source& source() {
+        static Source s = nullptr;
+        return s;
+    }
+
+    static uint64_t platformNowUs() {
+#if defined(ESP_PLATFORM)
+        return static_cast<uint64_t>(esp_timer_get_time());
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+};
+
+#endif // MIDI_CLOCK_H
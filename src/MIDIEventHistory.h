@@ -0,0 +1,150 @@
+#ifndef MIDI_EVENT_HISTORY_H
+#define MIDI_EVENT_HISTORY_H
+
+// Long-running event history (PSRAM when available, heap otherwise).
+//
+// Records live in fixed-size chunks. The history never moves a record once it
+// is written: growing links in one more chunk (only the small chunk pointer
+// table is ever reallocated), so push() has a bounded cost no matter how long
+// the session runs. Two modes, chosen in MIDIHandlerConfig:
+//
+//   MIDI_HISTORY_OVERWRITE  one chunk of `chunkRecords`; the oldest record is
+//                           overwritten when full. Memory is fixed at begin().
+//   MIDI_HISTORY_GROW       chunks of `chunkRecords` are added as needed, up to
+//                           `maxRecords` (0 = no limit). At the limit, or if a
+//                           chunk cannot be allocated, it overwrites like a ring.
+//
+// Records are addressed oldest-first: at(0) is the oldest.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#include "MIDIHandlerConfig.h"
+
+#if ESP32_HOST_MIDI_HAS_PSRAM
+  #include "esp_heap_caps.h"
+#endif
+
+template <typename T>
+class MIDIEventHistory {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "MIDIEventHistory stores records by memcpy");
+
+public:
+  MIDIEventHistory()
+    : _chunks(nullptr), _chunkCount(0), _chunkTableSize(0), _chunkRecords(0),
+      _maxRecords(0), _mode(MIDI_HISTORY_OVERWRITE), _tail(0), _size(0) {}
+  ~MIDIEventHistory() { release(); }
+
+  MIDIEventHistory(const MIDIEventHistory&) = delete;
+  MIDIEventHistory& operator=(const MIDIEventHistory&) = delete;
+
+  // Frees everything and allocates the first chunk. Returns false if that
+  // allocation failed (the history is then disabled).
+  bool configure(MIDIHistoryMode mode, size_t chunkRecords, size_t maxRecords = 0) {
+    release();
+    if (chunkRecords == 0) return false;
+    _mode = mode;
+    _chunkRecords = chunkRecords;
+    _maxRecords = (mode == MIDI_HISTORY_OVERWRITE) ? chunkRecords : maxRecords;
+    if (!addChunk()) {
+      release();
+      return false;
+    }
+    return true;
+  }
+
+  void release() {
+    for (size_t i = 0; i < _chunkCount; i++) freeBlock(_chunks[i]);
+    freeBlock(_chunks);
+    _chunks = nullptr;
+    _chunkCount = 0;
+    _chunkTableSize = 0;
+    _chunkRecords = 0;
+    _tail = 0;
+    _size = 0;
+  }
+
+  // Forgets all records but keeps the allocated chunks.
+  void clear() { _tail = 0; _size = 0; }
+
+  void push(const T& item) {
+    if (_chunkCount == 0) return;
+    if (_size == slots() && !grow()) {
+      // Full and not growing: overwrite the oldest.
+      memcpy(&slot(_tail), &item, sizeof(T));
+      if (++_tail == slots()) _tail = 0;
+      return;
+    }
+    size_t s = _tail + _size;
+    if (s >= slots()) s -= slots();
+    memcpy(&slot(s), &item, sizeof(T));
+    _size++;
+  }
+
+  bool enabled() const { return _chunkCount > 0; }
+  size_t size() const { return _size; }
+  size_t capacity() const { return slots(); }
+  size_t chunkCount() const { return _chunkCount; }
+  MIDIHistoryMode mode() const { return _mode; }
+
+  const T& at(size_t i) const {
+    size_t s = _tail + i;
+    if (s >= slots()) s -= slots();
+    return const_cast<MIDIEventHistory*>(this)->slot(s);
+  }
+
+private:
+  T** _chunks;
+  size_t _chunkCount;
+  size_t _chunkTableSize;
+  size_t _chunkRecords;
+  size_t _maxRecords;
+  MIDIHistoryMode _mode;
+  size_t _tail;   // Oldest record (slot index)
+  size_t _size;
+
+  size_t slots() const { return _chunkCount * _chunkRecords; }
+  T& slot(size_t s) { return _chunks[s / _chunkRecords][s % _chunkRecords]; }
+
+  // Adds a chunk when the mode and limit allow it. Only valid while nothing
+  // has been overwritten yet (_tail == 0), which holds until the limit is hit.
+  bool grow() {
+    if (_mode != MIDI_HISTORY_GROW || _tail != 0) return false;
+    if (_maxRecords > 0 && slots() + _chunkRecords > _maxRecords) return false;
+    return addChunk();
+  }
+
+  bool addChunk() {
+    if (_chunkCount == _chunkTableSize) {
+      // Pointer table only: existing records are not touched.
+      size_t newSize = (_chunkTableSize > 0) ? _chunkTableSize * 2 : 4;
+      T** table = static_cast<T**>(allocBlock(newSize * sizeof(T*)));
+      if (!table) return false;
+      if (_chunks) memcpy(table, _chunks, _chunkCount * sizeof(T*));
+      freeBlock(_chunks);
+      _chunks = table;
+      _chunkTableSize = newSize;
+    }
+    T* chunk = static_cast<T*>(allocBlock(_chunkRecords * sizeof(T)));
+    if (!chunk) return false;
+    _chunks[_chunkCount++] = chunk;
+    return true;
+  }
+
+  static void* allocBlock(size_t bytes) {
+#if ESP32_HOST_MIDI_HAS_PSRAM
+    void* p = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    return p ? p : malloc(bytes);
+#else
+    return malloc(bytes);
+#endif
+  }
+
+  static void freeBlock(void* p) { free(p); }
+};
+
+#endif // MIDI_EVENT_HISTORY_H
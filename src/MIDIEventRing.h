@@ -0,0 +1,127 @@
+#ifndef MIDI_EVENT_RING_H
+#define MIDI_EVENT_RING_H
+
+// Fixed-capacity ring of trivially copyable records.
+//
+// Storage is a single contiguous block allocated by reserve(); push() never
+// allocates and overwrites the oldest record once the ring is full. Records
+// are addressed oldest-first (at(0) is the oldest, at(size() - 1) the newest)
+// and the ring keeps a running count of every record ever pushed, so a reader
+// can tell how many records it missed since it last looked. clear() records
+// where it happened, so records removed by it are not mistaken for missed ones.
+//
+// Single producer, single consumer on the same task: MIDIHandler fills it from
+// the transport callbacks inside task() and user code reads it from loop().
+// No locking is done here.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+template <typename T>
+class MIDIEventRing {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "MIDIEventRing stores records by memcpy");
+
+public:
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T* pointer;
+    typedef const T& reference;
+
+    const_iterator(const MIDIEventRing* ring, size_t pos) : _ring(ring), _pos(pos) {}
+    const T& operator*() const { return _ring->at(_pos); }
+    const T* operator->() const { return &_ring->at(_pos); }
+    const_iterator& operator++() { ++_pos; return *this; }
+    const_iterator operator++(int) { const_iterator t = *this; ++_pos; return t; }
+    bool operator==(const const_iterator& o) const { return _pos == o._pos; }
+    bool operator!=(const const_iterator& o) const { return _pos != o._pos; }
+
+  private:
+    const MIDIEventRing* _ring;
+    size_t _pos;
+  };
+
+  MIDIEventRing() : _buf(nullptr), _capacity(0), _tail(0), _size(0), _pushed(0), _cleared(0) {}
+  ~MIDIEventRing() { free(_buf); }
+
+  MIDIEventRing(const MIDIEventRing&) = delete;
+  MIDIEventRing& operator=(const MIDIEventRing&) = delete;
+
+  // Allocates room for `capacity` records. Keeps the newest records that fit
+  // and the pushed counter; a no-op when the capacity is unchanged. Returns
+  // false if the allocation failed (the ring is left as it was).
+  bool reserve(size_t capacity) {
+    if (capacity == _capacity) return true;
+    T* buf = nullptr;
+    if (capacity > 0) {
+      buf = static_cast<T*>(malloc(capacity * sizeof(T)));
+      if (!buf) return false;
+    }
+    size_t keep = (_size < capacity) ? _size : capacity;
+    for (size_t i = 0; i < keep; i++) {
+      memcpy(&buf[i], &at(_size - keep + i), sizeof(T));
+    }
+    free(_buf);
+    _buf = buf;
+    _capacity = capacity;
+    _tail = 0;
+    _size = keep;
+    return true;
+  }
+
+  // Appends a record, overwriting the oldest one when full.
+  void push(const T& item) {
+    if (_capacity == 0) return;
+    size_t head = _tail + _size;
+    if (head >= _capacity) head -= _capacity;
+    memcpy(&_buf[head], &item, sizeof(T));
+    if (_size == _capacity) {
+      if (++_tail == _capacity) _tail = 0;
+    } else {
+      _size++;
+    }
+    _pushed++;
+  }
+
+  void clear() { _tail = 0; _size = 0; _cleared = _pushed; }
+
+  size_t size() const { return _size; }
+  size_t capacity() const { return _capacity; }
+  bool empty() const { return _size == 0; }
+  bool full() const { return _size == _capacity; }
+
+  // Total number of records pushed since construction (wraps at 2^32).
+  uint32_t pushed() const { return _pushed; }
+
+  // Value of pushed() at the last clear() (0 if never cleared).
+  uint32_t cleared() const { return _cleared; }
+
+  const T& at(size_t i) const {
+    size_t idx = _tail + i;
+    if (idx >= _capacity) idx -= _capacity;
+    return _buf[idx];
+  }
+  const T& operator[](size_t i) const { return at(i); }
+  const T& front() const { return at(0); }
+  const T& back() const { return at(_size - 1); }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, _size); }
+
+private:
+  T* _buf;
+  size_t _capacity;
+  size_t _tail;
+  size_t _size;
+  uint32_t _pushed;
+  uint32_t _cleared;
+};
+
+#endif // MIDI_EVENT_RING_H
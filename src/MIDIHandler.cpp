@@ -6,36 +6,55 @@ MIDIHandler midiHandler;
 #include <cstdio>
 #include <sstream>
 
-#if ESP32_HOST_MIDI_HAS_PSRAM
-  #include "esp_heap_caps.h"
+// --- MIDIEventData ---
+
+MIDIEventData::MIDIEventData() : MIDIEventRecord() {
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
+  channel = 0;
+  note = 0;
+  velocity = 0;
+  pitchBend = 0;
 #endif
+}
+
+MIDIEventData::MIDIEventData(const MIDIEventRecord& record) : MIDIEventRecord(record) {
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
+  // Derived on read; every string here fits the small-string buffer.
+  channel = channel0 + 1;
+  status = MIDIHandler::statusName(statusCode);
+  note = noteNumber;
+  velocity = velocity7;
+  pitchBend = pitchBend14;
+  if (statusCode == MIDI_NOTE_ON || statusCode == MIDI_NOTE_OFF) {
+    char buf[8];
+    noteName = MIDIHandler::noteName(noteNumber);
+    noteOctave = MIDIHandler::noteWithOctave(noteNumber, buf, sizeof(buf));
+  }
+#endif
+}
 
 MIDIHandler::MIDIHandler()
-  : maxEvents(20),
+  : eventQueueView(&eventQueue),
+    maxEvents(20),
     globalIndex(0),
     nextMsgIndex(1),
-    lastTimestamp(0),
-    lastNoteOnTimestamp(0),
+    lastTimestampUs(0),
+    lastNoteOnTimestampUs(0),
     nextChordIndex(1),
     currentChordIndex(0),
-    historyQueue(nullptr),
-    historyQueueCapacity(0),
-    historyQueueSize(0),
-    historyQueueHead(0),
+    lastChordIndex(0),
     transportCount(0)
 {
   memset(transports, 0, sizeof(transports));
+  memset(activeNoteBits, 0, sizeof(activeNoteBits));
+  memset(activeChord, 0, sizeof(activeChord));
+  memset(activeMsgIndex, 0, sizeof(activeMsgIndex));
+  activeNoteTotal = 0;
+  clearChordIndex();
+  unsubscribeAll();
 }
 
 MIDIHandler::~MIDIHandler() {
-  if (historyQueue) {
-    // Call destructor on each element to properly release std::string
-    for (int i = 0; i < historyQueueCapacity; i++) {
-      historyQueue[i].~MIDIEventData();
-    }
-    free(historyQueue);
-    historyQueue = nullptr;
-  }
 }
 
 void MIDIHandler::begin() {
@@ -45,7 +64,7 @@ void MIDIHandler::begin() {
 
 void MIDIHandler::begin(const MIDIHandlerConfig& cfg) {
   this->config = cfg;
-  this->maxEvents = cfg.maxEvents;
+  setQueueLimit(cfg.maxEvents);
 
   // v6.0: MIDIHandler::begin no longer auto-instantiates USB Host or BLE
   // transports. User code is responsible for constructing each transport,
@@ -65,135 +84,116 @@ void MIDIHandler::task() {
 
 // --- Transport Abstraction ---
 
-void MIDIHandler::_onTransportMidiData(void* ctx, const uint8_t* data, size_t len) {
-  static_cast<MIDIHandler*>(ctx)->handleMidiMessage(data, len);
+void MIDIHandler::_onTransportMidiData(void* ctx, const uint8_t* data, size_t len, uint64_t timestampUs) {
+  static_cast<MIDIHandler*>(ctx)->handleMidiMessage(data, len, timestampUs);
 }
 
 void MIDIHandler::_onTransportDisconnected(void* ctx) {
   static_cast<MIDIHandler*>(ctx)->clearActiveNotesNow();
 }
 
-void MIDIHandler::registerTransport(MIDITransport* t) {
-  if (transportCount >= MAX_TRANSPORTS) return;
-  t->setMidiCallback(_onTransportMidiData, this);
+void MIDIHandler::_onTransportUMPData(void* ctx, const uint32_t* words, size_t count, uint64_t timestampUs) {
+  static_cast<MIDIHandler*>(ctx)->handleUMP(words, count, timestampUs);
+}
+
+bool MIDIHandler::registerTransport(MIDITransport* t) {
+  if (transportCount >= MAX_TRANSPORTS) return false;
+  t->setTimedMidiCallback(_onTransportMidiData, this);
+  t->setTimedUMPBatchCallback(_onTransportUMPData, this);
   t->setSysExCallback(_onTransportSysExData, this);
   t->setConnectionCallbacks(nullptr, _onTransportDisconnected, this);
   transports[transportCount++] = t;
+  return true;
 }
 
-void MIDIHandler::addTransport(MIDITransport* transport) {
-  registerTransport(transport);
+bool MIDIHandler::addTransport(MIDITransport* transport) {
+  return registerTransport(transport);
 }
 
+// Allocates the first history block up front; MIDI_HISTORY_GROW adds more
+// blocks from addEvent() without moving the events already stored.
 void MIDIHandler::enableHistory(int capacity) {
   if (capacity <= 0) {
     // Disable history, freeing allocated memory
-    if (historyQueue) {
-      free(historyQueue);
-      historyQueue = nullptr;
-    }
-    historyQueueCapacity = 0;
-    historyQueueSize = 0;
-    historyQueueHead = 0;
+    history.release();
     Serial.println("MIDI history disabled!");
     return;
   }
 
-  // Free existing history before reallocating
-  if (historyQueue) {
-    free(historyQueue);
-    historyQueue = nullptr;
-  }
-
-  // Allocate history buffer — prefer PSRAM if available, fall back to heap
-#if ESP32_HOST_MIDI_HAS_PSRAM
-  historyQueue = static_cast<MIDIEventData*>(heap_caps_malloc(capacity * sizeof(MIDIEventData), MALLOC_CAP_SPIRAM));
-#else
-  historyQueue = static_cast<MIDIEventData*>(malloc(capacity * sizeof(MIDIEventData)));
-#endif
-
-  if (!historyQueue) {
+  size_t maxRecords = (config.historyMaxCapacity > 0) ? static_cast<size_t>(config.historyMaxCapacity) : 0;
+  if (!history.configure(config.historyMode, static_cast<size_t>(capacity), maxRecords)) {
     Serial.println("Failed to allocate memory for history buffer!");
-    historyQueueCapacity = 0;
     return;
   }
 
-  historyQueueCapacity = capacity;
-  historyQueueSize = 0;
-  historyQueueHead = 0;
+  Serial.println("MIDI history enabled!");
+}
 
-  // Initialize each object using placement new to avoid std::string issues
-  for (int i = 0; i < historyQueueCapacity; i++) {
-    new (&historyQueue[i]) MIDIEventData();
-  }
+size_t MIDIHandler::getHistorySize() const {
+  return history.size();
+}
 
-  Serial.println("MIDI history enabled!");
+const MIDIEventRecord* MIDIHandler::getHistoryEvent(size_t i) const {
+  return (i < history.size()) ? &history.at(i) : nullptr;
 }
 
 
+// Resizes the event ring. This is the only place the queue allocates; the
+// newest events that fit are kept.
 void MIDIHandler::setQueueLimit(int maxEvents) {
+  if (maxEvents < 1) maxEvents = 1;
+  if (!eventQueue.reserve(static_cast<size_t>(maxEvents))) {
+    Serial.println("Failed to allocate MIDI event queue!");
+    return;
+  }
   this->maxEvents = maxEvents;
 }
 
-const std::deque<MIDIEventData>& MIDIHandler::getQueue() const {
-  return eventQueue;
+const MIDIEventQueueView& MIDIHandler::getQueue() const {
+  return eventQueueView;
 }
 
-// Expands the dynamic ring buffer.
-void MIDIHandler::expandHistoryQueue() {
-  int newCapacity = (historyQueueCapacity > 0) ? (historyQueueCapacity * 2) : 10;
+size_t MIDIHandler::read(MIDIEventCursor& cursor, MIDIEventRecord* out, size_t max, uint32_t* overrun) const {
+  const uint32_t pushed = eventQueue.pushed();
+  uint32_t pending = pushed - cursor.seq;
+  uint32_t lost = 0;
 
-#if ESP32_HOST_MIDI_HAS_PSRAM
-  MIDIEventData* newQueue = static_cast<MIDIEventData*>(heap_caps_malloc(newCapacity * sizeof(MIDIEventData), MALLOC_CAP_SPIRAM));
-#else
-  MIDIEventData* newQueue = static_cast<MIDIEventData*>(malloc(newCapacity * sizeof(MIDIEventData)));
-#endif
+  // Events removed by clearQueue() are skipped, not reported as lost.
+  const uint32_t sinceClear = pushed - eventQueue.cleared();
+  if (pending > sinceClear) pending = sinceClear;
 
-  if (!newQueue) {
-    Serial.println("Failed to expand MIDI history buffer!");
-    return;
+  // Anything older than the oldest queued event has been overwritten.
+  if (pending > eventQueue.size()) {
+    lost = pending - static_cast<uint32_t>(eventQueue.size());
+    pending = static_cast<uint32_t>(eventQueue.size());
   }
-  // Calculate tail index in the current circular buffer.
-  int tail = (historyQueueHead + historyQueueCapacity - historyQueueSize) % historyQueueCapacity;
-  // Copy events from old buffer to new, preserving order.
-  for (int i = 0; i < historyQueueSize; i++) {
-    int index = (tail + i) % historyQueueCapacity;
-    newQueue[i] = historyQueue[index];
-  }
-  // Initialize remaining elements in the new buffer
-  for (int i = historyQueueSize; i < newCapacity; i++) {
-    new (&newQueue[i]) MIDIEventData();
-  }
-  free(historyQueue);
-  historyQueue = newQueue;
-  historyQueueCapacity = newCapacity;
-  // After copying, new head is immediately after the last element.
-  historyQueueHead = historyQueueSize;
-  Serial.printf("MIDI history expanded to %d events!\n", historyQueueCapacity);
-}
-
-void MIDIHandler::addEvent(const MIDIEventData& event) {
-  // Add event to the main queue (stored in SRAM)
-  eventQueue.push_back(event);
-  processQueue();
-
-  // If history is active, add event to the dynamic buffer
-  if (historyQueue != nullptr && historyQueueCapacity > 0) {
-    // If buffer is full, expand to avoid discarding events
-    if (historyQueueSize == historyQueueCapacity) {
-      expandHistoryQueue();
-    }
-    historyQueue[historyQueueHead] = event;
-    historyQueueHead = (historyQueueHead + 1) % historyQueueCapacity;
-    historyQueueSize++;
+
+  size_t count = (pending < max) ? pending : max;
+  size_t first = eventQueue.size() - pending;
+  for (size_t i = 0; i < count; i++) {
+    out[i] = eventQueue.at(first + i);
   }
+
+  cursor.seq = pushed - pending + static_cast<uint32_t>(count);
+  if (overrun) *overrun = lost;
+  return count;
+}
+
+void MIDIHandler::addEvent(const MIDIEventRecord& event) {
+  // Events that arrive before begin() get the default-sized queue.
+  if (eventQueue.capacity() == 0) {
+    setQueueLimit(maxEvents);
+  }
+  // Add event to the main queue (stored in SRAM); the oldest is overwritten when full
+  eventQueue.push(event);
+
+  // If history is active, add event to it (never copies stored events)
+  history.push(event);
 }
 
 
+// Kept for API compatibility: the ring is bounded by maxEvents on every push.
 void MIDIHandler::processQueue() {
-  while (eventQueue.size() > static_cast<size_t>(maxEvents)) {
-    eventQueue.pop_front();
-  }
 }
 
 std::string MIDIHandler::getNoteName(int note) const {
@@ -235,22 +235,27 @@ const char* MIDIHandler::statusName(MIDIStatus code) {
   }
 }
 
+// ORs the per-channel sets into one 128-bit set (bit n = note n).
+void MIDIHandler::activeNotesUnion(uint64_t out[2]) const {
+  out[0] = 0;
+  out[1] = 0;
+  for (int ch = 0; ch < 16; ch++) {
+    out[0] |= activeNoteBits[ch][0];
+    out[1] |= activeNoteBits[ch][1];
+  }
+}
+
 std::string MIDIHandler::getActiveNotes() const {
   std::ostringstream oss;
   oss << "{";
 
-  // Step 1: Create a sorted vector from the active notes map
-  std::vector<int> sortedNotes;
-  for (const auto& kv : activeNotes) {
-    sortedNotes.push_back(kv.first);
-  }
-
-  // Step 2: Sort by note number
-  std::sort(sortedNotes.begin(), sortedNotes.end());
+  uint64_t bits[2];
+  activeNotesUnion(bits);
 
-  // Step 3: Build the formatted string
+  // Walking the set in bit order yields the notes already sorted.
   bool first = true;
-  for (int note : sortedNotes) {
+  for (int note = 0; note < 128; note++) {
+    if (!(bits[note >> 6] & (1ULL << (note & 63)))) continue;
     if (!first) oss << ", ";
     oss << getNoteName(note);
     first = false;
@@ -263,11 +268,13 @@ std::string MIDIHandler::getActiveNotes() const {
 std::vector<std::string> MIDIHandler::getActiveNotesVector() const {
   std::vector<std::string> activeNotesVector;
 
-  // Use std::map for automatic sorting by MIDI note number
-  std::map<int, int> sortedActiveNotes(activeNotes.begin(), activeNotes.end());
+  uint64_t bits[2];
+  activeNotesUnion(bits);
 
-  for (const auto& kv : sortedActiveNotes) {
-    activeNotesVector.push_back(getNoteName(kv.first));
+  for (int note = 0; note < 128; note++) {
+    if (bits[note >> 6] & (1ULL << (note & 63))) {
+      activeNotesVector.push_back(getNoteName(note));
+    }
   }
 
   return activeNotesVector;
@@ -277,14 +284,16 @@ std::string MIDIHandler::getActiveNotesString() const {
   std::ostringstream oss;
   oss << "{";
 
-  // Use std::map for automatic sorting
-  std::map<int, int> sortedActiveNotes(activeNotes.begin(), activeNotes.end());
-
   bool first = true;
-  for (const auto& kv : sortedActiveNotes) {
-    if (!first) oss << ", ";
-    oss << getNoteName(kv.first) << ", {" << kv.second << "}";
-    first = false;
+  for (int note = 0; note < 128; note++) {
+    // Report the chord of the lowest channel holding this note.
+    for (int ch = 0; ch < 16; ch++) {
+      if (!(activeNoteBits[ch][note >> 6] & (1ULL << (note & 63)))) continue;
+      if (!first) oss << ", ";
+      oss << getNoteName(note) << ", {" << activeChord[ch][note] << "}";
+      first = false;
+      break;
+    }
   }
 
   oss << "}";
@@ -293,21 +302,34 @@ std::string MIDIHandler::getActiveNotesString() const {
 
 
 size_t MIDIHandler::getActiveNotesCount() const {
-  return activeNotes.size();
+  uint64_t bits[2];
+  activeNotesUnion(bits);
+  return __builtin_popcountll(bits[0]) + __builtin_popcountll(bits[1]);
+}
+
+size_t MIDIHandler::getActiveNotesCount(uint8_t channel) const {
+  if (channel < 1 || channel > 16) return 0;
+  const uint64_t* bits = activeNoteBits[channel - 1];
+  return __builtin_popcountll(bits[0]) + __builtin_popcountll(bits[1]);
+}
+
+bool MIDIHandler::isNoteActive(uint8_t channel, uint8_t note) const {
+  if (channel < 1 || channel > 16 || note > 127) return false;
+  return (activeNoteBits[channel - 1][note >> 6] >> (note & 63)) & 1;
 }
 
 void MIDIHandler::fillActiveNotes(bool out[128]) const {
-  memset(out, 0, 128);
-  for (const auto& kv : activeNotes) {
-    if (kv.first >= 0 && kv.first < 128)
-      out[kv.first] = true;
+  uint64_t bits[2];
+  activeNotesUnion(bits);
+  for (int note = 0; note < 128; note++) {
+    out[note] = (bits[note >> 6] >> (note & 63)) & 1;
   }
 }
 
 // Clears active notes
 void MIDIHandler::clearActiveNotesNow() {
-  activeNotes.clear();
-  activeMsgIndex.clear();
+  memset(activeNoteBits, 0, sizeof(activeNoteBits));
+  activeNoteTotal = 0;
   currentChordIndex = 0;
 }
 
@@ -317,14 +339,91 @@ void MIDIHandler::clearQueue() {
   clearActiveNotesNow();
   globalIndex = 0;
   nextMsgIndex = 1;
-  lastTimestamp = 0;
-  lastNoteOnTimestamp = 0;
+  lastTimestampUs = 0;
+  lastNoteOnTimestampUs = 0;
   nextChordIndex = 1;
+  clearChordIndex();
+}
+
+void MIDIHandler::clearChordIndex() {
+  memset(chordTable, 0, sizeof(chordTable));
+  lastChordIndex = 0;
+}
+
+const MIDIChordRecord* MIDIHandler::chord(int chordIndex) const {
+  if (chordIndex <= 0) return nullptr;
+  const MIDIChordRecord& rec = chordTable[chordIndex % CHORD_HISTORY];
+  return (rec.chordIndex == chordIndex) ? &rec : nullptr;
+}
+
+// Walks a 128-bit note set lowest first, one count-trailing-zeros per note.
+uint8_t MIDIHandler::noteSetToArray(const uint64_t set[2], uint8_t* notes, uint8_t maxNotes) {
+  uint8_t count = 0;
+  for (int word = 0; word < 2; word++) {
+    uint64_t bits = set[word];
+    while (bits && count < maxNotes) {
+      notes[count++] = static_cast<uint8_t>((word << 6) + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+  return count;
+}
+
+uint16_t MIDIHandler::noteSetToPitchClasses(const uint64_t set[2]) {
+  uint16_t mask = 0;
+  for (int word = 0; word < 2; word++) {
+    uint64_t bits = set[word];
+    while (bits) {
+      int note = (word << 6) + __builtin_ctzll(bits);
+      mask |= static_cast<uint16_t>(1u << (note % 12));
+      bits &= bits - 1;
+    }
+  }
+  return mask;
+}
+
+uint8_t MIDIHandler::getChordNotes(int chordIndex, uint8_t* notes, uint8_t maxNotes) const {
+  const MIDIChordRecord* rec = chord(chordIndex);
+  if (!rec || !notes) return 0;
+  return noteSetToArray(rec->notes, notes, maxNotes);
+}
+
+uint16_t MIDIHandler::getChordPitchClasses(int chordIndex) const {
+  const MIDIChordRecord* rec = chord(chordIndex);
+  return rec ? noteSetToPitchClasses(rec->notes) : 0;
+}
+
+MIDIChordInfo MIDIHandler::getChordInfo(int chordIndex) const {
+  const MIDIChordRecord* rec = chord(chordIndex);
+  if (!rec) return MIDIChordTable::lookup(0, 0);
+  return MIDIChordTable::lookup(noteSetToPitchClasses(rec->notes), rec->lowestNote % 12);
+}
+
+MIDIChordInfo MIDIHandler::getActiveChordInfo() const {
+  uint64_t bits[2];
+  activeNotesUnion(bits);
+  uint8_t bass = 0;
+  noteSetToArray(bits, &bass, 1);
+  return MIDIChordTable::lookup(noteSetToPitchClasses(bits), bass % 12);
+}
+
+uint8_t MIDIHandler::getActiveNoteNumbers(uint8_t* notes, uint8_t maxNotes) const {
+  if (!notes) return 0;
+  uint64_t bits[2];
+  activeNotesUnion(bits);
+  return noteSetToArray(bits, notes, maxNotes);
+}
+
+uint16_t MIDIHandler::getActivePitchClasses() const {
+  uint64_t bits[2];
+  activeNotesUnion(bits);
+  return noteSetToPitchClasses(bits);
 }
 
-int MIDIHandler::lastChord(const std::deque<MIDIEventData>& queue) const {
+int MIDIHandler::lastChord(const MIDIEventQueueView& queue) const {
   int maxChord = 0;
-  for (const auto& event : queue) {
+  for (size_t i = 0; i < queue.size(); i++) {
+    const MIDIEventRecord& event = queue.record(i);
     if (event.chordIndex > maxChord) {
       maxChord = event.chordIndex;
     }
@@ -332,22 +431,30 @@ int MIDIHandler::lastChord(const std::deque<MIDIEventData>& queue) const {
   return maxChord;
 }
 
-std::vector<std::string> MIDIHandler::getChord(int chord, const std::deque<MIDIEventData>& queue, const std::vector<std::string>& fields, bool includeLabels) const {
-  std::vector<MIDIEventData> chordEvents;
+std::vector<std::string> MIDIHandler::getChord(int chord, const MIDIEventQueueView& queue, const std::vector<std::string>& fields, bool includeLabels) const {
+  std::vector<MIDIEventRecord> chordEvents;
 
   // Filter only NoteOn events from the specified chord
-  for (const auto& event : queue) {
-    if (event.chordIndex == chord && event.status == "NoteOn") {
+  for (size_t i = 0; i < queue.size(); i++) {
+    const MIDIEventRecord& event = queue.record(i);
+    if (event.chordIndex == chord && event.statusCode == MIDI_NOTE_ON) {
       chordEvents.push_back(event);
     }
   }
 
+  return formatChord(chordEvents, fields, includeLabels);
+}
+
+// Sorts the chord's NoteOn records by note number and formats the requested
+// fields, one string per note.
+std::vector<std::string> MIDIHandler::formatChord(std::vector<MIDIEventRecord>& chordEvents, const std::vector<std::string>& fields, bool includeLabels) const {
   // Sort events by note number
-  std::sort(chordEvents.begin(), chordEvents.end(), [](const MIDIEventData& a, const MIDIEventData& b) {
-    return a.note < b.note;
+  std::sort(chordEvents.begin(), chordEvents.end(), [](const MIDIEventRecord& a, const MIDIEventRecord& b) {
+    return a.noteNumber < b.noteNumber;
   });
 
   std::vector<std::string> result;
+  char octBuf[8];
 
   // If "all" was requested, return all fields
   if (fields.size() == 1 && fields[0] == "all") {
@@ -358,27 +465,27 @@ std::vector<std::string> MIDIHandler::getChord(int chord, const std::deque<MIDIE
             << ", msgIndex:" << event.msgIndex
             << ", timestamp:" << event.timestamp
             << ", delay:" << event.delay
-            << ", channel:" << event.channel
-            << ", status:" << event.status
-            << ", note:" << event.note
-            << ", noteName:" << event.noteName
-            << ", noteOctave:" << event.noteOctave
-            << ", velocity:" << event.velocity
+            << ", channel:" << (event.channel0 + 1)
+            << ", status:" << statusName(event.statusCode)
+            << ", note:" << (int)event.noteNumber
+            << ", noteName:" << noteName(event.noteNumber)
+            << ", noteOctave:" << noteWithOctave(event.noteNumber, octBuf, sizeof(octBuf))
+            << ", velocity:" << (int)event.velocity7
             << ", chordIndex:" << event.chordIndex
-            << ", pitchBend:" << event.pitchBend << "}";
+            << ", pitchBend:" << event.pitchBend14 << "}";
       } else {
         oss << "{ " << event.index
             << ", " << event.msgIndex
             << ", " << event.timestamp
             << ", " << event.delay
-            << ", " << event.channel
-            << ", " << event.status
-            << ", " << event.note
-            << ", " << event.noteName
-            << ", " << event.noteOctave
-            << ", " << event.velocity
+            << ", " << (event.channel0 + 1)
+            << ", " << statusName(event.statusCode)
+            << ", " << (int)event.noteNumber
+            << ", " << noteName(event.noteNumber)
+            << ", " << noteWithOctave(event.noteNumber, octBuf, sizeof(octBuf))
+            << ", " << (int)event.velocity7
             << ", " << event.chordIndex
-            << ", " << event.pitchBend << " }";
+            << ", " << event.pitchBend14 << " }";
       }
       result.push_back(oss.str());
     }
@@ -388,21 +495,21 @@ std::vector<std::string> MIDIHandler::getChord(int chord, const std::deque<MIDIE
     std::string field = fields[0];
     for (const auto& event : chordEvents) {
       if (field == "noteName") {
-        result.push_back(event.noteName);
+        result.push_back(noteName(event.noteNumber));
       } else if (field == "noteOctave") {
-        result.push_back(event.noteOctave);
+        result.push_back(noteWithOctave(event.noteNumber, octBuf, sizeof(octBuf)));
       } else if (field == "status") {
-        result.push_back(event.status);
+        result.push_back(statusName(event.statusCode));
       } else if (field == "note") {
-        result.push_back(std::to_string(event.note));
+        result.push_back(std::to_string(event.noteNumber));
       } else if (field == "timestamp") {
         result.push_back(std::to_string(event.timestamp));
       } else if (field == "velocity") {
-        result.push_back(std::to_string(event.velocity));
+        result.push_back(std::to_string(event.velocity7));
       } else if (field == "channel") {
-        result.push_back(std::to_string(event.channel));
+        result.push_back(std::to_string(event.channel0 + 1));
       } else if (field == "pitchBend") {
-        result.push_back(std::to_string(event.pitchBend));
+        result.push_back(std::to_string(event.pitchBend14));
       }
     }
   }
@@ -414,21 +521,21 @@ std::vector<std::string> MIDIHandler::getChord(int chord, const std::deque<MIDIE
       for (const auto& field : fields) {
         if (!first) oss << ", ";
         if (field == "noteName") {
-          oss << event.noteName;
+          oss << noteName(event.noteNumber);
         } else if (field == "noteOctave") {
-          oss << event.noteOctave;
+          oss << noteWithOctave(event.noteNumber, octBuf, sizeof(octBuf));
         } else if (field == "status") {
-          oss << event.status;
+          oss << statusName(event.statusCode);
         } else if (field == "note") {
-          oss << event.note;
+          oss << (int)event.noteNumber;
         } else if (field == "timestamp") {
           oss << event.timestamp;
         } else if (field == "velocity") {
-          oss << event.velocity;
+          oss << (int)event.velocity7;
         } else if (field == "channel") {
-          oss << event.channel;
+          oss << (event.channel0 + 1);
         } else if (field == "pitchBend") {
-          oss << event.pitchBend;
+          oss << event.pitchBend14;
         }
         first = false;
       }
@@ -443,20 +550,60 @@ std::vector<std::string> MIDIHandler::getAnswer(const std::string& field, bool i
   return getAnswer(std::vector<std::string>{ field }, includeLabels);
 }
 
+// Answered from the chord index: note fields come from the chord record
+// alone; the others read back only the events since the chord's first NoteOn.
 std::vector<std::string> MIDIHandler::getAnswer(const std::vector<std::string>& fields, bool includeLabels) const {
   std::vector<std::string> result;
-  const std::deque<MIDIEventData>& queue = getQueue();
+  const MIDIChordRecord* rec = chord(lastChordIndex);
+  if (!rec || fields.empty()) return result;
+
+  bool notesOnly = true;
+  for (const auto& field : fields) {
+    if (field != "note" && field != "noteName" && field != "noteOctave" && field != "status") {
+      notesOnly = false;
+      break;
+    }
+  }
 
-  if (!queue.empty()) {
-    int lastChordIdx = lastChord(queue);
-    result = getChord(lastChordIdx, queue, fields, includeLabels);
+  if (notesOnly) {
+    uint8_t notes[128];
+    uint8_t count = noteSetToArray(rec->notes, notes, 128);
+    char octBuf[8];
+    result.reserve(count);
+    for (uint8_t i = 0; i < count; i++) {
+      std::string line;
+      for (size_t f = 0; f < fields.size(); f++) {
+        if (f > 0) line += ", ";
+        if (fields[f] == "note") line += std::to_string(notes[i]);
+        else if (fields[f] == "noteName") line += noteName(notes[i]);
+        else if (fields[f] == "noteOctave") line += noteWithOctave(notes[i], octBuf, sizeof(octBuf));
+        else line += statusName(MIDI_NOTE_ON);
+      }
+      result.push_back(line);
+    }
+    return result;
   }
 
-  return result;
+  // Event indices grow with queue position, so the scan stops at the first
+  // event older than the chord.
+  std::vector<MIDIEventRecord> chordEvents;
+  const MIDIEventQueueView& queue = getQueue();
+  for (size_t i = queue.size(); i-- > 0;) {
+    const MIDIEventRecord& event = queue.record(i);
+    if (event.index < rec->firstEvent) break;
+    if (event.chordIndex == lastChordIndex && event.statusCode == MIDI_NOTE_ON) {
+      chordEvents.push_back(event);
+    }
+  }
+  return formatChord(chordEvents, fields, includeLabels);
 }
 
 
 void MIDIHandler::handleMidiMessage(const uint8_t* data, size_t length) {
+  handleMidiMessage(data, length, MIDIClock::nowUs());
+}
+
+void MIDIHandler::handleMidiMessage(const uint8_t* data, size_t length, uint64_t timestampUs) {
   // USB-MIDI: 4+ bytes (CIN + MIDI), skip first byte.
   // BLE/raw MIDI: 2-3 bytes, use directly.
   const uint8_t* midiData;
@@ -467,207 +614,288 @@ void MIDIHandler::handleMidiMessage(const uint8_t* data, size_t length) {
   // Debug callback — fire before parsing
   if (rawMidiCb) rawMidiCb(data, length, midiData);
 
-  unsigned long now = millis();
+  handleChannelMessage(midiData, 0, timestampUs);
+}
 
-  uint8_t midiStatus = midiData[0] & 0xF0;
-  int channel = (midiData[0] & 0x0F) + 1;
-  unsigned long diff = (globalIndex == 0) ? 0 : (now - lastTimestamp);
-  lastTimestamp = now;
+void MIDIHandler::handleUMP(const uint32_t* words, size_t count) {
+  handleUMP(words, count, MIDIClock::nowUs());
+}
 
-  // Channel messages other than NoteOn/NoteOff
-  if (midiStatus == 0xB0) {  // Control Change
-    MIDIEventData event;
-    event.index = ++globalIndex;
-    event.msgIndex = 0;
-    event.timestamp = now;
-    event.delay = diff;
-    event.statusCode = MIDI_CONTROL_CHANGE;
-    event.channel0 = midiData[0] & 0x0F;
-    event.noteNumber = midiData[1];
-    event.velocity7 = midiData[2];
-    event.velocity16 = MIDI2Scaler::scale7to16(midiData[2]);
-    event.pitchBend14 = 0;
-    event.pitchBend32 = 0x80000000;
-    // Deprecated fields
-    event.channel = channel;
-    event.status = "ControlChange";
-    event.note = midiData[1];        // Controller number
-    event.noteName = "";
-    event.noteOctave = "";
-    event.velocity = midiData[2];    // CC value
-    event.chordIndex = currentChordIndex;
-    event.pitchBend = 0;
-    addEvent(event);
-    return;
+void MIDIHandler::handleUMP(const uint32_t* words, size_t count, uint64_t timestampUs) {
+  static const uint8_t WORDS_BY_MT[16] = { 1,1,1,2,2,4,1,1,2,2,2,3,3,4,4,4 };
+  size_t i = 0;
+  while (i < count) {
+    uint8_t mt = static_cast<uint8_t>(words[i] >> 28);
+    uint8_t n = WORDS_BY_MT[mt];
+    if (i + n > count) break;  // Partial packet
+
+    if (mt == UMP_MT_MIDI1_VOICE) {
+      UMPWord32 pkt(words[i]);
+      const uint8_t midi[3] = { pkt.statusByte(), pkt.data1(), pkt.data2() };
+      handleChannelMessage(midi, pkt.group(), timestampUs);
+    } else if (mt == UMP_MT_MIDI2_VOICE) {
+      handleMIDI2Voice(UMPWord64(words[i], words[i + 1]), timestampUs);
+    }
+    i += n;
   }
+}
 
-  if (midiStatus == 0xC0) {  // Program Change
-    MIDIEventData event;
-    event.index = ++globalIndex;
-    event.msgIndex = 0;
-    event.timestamp = now;
-    event.delay = diff;
-    event.statusCode = MIDI_PROGRAM_CHANGE;
-    event.channel0 = midiData[0] & 0x0F;
-    event.noteNumber = midiData[1];
-    event.velocity7 = 0;
-    event.velocity16 = 0;
-    event.pitchBend14 = 0;
-    event.pitchBend32 = 0x80000000;
-    // Deprecated fields
-    event.channel = channel;
-    event.status = "ProgramChange";
-    event.note = midiData[1];  // Program number
-    event.noteName = "";
-    event.noteOctave = "";
-    event.velocity = 0;
-    event.chordIndex = currentChordIndex;
-    event.pitchBend = 0;
-    addEvent(event);
-    return;
+// Arrival time, delta since the previous message and the fields every
+// message type shares. The record is a POD: nothing on the receive path
+// allocates.
+void MIDIHandler::stampEvent(MIDIEventRecord& event, uint8_t group, uint8_t channel0, uint64_t timestampUs) {
+  // Times come from the transport (arrival), not from when task() got here.
+  event.timestamp = static_cast<uint32_t>(timestampUs / 1000);
+  event.timestampUs = static_cast<uint32_t>(timestampUs);
+  // Transports are drained one after another, so a stamp can be older than
+  // the previous one: that counts as no delay, and the latest time is kept.
+  if (globalIndex == 0 || timestampUs <= lastTimestampUs) {
+    event.delay = 0;
+  } else {
+    event.delay = static_cast<uint32_t>((timestampUs - lastTimestampUs) / 1000);
   }
+  if (globalIndex == 0 || timestampUs > lastTimestampUs) lastTimestampUs = timestampUs;
 
-  if (midiStatus == 0xD0) {  // Channel Pressure (Aftertouch)
-    MIDIEventData event;
-    event.index = ++globalIndex;
-    event.msgIndex = 0;
-    event.timestamp = now;
-    event.delay = diff;
-    event.statusCode = MIDI_CHANNEL_PRESSURE;
-    event.channel0 = midiData[0] & 0x0F;
-    event.noteNumber = 0;
-    event.velocity7 = midiData[1];
-    event.velocity16 = MIDI2Scaler::scale7to16(midiData[1]);
-    event.pitchBend14 = 0;
-    event.pitchBend32 = 0x80000000;
-    // Deprecated fields
-    event.channel = channel;
-    event.status = "ChannelPressure";
-    event.note = 0;
-    event.noteName = "";
-    event.noteOctave = "";
-    event.velocity = midiData[1];  // Pressure value
-    event.chordIndex = currentChordIndex;
-    event.pitchBend = 0;
-    addEvent(event);
-    return;
+  event.msgIndex = 0;
+  event.chordIndex = static_cast<uint16_t>(currentChordIndex);
+  event.channel0 = channel0 & 0x0F;
+  event.group = group & 0x0F;
+  event.noteNumber = 0;
+  event.velocity7 = 0;
+  event.velocity16 = 0;
+  event.pitchBend14 = 0;
+  event.pitchBend32 = 0x80000000;
+}
+
+// MIDI 1.0 channel message (status + data bytes), from a byte stream or from
+// MIDI 1.0 Channel Voice in UMP.
+void MIDIHandler::handleChannelMessage(const uint8_t* midiData, uint8_t group, uint64_t timestampUs) {
+  uint8_t midiStatus = midiData[0] & 0xF0;
+  MIDIEventRecord event;
+  stampEvent(event, group, midiData[0] & 0x0F, timestampUs);
+
+  switch (midiStatus) {
+    case 0xB0:  // Control Change
+      event.statusCode = MIDI_CONTROL_CHANGE;
+      event.noteNumber = midiData[1];  // Controller number
+      event.velocity7 = midiData[2];   // CC value
+      event.velocity16 = MIDI2Scaler::scale7to16(midiData[2]);
+      event.value32 = MIDI2Scaler::scale7to32(midiData[2]);
+      break;
+    case 0xC0:  // Program Change
+      event.statusCode = MIDI_PROGRAM_CHANGE;
+      event.noteNumber = midiData[1];  // Program number
+      break;
+    case 0xD0:  // Channel Pressure (Aftertouch)
+      event.statusCode = MIDI_CHANNEL_PRESSURE;
+      event.velocity7 = midiData[1];   // Pressure value
+      event.velocity16 = MIDI2Scaler::scale7to16(midiData[1]);
+      event.value32 = MIDI2Scaler::scale7to32(midiData[1]);
+      break;
+    case 0xE0: {  // Pitch Bend
+      int pitchValue = (midiData[1] & 0x7F) | ((midiData[2] & 0x7F) << 7);
+      event.statusCode = MIDI_PITCH_BEND;
+      event.pitchBend14 = static_cast<uint16_t>(pitchValue);
+      event.pitchBend32 = MIDI2Scaler::scale14to32(pitchValue);
+      break;
+    }
+    case 0x90:  // NoteOn (velocity 0 is a NoteOff)
+    case 0x80:
+      event.statusCode = (midiStatus == 0x90 && midiData[2] > 0) ? MIDI_NOTE_ON : MIDI_NOTE_OFF;
+      event.noteNumber = midiData[1] & 0x7F;
+      event.velocity7 = midiData[2];
+      event.velocity16 = MIDI2Scaler::scale7to16(midiData[2]);
+      break;
+    default:
+      return;  // Unrecognized MIDI message
+  }
+
+  recordEvent(event, timestampUs);
+}
+
+// MIDI 2.0 Channel Voice (UMP MT 4): values are stored as received and scaled
+// down for the 7-bit and 14-bit fields.
+void MIDIHandler::handleMIDI2Voice(const UMPWord64& pkt, uint64_t timestampUs) {
+  MIDIEventRecord event;
+  stampEvent(event, pkt.group(), pkt.channel(), timestampUs);
+
+  switch (pkt.opcode()) {
+    case MIDI2_OP_CONTROL_CHANGE:
+    case MIDI2_OP_CHANNEL_PRESSURE:
+      event.statusCode = (pkt.opcode() == MIDI2_OP_CONTROL_CHANGE) ? MIDI_CONTROL_CHANGE : MIDI_CHANNEL_PRESSURE;
+      if (event.statusCode == MIDI_CONTROL_CHANGE) event.noteNumber = pkt.index() & 0x7F;
+      event.value32 = pkt.data();
+      event.velocity16 = pkt.dataHi();
+      event.velocity7 = MIDI2Scaler::scale32to7(pkt.data());
+      break;
+    case MIDI2_OP_PROGRAM_CHANGE:
+      event.statusCode = MIDI_PROGRAM_CHANGE;
+      event.noteNumber = static_cast<uint8_t>(pkt.data() >> 24) & 0x7F;  // Bank select (option flag) not kept
+      break;
+    case MIDI2_OP_PITCH_BEND:
+      event.statusCode = MIDI_PITCH_BEND;
+      event.pitchBend32 = pkt.data();
+      event.pitchBend14 = MIDI2Scaler::scale32to14(pkt.data());
+      break;
+    case MIDI2_OP_NOTE_ON:
+    case MIDI2_OP_NOTE_OFF: {
+      // A MIDI 2.0 NoteOn with velocity 0 is still a NoteOn; its 7-bit form
+      // is raised to 1, as the MIDI 2.0 to 1.0 translation does.
+      bool on = pkt.opcode() == MIDI2_OP_NOTE_ON;
+      uint8_t v7 = MIDI2Scaler::scale16to7(pkt.dataHi());
+      event.statusCode = on ? MIDI_NOTE_ON : MIDI_NOTE_OFF;
+      event.noteNumber = pkt.index() & 0x7F;
+      event.velocity16 = pkt.dataHi();
+      event.velocity7 = (on && v7 == 0) ? 1 : v7;
+      break;
+    }
+    default:
+      return;  // Per-note, registered / assignable controllers: not recorded
   }
 
-  if (midiStatus == 0xE0) {  // Pitch Bend
-    int pitchValue = (midiData[1] & 0x7F) | ((midiData[2] & 0x7F) << 7);
-    MIDIEventData event;
+  recordEvent(event, timestampUs);
+}
+
+// Numbers the event, pairs NoteOn/NoteOff and maintains the chord index, then
+// queues the event and runs the subscriptions.
+void MIDIHandler::recordEvent(MIDIEventRecord& event, uint64_t timestampUs) {
+  if (event.statusCode != MIDI_NOTE_ON && event.statusCode != MIDI_NOTE_OFF) {
     event.index = ++globalIndex;
-    event.msgIndex = 0;
-    event.timestamp = now;
-    event.delay = diff;
-    event.statusCode = MIDI_PITCH_BEND;
-    event.channel0 = midiData[0] & 0x0F;
-    event.noteNumber = 0;
-    event.velocity7 = 0;
-    event.velocity16 = 0;
-    event.pitchBend14 = static_cast<uint16_t>(pitchValue);
-    event.pitchBend32 = MIDI2Scaler::scale14to32(pitchValue);
-    // Deprecated fields
-    event.channel = channel;
-    event.status = "PitchBend";
-    event.note = 0;
-    event.noteName = "";
-    event.noteOctave = "";
-    event.velocity = 0;
-    event.chordIndex = currentChordIndex;
-    event.pitchBend = pitchValue;
     addEvent(event);
+    dispatchEvent(event);
     return;
   }
 
-  // NoteOn / NoteOff
-  int note = midiData[1];
-  int velocity = midiData[2];
-  std::string statusType;
+  int note = event.noteNumber;
+  int velocity = event.velocity7;
   int msgIndex = 0;
   int chordIdx = currentChordIndex;
+  uint8_t ch = event.channel0;
+  uint64_t& noteWord = activeNoteBits[ch][note >> 6];
+  const uint64_t noteBit = 1ULL << (note & 63);
+  const uint32_t now = event.timestamp;
+
+  if (event.statusCode == MIDI_NOTE_ON) {
+    // Velocity filter: ignore ghost notes below threshold
+    if (config.velocityThreshold > 0 && velocity < config.velocityThreshold) {
+      return;
+    }
 
-  if (midiStatus == 0x90) {  // NoteOn
-    if (velocity > 0) {
-      // Velocity filter: ignore ghost notes below threshold
-      if (config.velocityThreshold > 0 && velocity < config.velocityThreshold) {
-        return;
-      }
-
-      statusType = "NoteOn";
-      msgIndex = nextMsgIndex++;
-
-      // Chord detection: determine if this NoteOn starts a new chord
-      bool startNewChord = false;
-      if (activeNotes.empty()) {
-        startNewChord = true;
-      } else if (config.chordTimeWindow > 0 && (now - lastNoteOnTimestamp) > config.chordTimeWindow) {
-        startNewChord = true;
-      }
-
-      if (startNewChord) {
-        currentChordIndex = nextChordIndex++;
-      }
+    msgIndex = nextMsgIndex;
+    nextMsgIndex = (nextMsgIndex >= 0xFFFF) ? 1 : nextMsgIndex + 1;
 
-      lastNoteOnTimestamp = now;
-      chordIdx = currentChordIndex;
-      activeNotes[note] = currentChordIndex;
-      activeMsgIndex[note] = msgIndex;
-    } else {  // NoteOn with velocity 0 equals NoteOff
-      statusType = "NoteOff";
-      auto it = activeNotes.find(note);
-      if (it != activeNotes.end()) {
-        chordIdx = it->second;
-        msgIndex = activeMsgIndex[note];
-        activeNotes.erase(it);
-        activeMsgIndex.erase(note);
-      } else {
-        chordIdx = currentChordIndex;
-      }
+    // Chord detection: determine if this NoteOn starts a new chord
+    bool startNewChord = false;
+    if (activeNoteTotal == 0) {
+      startNewChord = true;
+    } else if (config.chordTimeWindow > 0 && timestampUs > lastNoteOnTimestampUs &&
+               (timestampUs - lastNoteOnTimestampUs) > static_cast<uint64_t>(config.chordTimeWindow) * 1000) {
+      startNewChord = true;
     }
-  } else if (midiStatus == 0x80) {  // NoteOff
-    statusType = "NoteOff";
-    auto it = activeNotes.find(note);
-    if (it != activeNotes.end()) {
-      chordIdx = it->second;
-      msgIndex = activeMsgIndex[note];
-      activeNotes.erase(it);
-      activeMsgIndex.erase(note);
-    } else {
-      chordIdx = currentChordIndex;
+
+    if (startNewChord) {
+      currentChordIndex = nextChordIndex;
+      nextChordIndex = (nextChordIndex >= 0xFFFF) ? 1 : nextChordIndex + 1;
+
+      MIDIChordRecord& rec = chordTable[currentChordIndex % CHORD_HISTORY];
+      memset(&rec, 0, sizeof(rec));
+      rec.chordIndex = static_cast<uint16_t>(currentChordIndex);
+      rec.firstEvent = globalIndex + 1;  // This NoteOn's index
+      rec.onset = now;
+      rec.lowestNote = 127;
+      rec.velocityMin = 127;
+      lastChordIndex = currentChordIndex;
     }
-  } else {
-    return;  // Unrecognized MIDI message
-  }
 
-  if (activeNotes.empty()) {
+    // Fold the note into the current chord's summary.
+    MIDIChordRecord& rec = chordTable[currentChordIndex % CHORD_HISTORY];
+    rec.notes[note >> 6] |= 1ULL << (note & 63);
+    rec.lastNoteOn = now;
+    rec.channelMask |= static_cast<uint16_t>(1u << ch);
+    if (rec.noteOnCount < 255) {
+      rec.noteOnCount++;
+      rec.velocitySum += static_cast<uint16_t>(velocity);
+    }
+    if (note < rec.lowestNote) rec.lowestNote = static_cast<uint8_t>(note);
+    if (note > rec.highestNote) rec.highestNote = static_cast<uint8_t>(note);
+    if (velocity < rec.velocityMin) rec.velocityMin = static_cast<uint8_t>(velocity);
+    if (velocity > rec.velocityMax) rec.velocityMax = static_cast<uint8_t>(velocity);
+
+    if (timestampUs > lastNoteOnTimestampUs) lastNoteOnTimestampUs = timestampUs;
+    chordIdx = currentChordIndex;
+    if (!(noteWord & noteBit)) activeNoteTotal++;
+    noteWord |= noteBit;
+    activeChord[ch][note] = static_cast<uint16_t>(currentChordIndex);
+    activeMsgIndex[ch][note] = static_cast<uint16_t>(msgIndex);
+  } else if (noteWord & noteBit) {  // NoteOff of a held note
+    chordIdx = activeChord[ch][note];
+    msgIndex = activeMsgIndex[ch][note];
+    noteWord &= ~noteBit;
+    activeNoteTotal--;
+  }
+
+  if (activeNoteTotal == 0) {
     currentChordIndex = 0;
   }
 
-  MIDIEventData event;
   event.index = ++globalIndex;
-  event.msgIndex = msgIndex;
-  event.timestamp = now;
-  event.delay = diff;
-  // New spec-compliant fields
-  event.statusCode = (midiStatus == 0x90 && velocity > 0) ? MIDI_NOTE_ON : MIDI_NOTE_OFF;
-  event.channel0 = midiData[0] & 0x0F;
-  event.noteNumber = static_cast<uint8_t>(note);
-  event.velocity7 = static_cast<uint8_t>(velocity);
-  event.velocity16 = MIDI2Scaler::scale7to16(velocity);
-  event.pitchBend14 = 0;
-  event.pitchBend32 = 0x80000000;
-  // Deprecated fields
-  event.channel = channel;
-  event.status = statusType;
-  event.note = note;
-  event.noteName = getNoteName(note);
-  event.noteOctave = getNoteWithOctave(note);
-  event.velocity = velocity;
-  event.chordIndex = chordIdx;
-  event.pitchBend = 0;
+  event.msgIndex = static_cast<uint16_t>(msgIndex);
+  event.chordIndex = static_cast<uint16_t>(chordIdx);
 
   addEvent(event);
+  dispatchEvent(event);
+}
+
+// --- Push subscriptions ---
+
+bool MIDIHandler::subscribe(MIDIStatus status, EventCallback cb, void* ctx, uint8_t channel) {
+  if (!cb || status < MIDI_NOTE_OFF || channel > 16) return false;
+  int slot = (status >> 4) - 8;
+  uint16_t mask = (channel == 0) ? 0xFFFF : static_cast<uint16_t>(1u << (channel - 1));
+
+  EventHandler* table = eventHandlers[slot];
+  for (int i = 0; i < eventHandlerCount[slot]; i++) {
+    if (table[i].cb == cb && table[i].ctx == ctx) {
+      table[i].channelMask |= mask;
+      return true;
+    }
+  }
+  if (eventHandlerCount[slot] >= MAX_EVENT_HANDLERS) return false;
+  table[eventHandlerCount[slot]++] = { cb, ctx, mask };
+  return true;
+}
+
+void MIDIHandler::unsubscribe(MIDIStatus status, EventCallback cb, void* ctx) {
+  if (status < MIDI_NOTE_OFF) return;
+  int slot = (status >> 4) - 8;
+
+  EventHandler* table = eventHandlers[slot];
+  for (int i = 0; i < eventHandlerCount[slot]; i++) {
+    if (table[i].cb == cb && table[i].ctx == ctx) {
+      // Keep registration order for the remaining handlers.
+      for (int j = i + 1; j < eventHandlerCount[slot]; j++) table[j - 1] = table[j];
+      eventHandlerCount[slot]--;
+      return;
+    }
+  }
+}
+
+void MIDIHandler::unsubscribeAll() {
+  memset(eventHandlers, 0, sizeof(eventHandlers));
+  memset(eventHandlerCount, 0, sizeof(eventHandlerCount));
+}
+
+void MIDIHandler::dispatchEvent(const MIDIEventRecord& event) {
+  int slot = (event.statusCode >> 4) - 8;
+  uint16_t bit = static_cast<uint16_t>(1u << event.channel0);
+  // Handlers may (un)subscribe from inside the callback, which shifts the
+  // table: call a copy, so every handler registered now gets this event.
+  EventHandler table[MAX_EVENT_HANDLERS];
+  int count = eventHandlerCount[slot];
+  memcpy(table, eventHandlers[slot], count * sizeof(EventHandler));
+  for (int i = 0; i < count; i++) {
+    if (table[i].channelMask & bit) table[i].cb(table[i].ctx, event);
+  }
 }
 
 // --- MIDI Output (via any transport that supports sending) ---
@@ -751,7 +979,7 @@ void MIDIHandler::handleSysExMessage(const uint8_t* data, size_t length) {
 
   MIDISysExEvent event;
   event.index = ++sysexGlobalIndex;
-  event.timestamp = millis();
+  event.timestamp = MIDIClock::nowMs();
   event.data.assign(data, data + truncLen);
   sysexQueue.push_back(std::move(event));
 
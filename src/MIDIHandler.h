@@ -1,49 +1,23 @@
 #ifndef MIDI_HANDLER_H
 #define MIDI_HANDLER_H
 
+#include <cstddef>
 #include <deque>
+#include <iterator>
 #include <map>
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include "MIDIHandlerConfig.h"
+#include "MIDIChordTable.h"
+#include "MIDIEventRing.h"
+#include "MIDIEventHistory.h"
 #include "MIDITransport.h"
 #include "MIDI2Support.h"
 
-// --- Feature detection macros ---
-// If ESP32_Host_MIDI.h was included first, these are already defined.
-// Otherwise, detect features from ESP-IDF / SDK configuration.
-#ifndef ESP32_HOST_MIDI_HAS_USB
-  #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || \
-      defined(CONFIG_IDF_TARGET_ESP32P4)
-    #define ESP32_HOST_MIDI_HAS_USB 1
-  #else
-    #define ESP32_HOST_MIDI_HAS_USB 0
-  #endif
-#endif
-
-#ifndef ESP32_HOST_MIDI_HAS_BLE
-  #if defined(CONFIG_BT_ENABLED)
-    #define ESP32_HOST_MIDI_HAS_BLE 1
-  #else
-    #define ESP32_HOST_MIDI_HAS_BLE 0
-  #endif
-#endif
-
-#ifndef ESP32_HOST_MIDI_HAS_PSRAM
-  #if defined(CONFIG_SPIRAM) || defined(CONFIG_SPIRAM_SUPPORT)
-    #define ESP32_HOST_MIDI_HAS_PSRAM 1
-  #else
-    #define ESP32_HOST_MIDI_HAS_PSRAM 0
-  #endif
-#endif
-
-#ifndef ESP32_HOST_MIDI_HAS_ETH_MAC
-  #if defined(CONFIG_IDF_TARGET_ESP32P4)
-    #define ESP32_HOST_MIDI_HAS_ETH_MAC 1
-  #else
-    #define ESP32_HOST_MIDI_HAS_ETH_MAC 0
-  #endif
+// Transports one MIDIHandler can hold: the 16 cable views of a multi-port
+// USB interface plus a few others. One pointer each.
+#ifndef ESP32_HOST_MIDI_MAX_TRANSPORTS
+  #define ESP32_HOST_MIDI_MAX_TRANSPORTS 20
 #endif
 
 // v6.0 separation: MIDIHandler is a pure aggregator. It no longer pulls
@@ -63,24 +37,43 @@ enum MIDIStatus : uint8_t {
     MIDI_PITCH_BEND        = 0xE0,
 };
 
-// Structure representing a parsed MIDI event using MIDI 1.0 terminology.
-struct MIDIEventData {
+// Compact, allocation-free event record (32 bytes, trivially copyable).
+// This is what the event queue and the history buffer store: the receive path
+// fills one of these per message and never touches the heap.
+//
+// MIDI 2.0 sources (MIDIHandler::handleUMP()) store their values as received;
+// MIDI 1.0 sources are scaled up via MIDI2Scaler. The 7-bit and 14-bit fields
+// are always filled, scaled down where needed.
+struct MIDIEventRecord {
   int index;                // Global event counter
-  int msgIndex;             // Index linking NoteOn/NoteOff pairs
-  unsigned long timestamp;  // Timestamp in milliseconds (millis())
-  unsigned long delay;      // Delta time (ms) since previous event
-  int chordIndex;           // Chord grouping index (simultaneous notes share the same index)
-
-  // --- MIDI spec compliant fields (v5.2+) ---
+  uint32_t timestamp;       // Arrival time in milliseconds (MIDIClock::nowMs())
+  uint32_t timestampUs;     // Arrival time in microseconds (low 32 bits of MIDIClock::nowUs(), wraps every ~71 min)
+  uint32_t delay;           // Delta time (ms) since previous event
+  union {
+    uint32_t pitchBend32;   // 32-bit pitch bend (MIDI 2.0, center = 0x80000000)
+    uint32_t value32;       // Same field for CC and Channel Pressure: the 32-bit value
+  };
+  uint16_t msgIndex;        // Index linking NoteOn/NoteOff pairs (wraps, skips 0)
+  uint16_t chordIndex;      // Chord grouping index (simultaneous notes share the same index)
+  uint16_t velocity16;      // 16-bit velocity (MIDI 2.0 resolution; upper half of value32 for CC / pressure)
+  uint16_t pitchBend14;     // 14-bit pitch bend (0-16383, center = 8192)
   MIDIStatus statusCode;    // Status as enum (MIDI_NOTE_ON, MIDI_CONTROL_CHANGE, etc.)
-  uint8_t channel0;         // MIDI channel 0-15 (MIDI spec convention)
+  uint8_t channel0 : 4;     // MIDI channel 0-15 (MIDI spec convention)
+  uint8_t group : 4;        // UMP group 0-15 (0 for MIDI 1.0 byte streams)
   uint8_t noteNumber;       // MIDI note number 0-127 (or controller number for CC)
-  uint16_t velocity16;      // 16-bit velocity (MIDI 2.0 resolution); MIDI 1.0 input scaled via MIDI2Scaler
   uint8_t velocity7;        // 7-bit velocity (original MIDI 1.0 value)
-  uint32_t pitchBend32;     // 32-bit pitch bend (MIDI 2.0, center = 0x80000000)
-  uint16_t pitchBend14;     // 14-bit pitch bend (0-16383, center = 8192)
+};
+static_assert(sizeof(MIDIEventRecord) == 32, "MIDIEventRecord layout must stay compact");
 
-  // --- Deprecated fields (kept for backward compatibility, will be removed in v6.0) ---
+// Structure representing a parsed MIDI event using MIDI 1.0 terminology.
+// The spec compliant fields live in MIDIEventRecord; this adds the deprecated
+// v5.1 fields, which are derived from the record when the event is read.
+//
+// Define ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS to drop them: MIDIEventData is
+// then the bare compact record and reading the queue copies 32 bytes per event.
+struct MIDIEventData : MIDIEventRecord {
+#ifndef ESP32_HOST_MIDI_NO_DEPRECATED_FIELDS
+  // --- Deprecated fields (kept for backward compatibility) ---
   int channel;              // MIDI channel (1-16) — deprecated: use channel0 (0-15)
   std::string status;       // "NoteOn", "NoteOff", etc. — deprecated: use statusCode
   int note;                 // MIDI note number — deprecated: use noteNumber
@@ -88,6 +81,84 @@ struct MIDIEventData {
   std::string noteOctave;   // "C4", "D#5" — deprecated: use MIDIHandler::noteWithOctave()
   int velocity;             // 7-bit velocity — deprecated: use velocity16 or velocity7
   int pitchBend;            // 14-bit pitch bend — deprecated: use pitchBend32 or pitchBend14
+#endif
+
+  MIDIEventData();
+  MIDIEventData(const MIDIEventRecord& record);
+};
+
+// Read-only view over the event queue. Iterating yields MIDIEventData by
+// value, expanded from the stored MIDIEventRecord; use record() or records()
+// to read the compact form without the copy.
+class MIDIEventQueueView {
+public:
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef MIDIEventData value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const MIDIEventData* pointer;
+    typedef MIDIEventData reference;
+
+    struct arrow_proxy {
+      MIDIEventData ev;
+      const MIDIEventData* operator->() const { return &ev; }
+    };
+
+    const_iterator(const MIDIEventQueueView* view, size_t pos) : _view(view), _pos(pos) {}
+    MIDIEventData operator*() const { return MIDIEventData(_view->record(_pos)); }
+    arrow_proxy operator->() const { return arrow_proxy{ **this }; }
+    const_iterator& operator++() { ++_pos; return *this; }
+    const_iterator operator++(int) { const_iterator t = *this; ++_pos; return t; }
+    bool operator==(const const_iterator& o) const { return _pos == o._pos; }
+    bool operator!=(const const_iterator& o) const { return _pos != o._pos; }
+
+  private:
+    const MIDIEventQueueView* _view;
+    size_t _pos;
+  };
+
+  typedef MIDIEventRing<MIDIEventRecord> Ring;
+
+  explicit MIDIEventQueueView(const Ring* records) : _records(records) {}
+
+  size_t size() const { return _records->size(); }
+  bool empty() const { return _records->empty(); }
+  const MIDIEventRecord& record(size_t i) const { return _records->at(i); }
+  const Ring& records() const { return *_records; }
+  MIDIEventData operator[](size_t i) const { return MIDIEventData(record(i)); }
+  MIDIEventData front() const { return (*this)[0]; }
+  MIDIEventData back() const { return (*this)[size() - 1]; }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size()); }
+
+private:
+  const Ring* _records;
+};
+
+// Read position of one consumer of the event queue (see MIDIHandler::read()).
+// Each reader keeps its own cursor; a default-constructed cursor starts at the
+// beginning of the event stream.
+struct MIDIEventCursor {
+  uint32_t seq = 0;         // Number of events consumed (matches the queue's push count)
+};
+
+// Summary of one chord (notes sharing a chordIndex), maintained incrementally
+// as NoteOns arrive. Describes the chord as struck: NoteOffs do not remove
+// notes from it.
+struct MIDIChordRecord {
+  uint64_t notes[2];        // 128-bit note set (bit n = MIDI note n)
+  int firstEvent;           // MIDIEventRecord::index of the first NoteOn
+  uint32_t onset;           // Timestamp (ms) of the first NoteOn
+  uint32_t lastNoteOn;      // Timestamp (ms) of the most recent NoteOn
+  uint16_t chordIndex;      // Matches MIDIEventRecord::chordIndex (0 = empty slot)
+  uint16_t channelMask;     // bit n = a NoteOn arrived on channel0 n
+  uint16_t velocitySum;     // Sum of 7-bit NoteOn velocities (mean = sum / noteOnCount)
+  uint8_t noteOnCount;      // NoteOns in the chord (saturates at 255)
+  uint8_t lowestNote;       // Bass note
+  uint8_t highestNote;
+  uint8_t velocityMin;
+  uint8_t velocityMax;
 };
 
 // Structure representing a complete SysEx message (0xF0 ... payload ... 0xF7).
@@ -107,12 +178,34 @@ public:
   void begin(const MIDIHandlerConfig& config);
   void task();
   void enableHistory(int capacity);
-  void addEvent(const MIDIEventData& event);
+  void addEvent(const MIDIEventRecord& event);
   void processQueue();
   void setQueueLimit(int maxEvents);
-  const std::deque<MIDIEventData>& getQueue() const;
-
+  const MIDIEventQueueView& getQueue() const;
+
+  // Copies up to `max` events pushed since `cursor` into `out` (oldest first)
+  // and advances the cursor. Returns the number of events copied. If the queue
+  // wrapped since the last read, `overrun` receives the number of events that
+  // were overwritten before this reader saw them (0 otherwise). Events removed
+  // by clearQueue() are skipped without counting as overwritten.
+  size_t read(MIDIEventCursor& cursor, MIDIEventRecord* out, size_t max, uint32_t* overrun = nullptr) const;
+
+  // History (config.historyCapacity > 0). Events are numbered oldest-first;
+  // getHistoryEvent() returns nullptr past the end.
+  size_t getHistorySize() const;
+  const MIDIEventRecord* getHistoryEvent(size_t i) const;
+
+  // Parses one message. Without a timestamp the message is stamped now;
+  // transports pass the time it was received (MIDIClock::nowUs()).
   void handleMidiMessage(const uint8_t* data, size_t length);
+  void handleMidiMessage(const uint8_t* data, size_t length, uint64_t timestampUs);
+
+  // Parses whole UMP packets, back to back (as a UMP batch callback gets
+  // them). MIDI 2.0 Channel Voice keeps its 16-bit velocity and 32-bit
+  // values; MIDI 1.0 Channel Voice in UMP is parsed like handleMidiMessage().
+  // Both record the packet's group. Other message types are skipped.
+  void handleUMP(const uint32_t* words, size_t count);
+  void handleUMP(const uint32_t* words, size_t count, uint64_t timestampUs);
 
   // Debug callback — called with raw MIDI bytes before parsing.
   // Set to nullptr to disable. Signature: (rawData, rawLength, midiBytes3)
@@ -126,20 +219,33 @@ public:
   static const char* noteWithOctave(uint8_t noteNumber, char* buf, size_t bufLen);
   static const char* statusName(MIDIStatus code);
 
+  // Active notes are tracked per channel. The functions without a channel
+  // argument report the union over all 16 channels.
   std::string getActiveNotesString() const;
   std::string getActiveNotes() const;
   std::vector<std::string> getActiveNotesVector() const;
   size_t getActiveNotesCount() const;
+  size_t getActiveNotesCount(uint8_t channel) const;            // channel: 1-16
+  bool isNoteActive(uint8_t channel, uint8_t note) const;       // channel: 1-16
   void fillActiveNotes(bool out[128]) const;
   void clearActiveNotesNow();
   void clearQueue();
 
   // Register an external transport (ESP-NOW, RTP-MIDI, custom, etc.).
   // The transport must already be initialized (begin() called) before adding.
-  // MIDIHandler will call task() on it and receive data via callbacks.
-  void addTransport(MIDITransport* transport);
-
-  // MIDI Output — send via any transport that supports sending.
+  // MIDIHandler will call task() on it and receive data via callbacks: MIDI
+  // 1.0 bytes, SysEx, and UMP from transports that deliver it (MIDI 2.0 data
+  // reaches the queue at full resolution). The handler takes over the
+  // transport's MIDI and SysEx callbacks and its timed UMP batch callback;
+  // the plain and batch UMP callbacks stay free for the sketch, and both
+  // see the same packets. Returns false once
+  // MAX_TRANSPORTS are registered.
+  static const int MAX_TRANSPORTS = ESP32_HOST_MIDI_MAX_TRANSPORTS;
+  bool addTransport(MIDITransport* transport);
+
+  // MIDI Output — sent by the first registered transport that accepts it
+  // (registration order), not by all of them. To address one port of a
+  // multi-port interface, call its view's sendMidiMessage() directly.
   // channel: 1-16. Returns true if any transport sent the message.
   bool sendNoteOn(uint8_t channel, uint8_t note, uint8_t velocity);
   bool sendNoteOff(uint8_t channel, uint8_t note, uint8_t velocity);
@@ -157,12 +263,51 @@ public:
   typedef void (*SysExCallback)(const uint8_t* data, size_t length);
   void setSysExCallback(SysExCallback cb) { sysExCb = cb; }
 
+  // Push subscriptions — parsed events delivered in the same call stack as the
+  // transport dispatch, right after the event is queued. Handlers are plain
+  // function pointers with a context pointer (no allocation) and run on the
+  // task that calls task(), so keep them short.
+  // status: which message type to receive. channel: 1-16, or 0 for all.
+  // Subscribing the same (cb, ctx) again for another channel widens the
+  // existing entry. Returns false if that status already has
+  // MAX_EVENT_HANDLERS entries. A handler may (un)subscribe from inside its
+  // callback; the change applies from the next event.
+  typedef void (*EventCallback)(void* ctx, const MIDIEventRecord& event);
+  static const int MAX_EVENT_HANDLERS = 4;  // per status
+  bool subscribe(MIDIStatus status, EventCallback cb, void* ctx = nullptr, uint8_t channel = 0);
+  void unsubscribe(MIDIStatus status, EventCallback cb, void* ctx = nullptr);
+  void unsubscribeAll();
+
   // v6.0: isBleConnected() removed; query the BLEConnection instance
   // directly via its isConnected() method instead.
 
-  // Chord event utility methods:
-  int lastChord(const std::deque<MIDIEventData>& queue) const;
-  std::vector<std::string> getChord(int chord, const std::deque<MIDIEventData>& queue, const std::vector<std::string>& fields = { "all" }, bool includeLabels = false) const;
+  // Chord index: the last CHORD_HISTORY chords, looked up in O(1).
+  // chord() returns nullptr if the chord is unknown or no longer retained.
+  static const int CHORD_HISTORY = 16;
+  int lastChord() const { return lastChordIndex; }
+  const MIDIChordRecord* chord(int chordIndex) const;
+  const MIDIChordRecord* lastChordRecord() const { return chord(lastChordIndex); }
+
+  // Typed chord / active-note accessors (no strings, no allocation).
+  // Note lists are written lowest first; the return value is the number of
+  // notes written (at most maxNotes). Pitch-class masks use bit n = pitch
+  // class n (C = bit 0 ... B = bit 11).
+  uint8_t getChordNotes(int chordIndex, uint8_t* notes, uint8_t maxNotes) const;
+  uint16_t getChordPitchClasses(int chordIndex) const;
+  uint8_t getActiveNoteNumbers(uint8_t* notes, uint8_t maxNotes) const;
+  uint16_t getActivePitchClasses() const;
+  // Chord name (root, quality, inversion) by table lookup; see MIDIChordTable.h.
+  MIDIChordInfo getChordInfo(int chordIndex) const;
+  MIDIChordInfo getActiveChordInfo() const;
+  static uint8_t noteSetToArray(const uint64_t set[2], uint8_t* notes, uint8_t maxNotes);
+  static uint16_t noteSetToPitchClasses(const uint64_t set[2]);
+
+  // Chord event utility methods (scan the given queue):
+  int lastChord(const MIDIEventQueueView& queue) const;
+  std::vector<std::string> getChord(int chord, const MIDIEventQueueView& queue, const std::vector<std::string>& fields = { "all" }, bool includeLabels = false) const;
+  // getAnswer() formats the last chord: note fields ("note", "noteName",
+  // "noteOctave", "status") come from the chord index without a scan; other
+  // fields read back only the events since the chord began.
   std::vector<std::string> getAnswer(const std::string& field = "all", bool includeLabels = false) const;
   std::vector<std::string> getAnswer(const std::vector<std::string>& fields, bool includeLabels = false) const;
 
@@ -170,39 +315,67 @@ private:
   MIDIHandlerConfig config;
   RawMidiCallback rawMidiCb = nullptr;
 
-  std::deque<MIDIEventData> eventQueue;
+  MIDIEventRing<MIDIEventRecord> eventQueue;  // Fixed capacity (maxEvents), allocated in begin()
+  MIDIEventQueueView eventQueueView;
   int maxEvents;
   int globalIndex;
   int nextMsgIndex;
-  unsigned long lastTimestamp;
-  unsigned long lastNoteOnTimestamp;
+  uint64_t lastTimestampUs;
+  uint64_t lastNoteOnTimestampUs;
 
-  std::unordered_map<int, int> activeNotes;
-  std::unordered_map<int, int> activeMsgIndex;
+  // Active notes: one 128-bit set per channel, plus the chord and msgIndex of
+  // each held note so NoteOff can be paired without a lookup structure.
+  uint64_t activeNoteBits[16][2];
+  uint16_t activeChord[16][128];
+  uint16_t activeMsgIndex[16][128];
+  int activeNoteTotal;  // Held (channel, note) pairs
+
+  void activeNotesUnion(uint64_t out[2]) const;
 
   int nextChordIndex;
   int currentChordIndex;
 
-  // History buffer (PSRAM when available, heap otherwise)
-  MIDIEventData* historyQueue;
-  int historyQueueCapacity;
-  int historyQueueSize;
-  int historyQueueHead;
+  // Chord index, direct-mapped by chordIndex % CHORD_HISTORY. Chord indices
+  // are handed out sequentially, so the last CHORD_HISTORY chords never
+  // collide.
+  MIDIChordRecord chordTable[CHORD_HISTORY];
+  int lastChordIndex;
+  void clearChordIndex();
+  std::vector<std::string> formatChord(std::vector<MIDIEventRecord>& chordEvents, const std::vector<std::string>& fields, bool includeLabels) const;
 
-  void expandHistoryQueue();
+  // History buffer (PSRAM when available, heap otherwise)
+  MIDIEventHistory<MIDIEventRecord> history;
 
   std::string getNoteName(int note) const;
   std::string getNoteWithOctave(int note) const;
 
   // --- Transport abstraction ---
-  static const int MAX_TRANSPORTS = 4;
   MIDITransport* transports[MAX_TRANSPORTS];
   int transportCount;
 
-  void registerTransport(MIDITransport* t);
-  static void _onTransportMidiData(void* ctx, const uint8_t* data, size_t len);
+  bool registerTransport(MIDITransport* t);
+  static void _onTransportMidiData(void* ctx, const uint8_t* data, size_t len, uint64_t timestampUs);
   static void _onTransportDisconnected(void* ctx);
   static void _onTransportSysExData(void* ctx, const uint8_t* data, size_t len);
+  static void _onTransportUMPData(void* ctx, const uint32_t* words, size_t count, uint64_t timestampUs);
+
+  // Receive path shared by MIDI 1.0 bytes and UMP: stampEvent() fills the
+  // arrival time and defaults, the parser fills the message, recordEvent()
+  // tracks notes and chords, then queues and dispatches.
+  void handleChannelMessage(const uint8_t* midi, uint8_t group, uint64_t timestampUs);
+  void handleMIDI2Voice(const UMPWord64& pkt, uint64_t timestampUs);
+  void stampEvent(MIDIEventRecord& event, uint8_t group, uint8_t channel0, uint64_t timestampUs);
+  void recordEvent(MIDIEventRecord& event, uint64_t timestampUs);
+
+  // Push subscriptions: one small table per status nibble (0x8n..0xEn).
+  struct EventHandler {
+    EventCallback cb;
+    void* ctx;
+    uint16_t channelMask;  // bit n = channel0 n
+  };
+  EventHandler eventHandlers[7][MAX_EVENT_HANDLERS];
+  uint8_t eventHandlerCount[7];
+  void dispatchEvent(const MIDIEventRecord& event);
 
   // SysEx
   std::deque<MIDISysExEvent> sysexQueue;
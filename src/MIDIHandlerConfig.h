@@ -11,6 +11,52 @@
 //   config.chordTimeWindow = 50;
 //   midiHandler.begin(config);
 
+#include <stdint.h>
+
+// --- Feature detection macros ---
+// If ESP32_Host_MIDI.h was included first, these are already defined.
+// Otherwise, detect features from ESP-IDF / SDK configuration. They live here,
+// not in MIDIHandler.h, so every header that includes this one (e.g.
+// MIDIEventHistory.h for the PSRAM path) sees them.
+#ifndef ESP32_HOST_MIDI_HAS_USB
+  #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || \
+      defined(CONFIG_IDF_TARGET_ESP32P4)
+    #define ESP32_HOST_MIDI_HAS_USB 1
+  #else
+    #define ESP32_HOST_MIDI_HAS_USB 0
+  #endif
+#endif
+
+#ifndef ESP32_HOST_MIDI_HAS_BLE
+  #if defined(CONFIG_BT_ENABLED)
+    #define ESP32_HOST_MIDI_HAS_BLE 1
+  #else
+    #define ESP32_HOST_MIDI_HAS_BLE 0
+  #endif
+#endif
+
+#ifndef ESP32_HOST_MIDI_HAS_PSRAM
+  #if defined(CONFIG_SPIRAM) || defined(CONFIG_SPIRAM_SUPPORT)
+    #define ESP32_HOST_MIDI_HAS_PSRAM 1
+  #else
+    #define ESP32_HOST_MIDI_HAS_PSRAM 0
+  #endif
+#endif
+
+#ifndef ESP32_HOST_MIDI_HAS_ETH_MAC
+  #if defined(CONFIG_IDF_TARGET_ESP32P4)
+    #define ESP32_HOST_MIDI_HAS_ETH_MAC 1
+  #else
+    #define ESP32_HOST_MIDI_HAS_ETH_MAC 0
+  #endif
+#endif
+
+// How the history buffer behaves once it is full (see MIDIEventHistory.h).
+enum MIDIHistoryMode : uint8_t {
+    MIDI_HISTORY_OVERWRITE = 0,  // Fixed ring: the oldest event is overwritten
+    MIDI_HISTORY_GROW      = 1,  // Links in another block of historyCapacity events
+};
+
 struct MIDIHandlerConfig {
     // --- Event Queue ---
 
@@ -40,11 +86,22 @@ struct MIDIHandlerConfig {
 
     // --- History (PSRAM) ---
 
-    // Initial capacity for the PSRAM history buffer.
+    // Capacity (events) of the PSRAM history buffer. In MIDI_HISTORY_GROW
+    // mode this is the size of each block added as the history fills up.
     // Set to 0 to disable history (default).
     // Set to a positive value to enable history on begin().
     int historyCapacity = 0;
 
+    // MIDI_HISTORY_GROW (default) keeps every event, adding blocks as needed;
+    // existing events are never copied. MIDI_HISTORY_OVERWRITE allocates
+    // historyCapacity events once and then overwrites the oldest.
+    MIDIHistoryMode historyMode = MIDI_HISTORY_GROW;
+
+    // Upper bound (events) for MIDI_HISTORY_GROW. Once reached the history
+    // overwrites its oldest events. 0 = no limit: the history grows while
+    // memory lasts, so set a bound for long sessions.
+    int historyMaxCapacity = 0;
+
     // --- SysEx Configuration ---
 
     // Maximum size of a single SysEx message (bytes, including 0xF0 and 0xF7).
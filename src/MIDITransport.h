@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include "MIDIClock.h"
 
 // Abstract base class for MIDI transports.
 // USB, BLE, ESP-NOW, RTP-MIDI — any transport implements this interface.
@@ -32,8 +33,18 @@ public:
 
     // Callback registration — used by MIDIHandler to receive data and events.
     void setMidiCallback(MIDIDataCallback cb, void* ctx) {
-        _midiCb = cb; _midiCtx = ctx;
+        _midiCb = cb; _midiCtx = ctx; _timedMidiCb = nullptr;
     }
+
+    // Same as the MIDI callback, plus the arrival time (MIDIClock::nowUs()).
+    // Transports with a receive ring stamp each packet when it is enqueued,
+    // so the time does not include the wait for task(). Replaces the plain
+    // MIDI callback (and vice versa).
+    typedef void (*TimedMIDIDataCallback)(void* context, const uint8_t* data, size_t length, uint64_t timestampUs);
+    void setTimedMidiCallback(TimedMIDIDataCallback cb, void* ctx) {
+        _timedMidiCb = cb; _midiCtx = ctx; _midiCb = nullptr;
+    }
+
     void setConnectionCallbacks(ConnectionCallback onConn, ConnectionCallback onDisconn, void* ctx) {
         _onConnect = onConn; _onDisconnect = onDisconn; _connCtx = ctx;
     }
@@ -43,34 +54,88 @@ public:
         _sysExCb = cb; _sysExCtx = ctx;
     }
 
-    // UMP callback — delivers raw 32-bit UMP words (MIDI 2.0 native).
+    // UMP callbacks — deliver raw 32-bit UMP words (MIDI 2.0 native).
     // Only fired when transport negotiated MIDI 2.0 (Alt 1 / UMP endpoint).
+    // The three forms below are separate slots, each with its own context,
+    // and every one that is set gets the same packets: a sketch can watch
+    // raw UMP while MIDIHandler (which takes the timed batch slot in
+    // addTransport()) fills its queue.
+
+    // One whole packet per call.
     typedef void (*UMPDataCallback)(void* context, const uint32_t* words, uint8_t count);
     void setUMPCallback(UMPDataCallback cb, void* ctx) {
         _umpCb = cb; _umpCtx = ctx;
     }
 
+    // Batch form: count words of whole UMP packets, back to back, in one call
+    // per received span instead of one call per packet. Walk it with the
+    // packet sizes of each MT.
+    typedef void (*UMPBatchCallback)(void* context, const uint32_t* words, size_t count);
+    void setUMPBatchCallback(UMPBatchCallback cb, void* ctx) {
+        _umpBatchCb = cb; _umpBatchCtx = ctx;
+    }
+
+    // Same as the batch callback, plus the arrival time of the span, as for
+    // the timed MIDI callback.
+    typedef void (*TimedUMPBatchCallback)(void* context, const uint32_t* words, size_t count, uint64_t timestampUs);
+    void setTimedUMPBatchCallback(TimedUMPBatchCallback cb, void* ctx) {
+        _timedUmpBatchCb = cb; _timedUmpBatchCtx = ctx;
+    }
+
 protected:
     // Transport implementations call these to deliver data/events to the consumer.
+    // Without a timestamp the message is stamped now, at dispatch.
     void dispatchMidiData(const uint8_t* data, size_t len) {
-        if (_midiCb) _midiCb(_midiCtx, data, len);
+        if (_timedMidiCb) _timedMidiCb(_midiCtx, data, len, MIDIClock::nowUs());
+        else if (_midiCb) _midiCb(_midiCtx, data, len);
+    }
+    void dispatchMidiData(const uint8_t* data, size_t len, uint64_t timestampUs) {
+        if (_timedMidiCb) _timedMidiCb(_midiCtx, data, len, timestampUs);
+        else if (_midiCb) _midiCb(_midiCtx, data, len);
     }
     void dispatchSysExData(const uint8_t* data, size_t len) {
         if (_sysExCb) _sysExCb(_sysExCtx, data, len);
     }
     void dispatchUMPData(const uint32_t* words, uint8_t count) {
         if (_umpCb) _umpCb(_umpCtx, words, count);
+        if (_umpBatchCb) _umpBatchCb(_umpBatchCtx, words, count);
+        if (_timedUmpBatchCb) _timedUmpBatchCb(_timedUmpBatchCtx, words, count, MIDIClock::nowUs());
+    }
+    // Whole packets only (a trailing partial packet is not delivered).
+    void dispatchUMPBatch(const uint32_t* words, size_t count) {
+        dispatchUMPBatch(words, count, MIDIClock::nowUs());
+    }
+    void dispatchUMPBatch(const uint32_t* words, size_t count, uint64_t timestampUs) {
+        if (_timedUmpBatchCb) _timedUmpBatchCb(_timedUmpBatchCtx, words, count, timestampUs);
+        if (_umpBatchCb) _umpBatchCb(_umpBatchCtx, words, count);
+        if (!_umpCb) return;
+        static const uint8_t WORDS_BY_MT[16] = { 1,1,1,2,2,4,1,1,2,2,2,3,3,4,4,4 };
+        size_t i = 0;
+        while (i < count) {
+            uint8_t n = WORDS_BY_MT[words[i] >> 28];
+            if (i + n > count) break;
+            _umpCb(_umpCtx, &words[i], n);
+            i += n;
+        }
     }
+    // True when a consumer takes UMP. Transports that can deliver either
+    // UMP or MIDI 1.0 bytes send UMP then, so nothing is scaled down.
+    bool hasUMPConsumer() const { return _umpCb || _umpBatchCb || _timedUmpBatchCb; }
     void dispatchConnected() { if (_onConnect) _onConnect(_connCtx); }
     void dispatchDisconnected() { if (_onDisconnect) _onDisconnect(_connCtx); }
 
 private:
     MIDIDataCallback _midiCb = nullptr;
+    TimedMIDIDataCallback _timedMidiCb = nullptr;
     void* _midiCtx = nullptr;
     SysExDataCallback _sysExCb = nullptr;
     void* _sysExCtx = nullptr;
     UMPDataCallback _umpCb = nullptr;
     void* _umpCtx = nullptr;
+    UMPBatchCallback _umpBatchCb = nullptr;
+    void* _umpBatchCtx = nullptr;
+    TimedUMPBatchCallback _timedUmpBatchCb = nullptr;
+    void* _timedUmpBatchCtx = nullptr;
     ConnectionCallback _onConnect = nullptr;
     ConnectionCallback _onDisconnect = nullptr;
     void* _connCtx = nullptr;
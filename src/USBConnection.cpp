@@ -1,4 +1,5 @@
 #include "USBConnection.h"
+#include "USBMIDICable.h"
 #include <string.h>
 
 static bool isValidMidiMessage(const uint8_t* midiData, size_t length) {
@@ -11,55 +12,116 @@ static bool isValidMidiMessage(const uint8_t* midiData, size_t length) {
         return (length >= 3);
 }
 
+USBConnection* USBConnection::_devices[USBConnection::MAX_DEVICES] = {};
+portMUX_TYPE USBConnection::_devicesMux = portMUX_INITIALIZER_UNLOCKED;
+usbmidi::core::EventRing<ESP32_HOST_MIDI_USB_RX_EVENTS> USBConnection::_rxRing;
+usb_host_client_handle_t USBConnection::_client = nullptr;
+TaskHandle_t USBConnection::_usbTaskHandle = nullptr;
+TaskHandle_t USBConnection::_usbLibTaskHandle = nullptr;
+uint32_t USBConnection::_eventFlags = 0;
+usbmidi::core::ProfileCache<usbmidi::core::PROFILE_CACHE_SLOTS> USBConnection::_profiles = {};
+
 USBConnection::USBConnection()
   : isReady(false),
-    interval(0),
-    lastCheck(0),
     clientHandle(nullptr),
     deviceHandle(nullptr),
-    eventFlags(0),
-    midiTransfer(nullptr),
-    _outTransfer(nullptr),
-    _outTransferBusy(false),
-    queueHead(0),
-    queueTail(0),
-    queueMux(portMUX_INITIALIZER_UNLOCKED),
+    _slot(-1),
+    _matchVid(0),
+    _matchPid(0),
+    _vid(0),
+    _pid(0),
+    _bcdDevice(0),
+    _devAddress(0),
+    _inPoolSize(0),
+    _inMux(portMUX_INITIALIZER_UNLOCKED),
+    _outPoolSize(0),
+    _outFree(0),
+    _outPumping(false),
+    _outTransfers(0),
+    _outMux(portMUX_INITIALIZER_UNLOCKED),
+    _configHash(0),
     firstMidiReceived(false),
     isMidiDeviceConfirmed(false),
     deviceName(""),
     lastError(""),
-    usbTaskHandle(nullptr)
+    _inCables(0),
+    _outCables(0)
 {
+    for (int i = 0; i < 16; i++) _cables[i] = nullptr;
+    for (int i = 0; i < usbmidi::core::IN_POOL_SIZE; i++) _inPool[i] = nullptr;
+    for (int i = 0; i < OUT_POOL_SIZE; i++) {
+        _outPool[i] = nullptr;
+        _outEvents[i] = 0;
+    }
+}
+
+// Instances are meant to live as long as the program; this only keeps a
+// destroyed one from being handed devices or events.
+USBConnection::~USBConnection() {
+    if (_slot < 0) return;
+    portENTER_CRITICAL(&_devicesMux);
+    _devices[_slot] = nullptr;
+    portEXIT_CRITICAL(&_devicesMux);
+    _slot = -1;
+}
+
+void USBConnection::matchDevice(uint16_t vendorId, uint16_t productId) {
+    _matchVid = vendorId;
+    _matchPid = vendorId ? productId : 0;
 }
 
 bool USBConnection::begin() {
-    usb_host_config_t config = {
-        .skip_phy_setup = false,
-        .intr_flags = ESP_INTR_FLAG_LEVEL1,
-    };
-    esp_err_t err = usb_host_install(&config);
-    if (err != ESP_OK) {
-        lastError = "USB host install failed (err=" + String(err) + ")";
+    if (_slot >= 0) return true;  // already initialized
+
+    int slot = -1;
+    portENTER_CRITICAL(&_devicesMux);
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (_devices[i] == nullptr) { slot = i; break; }
+    }
+    portEXIT_CRITICAL(&_devicesMux);
+    if (slot < 0) {
+        lastError = "Too many USB connections (max " + String(MAX_DEVICES) + ")";
         return false;
     }
 
-    usb_host_client_config_t client_config = {
-        .is_synchronous = true,
-        .max_num_event_msg = 10,
-        .async = {
-            .client_event_callback = _clientEventCallback,
-            .callback_arg = this,
+    // The host, its client and the tasks are shared by every instance.
+    if (_client == nullptr) {
+        usb_host_config_t config = {
+            .skip_phy_setup = false,
+            .intr_flags = ESP_INTR_FLAG_LEVEL1,
+        };
+        esp_err_t err = usb_host_install(&config);
+        if (err != ESP_OK) {
+            lastError = "USB host install failed (err=" + String(err) + ")";
+            return false;
         }
-    };
-    err = usb_host_client_register(&client_config, &clientHandle);
-    if (err != ESP_OK) {
-        lastError = "USB client register failed (err=" + String(err) + ")";
-        return false;
+
+        usb_host_client_config_t client_config = {
+            .is_synchronous = true,
+            .max_num_event_msg = 10,
+            .async = {
+                .client_event_callback = _clientEventCallback,
+                .callback_arg = nullptr,
+            }
+        };
+        err = usb_host_client_register(&client_config, &_client);
+        if (err != ESP_OK) {
+            lastError = "USB client register failed (err=" + String(err) + ")";
+            return false;
+        }
+
+        // Creates dedicated tasks on core 0 for USB event handling, so MIDI events
+        // are never lost due to delays in the main loop. Both block in the USB
+        // Host library until an event or transfer completes.
+        xTaskCreatePinnedToCore(_usbLibTask, "usb_host", 2048, nullptr, 5, &_usbLibTaskHandle, 0);
+        xTaskCreatePinnedToCore(_usbTask, "usb_midi", 4096, nullptr, 5, &_usbTaskHandle, 0);
     }
 
-    // Creates dedicated task on core 0 for continuous USB polling.
-    // Ensures MIDI events are never lost due to delays in the main loop.
-    xTaskCreatePinnedToCore(_usbTask, "usb_midi", 4096, this, 5, &usbTaskHandle, 0);
+    clientHandle = _client;
+    _slot = (int8_t)slot;
+    portENTER_CRITICAL(&_devicesMux);
+    _devices[slot] = this;
+    portEXIT_CRITICAL(&_devicesMux);
 
     lastError = "";
     return true;
@@ -71,181 +133,300 @@ void USBConnection::task() {
     processQueue();
 }
 
-bool USBConnection::enqueueMidiMessage(const uint8_t* data, size_t /*length*/) {
-    portENTER_CRITICAL(&queueMux);
-    int next = (queueHead + 1) % QUEUE_SIZE;
-    if (next == queueTail) {
-        // Queue full; discard the message.
-        portEXIT_CRITICAL(&queueMux);
-        return false;
-    }
-    size_t copyLength = 4;
-    memcpy(usbQueue[queueHead].data, data, copyLength);
-    usbQueue[queueHead].length = copyLength;
-    queueHead = next;
-    portEXIT_CRITICAL(&queueMux);
-    return true;
+// Whichever instance's task() runs drains the events of all devices; each
+// goes through the instance that owns the slot it is tagged with.
+void USBConnection::processQueue() {
+    _rxRing.drainTagged([](const uint32_t* events, const uint32_t* stamps,
+                           const uint8_t* tags, size_t n) {
+        // Read the clock after the span was published, so no stamp in it is
+        // newer than now.
+        uint64_t now = MIDIClock::nowUs();
+        for (size_t i = 0; i < n; i++) {
+            USBConnection* owner = tags[i] < MAX_DEVICES ? _devices[tags[i]] : nullptr;
+            if (!owner) continue;
+            uint8_t packet[4];
+            usbmidi::core::unpackEvent(events[i], packet);
+            owner->processEvent(packet, usbmidi::core::expandStamp(stamps[i], now));
+        }
+    });
 }
 
-bool USBConnection::dequeueMidiMessage(RawUsbMessage &msg) {
-    portENTER_CRITICAL(&queueMux);
-    if (queueTail == queueHead) {
-        portEXIT_CRITICAL(&queueMux);
-        return false;
+void USBConnection::processEvent(const uint8_t packet[4], uint64_t timestampUs) {
+    uint8_t cable = usbmidi::core::eventCable(packet[0]);
+    uint8_t cin = packet[0] & 0x0F;
+    uint16_t bit = (uint16_t)(1u << cable);
+    std::vector<uint8_t>& sysex = _sysexBuf[cable];
+    USBMIDICable* view = _cables[cable];
+
+    switch (cin) {
+        case 0x04:  // SysEx start or continue (3 data bytes)
+            if (!(_sysexActive & bit)) {
+                sysex.clear();
+                _sysexActive |= bit;
+            }
+            sysex.push_back(packet[1]);
+            sysex.push_back(packet[2]);
+            sysex.push_back(packet[3]);
+            return;
+
+        case 0x05:  // SysEx end — 1 data byte
+        case 0x06:  // SysEx end — 2 data bytes
+        case 0x07:  // SysEx end — 3 data bytes
+            if (_sysexActive & bit) {
+                for (int i = 0; i < cin - 0x04; i++) sysex.push_back(packet[1 + i]);
+                if (view) view->deliverSysEx(sysex.data(), sysex.size());
+                else      dispatchSysExData(sysex.data(), sysex.size());
+                _sysexActive &= (uint16_t)~bit;
+                sysex.clear();
+            }
+            return;
+
+        default:
+            // Non-SysEx message — abort any incomplete SysEx on this cable and dispatch normally
+            if (_sysexActive & bit) { _sysexActive &= (uint16_t)~bit; sysex.clear(); }
+            if (view) view->deliverMidi(packet, 4, timestampUs);
+            else      dispatchMidiData(packet, 4, timestampUs);
+            return;
     }
-    msg = usbQueue[queueTail];
-    queueTail = (queueTail + 1) % QUEUE_SIZE;
-    portEXIT_CRITICAL(&queueMux);
+}
+
+// ---------- Virtual Cables ----------
+
+bool USBConnection::attachCable(USBMIDICable* view) {
+    if (!view || _cables[view->cable()]) return false;
+    _cables[view->cable()] = view;
     return true;
 }
 
-void USBConnection::processQueue() {
-    RawUsbMessage msg;
-    while (dequeueMidiMessage(msg)) {
-        if (msg.length < 4) {
-            dispatchMidiData(msg.data, msg.length);
-            continue;
-        }
-        uint8_t cin = msg.data[0] & 0x0F;
+void USBConnection::detachCable(USBMIDICable* view) {
+    if (view && _cables[view->cable()] == view) _cables[view->cable()] = nullptr;
+}
 
-        switch (cin) {
-            case 0x04:  // SysEx start or continue (3 data bytes)
-                if (!_sysexActive) {
-                    _sysexBuf.clear();
-                    _sysexActive = true;
-                }
-                _sysexBuf.push_back(msg.data[1]);
-                _sysexBuf.push_back(msg.data[2]);
-                _sysexBuf.push_back(msg.data[3]);
-                break;
-
-            case 0x05:  // SysEx end — 1 data byte
-                if (_sysexActive) {
-                    _sysexBuf.push_back(msg.data[1]);
-                    dispatchSysExData(_sysexBuf.data(), _sysexBuf.size());
-                    _sysexActive = false;
-                    _sysexBuf.clear();
-                }
-                break;
-
-            case 0x06:  // SysEx end — 2 data bytes
-                if (_sysexActive) {
-                    _sysexBuf.push_back(msg.data[1]);
-                    _sysexBuf.push_back(msg.data[2]);
-                    dispatchSysExData(_sysexBuf.data(), _sysexBuf.size());
-                    _sysexActive = false;
-                    _sysexBuf.clear();
-                }
-                break;
-
-            case 0x07:  // SysEx end — 3 data bytes
-                if (_sysexActive) {
-                    _sysexBuf.push_back(msg.data[1]);
-                    _sysexBuf.push_back(msg.data[2]);
-                    _sysexBuf.push_back(msg.data[3]);
-                    dispatchSysExData(_sysexBuf.data(), _sysexBuf.size());
-                    _sysexActive = false;
-                    _sysexBuf.clear();
-                }
-                break;
+void USBConnection::_dispatchConnected() {
+    dispatchConnected();
+    for (int i = 0; i < 16; i++) {
+        if (_cables[i]) _cables[i]->deliverConnected();
+    }
+}
 
-            default:
-                // Non-SysEx message — abort any incomplete SysEx and dispatch normally
-                if (_sysexActive) { _sysexActive = false; _sysexBuf.clear(); }
-                dispatchMidiData(msg.data, msg.length);
-                break;
-        }
+void USBConnection::_dispatchDisconnected() {
+    dispatchDisconnected();
+    for (int i = 0; i < 16; i++) {
+        if (_cables[i]) _cables[i]->deliverDisconnected();
     }
 }
 
 int USBConnection::getQueueSize() const {
-    int size = queueHead - queueTail;
-    if (size < 0) size += QUEUE_SIZE;
-    return size;
+    return (int)_rxRing.size();
 }
 
-const RawUsbMessage& USBConnection::getQueueMessage(int index) const {
-    int realIndex = (queueTail + index) % QUEUE_SIZE;
-    return usbQueue[realIndex];
+RawUsbMessage USBConnection::getQueueMessage(int index) const {
+    RawUsbMessage msg;
+    usbmidi::core::unpackEvent(_rxRing.at(index), msg.data);
+    msg.length = 4;
+    msg.timestampUs = usbmidi::core::expandStamp(_rxRing.stampAt(index), MIDIClock::nowUs());
+    return msg;
 }
 
 // ---------- USB Task (core 0) ----------
 
-void USBConnection::_usbTask(void* arg) {
-    USBConnection* usbCon = static_cast<USBConnection*>(arg);
+// Host library daemon: enumeration, hub and port events.
+void USBConnection::_usbLibTask(void*) {
     for (;;) {
-        usb_host_lib_handle_events(1, &usbCon->eventFlags);
-        usb_host_client_handle_events(usbCon->clientHandle, 1);
-
-        if (usbCon->isReady && usbCon->midiTransfer) {
-            unsigned long now = millis();
-            if ((now - usbCon->lastCheck) > usbCon->interval) {
-                usbCon->lastCheck = now;
-                usb_host_transfer_submit(usbCon->midiTransfer);
-            }
-        }
+        usb_host_lib_handle_events(portMAX_DELAY, &_eventFlags);
+    }
+}
+
+// Client: device events and every transfer completion callback. IN transfers
+// resubmit themselves from _onReceive, so there is nothing to poll here.
+void USBConnection::_usbTask(void*) {
+    for (;;) {
+        usb_host_client_handle_events(_client, portMAX_DELAY);
+    }
+}
+
+// ---------- Device Slots ----------
+
+// Picks the instance for a new device (see chooseDeviceSlot). Runs on the USB
+// task only, which also sets the chosen instance's deviceHandle.
+USBConnection* USBConnection::_claimSlot(uint16_t vid, uint16_t pid) {
+    usbmidi::core::DeviceSlot slots[MAX_DEVICES];
+    portENTER_CRITICAL(&_devicesMux);
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        USBConnection* c = _devices[i];
+        slots[i].registered = c != nullptr;
+        slots[i].busy       = c && c->deviceHandle != nullptr;
+        slots[i].vid        = c ? c->_matchVid : 0;
+        slots[i].pid        = c ? c->_matchPid : 0;
     }
+    int slot = usbmidi::core::chooseDeviceSlot(slots, MAX_DEVICES, vid, pid);
+    USBConnection* usbCon = slot >= 0 ? _devices[slot] : nullptr;
+    portEXIT_CRITICAL(&_devicesMux);
+    return usbCon;
 }
 
 // ---------- Internal Callbacks ----------
 
-void USBConnection::_clientEventCallback(const usb_host_client_event_msg_t *eventMsg, void *arg) {
-    USBConnection *usbCon = static_cast<USBConnection*>(arg);
+void USBConnection::_clientEventCallback(const usb_host_client_event_msg_t *eventMsg, void *) {
     esp_err_t err;
     switch (eventMsg->event) {
-        case USB_HOST_CLIENT_EVENT_NEW_DEV:
-            err = usb_host_device_open(usbCon->clientHandle, eventMsg->new_dev.address, &usbCon->deviceHandle);
+        case USB_HOST_CLIENT_EVENT_NEW_DEV: {
+            usb_device_handle_t dev = nullptr;
+            err = usb_host_device_open(_client, eventMsg->new_dev.address, &dev);
+            if (err != ESP_OK) return;
+
+            const usb_device_desc_t *dev_desc = nullptr;
+            uint16_t vid = 0, pid = 0, bcd = 0;
+            if (usb_host_get_device_descriptor(dev, &dev_desc) == ESP_OK && dev_desc) {
+                vid = dev_desc->idVendor;
+                pid = dev_desc->idProduct;
+                bcd = dev_desc->bcdDevice;
+            }
+
+            // Devices no instance wants are left alone.
+            USBConnection *usbCon = _claimSlot(vid, pid);
+            if (!usbCon) {
+                usb_host_device_close(_client, dev);
+                return;
+            }
+            usbCon->deviceHandle = dev;
+            usbCon->_vid = vid;
+            usbCon->_pid = pid;
+            usbCon->_bcdDevice = bcd;
+            usbCon->_devAddress = eventMsg->new_dev.address;
+
+            const usb_config_desc_t *config_desc;
+            err = usb_host_get_active_config_descriptor(dev, &config_desc);
             if (err != ESP_OK) {
-                usbCon->lastError = "Device open failed (err=" + String(err) + ")";
+                usbCon->lastError = "Config descriptor failed (err=" + String(err) + ")";
+                usbCon->_releaseDevice();
                 return;
             }
-            {
-                const usb_config_desc_t *config_desc;
-                err = usb_host_get_active_config_descriptor(usbCon->deviceHandle, &config_desc);
-                if (err != ESP_OK) {
-                    usbCon->lastError = "Config descriptor failed (err=" + String(err) + ")";
-                    return;
-                }
-                usbCon->_processConfig(config_desc);
+            usbCon->_processConfig(config_desc);
+            if (!usbCon->isReady) {
+                // Frees the slot for the next device
+                usbCon->_freeInPool();
+                usbCon->_freeOutPool();
+                usbCon->_releaseDevice();
+                return;
             }
+            usbCon->_startIn();
             usbCon->lastError = "";
-            usbCon->dispatchConnected();
+            usbCon->_dispatchConnected();
             break;
-        case USB_HOST_CLIENT_EVENT_DEV_GONE:
-            usbCon->_onDeviceGone();
-            if (usbCon->midiTransfer) {
-                usb_host_transfer_free(usbCon->midiTransfer);
-                usbCon->midiTransfer = nullptr;
-            }
-            if (usbCon->_outTransfer) {
-                usb_host_transfer_free(usbCon->_outTransfer);
-                usbCon->_outTransfer = nullptr;
+        }
+        case USB_HOST_CLIENT_EVENT_DEV_GONE: {
+            USBConnection *usbCon = nullptr;
+            portENTER_CRITICAL(&_devicesMux);
+            for (int i = 0; i < MAX_DEVICES; i++) {
+                if (_devices[i] && _devices[i]->deviceHandle == eventMsg->dev_gone.dev_hdl) {
+                    usbCon = _devices[i];
+                    break;
+                }
             }
-            usb_host_device_close(usbCon->clientHandle, usbCon->deviceHandle);
-            usbCon->isReady = false;
-            usbCon->dispatchDisconnected();
+            portEXIT_CRITICAL(&_devicesMux);
+            if (!usbCon) return;
+
+            usbCon->isReady = false;     // Completions stop resubmitting
+            usbCon->_onDeviceGone();
+            usbCon->_freeInPool();
+            usbCon->_freeOutPool();
+            usbCon->_releaseDevice();
+            usbCon->_inCables = 0;
+            usbCon->_outCables = 0;
+            usbCon->_sysexActive = 0;
+            usbCon->_dispatchDisconnected();
             break;
+        }
         default:
             break;
     }
 }
 
+void USBConnection::_releaseDevice() {
+    usb_host_device_close(_client, deviceHandle);
+    _vid = _pid = _bcdDevice = 0;
+    _devAddress = 0;
+    deviceHandle = nullptr;
+}
+
 void USBConnection::_onReceive(usb_transfer_t *transfer) {
     USBConnection *usbCon = static_cast<USBConnection*>(transfer->context);
+    // Every event in one transfer arrived together: stamp them once.
+    uint64_t now = MIDIClock::nowUs();
     if (transfer->status == 0 && transfer->actual_num_bytes >= 4) {
-        // Iterate in 4-byte blocks (each block = 1 USB-MIDI event)
-        for (int offset = 0; offset + 4 <= transfer->actual_num_bytes; offset += 4) {
-            if (transfer->data_buffer[offset] == 0x00) continue;
-            usbCon->enqueueMidiMessage(transfer->data_buffer + offset, 4);
-        }
+        // Each 4-byte block is one USB-MIDI event; all of them go in at once.
+        _rxRing.pushPackets(transfer->data_buffer, transfer->actual_num_bytes,
+                            (uint32_t)now, (uint8_t)usbCon->_slot);
     }
     if (usbCon->isReady) {
         esp_err_t err = usb_host_transfer_submit(transfer);
         (void)err;
     }
+    usbCon->_countInTransfer(now, transfer);
+}
+
+// ---------- IN Transfer Pool ----------
+
+bool USBConnection::_allocInPool(uint8_t epAddress, uint16_t maxPacket, void (*callback)(usb_transfer_t*)) {
+    _freeInPool();
+    uint16_t bytes = usbmidi::core::inTransferBytes(maxPacket);
+    for (int i = 0; i < usbmidi::core::IN_POOL_SIZE; i++) {
+        usb_transfer_t* t = nullptr;
+        if (usb_host_transfer_alloc(bytes, 0, &t) != ESP_OK || t == nullptr) break;
+        t->device_handle    = deviceHandle;
+        t->bEndpointAddress = epAddress;
+        t->callback         = callback;
+        t->context          = this;
+        t->num_bytes        = bytes;
+        _inPool[_inPoolSize++] = t;
+    }
+    return _inPoolSize > 0;
+}
+
+void USBConnection::_freeInPool() {
+    for (int i = 0; i < _inPoolSize; i++) {
+        usb_host_transfer_free(_inPool[i]);
+        _inPool[i] = nullptr;
+    }
+    _inPoolSize = 0;
+}
+
+// Queues every IN transfer once; from here on only completions resubmit.
+void USBConnection::_startIn() {
+    if (!isReady) return;
+    portENTER_CRITICAL(&_inMux);
+    _inMeter = usbmidi::core::TransferMeter();
+    portEXIT_CRITICAL(&_inMux);
+    for (int i = 0; i < _inPoolSize; i++) {
+        usb_host_transfer_submit(_inPool[i]);
+    }
+}
+
+void USBConnection::_countInTransfer(uint64_t startUs, const usb_transfer_t* transfer) {
+    uint64_t endUs = MIDIClock::nowUs();
+    portENTER_CRITICAL(&_inMux);
+    usbmidi::core::countTransfer(_inMeter, startUs, endUs, transfer->actual_num_bytes,
+                                 transfer->status == USB_TRANSFER_STATUS_COMPLETED);
+    portEXIT_CRITICAL(&_inMux);
 }
 
+USBConnection::ReceiveStats USBConnection::getReceiveStats() const {
+    portENTER_CRITICAL(&_inMux);
+    ReceiveStats s = _inMeter;
+    portEXIT_CRITICAL(&_inMux);
+    return s;
+}
+
+// ---------- Configuration ----------
+
 void USBConnection::_processConfig(const usb_config_desc_t *config_desc) {
+    // A device seen before is claimed as it was then, without parsing again.
+    if (usbmidi::core::DeviceProfile* prof = _cachedProfile(config_desc)) {
+        if (_claimAlt(prof->alt)) return;
+        usbmidi::core::forgetProfile(_profiles, _vid, _pid, _bcdDevice);
+    }
+
     const uint8_t* p = config_desc->val;
     uint16_t totalLength = config_desc->wTotalLength;
     uint16_t index = 0;
@@ -270,126 +451,268 @@ void USBConnection::_processConfig(const usb_config_desc_t *config_desc) {
             if (bInterfaceClass == 0x01 && bInterfaceSubClass == 0x03) {
                 esp_err_t err = usb_host_interface_claim(clientHandle, deviceHandle, bInterfaceNumber, bAlternateSetting);
                 if (err == ESP_OK) {
+                    usbmidi::core::AltCandidate chosen = {};
+                    chosen.ifaceNumber = bInterfaceNumber;
+                    chosen.altSetting  = bAlternateSetting;
                     uint16_t idx2 = index + len;
+                    bool lastEpIn = false;
                     while (idx2 < totalLength) {
                         if (idx2 + 1 >= totalLength) break;
                         uint8_t len2 = p[idx2];
                         if (len2 < 2 || (idx2 + len2) > totalLength) break;
                         uint8_t type2 = p[idx2 + 1];
                         if (type2 == 0x04) break; // Next interface
+
+                        // Class-specific endpoint descriptor: cables of the endpoint above
+                        if (uint8_t cables = usbmidi::core::msEndpointCables(p + idx2, len2)) {
+                            if (lastEpIn) _inCables = cables;
+                            else          _outCables = cables;
+                        }
                         
                         if (type2 == 0x05 && bNumEndpoints > 0) { // It's an endpoint descriptor!
                             if (len2 >= 7) {
                                 uint8_t bEndpointAddress = p[idx2 + 2];
-                                uint8_t bmAttributes = p[idx2 + 3];
+                                lastEpIn = (bEndpointAddress & 0x80) != 0;
                                 uint16_t wMaxPacketSize = (p[idx2 + 4] | (p[idx2 + 5] << 8));
-                                uint8_t bInterval = p[idx2 + 6];
                                 if (wMaxPacketSize > 512) wMaxPacketSize = 512;
                                 if (wMaxPacketSize == 0) wMaxPacketSize = 64;
-                                uint8_t transferType = bmAttributes & 0x03;
-                                uint32_t timeout = (transferType == 0x02) ? 3000 : 0;
-                                
+
                                 if (bEndpointAddress & 0x80) { // IN Endpoint
-                                    esp_err_t e2 = usb_host_transfer_alloc(wMaxPacketSize, timeout, &midiTransfer);
-                                    if (e2 == ESP_OK && midiTransfer != nullptr) {
-                                        midiTransfer->device_handle = deviceHandle;
-                                        midiTransfer->bEndpointAddress = bEndpointAddress;
-                                        midiTransfer->callback = _onReceive;
-                                        midiTransfer->context = this;
-                                        midiTransfer->num_bytes = wMaxPacketSize;
-                                        interval = (bInterval == 0) ? 1 : bInterval;
+                                    if (_allocInPool(bEndpointAddress, wMaxPacketSize, _onReceive)) {
+                                        chosen.epInAddress   = bEndpointAddress;
+                                        chosen.epInMaxPacket = wMaxPacketSize;
                                         isReady = true;
                                         claimedOk = true;
                                     }
-                                } else { // OUT Endpoint
-                                    esp_err_t e2 = usb_host_transfer_alloc(wMaxPacketSize, timeout, &_outTransfer);
-                                    if (e2 == ESP_OK && _outTransfer != nullptr) {
-                                        _outTransfer->device_handle = deviceHandle;
-                                        _outTransfer->bEndpointAddress = bEndpointAddress;
-                                        _outTransfer->callback = _onSendComplete;
-                                        _outTransfer->context = this;
-                                        _outTransfer->num_bytes = wMaxPacketSize;
+                                } else if (_outPoolSize == 0) { // OUT Endpoint
+                                    if (_allocOutPool(bEndpointAddress, wMaxPacketSize)) {
+                                        chosen.epOutAddress   = bEndpointAddress;
+                                        chosen.epOutMaxPacket = wMaxPacketSize;
                                     }
                                 }
                             }
                         }
                         idx2 += len2;
                     }
-                    if (claimedOk) return;
+                    if (claimedOk) {
+                        chosen.inCables  = _inCables;
+                        chosen.outCables = _outCables;
+                        _cacheProfile(chosen);
+                        return;
+                    }
                     usb_host_interface_release(clientHandle, deviceHandle, bInterfaceNumber);
                 }
             }
         }
         index += len;
     }
-    if (!claimedOk) {
-        // Fallback: try a default endpoint with safe size
-        esp_err_t err = usb_host_transfer_alloc(64, 3000, &midiTransfer);
-        if (err == ESP_OK && midiTransfer != nullptr) {
-            midiTransfer->device_handle = deviceHandle;
-            midiTransfer->bEndpointAddress = 0x81;
-            midiTransfer->callback = _onReceive;
-            midiTransfer->context = this;
-            midiTransfer->num_bytes = 64;
-            interval = 1;
-            isReady = true;
-        }
-    }
+    // No MIDIStreaming interface claimed: not ours. isReady stays false, so
+    // NEW_DEV releases the slot (a HID keyboard or USB stick on the same hub
+    // must not take an instance or get reads on an unclaimed endpoint).
 }
 
-// ---------- Send ----------
+// Looks the current device up in the profile cache (and remembers the
+// descriptor hash for _cacheProfile()).
+usbmidi::core::DeviceProfile* USBConnection::_cachedProfile(const usb_config_desc_t *config_desc) {
+    _configHash = usbmidi::core::descriptorHash(config_desc->val, config_desc->wTotalLength);
+    return usbmidi::core::lookupProfile(_profiles, _vid, _pid, _bcdDevice, _configHash);
+}
 
-// USB-MIDI 1.0 CIN lookup (Table 4-1).
-// Returns CIN for a given MIDI status byte, or 0 on unknown.
-static uint8_t _midiStatusToCIN(uint8_t status) {
-    if (status >= 0x80 && status <= 0xEF) {
-        // Channel Voice / Mode messages: CIN = high nibble
-        return status >> 4;
-    }
-    switch (status) {
-        case 0xF0: return 0x04; // SysEx Start (caller must handle continuation/end)
-        case 0xF1: return 0x02; // MTC Quarter Frame (2 bytes)
-        case 0xF2: return 0x03; // Song Position Pointer (3 bytes)
-        case 0xF3: return 0x02; // Song Select (2 bytes)
-        case 0xF6: return 0x05; // Tune Request (1 byte)
-        case 0xF7: return 0x05; // SysEx End (single-byte, edge case)
-        case 0xF8: return 0x0F; // Timing Clock
-        case 0xFA: return 0x0F; // Start
-        case 0xFB: return 0x0F; // Continue
-        case 0xFC: return 0x0F; // Stop
-        case 0xFE: return 0x0F; // Active Sensing
-        case 0xFF: return 0x0F; // System Reset
-        default:   return 0;    // Undefined (0xF4, 0xF5, 0xFD)
+void USBConnection::_cacheProfile(const usbmidi::core::AltCandidate& alt) {
+    usbmidi::core::DeviceProfile prof = {};
+    prof.vid        = _vid;
+    prof.pid        = _pid;
+    prof.bcdDevice  = _bcdDevice;
+    prof.configHash = _configHash;
+    prof.alt        = alt;
+    usbmidi::core::storeProfile(_profiles, prof);
+}
+
+// Claims a MIDI 1.0 interface from a cached profile.
+bool USBConnection::_claimAlt(const usbmidi::core::AltCandidate& alt) {
+    if (usb_host_interface_claim(clientHandle, deviceHandle, alt.ifaceNumber, alt.altSetting) != ESP_OK)
+        return false;
+    if (!_allocInPool(alt.epInAddress, alt.epInMaxPacket, _onReceive)) {
+        usb_host_interface_release(clientHandle, deviceHandle, alt.ifaceNumber);
+        return false;
     }
+    if (alt.epOutAddress != 0) _allocOutPool(alt.epOutAddress, alt.epOutMaxPacket);
+    _inCables  = alt.inCables;
+    _outCables = alt.outCables;
+    isReady = true;
+    return true;
 }
 
+// ---------- Send ----------
+
 bool USBConnection::sendMidiMessage(const uint8_t* data, size_t length) {
-    if (!isReady || !_outTransfer || length == 0) return false;
-    if (_outTransferBusy) return false;
+    return sendMidiMessage(0, data, length);
+}
+
+bool USBConnection::sendMidiMessage(uint8_t cable, const uint8_t* data, size_t length) {
+    if (!isReady || _outPoolSize == 0 || length == 0 || cable > 15) return false;
+    if (data[0] == 0xF0) return _queueSysEx(cable, data, length);
 
-    uint8_t cin = _midiStatusToCIN(data[0]);
-    if (cin == 0) return false;
+    uint8_t event[1][4];
+    if (!usbmidi::core::buildEventPacket(data, length, cable, event[0])) return false;
+    return _queueEvents(event, 1);
+}
+
+bool USBConnection::_queueEvents(const uint8_t (*events)[4], size_t n) {
+    portENTER_CRITICAL(&_outMux);
+    bool ok = usbmidi::core::pushEvents(_outQueue, events, n);
+    portEXIT_CRITICAL(&_outMux);
+    if (ok) _pumpOut();
+    return ok;
+}
 
-    // Cable number 0 | CIN
-    uint8_t packet[4] = { cin, 0, 0, 0 };
-    for (size_t i = 0; i < length && i < 3; i++) {
-        packet[i + 1] = data[i];
+// Segments a SysEx into CIN 0x4-0x7 events. A message that fits the queue is
+// queued whole once there is room; a longer one (patch dump, firmware) is fed
+// in as transfers complete, with its cable closed to other messages until the
+// last event is queued. Either way the caller blocks until then. Gives up if
+// the bus makes no progress for SYSEX_STALL_MS.
+bool USBConnection::_queueSysEx(uint8_t cable, const uint8_t* data, size_t length) {
+    if (!usbmidi::core::isCompleteSysEx(data, length)) return false;
+
+    usbmidi::core::SysExSegmenter seg;
+    usbmidi::core::beginSysEx(seg, data, length, cable);
+    unsigned long lastProgress = millis();
+    for (;;) {
+        portENTER_CRITICAL(&_outMux);
+        size_t pushed = usbmidi::core::pushSysEx(_outQueue, seg);
+        portEXIT_CRITICAL(&_outMux);
+
+        if (pushed > 0) {
+            _pumpOut();
+            lastProgress = millis();
+        }
+        if (usbmidi::core::sysExDone(seg)) return true;
+        if (!isReady || millis() - lastProgress > SYSEX_STALL_MS) {
+            portENTER_CRITICAL(&_outMux);
+            usbmidi::core::abortSysEx(_outQueue, seg);
+            _outQueue.dropped += (uint32_t)usbmidi::core::sysExEventCount(seg.length - seg.offset);
+            portEXIT_CRITICAL(&_outMux);
+            return false;
+        }
+        vTaskDelay(1);
     }
+}
 
-    memcpy(_outTransfer->data_buffer, packet, 4);
-    _outTransfer->num_bytes = 4;
+// Fills idle transfers from the queue and submits them. Runs from
+// sendMidiMessage() (any task) and from _onSendComplete() (USB task). Only one
+// caller pumps at a time, so transfers are submitted in queue order; a caller
+// that finds another pumping leaves its events to it. The pumper gives up its
+// role under the same lock that pushEvents() takes, so no event is stranded.
+void USBConnection::_pumpOut() {
+    portENTER_CRITICAL(&_outMux);
+    if (_outPumping) {
+        portEXIT_CRITICAL(&_outMux);
+        return;
+    }
+    _outPumping = true;
 
-    _outTransferBusy = true;
-    esp_err_t err = usb_host_transfer_submit(_outTransfer);
-    if (err != ESP_OK) {
-        _outTransferBusy = false;
+    for (;;) {
+        if (!isReady || _outFree == 0 || !_outPending()) break;
+        int i = __builtin_ctz(_outFree);
+        usb_transfer_t* t = _outPool[i];
+        size_t bytes = _fillOut(t->data_buffer, t->data_buffer_size, _outEvents[i]);
+        if (bytes == 0) break;
+        _outFree &= (uint8_t)~(1u << i);
+        portEXIT_CRITICAL(&_outMux);
+
+        t->num_bytes = bytes;
+        esp_err_t err = usb_host_transfer_submit(t);
+
+        portENTER_CRITICAL(&_outMux);
+        if (err != ESP_OK) {
+            _outDone(_outEvents[i], false);
+            _outEvents[i] = 0;
+            _outFree |= (uint8_t)(1u << i);
+            break;
+        }
     }
-    return err == ESP_OK;
+
+    _outPumping = false;
+    portEXIT_CRITICAL(&_outMux);
 }
 
 void USBConnection::_onSendComplete(usb_transfer_t *transfer) {
     USBConnection *usbCon = static_cast<USBConnection*>(transfer->context);
-    if (usbCon) {
-        usbCon->_outTransferBusy = false;
+    if (!usbCon) return;
+
+    portENTER_CRITICAL(&usbCon->_outMux);
+    for (int i = 0; i < usbCon->_outPoolSize; i++) {
+        if (usbCon->_outPool[i] != transfer) continue;
+        usbCon->_outDone(usbCon->_outEvents[i], transfer->status == USB_TRANSFER_STATUS_COMPLETED);
+        usbCon->_outEvents[i] = 0;
+        usbCon->_outFree |= (uint8_t)(1u << i);
+        usbCon->_outTransfers++;
+        break;
     }
+    portEXIT_CRITICAL(&usbCon->_outMux);
+
+    // Completion-driven: whatever queued meanwhile leaves in this transfer.
+    usbCon->_pumpOut();
+}
+
+size_t USBConnection::_fillOut(uint8_t* buf, size_t maxBytes, uint16_t& units) {
+    size_t bytes = usbmidi::core::fillTransfer(_outQueue, buf, maxBytes);
+    units = (uint16_t)(bytes / 4);
+    return bytes;
+}
+
+void USBConnection::_outDone(uint16_t units, bool ok) {
+    if (ok) _outQueue.sent += units;
+    else    _outQueue.dropped += units;
+}
+
+bool USBConnection::_allocOutPool(uint8_t epAddress, uint16_t maxPacket) {
+    _freeOutPool();
+    uint8_t n = 0;
+    for (int i = 0; i < OUT_POOL_SIZE; i++) {
+        usb_transfer_t* t = nullptr;
+        if (usb_host_transfer_alloc(maxPacket, 0, &t) != ESP_OK || t == nullptr) break;
+        t->device_handle    = deviceHandle;
+        t->bEndpointAddress = epAddress;
+        t->callback         = _onSendComplete;
+        t->context          = this;
+        t->num_bytes        = 0;
+        t->timeout_ms       = 3000;
+        _outPool[n++] = t;
+    }
+    portENTER_CRITICAL(&_outMux);
+    _outPoolSize = n;
+    _outFree = (uint8_t)((1u << n) - 1);
+    portEXIT_CRITICAL(&_outMux);
+    return n > 0;
+}
+
+void USBConnection::_freeOutPool() {
+    portENTER_CRITICAL(&_outMux);
+    uint8_t n = _outPoolSize;
+    _outPoolSize = 0;
+    _outFree = 0;
+    // Events still queued have nowhere to go.
+    _outQueue.dropped += (uint32_t)_outQueue.count;
+    _outQueue.head = 0;
+    _outQueue.count = 0;
+    portEXIT_CRITICAL(&_outMux);
+
+    for (int i = 0; i < n; i++) {
+        usb_host_transfer_free(_outPool[i]);
+        _outPool[i] = nullptr;
+        _outEvents[i] = 0;
+    }
+}
+
+USBConnection::SendStats USBConnection::getSendStats() const {
+    portENTER_CRITICAL(&_outMux);
+    SendStats s;
+    s.queued    = _outQueue.queued;
+    s.sent      = _outQueue.sent;
+    s.dropped   = _outQueue.dropped;
+    s.transfers = _outTransfers;
+    s.pending   = (uint16_t)_outQueue.count;
+    portEXIT_CRITICAL(&_outMux);
+    return s;
 }
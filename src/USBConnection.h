@@ -8,56 +8,190 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "MIDITransport.h"
+#include "USBMIDITransportCore.h"
 
-// Structure to store a raw USB packet.
-// Although transfers can be up to 64 bytes, only the first 4 are relevant per USB-MIDI event.
+// Depth of the receive ring, in USB-MIDI events (power of two, 9 bytes each).
+// One ring is shared by every USBConnection instance.
+#ifndef ESP32_HOST_MIDI_USB_RX_EVENTS
+#define ESP32_HOST_MIDI_USB_RX_EVENTS 256
+#endif
+
+class USBMIDICable;
+
+// One queued USB-MIDI event packet, as returned by getQueueMessage().
 struct RawUsbMessage {
-    uint8_t data[64];
+    uint8_t data[4];        // Cable | CIN, then up to 3 MIDI bytes
     size_t length;
+    uint64_t timestampUs;   // MIDIClock::nowUs() when the transfer completed
 };
 
+// Several devices behind a USB hub: declare one USBConnection per device.
+// All instances share the USB Host client, its two tasks and the receive
+// ring; each newly enumerated device is given to a free instance (one whose
+// matchDevice() filter fits first, then any unfiltered one). Call begin() on
+// every instance in setup(), and task() of all of them from the same task.
+//
+//   USBConnection keys, pads;
+//   pads.matchDevice(0x09E8);            // This vendor's devices go to pads
+//   keys.begin();
+//   pads.begin();
+//
+// Hub support itself depends on the core: ESP-IDF 5.3+ with external hub
+// support enabled (CONFIG_USB_HOST_HUBS_SUPPORTED).
+
 class USBConnection : public MIDITransport {
 public:
     USBConnection();
+    virtual ~USBConnection();
 
-    // Initializes the USB Host, registers the client, and starts the USB task on core 0.
+    // Claims a device slot and, on the first call, initializes the USB Host,
+    // registers the client, and starts the USB tasks on core 0. Fails when
+    // MAX_DEVICES instances are already running.
     bool begin();
 
-    // Drains the ring buffer and dispatches MIDI data via MIDITransport callbacks. Call from loop().
+    // Restricts this instance to devices with this vendor ID (and product ID,
+    // unless 0). Call before begin(); matchDevice(0) accepts any device again.
+    void matchDevice(uint16_t vendorId, uint16_t productId = 0);
+
+    static const int MAX_DEVICES = usbmidi::core::MAX_DEVICES;
+
+    // Drains the shared receive ring and dispatches each event through the
+    // instance that owns its device. Call from loop().
     void task() override;
 
     // Returns whether the USB connection is ready.
     bool isConnected() const override { return isReady; }
 
-    // Sends a MIDI message to the connected USB device.
+    // Queues a MIDI message for the connected USB device. Short messages
+    // never wait for the bus: queued events go out in the next free OUT
+    // transfer, several per transfer. A complete SysEx (F0 ... F7) of any
+    // length is segmented into USB-MIDI SysEx events and blocks until its
+    // last event is queued: one that fits the queue waits for room and goes
+    // in whole; a longer one streams in as transfers complete, and short
+    // messages sent meanwhile on its cable are refused (real-time excepted).
+    // Returns false if not connected, the message is invalid, the queue is
+    // full, or its cable is busy with a streaming SysEx.
     bool sendMidiMessage(const uint8_t* data, size_t length) override;
 
+    // Same, addressed to one virtual cable (0-15) of a multi-port interface.
+    // sendMidiMessage(data, length) sends on cable 0.
+    bool sendMidiMessage(uint8_t cable, const uint8_t* data, size_t length);
+
+    // Virtual cables the device declares (embedded MIDI jacks) on its IN and
+    // OUT endpoints; 0 if not connected or not declared.
+    uint8_t getInCableCount() const { return _inCables; }
+    uint8_t getOutCableCount() const { return _outCables; }
+
+    // Per-cable transport views (see USBMIDICable.h). A cable with a view
+    // attached is delivered through the view instead of this transport.
+    // Called by the USBMIDICable constructor / destructor.
+    bool attachCable(USBMIDICable* view);
+    void detachCable(USBMIDICable* view);
+
+    // Outbound traffic, counted in USB-MIDI event packets (one per short message).
+    struct SendStats {
+        uint32_t queued;      // Accepted by sendMidiMessage()
+        uint32_t sent;        // Delivered by a completed OUT transfer
+        uint32_t dropped;     // Queue full, submit failed or transfer error
+        uint32_t transfers;   // OUT transfers completed
+        uint16_t pending;     // Still waiting in the queue
+    };
+    SendStats getSendStats() const;
+
+    // Receive pipeline load: IN transfers/s, bytes/s and the share of core 0
+    // spent handling them (see "Transfer statistics" in USBMIDITransportCore.h).
+    typedef usbmidi::core::TransferMeter ReceiveStats;
+    ReceiveStats getReceiveStats() const;
+
+    // Device currently held by this instance (0 when none).
+    uint16_t getVendorId() const { return _vid; }
+    uint16_t getProductId() const { return _pid; }
+    uint8_t getDeviceAddress() const { return _devAddress; }
+
     // Returns the last error message (empty if none).
     const String& getLastError() const { return lastError; }
 
-    // Queue access methods (for debugging or external analysis)
+    // Queue access methods (for debugging or external analysis). The ring is
+    // shared, so these cover the events of every device.
     int getQueueSize() const;
-    const RawUsbMessage& getQueueMessage(int index) const;
+    RawUsbMessage getQueueMessage(int index) const;
+    uint32_t getQueueDropped() const { return _rxRing.dropped(); }
 
 protected:
     bool isReady;
-    uint8_t interval;         // Polling interval (ms)
-    unsigned long lastCheck;
-
-    usb_host_client_handle_t clientHandle;
-    usb_device_handle_t deviceHandle;
-    uint32_t eventFlags;
-    usb_transfer_t* midiTransfer;     // IN transfer (receive)
-    usb_transfer_t* _outTransfer;     // OUT transfer (send)
-    volatile bool _outTransferBusy;   // True while an OUT transfer is pending
-
-    // Ring buffer for raw USB packets.
-    // Protected by spinlock for thread-safe access on dual-core ESP32.
-    static const int QUEUE_SIZE = 64;
-    RawUsbMessage usbQueue[QUEUE_SIZE];
-    volatile int queueHead;
-    volatile int queueTail;
-    portMUX_TYPE queueMux;
+
+    usb_host_client_handle_t clientHandle;   // The shared client, set by begin()
+    usb_device_handle_t deviceHandle;        // nullptr while no device is held
+
+    // Device slot of this instance (-1 before begin()) and what it holds.
+    int8_t _slot;
+    uint16_t _matchVid;
+    uint16_t _matchPid;
+    uint16_t _vid;
+    uint16_t _pid;
+    uint16_t _bcdDevice;
+    uint8_t _devAddress;
+
+    // IN transfer pool (receive). All transfers stay queued on the IN
+    // endpoint; each completion callback parses its buffer and resubmits it,
+    // nothing else submits them after _startIn().
+    usb_transfer_t* _inPool[usbmidi::core::IN_POOL_SIZE];
+    uint8_t _inPoolSize;
+    usbmidi::core::TransferMeter _inMeter;
+    mutable portMUX_TYPE _inMux;
+
+    bool _allocInPool(uint8_t epAddress, uint16_t maxPacket, void (*callback)(usb_transfer_t*));
+    void _freeInPool();
+    void _startIn();
+    void _countInTransfer(uint64_t startUs, const usb_transfer_t* transfer);
+
+    // OUT transfer pool (send). An idle transfer is filled with as many
+    // queued events as wMaxPacketSize allows and submitted; its completion
+    // returns it to the pool and refills it while events remain. Pool,
+    // queue and counters are guarded by _outMux.
+    static const int OUT_POOL_SIZE = 4;
+    static const size_t OUT_QUEUE_EVENTS = 256;
+    usb_transfer_t* _outPool[OUT_POOL_SIZE];
+    uint16_t _outEvents[OUT_POOL_SIZE];   // Queued units carried by each in-flight transfer
+    uint8_t _outPoolSize;
+    uint8_t _outFree;                 // Bit i set: _outPool[i] is idle
+    bool _outPumping;                 // One caller at a time fills transfers
+    uint32_t _outTransfers;
+    usbmidi::core::EventQueue<OUT_QUEUE_EVENTS> _outQueue;
+    mutable portMUX_TYPE _outMux;
+
+    bool _allocOutPool(uint8_t epAddress, uint16_t maxPacket);
+    void _freeOutPool();
+    bool _queueEvents(const uint8_t (*events)[4], size_t n);
+    static const unsigned long SYSEX_STALL_MS = 500;
+    bool _queueSysEx(uint8_t cable, const uint8_t* data, size_t length);
+    void _pumpOut();
+    // What the pool carries, called under _outMux: USB-MIDI 1.0 events from
+    // _outQueue here; USBMIDI2Connection feeds UMP instead on MIDI 2.0
+    // devices. units is what one transfer holds, for the send counters.
+    virtual bool _outPending() const { return _outQueue.count > 0; }
+    virtual size_t _fillOut(uint8_t* buf, size_t maxBytes, uint16_t& units);
+    virtual void _outDone(uint16_t units, bool ok);
+
+    // Instances by slot, shared by the USB task (device events) and task().
+    static USBConnection* _devices[MAX_DEVICES];
+    static portMUX_TYPE _devicesMux;
+    static USBConnection* _claimSlot(uint16_t vid, uint16_t pid);
+    void _releaseDevice();          // Closes deviceHandle and clears the device info
+
+    // Claim results of recent devices, shared by every instance and only
+    // touched on the USB task (see "Device profile cache" in
+    // USBMIDITransportCore.h). _configHash is the current device's.
+    static usbmidi::core::ProfileCache<usbmidi::core::PROFILE_CACHE_SLOTS> _profiles;
+    uint32_t _configHash;
+    usbmidi::core::DeviceProfile* _cachedProfile(const usb_config_desc_t* config_desc);
+    void _cacheProfile(const usbmidi::core::AltCandidate& alt);
+    bool _claimAlt(const usbmidi::core::AltCandidate& alt);
+
+    // Received event packets of every device, from the USB task (_onReceive)
+    // to task(), tagged with the slot. Lock-free single-producer /
+    // single-consumer ring.
+    static usbmidi::core::EventRing<ESP32_HOST_MIDI_USB_RX_EVENTS> _rxRing;
 
     // Connection control data
     bool firstMidiReceived;
@@ -65,18 +199,31 @@ protected:
     String deviceName;
     String lastError;
 
-    // Helper functions to manage the queue.
-    bool enqueueMidiMessage(const uint8_t* data, size_t length);
-    bool dequeueMidiMessage(RawUsbMessage &msg);
+    // Dispatches everything in _rxRing (task()).
     void processQueue();
-
-    // SysEx reassembly state
-    bool _sysexActive = false;
-    std::vector<uint8_t> _sysexBuf;
-
-    // Dedicated FreeRTOS task for USB event handling (core 0)
-    TaskHandle_t usbTaskHandle;
+    void processEvent(const uint8_t packet[4], uint64_t timestampUs);
+
+    // Received events carry their cable in byte 0 (high nibble), so every
+    // consumer can tell the ports of a multi-port interface apart.
+    USBMIDICable* _cables[16];
+    uint8_t _inCables;
+    uint8_t _outCables;
+    virtual void _dispatchConnected();      // Also tells attached views
+    virtual void _dispatchDisconnected();
+
+    // SysEx reassembly state, per cable (cables may interleave SysEx)
+    uint16_t _sysexActive = 0;        // Bit n: cable n is inside a SysEx
+    std::vector<uint8_t> _sysexBuf[16];
+
+    // Dedicated FreeRTOS tasks on core 0, both blocking until there is work:
+    // the USB Host library daemon, and the client task that runs every
+    // device event and transfer callback. Started by the first begin().
+    static usb_host_client_handle_t _client;
+    static TaskHandle_t _usbTaskHandle;
+    static TaskHandle_t _usbLibTaskHandle;
+    static uint32_t _eventFlags;
     static void _usbTask(void* arg);
+    static void _usbLibTask(void* arg);
 
     // Internal USB Host callbacks.
     static void _clientEventCallback(const usb_host_client_event_msg_t *eventMsg, void *arg);
@@ -0,0 +1,71 @@
+#ifndef USB_MIDI2_BLOCK_H
+#define USB_MIDI2_BLOCK_H
+
+#include "MIDITransport.h"
+#include "USBMIDI2Connection.h"
+
+// One Function Block of a USB MIDI 2.0 device, as a transport of its own. A
+// device that exposes, say, a keyboard block on group 0 and a pad block on
+// groups 1-2 reports that topology in Function Block Info (and its Group
+// Terminal Blocks); a view per block receives the UMP of that block's
+// groups only:
+//
+//   USBMIDI2Connection usb;
+//   USBMIDI2Block keys(usb, 0), pads(usb, 1);
+//   keys.setUMPCallback(onKeys, nullptr);
+//   pads.setUMPBatchCallback(onPads, nullptr);
+//   usb.setGroupFilter(0);          // Drop every group no view owns
+//
+// Groups follow the block as discovery reports it, so a view can be created
+// before the device is plugged in. Groups of no view go to the connection's
+// own callbacks (within its setGroupFilter() mask) or are dropped on the USB
+// task. The view's task() runs the parent's, so registering just the views
+// is enough.
+
+class USBMIDI2Block : public MIDITransport {
+public:
+    USBMIDI2Block(USBMIDI2Connection& usb, uint8_t block)
+        : _usb(usb), _block(block) {
+        _usb.attachBlock(this);
+    }
+    ~USBMIDI2Block() override { _usb.detachBlock(this); }
+
+    void task() override { _usb.task(); }
+
+    // Connected and the block is known (discovered or cached).
+    bool isConnected() const override {
+        uint8_t first, count;
+        return _usb.isConnected() && _usb.getBlockGroups(_block, first, count);
+    }
+
+    // Sends a MIDI 1.0 short message as a one-word UMP on the block's first
+    // group. SysEx is not supported here; use sendUMPMessage().
+    bool sendMidiMessage(const uint8_t* data, size_t length) override {
+        uint8_t first, count;
+        uint32_t word;
+        if (!_usb.getBlockGroups(_block, first, count)) return false;
+        if (!usbmidi::core::buildMIDI1UMP(data, length, first, word)) return false;
+        return _usb.sendUMPMessage(&word, 1);
+    }
+
+    bool sendUMPMessage(const uint32_t* words, uint8_t count) {
+        return _usb.sendUMPMessage(words, count);
+    }
+
+    uint8_t block() const { return _block; }
+    USBMIDI2Connection& connection() const { return _usb; }
+
+private:
+    friend class USBMIDI2Connection;   // Delivers this block's UMP and link state
+
+    USBMIDI2Connection& _usb;
+    uint8_t _block;
+
+    void deliverUMP(const uint32_t* words, size_t count, uint64_t timestampUs) {
+        dispatchUMPBatch(words, count, timestampUs);
+    }
+    void deliverConnected() { dispatchConnected(); }
+    void deliverDisconnected() { dispatchDisconnected(); }
+};
+
+#endif // USB_MIDI2_BLOCK_H
@@ -1,4 +1,5 @@
 #include "USBMIDI2Connection.h"
+#include "USBMIDI2Block.h"
 #include <string.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
@@ -20,8 +21,10 @@ static const uint8_t UMP_VER_MINOR = 1;
 
 USBMIDI2Connection::USBMIDI2Connection()
   : USBConnection(),
-    _midi2Active(false)
+    _midi2Active(false),
+    _routeMux(portMUX_INITIALIZER_UNLOCKED)
 {
+    _rebuildRoutes();
 }
 
 // ── _processConfig — override with Alt 1 detection ──────────────────────────
@@ -30,33 +33,70 @@ void USBMIDI2Connection::_processConfig(const usb_config_desc_t* config_desc) {
     AltCandidate best;
     memset(&best, 0, sizeof(best));
 
-    if (!usbmidi::core::findBestAlt(config_desc->val, config_desc->wTotalLength, best)) {
+    // A replugged device is claimed with the alt it had last time; its
+    // discovery results are published at once and revalidated below.
+    DeviceProfile* prof = _cachedProfile(config_desc);
+    if (prof) {
+        best = prof->alt;
+    } else if (!usbmidi::core::findBestAlt(config_desc->val, config_desc->wTotalLength, best)) {
         USBConnection::_processConfig(config_desc);
         return;
     }
 
     if (!_claimAndSetup(best)) {
+        if (prof) forgetProfile(_profiles, _vid, _pid, _bcdDevice);
         return;
     }
 
     _midi2Active = best.isMIDI2;
+    if (prof && prof->discovered) _restoreProfile(*prof);
+    else if (!prof) _cacheProfile(best);
 
     if (_midi2Active) {
         _readGTBDescriptors();
-        if (_outTransfer) {
+        if (_outPoolSize > 0) {
             _startNegotiation();
         }
     }
 }
 
-// ── _onDeviceGone — free OUT transfer on disconnect ──────────────────────────
+// ── Descriptor cache ─────────────────────────────────────────────────────────
+//
+// Runs on the USB task only (device events and transfer callbacks), like
+// every other user of the shared cache.
+
+void USBMIDI2Connection::_restoreProfile(const DeviceProfile& prof) {
+    _epInfo = prof.endpoint;
+    memcpy(_fbInfo, prof.fb, sizeof(_fbInfo));
+    _fbCount = prof.fbCount;
+    memcpy(_gtb, prof.gtb, sizeof(_gtb));
+    _gtbCount = prof.gtbCount;
+    _fromProfile = true;
+    _rebuildRoutes();
+}
+
+void USBMIDI2Connection::_saveProfile() {
+    int slot = findProfileSlot(_profiles, _vid, _pid, _bcdDevice);
+    if (slot < 0) return;     // Claimed from the descriptor fallback: not cached
+    DeviceProfile& prof = _profiles.entries[slot];
+    prof.discovered = true;
+    prof.endpoint = _epInfo;
+    memcpy(prof.fb, _fbInfo, sizeof(prof.fb));
+    prof.fbCount = _fbCount;
+    memcpy(prof.gtb, _gtb, sizeof(prof.gtb));
+    prof.gtbCount = _gtbCount;
+}
+
+// ── _onDeviceGone — reset MIDI 2.0 state on disconnect ───────────────────────
+// (the base frees the OUT transfer pool afterwards; UMP still queued is
+// counted as dropped)
 
 void USBMIDI2Connection::_onDeviceGone() {
-    if (_outTransfer) {
-        usb_host_transfer_free(_outTransfer);
-        _outTransfer = nullptr;
-    }
+    portENTER_CRITICAL(&_outMux);
+    clearUMP(_umpQueue);
     _midi2Active = false;
+    portEXIT_CRITICAL(&_outMux);
+    _fromProfile = false;
     _neg = NegEngine{};
     _umpCarry = UMPCarry{};
     memset(&_epInfo, 0, sizeof(_epInfo));
@@ -64,6 +104,7 @@ void USBMIDI2Connection::_onDeviceGone() {
     _gtbCount = 0;
     _epName[0] = '\0'; _epNameLen = 0;
     _prodId[0] = '\0'; _prodIdLen = 0;
+    _rebuildRoutes();
 }
 
 // ── _claimAndSetup ──────────────────────────────────────────────────────────
@@ -97,7 +138,13 @@ bool USBMIDI2Connection::_claimAndSetup(const AltCandidate& cand) {
     // wait always timed out and the transfer was freed while still queued, and
     // the later completion callback dereferenced freed memory.) A short settle
     // delay lets the device-side class driver repoint its TX path before reads.
-    {
+    //
+    // Alt 0 needs neither: SET_CONFIGURATION leaves every interface on alt 0,
+    // so a MIDI 1.0 claim (fresh or from the profile cache) switches nothing.
+    // For Alt 1 both stay, cached or not: the devices that need the resend
+    // claim the switch succeeded either way, so nothing in the profile can
+    // tell them apart.
+    if (cand.altSetting != 0) {
         usb_transfer_t* setifT = nullptr;
         if (usb_host_transfer_alloc(8, 0, &setifT) == ESP_OK && setifT != nullptr) {
             setifT->device_handle    = deviceHandle;
@@ -129,41 +176,30 @@ bool USBMIDI2Connection::_claimAndSetup(const AltCandidate& cand) {
         vTaskDelay(pdMS_TO_TICKS(50));
     }
 
-    // Allocate IN transfer (receive)
-    err = usb_host_transfer_alloc(cand.epInMaxPacket, 3000, &midiTransfer);
-    if (err != ESP_OK || midiTransfer == nullptr) {
+    // Allocate the IN transfer pool (receive); the base primes it once the
+    // configuration is processed.
+    if (!_allocInPool(cand.epInAddress, cand.epInMaxPacket,
+                      cand.isMIDI2 ? _onReceiveUMP : _onReceive)) {
         usb_host_interface_release(clientHandle, deviceHandle, cand.ifaceNumber);
         lastError = "MIDI2: IN transfer alloc failed";
         return false;
     }
 
-    midiTransfer->device_handle    = deviceHandle;
-    midiTransfer->bEndpointAddress = cand.epInAddress;
-    midiTransfer->num_bytes        = cand.epInMaxPacket;
-    midiTransfer->context          = this;
-    midiTransfer->callback         = cand.isMIDI2 ? _onReceiveUMP : _onReceive;
-
-    // Allocate OUT transfer (send) if OUT endpoint exists
+    // Allocate the OUT transfer pool (send) if OUT endpoint exists. Its
+    // completion handler is the base one, so the MIDI 1.0 send path
+    // (USBConnection::sendMidiMessage) works through this class.
     if (cand.epOutAddress != 0) {
-        err = usb_host_transfer_alloc(cand.epOutMaxPacket, 3000, &_outTransfer);
-        if (err != ESP_OK || _outTransfer == nullptr) {
-            usb_host_transfer_free(midiTransfer);
-            midiTransfer = nullptr;
+        if (!_allocOutPool(cand.epOutAddress, cand.epOutMaxPacket)) {
+            _freeInPool();
             usb_host_interface_release(clientHandle, deviceHandle, cand.ifaceNumber);
             lastError = "MIDI2: OUT transfer alloc failed";
             return false;
         }
-        _outTransfer->device_handle    = deviceHandle;
-        _outTransfer->bEndpointAddress = cand.epOutAddress;
-        _outTransfer->num_bytes        = 0;
-        _outTransfer->context          = this;
-        // Base completion handler clears _outTransferBusy, so the MIDI 1.0
-        // send path (USBConnection::sendMidiMessage) works through this class.
-        _outTransfer->callback         = USBConnection::_onSendComplete;
     }
 
     _claimedIfaceNumber = cand.ifaceNumber;
-    interval = cand.epInInterval;
+    _inCables  = cand.isMIDI2 ? 0 : cand.inCables;
+    _outCables = cand.isMIDI2 ? 0 : cand.outCables;
     isReady  = true;
     return true;
 }
@@ -217,8 +253,9 @@ void USBMIDI2Connection::_processStreamMessage(const uint32_t* words) {
     case STREAM_ENDPOINT_INFO:
         // Endpoint Info opens a discovery burst: reset the accumulators that
         // collect the responses, so a re-announce or retryNegotiation() does not
-        // append to (or overflow) the previous run's Function Block list / names.
-        _fbCount    = 0;
+        // append to the previous run's names. Function Blocks are updated by
+        // index; blocks restored from the cache stay listed while revalidating.
+        if (!_fromProfile) _fbCount = 0;
         _epNameLen  = 0;
         _prodIdLen  = 0;
         _epName[0]  = '\0';
@@ -250,18 +287,7 @@ void USBMIDI2Connection::_processStreamMessage(const uint32_t* words) {
     }
 
     case STREAM_FB_INFO:
-        if (_fbCount < MAX_FUNCTION_BLOCKS) {
-            FunctionBlockInfo& fb = _fbInfo[_fbCount];
-            fb.index            = (words[0] >> 8) & 0x7F;
-            fb.active           = (words[0] >> 15) & 0x01;
-            fb.direction        = words[0] & 0x03;
-            fb.firstGroup       = (words[1] >> 24) & 0xFF;
-            fb.groupLength      = (words[1] >> 16) & 0xFF;
-            fb.midiCISupport    = (words[1] >> 8) & 0xFF;
-            fb.isMIDI1          = (words[0] >> 2) & 0x03;
-            fb.maxSysEx8Streams = words[1] & 0xFF;
-            _fbCount++;
-        }
+        upsertFunctionBlock(_fbInfo, _fbCount, MAX_FUNCTION_BLOCKS, parseFunctionBlockInfo(words));
         break;
 
     default:
@@ -273,8 +299,14 @@ void USBMIDI2Connection::_processStreamMessage(const uint32_t* words) {
     case NegAction::SendFBDiscovery:
         _sendFunctionBlockDiscovery();
         break;
-    case NegAction::None:
     case NegAction::Complete:
+        // Fresh discovery confirms (or corrects) what the cache restored.
+        pruneFunctionBlocks(_fbInfo, _fbCount, _epInfo.numFunctionBlocks);
+        _fromProfile = false;
+        _saveProfile();
+        _rebuildRoutes();
+        break;
+    case NegAction::None:
         break;
     }
 }
@@ -285,35 +317,24 @@ void USBMIDI2Connection::_processStreamMessage(const uint32_t* words) {
 // No CIN header — each 4-byte block is one uint32_t UMP word.
 // ESP32 is little-endian, and USB transfers are also little-endian,
 // so we can read the words directly with no byte-swap.
+//
+// Packets are used where they lie in the transfer buffer (umpSplit); only
+// one split across the previous transfer is stitched together. Whole
+// packets go into _umpRing in one copy per run, stamped with the transfer's
+// arrival time, for task() to dispatch.
 
 void USBMIDI2Connection::_onReceiveUMP(usb_transfer_t* transfer) {
     USBMIDI2Connection* self = static_cast<USBMIDI2Connection*>(transfer->context);
+    uint64_t startUs = MIDIClock::nowUs();
 
     if (transfer->status == 0 && transfer->actual_num_bytes >= 4) {
         const uint32_t* words = reinterpret_cast<const uint32_t*>(transfer->data_buffer);
         uint16_t inCount = transfer->actual_num_bytes / 4;
 
-        // Reassemble UMP packets that may be split across bulk transfers.
-        uint16_t count = usbmidi::core::umpReassemble(
-            words, inCount, self->_umpCarry, self->_umpOut, usbmidi::core::UMP_OUT_WORDS);
-        const uint32_t* out = self->_umpOut;
-
-        // Process whole UMP packets — intercept Stream Messages (MT 0x0F) for
-        // negotiation, dispatch everything else to the user callback.
-        uint16_t i = 0;
-        while (i < count) {
-            uint8_t mt = (out[i] >> 28) & 0x0F;
-            uint8_t pktWords = usbmidi::core::umpWordCount(mt);
-            if (i + pktWords > count) break;  // safety: only whole packets are emitted
-
-            if (usbmidi::core::isInternalStreamMessage(&out[i])) {
-                // Internal negotiation message — consume, do not forward to the app.
-                self->_processStreamMessage(&out[i]);
-            } else {
-                self->dispatchUMPData(&out[i], pktWords);
-            }
-            i += pktWords;
-        }
+        UMPSplit split;
+        umpSplit(words, inCount, self->_umpCarry, split);
+        if (split.joinedWords) self->_queueUMP(split.joined, split.joinedWords, (uint32_t)startUs);
+        self->_queueUMP(split.body, split.bodyWords, (uint32_t)startUs);
     } else if (transfer->status != 0) {
         // Error: drop any partial so it is not stitched across the error boundary.
         self->_umpCarry = usbmidi::core::UMPCarry{};
@@ -322,27 +343,162 @@ void USBMIDI2Connection::_onReceiveUMP(usb_transfer_t* transfer) {
     if (self->isReady) {
         usb_host_transfer_submit(transfer);
     }
+    self->_countInTransfer(startUs, transfer);
+}
+
+// Queues runs of whole packets; Stream Messages (MT 0x0F) for negotiation are
+// consumed here, on the USB task, and never reach the app.
+// Groups nobody listens to are dropped here, before they take ring space.
+void USBMIDI2Connection::_queueUMP(const uint32_t* words, uint16_t count, uint32_t stampUs) {
+    GroupRoutes routes = _currentRoutes();
+    auto push = [this, &routes, stampUs](const uint32_t* w, size_t n) {
+        _umpFiltered += (uint32_t)routeUMP(routes, w, n, [this, stampUs](uint8_t, const uint32_t* run, size_t k) {
+            _umpRing.pushPackets(run, k, stampUs);
+        });
+    };
+    uint16_t run = 0, i = 0;
+    while (i < count) {
+        uint8_t pktWords = umpWordCount((words[i] >> 28) & 0x0F);
+        if (isInternalStreamMessage(&words[i])) {
+            if (i > run) push(words + run, i - run);
+            _processStreamMessage(&words[i]);
+            run = (uint16_t)(i + pktWords);
+        }
+        i += pktWords;
+    }
+    if (count > run) push(words + run, count - run);
+}
+
+void USBMIDI2Connection::task() {
+    USBConnection::task();
+    GroupRoutes routes = _currentRoutes();
+    _umpRing.drain([this, &routes](const uint32_t* words, size_t count, uint32_t stampUs) {
+        // Clock read per span, after it was published (see processQueue()).
+        uint64_t ts = usbmidi::core::expandStamp(stampUs, MIDIClock::nowUs());
+        routeUMP(routes, words, count, [this, ts](uint8_t target, const uint32_t* run, size_t n) {
+            if (target == UMP_ROUTE_MAIN) dispatchUMPBatch(run, n, ts);
+            else if (USBMIDI2Block* view = _blockViews[target]) view->deliverUMP(run, n, ts);
+        });
+    });
 }
 
-// ── sendUMPMessage — write raw UMP words to device via OUT endpoint ─────────
+// ── Group routing ────────────────────────────────────────────────────────────
+
+bool USBMIDI2Connection::getBlockGroups(uint8_t block, uint8_t& first, uint8_t& count) const {
+    return blockGroups(_fbInfo, _fbCount, _gtb, _gtbCount, block, first, count);
+}
+
+void USBMIDI2Connection::setGroupFilter(uint16_t groups) {
+    _mainGroups = groups;
+    _rebuildRoutes();
+}
+
+bool USBMIDI2Connection::attachBlock(USBMIDI2Block* view) {
+    if (!view || view->block() >= MAX_FUNCTION_BLOCKS || _blockViews[view->block()]) return false;
+    _blockViews[view->block()] = view;
+    _rebuildRoutes();
+    return true;
+}
+
+void USBMIDI2Connection::detachBlock(USBMIDI2Block* view) {
+    if (!view || view->block() >= MAX_FUNCTION_BLOCKS || _blockViews[view->block()] != view) return;
+    _blockViews[view->block()] = nullptr;
+    _rebuildRoutes();
+}
+
+// View slot = block index; a view whose block is not known yet owns nothing.
+void USBMIDI2Connection::_rebuildRoutes() {
+    uint8_t first[MAX_FUNCTION_BLOCKS] = {};
+    uint8_t count[MAX_FUNCTION_BLOCKS] = {};
+    for (uint8_t b = 0; b < MAX_FUNCTION_BLOCKS; b++) {
+        if (_blockViews[b] && !getBlockGroups(b, first[b], count[b])) count[b] = 0;
+    }
+    GroupRoutes routes;
+    buildGroupRoutes(routes, first, count, MAX_FUNCTION_BLOCKS, _mainGroups);
+    portENTER_CRITICAL(&_routeMux);
+    _routes = routes;
+    portEXIT_CRITICAL(&_routeMux);
+}
+
+GroupRoutes USBMIDI2Connection::_currentRoutes() const {
+    portENTER_CRITICAL(&_routeMux);
+    GroupRoutes routes = _routes;
+    portEXIT_CRITICAL(&_routeMux);
+    return routes;
+}
+
+void USBMIDI2Connection::_dispatchConnected() {
+    USBConnection::_dispatchConnected();
+    for (uint8_t b = 0; b < MAX_FUNCTION_BLOCKS; b++) {
+        if (_blockViews[b]) _blockViews[b]->deliverConnected();
+    }
+}
+
+void USBMIDI2Connection::_dispatchDisconnected() {
+    USBConnection::_dispatchDisconnected();
+    for (uint8_t b = 0; b < MAX_FUNCTION_BLOCKS; b++) {
+        if (_blockViews[b]) _blockViews[b]->deliverDisconnected();
+    }
+}
+
+// ── sendUMPMessage — queue UMP packets for the OUT endpoint ────────────────
 //
 // Each UMP word is 4 bytes, little-endian on the wire (matches ESP32 native).
-// Maximum payload = OUT endpoint's wMaxPacketSize.
+// Packets wait in _umpQueue; the base pump packs them into idle transfers of
+// the shared pool, as many whole packets per transfer as wMaxPacketSize
+// allows, so a chord of Note Ons leaves in one transfer.
 
 bool USBMIDI2Connection::sendUMPMessage(const uint32_t* words, uint8_t count) {
-    if (!isReady || !_outTransfer || count == 0)
+    if (!isReady || !_midi2Active || _outPoolSize == 0 || count == 0)
         return false;
 
-    size_t byteLen = (size_t)count * 4;
-    uint16_t maxPkt = _outTransfer->data_buffer_size;
-    if (byteLen > maxPkt)
-        return false;
+    portENTER_CRITICAL(&_outMux);
+    bool ok = pushUMP(_umpQueue, words, count);
+    portEXIT_CRITICAL(&_outMux);
+    if (ok) _pumpOut();
+    return ok;
+}
 
-    memcpy(_outTransfer->data_buffer, words, byteLen);
-    _outTransfer->num_bytes = byteLen;
+bool USBMIDI2Connection::_outPending() const {
+    return _midi2Active ? _umpQueue.count > 0 : USBConnection::_outPending();
+}
+
+size_t USBMIDI2Connection::_fillOut(uint8_t* buf, size_t maxBytes, uint16_t& units) {
+    if (!_midi2Active) return USBConnection::_fillOut(buf, maxBytes, units);
+    return fillUMPTransfer(_umpQueue, buf, maxBytes, units);
+}
+
+void USBMIDI2Connection::_outDone(uint16_t units, bool ok) {
+    if (!_midi2Active) { USBConnection::_outDone(units, ok); return; }
+    if (ok) _umpQueue.sent += units;
+    else    _umpQueue.dropped += units;
+}
+
+USBMIDI2Connection::UMPSendStats USBMIDI2Connection::getUMPSendStats() const {
+    portENTER_CRITICAL(&_outMux);
+    UMPSendStats s;
+    s.queued  = _umpQueue.queued;
+    s.sent    = _umpQueue.sent;
+    s.dropped = _umpQueue.dropped;
+    s.pending = (uint16_t)_umpQueue.count;
+    portEXIT_CRITICAL(&_outMux);
+    return s;
+}
+
+size_t USBMIDI2Connection::getUMPSendRoom(uint8_t group) const {
+    if (group > UMP_GROUPLESS) return 0;
+    portENTER_CRITICAL(&_outMux);
+    size_t room = umpSendRoom(_umpQueue, group);
+    portEXIT_CRITICAL(&_outMux);
+    return room;
+}
 
-    esp_err_t err = usb_host_transfer_submit(_outTransfer);
-    return (err == ESP_OK);
+uint32_t USBMIDI2Connection::getUMPRefused(uint8_t group) const {
+    if (group > UMP_GROUPLESS) return 0;
+    portENTER_CRITICAL(&_outMux);
+    uint32_t n = _umpQueue.groupRefused[group];
+    portEXIT_CRITICAL(&_outMux);
+    return n;
 }
 
 // ── _appendStreamText — accumulate text from multi-packet stream messages ───
@@ -423,4 +579,6 @@ void USBMIDI2Connection::_onGTBResponse(usb_transfer_t* transfer) {
 
 void USBMIDI2Connection::_parseGTBResponse(const uint8_t* data, uint16_t len) {
     _gtbCount = usbmidi::core::parseGTB(data, len, _gtb, MAX_GTB);
+    if (_neg.state == NegState::Done) _saveProfile();
+    _rebuildRoutes();
 }
@@ -4,6 +4,13 @@
 #include "USBConnection.h"
 #include "USBMIDITransportCore.h"
 
+class USBMIDI2Block;
+
+// Depth of the receive UMP ring, in 32-bit words (power of two).
+#ifndef ESP32_HOST_MIDI_USB_UMP_WORDS
+#define ESP32_HOST_MIDI_USB_UMP_WORDS 512
+#endif
+
 // USBMIDI2Connection — USB Host with MIDI 2.0/UMP negotiation.
 //
 // Overrides _processConfig() to scan for both Alt 0 (bcdMSC 1.00) and
@@ -17,15 +24,19 @@
 // The host does not send a Stream Configuration Request (which would command a
 // protocol switch); it relies on the descriptor and discovery responses.
 //
-// In MIDI 2.0 mode, bulk IN data is dispatched as raw UMP words via
-// dispatchUMPData(). In MIDI 1.0 mode, behaviour is identical to the
-// base USBConnection.
+// In MIDI 2.0 mode, whole UMP packets are split out of each bulk IN transfer
+// in place and handed through a lock-free ring to task(), which delivers them
+// in spans to every UMP callback that is set: one call per span to the batch
+// forms, one per packet to the plain one. Groups can be routed to
+// per-Function-Block views (USBMIDI2Block.h) and unwanted ones dropped before
+// they are queued. In MIDI 1.0 mode, behaviour is identical to the base
+// USBConnection.
 //
 // Hardware: USB-A host port (e.g. T-Display-S3 MIDI Shield).
 //
 // Usage:
 //   USBMIDI2Connection usb;
-//   usb.setUMPCallback(onUMP, nullptr);    // MIDI 2.0 native
+//   usb.setUMPCallback(onUMP, nullptr);    // MIDI 2.0 native (or a batch form)
 //   usb.setMidiCallback(onMidi, nullptr);  // MIDI 1.0 fallback
 //   usb.begin();
 
@@ -33,53 +44,59 @@ class USBMIDI2Connection : public USBConnection {
 public:
     USBMIDI2Connection();
 
+    // Drains received MIDI 1.0 events and UMP packets and dispatches them.
+    // Call from loop().
+    void task() override;
+
     // True when the connected device negotiated MIDI 2.0 (Alt 1).
     bool isMIDI2() const { return _midi2Active; }
 
     // True when discovery completed (Endpoint Info + all Function Block Info
     // received). Does not imply a protocol switch was commanded; the host only
     // reads discovery, it does not request a protocol change.
-    bool isNegotiated() const { return _neg.state == usbmidi::core::NegState::Done; }
-
-    // Send raw UMP words to the device via OUT endpoint.
-    // Returns true if the transfer was submitted successfully.
+    // A replugged device known to the descriptor cache counts as negotiated
+    // straight away (see isCachedProfile()).
+    bool isNegotiated() const { return _neg.state == usbmidi::core::NegState::Done || _fromProfile; }
+
+    // Queues whole UMP packets (count words, one or more packets) for the
+    // device's OUT endpoint. Queued packets are packed into bulk transfers up
+    // to wMaxPacketSize, never split between two. Returns false if not a
+    // MIDI 2.0 connection, a packet is cut short, or a group the packets
+    // belong to has no room (see getUMPSendRoom()); nothing is queued then.
     bool sendUMPMessage(const uint32_t* words, uint8_t count);
 
+    // Outbound UMP, counted in packets.
+    struct UMPSendStats {
+        uint32_t queued;      // Accepted by sendUMPMessage()
+        uint32_t sent;        // Delivered by a completed OUT transfer
+        uint32_t dropped;     // Refused, submit failed or transfer error
+        uint16_t pending;     // Words still waiting in the queue
+    };
+    UMPSendStats getUMPSendStats() const;
+
+    // Per-group backpressure: the words group (0-15) can still queue, and
+    // the packets refused so far for lack of room. One group may fill at most
+    // half of the queue. Group 16 is Utility / Stream messages (no group).
+    size_t getUMPSendRoom(uint8_t group) const;
+    uint32_t getUMPRefused(uint8_t group) const;
+
     // Retry Protocol Negotiation from scratch (useful when the device
     // was not ready when the Host first sent Endpoint Discovery).
     void retryNegotiation();
 
     // Device info discovered during negotiation.
-    struct EndpointInfo {
-        uint8_t  umpVersionMajor;
-        uint8_t  umpVersionMinor;
-        uint8_t  numFunctionBlocks;
-        bool     supportsMIDI2Protocol;
-        bool     supportsMIDI1Protocol;
-        bool     supportsRxJR;
-        bool     supportsTxJR;
-        uint8_t  currentProtocol;  // informational; set only if the device emits
-                                   // an unsolicited Stream Config Notify (0x006).
-                                   // 0x01=MIDI1, 0x02=MIDI2, 0=not reported
-    };
-
-    struct FunctionBlockInfo {
-        uint8_t  index;
-        bool     active;
-        uint8_t  direction;     // 0=input, 1=output, 2=bidirectional
-        uint8_t  firstGroup;
-        uint8_t  groupLength;
-        uint8_t  midiCISupport;
-        uint8_t  isMIDI1;       // 0=not MIDI1, 1=MIDI1 unrestricted, 2=MIDI1 restricted
-        uint8_t  maxSysEx8Streams;
-    };
-
+    using EndpointInfo = usbmidi::core::EndpointInfo;
+    using FunctionBlockInfo = usbmidi::core::FunctionBlockInfo;
     using GroupTerminalBlock = usbmidi::core::GTBlock;
 
-    static const uint8_t MAX_FUNCTION_BLOCKS = 8;
-    static const uint8_t MAX_GTB = 8;
+    static const uint8_t MAX_FUNCTION_BLOCKS = usbmidi::core::MAX_FUNCTION_BLOCKS;
+    static const uint8_t MAX_GTB = usbmidi::core::MAX_GTB;
     static const uint8_t MAX_NAME_LEN = 64;
 
+    // True while the info below was restored from the descriptor cache on a
+    // replug and the background discovery has not confirmed it yet.
+    bool isCachedProfile() const { return _fromProfile; }
+
     const EndpointInfo& getEndpointInfo() const { return _epInfo; }
     const FunctionBlockInfo* getFunctionBlocks() const { return _fbInfo; }
     uint8_t getFunctionBlockCount() const { return _fbCount; }
@@ -88,22 +105,64 @@ public:
     const char* getEndpointName() const { return _epName; }
     const char* getProductInstanceId() const { return _prodId; }
 
+    // Group routing (see "UMP group routing" in USBMIDITransportCore.h).
+    // Groups owned by a USBMIDI2Block view go to it; the others go to this
+    // connection's callbacks if they are in the mask (default: all), and are
+    // dropped on the USB task otherwise.
+    void setGroupFilter(uint16_t groups);
+    uint16_t getGroupFilter() const { return _mainGroups; }
+
+    // Groups of a Function Block (by index), from discovery or, failing
+    // that, the Group Terminal Block at that position.
+    bool getBlockGroups(uint8_t block, uint8_t& first, uint8_t& count) const;
+
+    // Per-block views (see USBMIDI2Block.h), one per block index below
+    // MAX_FUNCTION_BLOCKS. Called by the USBMIDI2Block constructor / destructor.
+    bool attachBlock(USBMIDI2Block* view);
+    void detachBlock(USBMIDI2Block* view);
+
+    // UMP packets of groups nobody listens to, dropped before dispatch.
+    uint32_t getUMPFiltered() const { return _umpFiltered; }
+
+    // UMP packets lost because the receive ring was full.
+    uint32_t getUMPDropped() const { return _umpRing.dropped(); }
+
 protected:
     void _processConfig(const usb_config_desc_t* config_desc) override;
     void _onDeviceGone() override;
+    void _dispatchConnected() override;
+    void _dispatchDisconnected() override;
 
 private:
     bool _midi2Active;
-    // OUT transfer (_outTransfer) and its busy flag live in the base
-    // USBConnection; both the MIDI 1.0 (sendMidiMessage) and MIDI 2.0
-    // (sendUMPMessage) send paths share them.
+    // The OUT transfer pool lives in the base USBConnection. On a MIDI 2.0
+    // device it is fed from _umpQueue (under the base _outMux), otherwise
+    // from the base MIDI 1.0 event queue.
+    static const size_t UMP_OUT_QUEUE_WORDS = 512;
+    usbmidi::core::UMPQueue<UMP_OUT_QUEUE_WORDS> _umpQueue;
+    bool _outPending() const override;
+    size_t _fillOut(uint8_t* buf, size_t maxBytes, uint16_t& units) override;
+    void _outDone(uint16_t units, bool ok) override;
 
     // Protocol Negotiation state machine (pure model in the transport core)
     usbmidi::core::NegEngine _neg;
 
     // UMP reassembly across bulk transfers (carry-over of split packets)
     usbmidi::core::UMPCarry _umpCarry = {};
-    uint32_t _umpOut[usbmidi::core::UMP_OUT_WORDS] = {};
+
+    // Whole received UMP packets, from the USB task (_onReceiveUMP) to task().
+    usbmidi::core::UMPRing<ESP32_HOST_MIDI_USB_UMP_WORDS> _umpRing;
+    void _queueUMP(const uint32_t* words, uint16_t count, uint32_t stampUs);
+
+    // Routes, rebuilt whenever views, the filter or the topology change and
+    // read (as a copy) on both sides of the ring, under _routeMux.
+    USBMIDI2Block* _blockViews[usbmidi::core::MAX_FUNCTION_BLOCKS] = {};
+    uint16_t _mainGroups = 0xFFFF;
+    usbmidi::core::GroupRoutes _routes;
+    mutable portMUX_TYPE _routeMux;
+    uint32_t _umpFiltered = 0;
+    void _rebuildRoutes();
+    usbmidi::core::GroupRoutes _currentRoutes() const;
 
     EndpointInfo _epInfo = {};
     FunctionBlockInfo _fbInfo[MAX_FUNCTION_BLOCKS] = {};
@@ -122,6 +181,12 @@ private:
 
     bool _claimAndSetup(const AltCandidate& cand);
 
+    // Descriptor cache: restore discovery results on a replug, store them
+    // once discovery (or the GTB read) completes.
+    bool _fromProfile = false;
+    void _restoreProfile(const usbmidi::core::DeviceProfile& prof);
+    void _saveProfile();
+
     // Protocol Negotiation helpers
     void _startNegotiation();
     void _processStreamMessage(const uint32_t* words);
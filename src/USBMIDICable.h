@@ -0,0 +1,61 @@
+#ifndef USB_MIDI_CABLE_H
+#define USB_MIDI_CABLE_H
+
+#include "MIDITransport.h"
+#include "USBConnection.h"
+
+// One virtual cable of a multi-port USB-MIDI 1.0 interface, as a transport of
+// its own. A 4x4 interface carries its four DIN ports as cables 0-3 of one
+// USB endpoint; attach a view per port and each shows up in MIDIHandler (or
+// anywhere a MIDITransport goes) as a separate source and destination:
+//
+//   USBConnection usb;
+//   USBMIDICable port1(usb, 0), port2(usb, 1);
+//   midiHandler.addTransport(&port1);
+//   midiHandler.addTransport(&port2);
+//   port2.sendMidiMessage(noteOn, 3);      // goes out on cable 1 only
+//   midiHandler.sendNoteOn(1, 60, 100);    // goes out on cable 0 (port1)
+//
+// Events from a cable with a view are delivered by that view only; the
+// others stay on the USBConnection itself. The view's task() runs the
+// parent's, so registering just the views is enough.
+//
+// MIDIHandler holds up to MIDIHandler::MAX_TRANSPORTS transports (20 by
+// default, ESP32_HOST_MIDI_MAX_TRANSPORTS), so all 16 cables fit. Its send*
+// helpers go to the first registered transport that accepts, i.e. the first
+// view; send on another cable through that view.
+
+class USBMIDICable : public MIDITransport {
+public:
+    USBMIDICable(USBConnection& usb, uint8_t cable)
+        : _usb(usb), _cable(cable & 0x0F) {
+        _usb.attachCable(this);
+    }
+    ~USBMIDICable() override { _usb.detachCable(this); }
+
+    void task() override { _usb.task(); }
+    bool isConnected() const override { return _usb.isConnected(); }
+
+    // Sends on this view's cable (SysEx included).
+    bool sendMidiMessage(const uint8_t* data, size_t length) override {
+        return _usb.sendMidiMessage(_cable, data, length);
+    }
+
+    uint8_t cable() const { return _cable; }
+    USBConnection& connection() const { return _usb; }
+
+private:
+    friend class USBConnection;    // Delivers this cable's events and link state
+
+    USBConnection& _usb;
+    uint8_t _cable;
+
+    void deliverMidi(const uint8_t* data, size_t len, uint64_t timestampUs) {
+        dispatchMidiData(data, len, timestampUs);
+    }
+    void deliverSysEx(const uint8_t* data, size_t len) { dispatchSysExData(data, len); }
+    void deliverConnected() { dispatchConnected(); }
+    void deliverDisconnected() { dispatchDisconnected(); }
+};
+
+#endif // USB_MIDI_CABLE_H
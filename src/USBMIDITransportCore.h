@@ -2,6 +2,8 @@
 #define USB_MIDI_TRANSPORT_CORE_H
 
 #include <cstdint>
+#include <cstddef>
+#include <atomic>
 
 // Pure USB MIDI host transport logic. No Arduino, no usb_host.h.
 // Consumed by the real transport classes AND the native tests, so tests
@@ -17,8 +19,19 @@ struct AltCandidate {
     uint8_t  epInInterval;
     uint8_t  epOutAddress;   // OUT endpoint (0 = none found)
     uint16_t epOutMaxPacket;
+    uint8_t  inCables;       // MIDI 1.0 virtual cables (embedded jacks) per direction,
+    uint8_t  outCables;      // from the class-specific endpoint descriptors; 0 = not given
 };
 
+// Virtual cables served by a MIDI 1.0 endpoint: bNumEmbMIDIJack of the
+// class-specific MS_GENERAL endpoint descriptor (CS_ENDPOINT 0x25, subtype
+// 0x01) that follows it. Returns 0 for any other descriptor.
+inline uint8_t msEndpointCables(const uint8_t* d, uint8_t len) {
+    if (len < 4 || d[1] != 0x25 || d[2] != 0x01) return 0;
+    uint8_t n = d[3];
+    return n > 16 ? 16 : n;
+}
+
 // Scan a full configuration descriptor; prefer the MIDI 2.0 alt setting.
 // Returns false if no MIDI Streaming interface with an IN endpoint exists.
 inline bool findBestAlt(const uint8_t* p, uint16_t totalLen, AltCandidate& best) {
@@ -47,6 +60,7 @@ inline bool findBestAlt(const uint8_t* p, uint16_t totalLen, AltCandidate& best)
                 cand.altSetting  = altSet;
 
                 // Scan descriptors belonging to this alt setting
+                bool lastEpIn = false;
                 uint16_t j = i + dlen;
                 while (j < totalLen) {
                     if (j + 1 >= totalLen) break;
@@ -68,6 +82,7 @@ inline bool findBestAlt(const uint8_t* p, uint16_t totalLen, AltCandidate& best)
                         uint8_t  bInt   = p[j + 6];
                         if (maxPkt == 0)   maxPkt = 64;
                         if (maxPkt > 512)  maxPkt = 512;
+                        lastEpIn = (epAddr & 0x80) != 0;
                         if (epAddr & 0x80) {   // IN endpoint
                             cand.epInAddress   = epAddr;
                             cand.epInMaxPacket = maxPkt;
@@ -78,6 +93,12 @@ inline bool findBestAlt(const uint8_t* p, uint16_t totalLen, AltCandidate& best)
                         }
                     }
 
+                    // Class-specific endpoint descriptor: cables of the endpoint above
+                    if (uint8_t cables = msEndpointCables(p + j, blen)) {
+                        if (lastEpIn) cand.inCables = cables;
+                        else          cand.outCables = cables;
+                    }
+
                     j += blen;
                 }
 
@@ -149,6 +170,52 @@ inline uint16_t umpReassemble(const uint32_t* in, uint16_t inCount,
     return w;
 }
 
+// In-place variant for the receive path. Only a packet that straddles the
+// previous transfer is copied (into joined[]); every other whole packet is
+// left where it is in the transfer buffer and described by body/bodyWords.
+// The trailing partial packet goes to carry, as with umpReassemble().
+struct UMPSplit {
+    uint32_t        joined[4];     // Packet completed from the carry
+    uint8_t         joinedWords;   // 0 = none
+    const uint32_t* body;          // Whole packets, inside the input buffer
+    uint16_t        bodyWords;
+};
+
+inline void umpSplit(const uint32_t* in, uint16_t inCount, UMPCarry& carry, UMPSplit& out) {
+    out.joinedWords = 0;
+    out.body = in;
+    out.bodyWords = 0;
+
+    uint16_t i = 0;
+    if (carry.count) {
+        uint8_t pw = umpWordCount((carry.words[0] >> 28) & 0x0F);
+        uint8_t need = (uint8_t)(pw - carry.count);
+        if (inCount < need) {             // Still not whole: keep carrying
+            for (uint16_t k = 0; k < inCount; ++k) carry.words[carry.count++] = in[k];
+            out.body = in + inCount;
+            return;
+        }
+        for (uint8_t k = 0; k < carry.count; ++k) out.joined[k] = carry.words[k];
+        for (uint8_t k = 0; k < need; ++k)        out.joined[carry.count + k] = in[k];
+        out.joinedWords = pw;
+        carry.count = 0;
+        i = need;
+    }
+
+    uint16_t start = i;
+    while (i < inCount) {
+        uint8_t pw = umpWordCount((in[i] >> 28) & 0x0F);
+        if (i + pw > inCount) break;
+        i += pw;
+    }
+    out.body = in + start;
+    out.bodyWords = (uint16_t)(i - start);
+
+    uint8_t rem = (uint8_t)(inCount - i);
+    for (uint8_t k = 0; k < rem; ++k) carry.words[k] = in[i + k];
+    carry.count = rem;
+}
+
 // ── Group Terminal Blocks ───────────────────────────────────────────────────
 
 static const uint8_t GTB_HEADER_SUBTYPE = 0x01;
@@ -333,6 +400,927 @@ inline bool isInternalStreamMessage(const uint32_t* words) {
     return status <= STREAM_FB_NAME;
 }
 
+// ── Discovery results ───────────────────────────────────────────────────────
+//
+// What Endpoint Info and Function Block Info notifications report, as kept by
+// USBMIDI2Connection (and its descriptor cache).
+
+static const uint8_t MAX_FUNCTION_BLOCKS = 8;
+static const uint8_t MAX_GTB = 8;
+
+struct EndpointInfo {
+    uint8_t  umpVersionMajor;
+    uint8_t  umpVersionMinor;
+    uint8_t  numFunctionBlocks;
+    bool     supportsMIDI2Protocol;
+    bool     supportsMIDI1Protocol;
+    bool     supportsRxJR;
+    bool     supportsTxJR;
+    uint8_t  currentProtocol;  // informational; set only if the device emits
+                               // an unsolicited Stream Config Notify (0x006).
+                               // 0x01=MIDI1, 0x02=MIDI2, 0=not reported
+};
+
+struct FunctionBlockInfo {
+    uint8_t  index;
+    bool     active;
+    uint8_t  direction;     // 0=input, 1=output, 2=bidirectional
+    uint8_t  firstGroup;
+    uint8_t  groupLength;
+    uint8_t  midiCISupport;
+    uint8_t  isMIDI1;       // 0=not MIDI1, 1=MIDI1 unrestricted, 2=MIDI1 restricted
+    uint8_t  maxSysEx8Streams;
+};
+
+inline FunctionBlockInfo parseFunctionBlockInfo(const uint32_t* words) {
+    FunctionBlockInfo fb;
+    fb.index            = (words[0] >> 8) & 0x7F;
+    fb.active           = (words[0] >> 15) & 0x01;
+    fb.direction        = words[0] & 0x03;
+    fb.firstGroup       = (words[1] >> 24) & 0xFF;
+    fb.groupLength      = (words[1] >> 16) & 0xFF;
+    fb.midiCISupport    = (words[1] >> 8) & 0xFF;
+    fb.isMIDI1          = (words[0] >> 2) & 0x03;
+    fb.maxSysEx8Streams = words[1] & 0xFF;
+    return fb;
+}
+
+// Stores fb in table[], replacing the entry with the same block index, so a
+// repeated notification updates instead of appending. Returns false if the
+// block is new and the table is full.
+inline bool upsertFunctionBlock(FunctionBlockInfo* table, uint8_t& count, uint8_t max,
+                                const FunctionBlockInfo& fb) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (table[i].index == fb.index) { table[i] = fb; return true; }
+    }
+    if (count >= max) return false;
+    table[count++] = fb;
+    return true;
+}
+
+// Drops blocks with an index the endpoint no longer declares (index >= n).
+inline void pruneFunctionBlocks(FunctionBlockInfo* table, uint8_t& count, uint8_t n) {
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (table[i].index < n) table[kept++] = table[i];
+    }
+    count = kept;
+}
+
+// ── USB-MIDI 1.0 event packets (OUT) ────────────────────────────────────────
+//
+//   byte 0   cable number (high nibble) | Code Index Number (low nibble)
+//   byte 1-3 MIDI bytes, zero-padded
+//
+// Every bulk OUT transfer carries whole 4-byte event packets, up to the
+// endpoint's wMaxPacketSize (16 events on a 64-byte full-speed endpoint).
+
+// USB-MIDI 1.0 CIN lookup (Table 4-1).
+// Returns CIN for a given MIDI status byte, or 0 on unknown.
+inline uint8_t statusToCIN(uint8_t status) {
+    if (status >= 0x80 && status <= 0xEF) {
+        // Channel Voice / Mode messages: CIN = high nibble
+        return status >> 4;
+    }
+    switch (status) {
+        case 0xF0: return 0x04; // SysEx Start (caller must handle continuation/end)
+        case 0xF1: return 0x02; // MTC Quarter Frame (2 bytes)
+        case 0xF2: return 0x03; // Song Position Pointer (3 bytes)
+        case 0xF3: return 0x02; // Song Select (2 bytes)
+        case 0xF6: return 0x05; // Tune Request (1 byte)
+        case 0xF7: return 0x05; // SysEx End (single-byte, edge case)
+        case 0xF8: return 0x0F; // Timing Clock
+        case 0xFA: return 0x0F; // Start
+        case 0xFB: return 0x0F; // Continue
+        case 0xFC: return 0x0F; // Stop
+        case 0xFE: return 0x0F; // Active Sensing
+        case 0xFF: return 0x0F; // System Reset
+        default:   return 0;    // Undefined (0xF4, 0xF5, 0xFD)
+    }
+}
+
+// Virtual cable (0-15) of a packed or raw event packet.
+inline uint8_t eventCable(uint8_t header) { return header >> 4; }
+
+// Builds the event packet for a short message. Returns false for data bytes
+// and undefined status bytes.
+inline bool buildEventPacket(const uint8_t* data, size_t length, uint8_t cable, uint8_t out[4]) {
+    if (length == 0) return false;
+    uint8_t cin = statusToCIN(data[0]);
+    if (cin == 0) return false;
+    out[0] = (uint8_t)((cable << 4) | cin);
+    out[1] = out[2] = out[3] = 0;
+    for (size_t i = 0; i < length && i < 3; i++) out[i + 1] = data[i];
+    return true;
+}
+
+// ── Outbound event queue ────────────────────────────────────────────────────
+//
+// Event packets waiting for an OUT transfer. sendMidiMessage() pushes whole
+// messages; each free transfer is filled with as many queued events as its
+// wMaxPacketSize holds, so a burst coalesces into a few transfers instead of
+// one 4-byte transfer per message. Not thread-safe on its own: USBConnection
+// wraps it in a spinlock.
+
+template <size_t N>
+struct EventQueue {
+    uint8_t  events[N][4];
+    size_t   head = 0;            // Oldest event
+    size_t   count = 0;
+
+    // Counters, in event packets
+    uint32_t queued = 0;
+    uint32_t sent = 0;            // Acknowledged by a completed transfer
+    uint32_t dropped = 0;         // Queue full, submit failed, transfer error or cable busy
+
+    uint16_t sysexBusy = 0;       // Bit n: a SysEx on cable n is partly queued
+};
+
+// True for a single-byte real-time event (F8-FF), which may sit between the
+// events of a SysEx.
+inline bool isRealTimeEvent(const uint8_t event[4]) {
+    return (event[0] & 0x0F) == 0x0F && event[1] >= 0xF8;
+}
+
+// Appends n events, all or none. Refused while a SysEx is partly queued on
+// the cable of any of them (real-time events excepted), so nothing lands
+// between its segments.
+template <size_t N>
+inline bool pushEvents(EventQueue<N>& q, const uint8_t (*events)[4], size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if ((q.sysexBusy & (1u << eventCable(events[i][0]))) && !isRealTimeEvent(events[i])) {
+            q.dropped += (uint32_t)n;
+            return false;
+        }
+    }
+    if (N - q.count < n) { q.dropped += (uint32_t)n; return false; }
+    for (size_t i = 0; i < n; i++) {
+        uint8_t* dst = q.events[(q.head + q.count + i) % N];
+        dst[0] = events[i][0]; dst[1] = events[i][1]; dst[2] = events[i][2]; dst[3] = events[i][3];
+    }
+    q.count += n;
+    q.queued += (uint32_t)n;
+    return true;
+}
+
+// Moves up to maxBytes / 4 events into buf. Returns the bytes written.
+template <size_t N>
+inline size_t fillTransfer(EventQueue<N>& q, uint8_t* buf, size_t maxBytes) {
+    size_t n = maxBytes / 4;
+    if (n > q.count) n = q.count;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t* src = q.events[(q.head + i) % N];
+        buf[i * 4 + 0] = src[0]; buf[i * 4 + 1] = src[1]; buf[i * 4 + 2] = src[2]; buf[i * 4 + 3] = src[3];
+    }
+    q.head = (q.head + n) % N;
+    q.count -= n;
+    return n * 4;
+}
+
+// ── USB-MIDI 1.0 SysEx segmentation (OUT) ───────────────────────────────────
+//
+// A SysEx travels as a run of event packets on one cable (Table 4-1):
+//
+//   CIN 0x4  starts or continues: 3 bytes, more follow
+//   CIN 0x5  ends with 1 byte  (F7)
+//   CIN 0x6  ends with 2 bytes (.. F7)
+//   CIN 0x7  ends with 3 bytes (.. .. F7)
+//
+// F0 01 02 03 04 F7 -> [04 F0 01 02] [07 03 04 F7]. A message that fits the
+// queue is pushed whole once there is room for all of it. A longer one is
+// pushed in pieces as transfers complete, so the segmenter keeps its position
+// between pushes, and its cable stays busy from the first piece to the last.
+
+struct SysExSegmenter {
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    size_t offset = 0;            // Next byte to packetize
+    uint8_t cable = 0;
+    bool streaming = false;       // Holds its cable's sysexBusy bit
+};
+
+// True for a complete F0 ... F7 message with only data bytes in between.
+inline bool isCompleteSysEx(const uint8_t* data, size_t length) {
+    if (length < 2 || data[0] != 0xF0 || data[length - 1] != 0xF7) return false;
+    for (size_t i = 1; i + 1 < length; i++) {
+        if (data[i] & 0x80) return false;
+    }
+    return true;
+}
+
+inline size_t sysExEventCount(size_t length) { return (length + 2) / 3; }
+
+inline void beginSysEx(SysExSegmenter& s, const uint8_t* data, size_t length, uint8_t cable) {
+    s.data = data;
+    s.length = length;
+    s.offset = 0;
+    s.cable = cable;
+}
+
+inline bool sysExDone(const SysExSegmenter& s) { return s.offset >= s.length; }
+
+// Builds the next event packet. Returns false once the message is consumed.
+inline bool nextSysExEvent(SysExSegmenter& s, uint8_t out[4]) {
+    size_t left = s.length - s.offset;
+    if (left == 0) return false;
+    size_t n = (left > 3) ? 3 : left;
+    uint8_t cin = (left > 3) ? 0x4 : (uint8_t)(0x4 + n);
+    out[0] = (uint8_t)((s.cable << 4) | cin);
+    out[1] = out[2] = out[3] = 0;
+    for (size_t i = 0; i < n; i++) out[i + 1] = s.data[s.offset + i];
+    s.offset += n;
+    return true;
+}
+
+// Releases the segmenter's cable. Called when the last piece is queued, or
+// by a sender that gives up part way (the device then sees the SysEx cut
+// short, and the next F0 starts afresh).
+template <size_t N>
+inline void abortSysEx(EventQueue<N>& q, SysExSegmenter& s) {
+    if (s.streaming) q.sysexBusy &= (uint16_t)~(1u << s.cable);
+    s.streaming = false;
+}
+
+// Queues the SysEx, or as much of it as may go now. Returns the count queued;
+// 0 means wait for room (or for another SysEx streaming on the same cable).
+template <size_t N>
+inline size_t pushSysEx(EventQueue<N>& q, SysExSegmenter& s) {
+    const uint16_t bit = (uint16_t)(1u << s.cable);
+    if (!s.streaming) {
+        if (q.sysexBusy & bit) return 0;
+        size_t need = sysExEventCount(s.length - s.offset);
+        if (need <= N) {
+            if (N - q.count < need) return 0;       // Whole or nothing
+        } else {
+            s.streaming = true;                      // Larger than the queue
+            q.sysexBusy |= bit;
+        }
+    }
+    size_t pushed = 0;
+    while (q.count < N && !sysExDone(s)) {
+        nextSysExEvent(s, q.events[(q.head + q.count) % N]);
+        q.count++;
+        pushed++;
+    }
+    q.queued += (uint32_t)pushed;
+    if (s.streaming && sysExDone(s)) abortSysEx(q, s);
+    return pushed;
+}
+
+// ── Outbound UMP queue (OUT, MIDI 2.0) ──────────────────────────────────────
+//
+// UMP packets waiting for the bulk OUT endpoint of a MIDI 2.0 device.
+// fillUMPTransfer() packs as many whole packets as fit in one transfer and
+// never splits a packet between two. Pending words are counted per group
+// (index 16 for the groupless MT 0x0 / 0xF), and one group may hold at most
+// half of the queue: a flood on one group (MPE pitch bends, say) is refused
+// while the others still get through. umpSendRoom() is that backpressure, as
+// the words a group can still queue.
+
+static const uint8_t UMP_GROUPLESS = 16;
+
+// Group of a packet (0-15), or UMP_GROUPLESS for Utility and Stream messages.
+inline uint8_t umpGroupIndex(uint32_t word0) {
+    uint8_t mt = (word0 >> 28) & 0x0F;
+    if (mt == 0x0 || mt == 0xF) return UMP_GROUPLESS;
+    return (word0 >> 24) & 0x0F;
+}
+
+template <size_t N>
+struct UMPQueue {
+    uint32_t words[N];
+    size_t   head = 0;            // Oldest word
+    size_t   count = 0;           // Words queued
+
+    // Counters, in UMP packets
+    uint32_t queued = 0;
+    uint32_t sent = 0;            // Acknowledged by a completed transfer
+    uint32_t dropped = 0;         // Refused, submit failed or transfer error
+
+    uint16_t groupWords[17] = {};       // Pending words per group
+    uint32_t groupRefused[17] = {};     // Packets refused for lack of room, per group
+};
+
+template <size_t N>
+inline size_t umpSendRoom(const UMPQueue<N>& q, uint8_t group) {
+    size_t room = N - q.count;
+    size_t share = N / 2 > q.groupWords[group] ? N / 2 - q.groupWords[group] : 0;
+    return share < room ? share : room;
+}
+
+// Appends count words of whole packets, all or none. Returns false (and
+// counts the packets as refused) if a packet is cut short or a group it
+// belongs to has no room.
+template <size_t N>
+inline bool pushUMP(UMPQueue<N>& q, const uint32_t* words, size_t count) {
+    uint16_t need[17] = {};
+    uint16_t packets[17] = {};
+    size_t total = 0;
+    for (size_t i = 0; i < count; ) {
+        uint8_t pw = umpWordCount((words[i] >> 28) & 0x0F);
+        if (i + pw > count) return false;
+        uint8_t g = umpGroupIndex(words[i]);
+        need[g] += pw;
+        packets[g]++;
+        total++;
+        i += pw;
+    }
+    if (total == 0) return false;
+
+    bool fits = count <= N - q.count;
+    for (uint8_t g = 0; g < 17 && fits; g++) {
+        if (need[g] && need[g] > umpSendRoom(q, g)) fits = false;
+    }
+    if (!fits) {
+        for (uint8_t g = 0; g < 17; g++) q.groupRefused[g] += packets[g];
+        q.dropped += (uint32_t)total;
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) q.words[(q.head + q.count + i) % N] = words[i];
+    for (uint8_t g = 0; g < 17; g++) q.groupWords[g] += need[g];
+    q.count += count;
+    q.queued += (uint32_t)total;
+    return true;
+}
+
+// Moves whole packets into buf (little-endian words, as on the wire) while
+// they fit in maxBytes. Returns the bytes written; packets counts them.
+template <size_t N>
+inline size_t fillUMPTransfer(UMPQueue<N>& q, uint8_t* buf, size_t maxBytes, uint16_t& packets) {
+    size_t bytes = 0;
+    packets = 0;
+    while (q.count > 0) {
+        uint32_t w0 = q.words[q.head];
+        uint8_t pw = umpWordCount((w0 >> 28) & 0x0F);
+        if (bytes + (size_t)pw * 4 > maxBytes) break;
+        for (uint8_t k = 0; k < pw; k++) {
+            uint32_t w = q.words[(q.head + k) % N];
+            buf[bytes++] = (uint8_t)w;
+            buf[bytes++] = (uint8_t)(w >> 8);
+            buf[bytes++] = (uint8_t)(w >> 16);
+            buf[bytes++] = (uint8_t)(w >> 24);
+        }
+        q.groupWords[umpGroupIndex(w0)] -= pw;
+        q.head = (q.head + pw) % N;
+        q.count -= pw;
+        packets++;
+    }
+    return bytes;
+}
+
+// Empties the queue, counting what was pending as dropped.
+template <size_t N>
+inline void clearUMP(UMPQueue<N>& q) {
+    for (size_t i = 0; i < q.count; ) {
+        i += umpWordCount((q.words[(q.head + i) % N] >> 28) & 0x0F);
+        q.dropped++;
+    }
+    q.head = 0;
+    q.count = 0;
+    for (uint8_t g = 0; g < 17; g++) q.groupWords[g] = 0;
+}
+
+// ── IN pipeline ─────────────────────────────────────────────────────────────
+//
+// The host keeps IN_POOL_SIZE transfers queued on the IN endpoint, so the
+// controller always has a buffer to complete into while the previous one is
+// being parsed; each completion callback parses its buffer and resubmits it.
+// Completions on one endpoint arrive in submit order, so UMP carry-over
+// between consecutive transfers stays valid.
+//
+// A transfer is one max packet: a bulk IN transfer only completes early on a
+// short packet, so a larger buffer could hold a full 64-byte packet back
+// until the next one arrives. On high-speed hosts (ESP32-P4) the endpoint's
+// own wMaxPacketSize is 512, which lets one transfer carry 128 events.
+
+static const int IN_POOL_SIZE = 3;
+static const uint16_t IN_TRANSFER_MAX = UMP_MAX_TRANSFER_WORDS * 4;
+
+inline uint16_t inTransferBytes(uint16_t wMaxPacketSize) {
+    if (wMaxPacketSize == 0) return 64;            // Missing descriptor: full-speed default
+    if (wMaxPacketSize > IN_TRANSFER_MAX) return IN_TRANSFER_MAX;
+    return wMaxPacketSize;
+}
+
+// ── Transfer statistics ─────────────────────────────────────────────────────
+//
+// Counts completed IN transfers and the time spent handling them in the USB
+// task (parse + enqueue + resubmit). Rates cover the last full one-second
+// window; busyPermille is that handling time as a share of the window, i.e.
+// the load the receive path puts on core 0.
+
+struct TransferMeter {
+    static const uint64_t WINDOW_US = 1000000;
+
+    // Current window
+    uint64_t windowStartUs = 0;
+    uint32_t windowTransfers = 0;
+    uint32_t windowBytes = 0;
+    uint64_t windowBusyUs = 0;
+
+    // Last completed window
+    uint32_t transfersPerSec = 0;
+    uint32_t bytesPerSec = 0;
+    uint16_t busyPermille = 0;    // 1000 = the USB task did nothing else
+
+    // Since connect
+    uint32_t transfers = 0;
+    uint32_t errors = 0;
+};
+
+// Closes the window if a full one has elapsed by nowUs.
+inline void rollTransferWindow(TransferMeter& m, uint64_t nowUs) {
+    if (m.windowStartUs == 0) { m.windowStartUs = nowUs; return; }
+    uint64_t elapsed = nowUs - m.windowStartUs;
+    if (elapsed < TransferMeter::WINDOW_US) return;
+
+    m.transfersPerSec = (uint32_t)((uint64_t)m.windowTransfers * 1000000 / elapsed);
+    m.bytesPerSec     = (uint32_t)((uint64_t)m.windowBytes * 1000000 / elapsed);
+    uint64_t permille = m.windowBusyUs * 1000 / elapsed;
+    m.busyPermille    = (uint16_t)(permille > 1000 ? 1000 : permille);
+    m.windowStartUs   = nowUs;
+    m.windowTransfers = 0;
+    m.windowBytes     = 0;
+    m.windowBusyUs    = 0;
+}
+
+// One completed transfer, handled from startUs to endUs.
+inline void countTransfer(TransferMeter& m, uint64_t startUs, uint64_t endUs, size_t bytes, bool ok) {
+    rollTransferWindow(m, startUs);
+    m.windowTransfers++;
+    m.windowBytes += (uint32_t)bytes;
+    m.windowBusyUs += endUs - startUs;
+    m.transfers++;
+    if (!ok) m.errors++;
+}
+
+// ── Receive event ring (IN) ─────────────────────────────────────────────────
+//
+// Single-producer / single-consumer ring between the USB task (producer,
+// transfer callbacks) and task() (consumer). Each USB-MIDI event packet is
+// stored packed in a uint32_t (byte 0 in the low bits), next to the low 32
+// bits of its arrival time and a one-byte tag (the device slot when several
+// devices share the ring), so an entry costs 9 bytes.
+//
+// Lock-free: head and tail are free-running counters, each written by one
+// side only. The producer fills slots and then publishes them with a release
+// store of head; the consumer reads them after an acquire load of head and
+// hands them back with a release store of tail. N must be a power of two.
+
+inline uint32_t packEvent(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline void unpackEvent(uint32_t ev, uint8_t out[4]) {
+    out[0] = (uint8_t)ev;
+    out[1] = (uint8_t)(ev >> 8);
+    out[2] = (uint8_t)(ev >> 16);
+    out[3] = (uint8_t)(ev >> 24);
+}
+
+// Rebuilds a full timestamp from its low 32 bits, for stamps less than
+// 35 minutes older than nowUs. A stamp slightly newer than nowUs (pushed
+// after the caller read the clock) counts as nowUs.
+inline uint64_t expandStamp(uint32_t stampUs, uint64_t nowUs) {
+    int32_t age = (int32_t)((uint32_t)nowUs - stampUs);
+    return age > 0 ? nowUs - (uint32_t)age : nowUs;
+}
+
+template <size_t N>
+class EventRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "EventRing depth must be a power of two");
+
+public:
+    EventRing() : head_(0), tail_(0), dropped_(0) {}
+
+    // ── Producer ──
+
+    bool push(uint32_t event, uint32_t stampUs, uint8_t tag = 0) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= N) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        events_[head & MASK] = event;
+        stamps_[head & MASK] = stampUs;
+        tags_[head & MASK] = tag;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Queues every event packet of one IN transfer (skipping zero padding)
+    // and publishes them together. Returns the number queued; the rest are
+    // counted as dropped.
+    size_t pushPackets(const uint8_t* data, size_t bytes, uint32_t stampUs, uint8_t tag = 0) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t room = N - (head - tail_.load(std::memory_order_acquire));
+        size_t queued = 0, lost = 0;
+        for (size_t off = 0; off + 4 <= bytes; off += 4) {
+            if (data[off] == 0x00) continue;           // Padding / CIN 0 on cable 0
+            if (queued == room) { lost++; continue; }
+            uint32_t slot = (head + (uint32_t)queued) & MASK;
+            events_[slot] = packEvent(data + off);
+            stamps_[slot] = stampUs;
+            tags_[slot] = tag;
+            queued++;
+        }
+        if (queued) head_.store(head + (uint32_t)queued, std::memory_order_release);
+        if (lost) dropped_.fetch_add((uint32_t)lost, std::memory_order_relaxed);
+        return queued;
+    }
+
+    // ── Consumer ──
+
+    // Points at the oldest queued events, in place: returns how many are
+    // contiguous from there (a wrapped ring takes two peek/release rounds).
+    size_t peek(const uint32_t*& events, const uint32_t*& stamps) const {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t avail = head_.load(std::memory_order_acquire) - tail;
+        uint32_t start = tail & MASK;
+        uint32_t run = N - start;
+        events = &events_[start];
+        stamps = &stamps_[start];
+        return avail < run ? avail : run;
+    }
+
+    // Same, plus the tags of the span.
+    size_t peek(const uint32_t*& events, const uint32_t*& stamps, const uint8_t*& tags) const {
+        size_t n = peek(events, stamps);
+        tags = &tags_[events - events_];
+        return n;
+    }
+
+    // Gives n peeked events back to the producer.
+    void release(size_t n) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + (uint32_t)n, std::memory_order_release);
+    }
+
+    // Calls fn(events, stamps, count) for each contiguous run until empty.
+    template <typename Fn>
+    size_t drain(Fn fn) {
+        size_t total = 0;
+        const uint32_t* ev;
+        const uint32_t* st;
+        size_t n;
+        while ((n = peek(ev, st)) > 0) {
+            fn(ev, st, n);
+            release(n);
+            total += n;
+        }
+        return total;
+    }
+
+    // Same, as fn(events, stamps, tags, count).
+    template <typename Fn>
+    size_t drainTagged(Fn fn) {
+        size_t total = 0;
+        const uint32_t* ev;
+        const uint32_t* st;
+        const uint8_t* tg;
+        size_t n;
+        while ((n = peek(ev, st, tg)) > 0) {
+            fn(ev, st, tg, n);
+            release(n);
+            total += n;
+        }
+        return total;
+    }
+
+    // ── Either side (snapshots) ──
+
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    uint32_t at(size_t index) const { return events_[(tail_.load(std::memory_order_acquire) + index) & MASK]; }
+    uint32_t stampAt(size_t index) const { return stamps_[(tail_.load(std::memory_order_acquire) + index) & MASK]; }
+    uint8_t tagAt(size_t index) const { return tags_[(tail_.load(std::memory_order_acquire) + index) & MASK]; }
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    static size_t capacity() { return N; }
+
+private:
+    static const uint32_t MASK = (uint32_t)(N - 1);
+    uint32_t events_[N];
+    uint32_t stamps_[N];
+    uint8_t  tags_[N];
+    std::atomic<uint32_t> head_;    // Written by the producer only
+    std::atomic<uint32_t> tail_;    // Written by the consumer only
+    std::atomic<uint32_t> dropped_;
+};
+
+// ── Receive UMP ring (IN, MIDI 2.0) ─────────────────────────────────────────
+//
+// Single-producer / single-consumer ring of UMP words, from the USB task to
+// task(), same scheme as EventRing. Only whole packets go in, so the consumer
+// is handed contiguous spans of whole packets straight from the ring; the one
+// packet that wraps past the end of the buffer is the only one copied. Each
+// word keeps the arrival stamp (low 32 bits of µs) of the run it came in with,
+// and a span never mixes two stamps.
+
+template <size_t N>
+class UMPRing {
+    static_assert(N >= 4 && (N & (N - 1)) == 0, "UMPRing size must be a power of two >= 4");
+
+public:
+    UMPRing() : head_(0), tail_(0), dropped_(0) {}
+
+    // ── Producer ──
+
+    // Queues whole packets from words[0..count), all stamped stampUs. Those
+    // that do not fit are counted as dropped (in packets). Returns the number
+    // of words queued.
+    size_t pushPackets(const uint32_t* words, size_t count, uint32_t stampUs) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        size_t room = N - (head - tail_.load(std::memory_order_acquire));
+        size_t fit = count;
+        if (fit > room) {
+            fit = 0;
+            while (fit < count) {
+                uint8_t pw = umpWordCount((words[fit] >> 28) & 0x0F);
+                if (fit + pw > room) break;
+                fit += pw;
+            }
+            uint32_t lost = 0;
+            for (size_t i = fit; i < count; i += umpWordCount((words[i] >> 28) & 0x0F)) lost++;
+            dropped_.fetch_add(lost, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < fit; ++i) {
+            words_[(head + (uint32_t)i) & MASK] = words[i];
+            stamps_[(head + (uint32_t)i) & MASK] = stampUs;
+        }
+        if (fit) head_.store(head + (uint32_t)fit, std::memory_order_release);
+        return fit;
+    }
+
+    // ── Consumer ──
+
+    // Calls fn(words, count, stampUs) with spans of whole packets that share
+    // one arrival stamp until the ring is empty; returns the number of words
+    // handed over.
+    template <typename Fn>
+    size_t drain(Fn fn) {
+        size_t total = 0;
+        for (;;) {
+            uint32_t tail = tail_.load(std::memory_order_relaxed);
+            uint32_t avail = head_.load(std::memory_order_acquire) - tail;
+            if (avail == 0) break;
+            uint32_t idx = tail & MASK;
+            uint32_t run = (uint32_t)N - idx;
+            if (avail < run) run = avail;
+
+            uint32_t stamp = stamps_[idx];
+            uint32_t whole = 0;
+            while (whole < run && stamps_[idx + whole] == stamp) {
+                uint8_t pw = umpWordCount((words_[idx + whole] >> 28) & 0x0F);
+                if (whole + pw > run) break;
+                whole += pw;
+            }
+            if (whole > 0) {
+                fn(&words_[idx], (size_t)whole, stamp);
+            } else {
+                // The packet at the end of the buffer continues at its start.
+                uint32_t packet[4];
+                whole = umpWordCount((words_[idx] >> 28) & 0x0F);
+                for (uint32_t k = 0; k < whole; ++k) packet[k] = words_[(tail + k) & MASK];
+                fn(packet, (size_t)whole, stamp);
+            }
+            tail_.store(tail + whole, std::memory_order_release);
+            total += whole;
+        }
+        return total;
+    }
+
+    // ── Either side (snapshots) ──
+
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    static size_t capacity() { return N; }
+
+private:
+    static const uint32_t MASK = (uint32_t)(N - 1);
+    uint32_t words_[N];
+    uint32_t stamps_[N];
+    std::atomic<uint32_t> head_;    // Written by the producer only
+    std::atomic<uint32_t> tail_;    // Written by the consumer only
+    std::atomic<uint32_t> dropped_;
+};
+
+// ── UMP group routing ───────────────────────────────────────────────────────
+//
+// Received UMP is split by group: each group goes to the view that owns it
+// (one per Function Block, see USBMIDI2Block.h), to the connection's own
+// callbacks, or nowhere. Groups nobody listens to are dropped on the USB task,
+// before they take ring space or a dispatch. Utility and Stream messages
+// (no group) always go to the connection.
+
+static const uint8_t UMP_ROUTE_MAIN = 0xFE;   // The connection's own callbacks
+static const uint8_t UMP_ROUTE_DROP = 0xFF;
+
+struct GroupRoutes {
+    uint8_t target[16];      // Per group: view slot, UMP_ROUTE_MAIN or UMP_ROUTE_DROP
+};
+
+// Groups of block `index`: its Function Block when discovery reported one,
+// else the Group Terminal Block at that position. False if neither is known.
+inline bool blockGroups(const FunctionBlockInfo* fb, uint8_t fbCount,
+                        const GTBlock* gtb, uint8_t gtbCount,
+                        uint8_t index, uint8_t& first, uint8_t& count) {
+    for (uint8_t i = 0; i < fbCount; i++) {
+        if (fb[i].index != index) continue;
+        first = fb[i].firstGroup;
+        count = fb[i].groupLength;
+        return first < 16 && count > 0;
+    }
+    if (index < gtbCount) {
+        first = gtb[index].firstGroup;
+        count = gtb[index].numGroups;
+        return first < 16 && count > 0;
+    }
+    return false;
+}
+
+// Gives view slot v the groups first[v] .. first[v] + count[v] - 1 (count 0:
+// no view or unknown topology; an earlier slot keeps a shared group). Other
+// groups in mainMask go to the connection, the rest are dropped.
+inline void buildGroupRoutes(GroupRoutes& r, const uint8_t* first, const uint8_t* count,
+                             int views, uint16_t mainMask) {
+    for (int g = 0; g < 16; g++) r.target[g] = (mainMask >> g) & 1 ? UMP_ROUTE_MAIN : UMP_ROUTE_DROP;
+    uint16_t owned = 0;
+    for (int v = 0; v < views; v++) {
+        for (int k = 0; k < count[v]; k++) {
+            int g = first[v] + k;
+            if (g >= 16 || (owned >> g) & 1) continue;
+            r.target[g] = (uint8_t)v;
+            owned |= (uint16_t)(1u << g);
+        }
+    }
+}
+
+inline uint8_t umpRoute(const GroupRoutes& r, uint32_t word0) {
+    uint8_t g = umpGroupIndex(word0);
+    return g == UMP_GROUPLESS ? UMP_ROUTE_MAIN : r.target[g];
+}
+
+// Splits whole packets into runs bound for the same target and calls
+// fn(target, words, count) for each run that is not dropped. Returns the
+// number of packets dropped.
+template <typename Fn>
+inline size_t routeUMP(const GroupRoutes& r, const uint32_t* words, size_t count, Fn fn) {
+    size_t dropped = 0, start = 0, i = 0;
+    uint8_t runTarget = UMP_ROUTE_DROP;
+    while (i < count) {
+        uint8_t pw = umpWordCount((words[i] >> 28) & 0x0F);
+        if (i + pw > count) break;
+        uint8_t t = umpRoute(r, words[i]);
+        if (t != runTarget) {
+            if (i > start && runTarget != UMP_ROUTE_DROP) fn(runTarget, words + start, i - start);
+            start = i;
+            runTarget = t;
+        }
+        if (t == UMP_ROUTE_DROP) dropped++;
+        i += pw;
+    }
+    if (i > start && runTarget != UMP_ROUTE_DROP) fn(runTarget, words + start, i - start);
+    return dropped;
+}
+
+// One-word UMP for a MIDI 1.0 short message on a group: Channel Voice as
+// MT 0x2, System Common / Real Time as MT 0x1. False for SysEx and
+// undefined status bytes.
+inline bool buildMIDI1UMP(const uint8_t* data, size_t length, uint8_t group, uint32_t& word) {
+    if (length == 0) return false;
+    uint8_t status = data[0];
+    uint32_t mt;
+    if (status >= 0x80 && status <= 0xEF) mt = 0x2;
+    else if (status >= 0xF1 && status != 0xF4 && status != 0xF5 && status != 0xF7 &&
+             status != 0xF9 && status != 0xFD) mt = 0x1;
+    else return false;
+    uint8_t d1 = length > 1 ? (data[1] & 0x7F) : 0;
+    uint8_t d2 = length > 2 ? (data[2] & 0x7F) : 0;
+    word = (mt << 28) | ((uint32_t)(group & 0x0F) << 24) | ((uint32_t)status << 16) |
+           ((uint32_t)d1 << 8) | d2;
+    return true;
+}
+
+// ── Multiple devices (hub) ──────────────────────────────────────────────────
+//
+// Each USBConnection instance is one device slot; all of them share the USB
+// host, its tasks and one receive ring (events are tagged with the slot). A
+// newly enumerated device goes to a free slot whose VID/PID filter matches
+// it; slots without a filter take whatever device is left over.
+
+static const int MAX_DEVICES = 4;
+
+struct DeviceSlot {
+    bool     registered;     // begin() was called on the instance
+    bool     busy;           // Currently holds a device
+    uint16_t vid;            // Filter: 0 = any device
+    uint16_t pid;            // Filter: 0 = any product of vid
+};
+
+inline bool slotMatches(const DeviceSlot& s, uint16_t vid, uint16_t pid) {
+    return s.vid == vid && (s.pid == 0 || s.pid == pid);
+}
+
+// Returns the slot for a device with this VID/PID, or -1 if none is free.
+inline int chooseDeviceSlot(const DeviceSlot* slots, int count, uint16_t vid, uint16_t pid) {
+    for (int i = 0; i < count; i++) {
+        const DeviceSlot& s = slots[i];
+        if (s.registered && !s.busy && s.vid != 0 && slotMatches(s, vid, pid)) return i;
+    }
+    for (int i = 0; i < count; i++) {
+        const DeviceSlot& s = slots[i];
+        if (s.registered && !s.busy && s.vid == 0) return i;
+    }
+    return -1;
+}
+
+// ── Device profile cache ────────────────────────────────────────────────────
+//
+// What enumeration learned about a device: the alt setting and endpoints it
+// was claimed with and, for MIDI 2.0, the discovery results. Keyed by
+// VID/PID/bcdDevice and checked against a hash of the configuration
+// descriptor, so a replugged device is claimed without parsing again and its
+// Function Blocks / GTBs are known before the first packet; discovery still
+// runs and refreshes the entry.
+
+static const int PROFILE_CACHE_SLOTS = 4;
+
+struct DeviceProfile {
+    uint16_t vid;
+    uint16_t pid;
+    uint16_t bcdDevice;
+    uint32_t configHash;       // descriptorHash() of the configuration descriptor
+    AltCandidate alt;          // What was claimed
+    bool     discovered;       // MIDI 2.0 discovery completed; fields below valid
+    EndpointInfo endpoint;
+    FunctionBlockInfo fb[MAX_FUNCTION_BLOCKS];
+    uint8_t  fbCount;
+    GTBlock  gtb[MAX_GTB];
+    uint8_t  gtbCount;
+};
+
+template <int N>
+struct ProfileCache {
+    DeviceProfile entries[N];
+    uint32_t lastUsed[N];      // LRU clock value; 0 = empty slot
+    uint32_t clock;
+};
+
+// 32-bit FNV-1a.
+inline uint32_t descriptorHash(const uint8_t* data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+template <int N>
+inline int findProfileSlot(const ProfileCache<N>& c, uint16_t vid, uint16_t pid, uint16_t bcd) {
+    for (int i = 0; i < N; i++) {
+        const DeviceProfile& e = c.entries[i];
+        if (c.lastUsed[i] && e.vid == vid && e.pid == pid && e.bcdDevice == bcd) return i;
+    }
+    return -1;
+}
+
+// The cached profile for this device, or nullptr if there is none or its
+// configuration descriptor changed. A hit counts as a use.
+template <int N>
+inline DeviceProfile* lookupProfile(ProfileCache<N>& c, uint16_t vid, uint16_t pid,
+                                    uint16_t bcd, uint32_t configHash) {
+    int i = findProfileSlot(c, vid, pid, bcd);
+    if (i < 0 || c.entries[i].configHash != configHash) return nullptr;
+    c.lastUsed[i] = ++c.clock;
+    return &c.entries[i];
+}
+
+// Stores p over the entry with the same key, else over an empty or the least
+// recently used one.
+template <int N>
+inline DeviceProfile& storeProfile(ProfileCache<N>& c, const DeviceProfile& p) {
+    int slot = findProfileSlot(c, p.vid, p.pid, p.bcdDevice);
+    if (slot < 0) {
+        slot = 0;
+        for (int i = 1; i < N; i++) {
+            if (c.lastUsed[i] < c.lastUsed[slot]) slot = i;
+        }
+    }
+    c.entries[slot] = p;
+    c.lastUsed[slot] = ++c.clock;
+    return c.entries[slot];
+}
+
+template <int N>
+inline void forgetProfile(ProfileCache<N>& c, uint16_t vid, uint16_t pid, uint16_t bcd) {
+    int i = findProfileSlot(c, vid, pid, bcd);
+    if (i >= 0) c.lastUsed[i] = 0;
+}
+
 }} // namespace usbmidi::core
 
 #endif // USB_MIDI_TRANSPORT_CORE_H